@@ -0,0 +1,135 @@
+#include<chrono>
+#include<cstdio>
+#include<sstream>
+#include<string>
+
+// Diaflow
+#include<compiler.h>
+#include<transpiler.h>
+#include<vm.h>
+
+using namespace Diaflow;
+
+static std::string run_binary(const std::string& binary)
+{
+	std::string out;
+	FILE* pipe = popen(("'" + binary + "' 2>&1").c_str(), "r");
+	if(!pipe)
+		return out;
+
+	char buffer[4096];
+	size_t n;
+	while((n = std::fread(buffer, 1, sizeof(buffer), pipe)) > 0)
+		out.append(buffer, n);
+
+	pclose(pipe);
+	return out;
+}
+
+// Runs one program in the VM and as an exported executable, printing the time
+// of each and whether their outputs agree.
+static void compare(const char* name, const Program& program)
+{
+	Module module;
+	Compiler compiler;
+	if(!compiler.compile(program, module))
+	{
+		std::printf("%s: %s\n", name, compiler.error.c_str());
+		return;
+	}
+
+	std::istringstream in;
+	std::ostringstream out;
+	VM vm(module, in, out);
+	auto start = std::chrono::steady_clock::now();
+	Status status = vm.run();
+	std::chrono::duration<double> interpreted = std::chrono::steady_clock::now() - start;
+	std::string expected = status == Status::Ok ? out.str() : vm.error + "\n";
+
+	Transpiler transpiler;
+	std::string binary = std::string("bin/aot_") + name;
+	for(char& c : binary)
+		if(c == ' ')
+			c = '_';
+
+	if(!transpiler.build(program, binary + ".cpp", binary))
+	{
+		std::printf("%s: %s\n", name, transpiler.error.c_str());
+		return;
+	}
+
+	start = std::chrono::steady_clock::now();
+	std::string result = run_binary(binary);
+	std::chrono::duration<double> native = std::chrono::steady_clock::now() - start;
+
+	std::printf("%-24s interpreted %.3fs  exported %.3fs  %s -> %s", name, interpreted.count(), native.count(),
+		result == expected ? "agree" : "DIFFER", result.c_str());
+}
+
+int main()
+{
+	Program loop;
+	loop["main"] = std::make_pair(Args(), Comp
+	{
+		new Assign("s = 0"),
+		new Assign("i = 0"),
+		new While("i < 20000000", Comp{ new Assign("s = s + i % 7"), new Assign("i = i + 1") }),
+		new Output("s"),
+	});
+	compare("int loop", loop);
+
+	Program calls;
+	calls["fib"] = std::make_pair(Args{ "n" }, Comp
+	{
+		new If("n < 2", Comp{ new Return("n") }, Comp{}),
+		new Call("fib", { "n - 1" }, "a"),
+		new Call("fib", { "n - 2" }, "b"),
+		new Return("a + b"),
+	});
+	calls["main"] = std::make_pair(Args(), Comp{ new Call("fib", { "27" }, "r"), new Output("r") });
+	compare("recursive calls", calls);
+
+	Program faults;
+	faults["main"] = std::make_pair(Args(), Comp{ new Assign("x = [1, 2]"), new Output("x[0] / (x[1] - 2)") });
+	compare("division by zero", faults);
+
+	// Tail calls run in one frame, past the depth limit of other calls.
+	Program countdown;
+	countdown["loop"] = std::make_pair(Args{ "n", "acc" }, Comp
+	{
+		new If("n == 0", Comp{ new Return("acc") }, Comp{}),
+		new Call("loop", { "n - 1", "acc + n % 7" }, "r"),
+		new Return("r"),
+	});
+	countdown["main"] = std::make_pair(Args(), Comp{ new Call("loop", { "2000000", "0" }, "x"), new Output("x") });
+	compare("tail countdown 2M", countdown);
+
+	Program factorial;
+	factorial["fact"] = std::make_pair(Args{ "n", "acc" }, Comp
+	{
+		new If("n <= 1", Comp{ new Return("acc") }, Comp{}),
+		new Assign("m = n - 1"),
+		new Call("fact", { "m", "acc * n" }, "r"),
+		new Comment("the result comes straight back"),
+		new Return("r"),
+	});
+	factorial["main"] = std::make_pair(Args(), Comp{ new Call("fact", { "100000", "1" }, "x"), new Output("x") });
+	compare("tail factorial", factorial);
+
+	// A last case with nothing in it, and a comment ending in a backslash,
+	// which must not swallow the line after it.
+	Program cases;
+	cases["main"] = std::make_pair(Args(), Comp
+	{
+		new Foreach("x", "3", Comp
+		{
+			new Switch("x", Cases{ { "1", Comp{ new Output("\"one\"") } }, { "2", Comp{} } }),
+			new Switch("x", Cases{ { "0", Comp{ new Output("\"zero\"") } }, { "default", Comp{ new Comment("nothing") } } }),
+		}),
+		new Comment("see C:\\temp\\"),
+		new Output("\"after comment\""),
+		new Comment("closes */ early \\  "),
+		new Output("\"after another\""),
+	});
+	compare("switch and comments", cases);
+}
@@ -0,0 +1,62 @@
+#include<cstdio>
+#include<string>
+#include<thread>
+
+// Diaflow
+#include<batch.h>
+#include<compiler.h>
+
+using namespace Diaflow;
+
+int main()
+{
+	// A submission graded against every test case: reads n and prints the
+	// number of primes below it and their sum.
+	Program program;
+	program["main"] = std::make_pair(Args(), Comp
+	{
+		new Input("n"),
+		new Assign("n = int(n)"),
+		new Assign("count = 0"),
+		new Assign("sum = 0"),
+		new For("p = 2", "p < n", "p++", Comp
+		{
+			new Assign("prime = 1"),
+			new For("d = 2", "d * d <= p", "d++", Comp
+			{
+				new If("p % d == 0", Comp{ new Assign("prime = 0"), new Break() }, Comp{}),
+			}),
+			new If("prime", Comp{ new Assign("count = count + 1"), new Assign("sum = sum + p") }, Comp{}),
+		}),
+		new Output("count"),
+		new Output("sum"),
+	});
+
+	Module module;
+	Compiler compiler;
+	if(!compiler.compile(program, module))
+	{
+		std::printf("%s\n", compiler.error.c_str());
+		return 1;
+	}
+
+	std::vector<std::string> inputs;
+	for(size_t k = 0; k < 2000; k++)
+		inputs.push_back(std::to_string(500 + (k * 7919) % 4000) + "\n");
+
+	std::vector<Batch::Run> expected;
+	for(uint32_t threads = 1; threads <= std::max(4u, std::thread::hardware_concurrency()); threads *= 2)
+	{
+		Scheduler scheduler(threads);
+		Batch batch(module, scheduler);
+		batch.run(inputs);
+		if(expected.empty())
+			expected = batch.runs;
+
+		size_t mismatched = 0;
+		for(size_t k = 0; k < inputs.size(); k++)
+			mismatched += batch.runs[k].output != expected[k].output;
+
+		std::printf("%u threads: %zu mismatched\n%s%s\n", threads, mismatched, batch.summary().c_str(), scheduler.report().c_str());
+	}
+}
@@ -0,0 +1,58 @@
+#include<chrono>
+#include<cstdio>
+#include<string>
+
+// Diaflow
+#include<cfg.h>
+
+using namespace Diaflow;
+
+// A function of `n` loops, each holding a branch, a switch and an early
+// return, as a stand-in for a large flowchart being edited.
+static Comp generate(size_t n)
+{
+	Comp body;
+	for(size_t i = 0; i < n; i++)
+	{
+		std::string v = "x" + std::to_string(i);
+		body.push_back(new Assign(v + " = 0"));
+		body.push_back(new For("i = 0", "i < 10", "i++", Comp
+		{
+			new If(v + " > 5", Comp{ new Assign(v + " -= 1") }, Comp{ new Assign(v + " += 2") }),
+			new Switch("i % 3", Cases
+			{
+				{ "0", Comp{ new Output(v), new Break() } },
+				{ "1", Comp{ new Continue() } },
+				{ "default", Comp{ new Output("i") } },
+			}),
+			new While(v + " < 100", Comp{ new Assign(v + " *= 2"), new If(v + " == 64", Comp{ new Return(v) }, Comp{}) }),
+		}));
+	}
+
+	return body;
+}
+
+int main()
+{
+	for(size_t n : { 10, 100, 1000 })
+	{
+		Comp body = generate(n);
+		Cfg cfg;
+		if(!cfg.build(body))
+		{
+			std::printf("%s\n", cfg.error.c_str());
+			return 1;
+		}
+
+		const int rounds = 2000000 / static_cast<int>(n * 10);
+		auto start = std::chrono::steady_clock::now();
+		for(int i = 0; i < rounds; i++)
+			cfg.build(body);
+
+		std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+		std::printf("%5zu loops  %6zu blocks  %5zu natural loops  %8.1f us per build\n", n, cfg.blocks.size(), cfg.loops.size(), elapsed.count() / rounds);
+
+		for(Block* block : body)
+			delete block;
+	}
+}
@@ -0,0 +1,121 @@
+#include<chrono>
+#include<cstdio>
+#include<sstream>
+#include<thread>
+
+// Diaflow
+#include<compiler.h>
+#include<scheduler.h>
+#include<vm.h>
+
+using namespace Diaflow;
+
+typedef std::vector<std::string> Names;
+
+// A pipeline of three stages over `count` values: one branch generates
+// them, `workers` branches each square their share and one adds up the
+// squares. Every stage hands on through a channel of `capacity`.
+static Program pipeline(size_t count, size_t workers, size_t capacity)
+{
+	std::string n = std::to_string(count);
+	Program program;
+	program["produce"] = std::make_pair(Args{ "n", "workers" }, Comp
+	{
+		new Assign("x = 12345"),
+		new For("i = 0", "i < n", "i++", Comp
+		{
+			new Assign("x = (x * 75 + 74) % 65537"),
+			new Send("work", "x"),
+		}),
+		new For("i = 0", "i < workers", "i++", Comp{ new Send("work", "-1") }),
+		new Return("0"),
+	});
+	program["square"] = std::make_pair(Args(), Comp
+	{
+		new Assign("v = 0"),
+		new While("true", Comp
+		{
+			new Receive("work", "v"),
+			new If("v < 0", Comp{ new Break() }, Comp{}),
+			new Send("squares", "v * v % 1000"),
+		}),
+		new Send("squares", "-1"),
+		new Return("0"),
+	});
+
+	std::vector<Comp> branches;
+	branches.push_back(Comp{ new Call("produce", Names{ n, std::to_string(workers) }, "") });
+	for(size_t k = 0; k < workers; k++)
+		branches.push_back(Comp{ new Call("square", Names(), "") });
+
+	branches.push_back(Comp
+	{
+		new Assign("s = 0"),
+		new Assign("left = " + std::to_string(workers)),
+		new Assign("v = 0"),
+		new While("left > 0", Comp
+		{
+			new Receive("squares", "v"),
+			new If("v < 0", Comp{ new Assign("left--") }, Comp{ new Assign("s = s + v") }),
+		}),
+		new Assign("total = s"),
+	});
+
+	program["main"] = std::make_pair(Args(), Comp
+	{
+		new Channel("work", std::to_string(capacity)),
+		new Channel("squares", std::to_string(capacity)),
+		new Assign("total = 0"),
+		new Parallel(branches),
+		new Output("total"),
+	});
+	return program;
+}
+
+static void time(const char* label, const Module& module, size_t messages, Scheduler* scheduler)
+{
+	std::istringstream in;
+	std::ostringstream out;
+	VM vm(module, in, out);
+	vm.scheduler = scheduler;
+
+	auto start = std::chrono::steady_clock::now();
+	Status status = vm.run();
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+	std::string result = status == Status::Ok ? out.str() : vm.error + "\n";
+	for(char& c : result)
+		c = c == '\n' ? ' ' : c;
+
+	std::printf("  %-12s %.3fs  %.2fM values/s  -> %s\n", label, elapsed.count(), messages / elapsed.count() / 1e6, result.c_str());
+}
+
+int main()
+{
+	size_t count = 200000;
+	for(size_t workers : { 1, 3 })
+	{
+		for(size_t capacity : { 1, 64, 4096 })
+		{
+			Module module;
+			Compiler compiler;
+			if(!compiler.compile(pipeline(count, workers, capacity), module))
+			{
+				std::printf("pipeline: %s\n", compiler.error.c_str());
+				return 1;
+			}
+
+			// Every value goes through both channels, and every worker
+			// receives and sends an end marker.
+			size_t messages = 2 * count + 2 * workers;
+			std::printf("%zu workers, capacity %zu\n", workers, capacity);
+			time("in turn", module, messages, nullptr);
+			for(uint32_t threads = 2; threads <= std::max(4u, std::thread::hardware_concurrency()); threads *= 2)
+			{
+				Scheduler scheduler(threads);
+				std::string label = std::to_string(threads) + " threads";
+				time(label.c_str(), module, messages, &scheduler);
+			}
+		}
+	}
+}
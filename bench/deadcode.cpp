@@ -0,0 +1,99 @@
+#include<chrono>
+#include<cstdio>
+#include<sstream>
+
+// Diaflow
+#include<compiler.h>
+#include<vm.h>
+
+using namespace Diaflow;
+
+typedef std::vector<std::string> Names;
+
+static void time(const char* name, const Program& program, bool optimize)
+{
+	Module module;
+	Compiler compiler;
+	compiler.optimize = optimize;
+	if(!compiler.compile(program, module))
+	{
+		std::printf("%s: %s\n", name, compiler.error.c_str());
+		return;
+	}
+
+	size_t size = 0;
+	for(const Function& function : module.functions)
+		size += function.code.size();
+
+	std::istringstream in("3\n");
+	std::ostringstream out;
+	VM vm(module, in, out);
+
+	auto start = std::chrono::steady_clock::now();
+	Status status = vm.run();
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+	std::string result = status == Status::Ok ? out.str() : vm.error + "\n";
+	std::printf("%-18s %-9s %.3fs  %4zu ops  %3zu dropped  %zu unreachable  -> %s", name, optimize ? "optimized" : "plain", elapsed.count(), size, compiler.dropped_ops, compiler.diagnostics.size(), result.c_str());
+}
+
+static void compare(const char* name, const Program& program)
+{
+	time(name, program, false);
+	time(name, program, true);
+}
+
+int main()
+{
+	// Charts as they look mid-edit: branches left empty, notes, a switch
+	// whose cases were not filled in yet and steps after a return.
+	Program sketch;
+	sketch["step"] = std::make_pair(Args{ "x", "mode" }, Comp
+	{
+		new Comment("todo: handle negative input"),
+		new If("x < 0", Comp{}, Comp{}),
+		new Switch("mode", Cases
+		{
+			Case("0", Comp{ new Break() }),
+			Case("1", Comp{ new Break() }),
+			Case("2", Comp{ new Break() }),
+			Case("default", Comp{ new Break() }),
+		}),
+		new If("mode == 3", Comp{ new Comment("scale later") }, Comp{ new Return("x + 1") }),
+		new Return("x * 2"),
+		new Output("\"unused\""),
+		new Assign("x = 0"),
+	});
+	sketch["main"] = std::make_pair(Args(), Comp
+	{
+		new Input("mode"),
+		new Assign("mode = int(mode)"),
+		new Assign("s = 0"),
+		new For("i = 0", "i < 3000000", "i++", Comp
+		{
+			new If("i % 2 == 0", Comp{ new Comment("even") }, Comp{}),
+			new Call("step", Names{ "i % 1000", "mode" }, "r"),
+			new Assign("s = s + r"),
+			new While("1", Comp{ new Break(), new Assign("s = 0") }),
+		}),
+		new Output("s"),
+	});
+	compare("sketch", sketch);
+
+	// Early exits nested in loops, leaving jumps to jumps behind them.
+	Program search;
+	search["main"] = std::make_pair(Args(), Comp
+	{
+		new Assign("found = 0"),
+		new For("i = 0", "i < 2000", "i++", Comp
+		{
+			new For("j = 0", "j < 1000", "j++", Comp
+			{
+				new If("(i * j) % 9973 == 1", Comp{ new Assign("found = found + 1"), new Break(), new Output("\"late\"") }, Comp{}),
+				new If("j > i", Comp{ new Continue() }, Comp{}),
+			}),
+		}),
+		new Output("found"),
+	});
+	compare("search", search);
+}
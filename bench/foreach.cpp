@@ -0,0 +1,74 @@
+#include<chrono>
+#include<cstdio>
+#include<sstream>
+#include<thread>
+
+// Diaflow
+#include<compiler.h>
+#include<scheduler.h>
+#include<vm.h>
+
+using namespace Diaflow;
+
+static void time(const char* label, const Module& module, Scheduler* scheduler)
+{
+	std::istringstream in;
+	std::ostringstream out;
+	VM vm(module, in, out);
+	vm.scheduler = scheduler;
+
+	auto start = std::chrono::steady_clock::now();
+	Status status = vm.run();
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+	std::string result = status == Status::Ok ? out.str() : vm.error + "\n";
+	for(char& c : result)
+		c = c == '\n' ? ' ' : c;
+
+	std::printf("%-12s %.3fs  %llu split  -> %s\n", label, elapsed.count(), static_cast<unsigned long long>(vm.splits), result.c_str());
+	if(scheduler)
+		std::printf("%s", scheduler->report().c_str());
+}
+
+int main()
+{
+	// Every item runs a short generator of its own and stores what it
+	// sums, so the first Foreach splits; the one adding up the sums reads
+	// the total it assigns and runs in turn.
+	Program program;
+	program["main"] = std::make_pair(Args(), Comp
+	{
+		new Assign("sums = []"),
+		new Foreach("i", "300000", Comp
+		{
+			new Assign("x = i"),
+			new Assign("s = 0"),
+			new For("k = 0", "k < 24", "k++", Comp
+			{
+				new Assign("x = (x * 75 + 74) % 65537"),
+				new Assign("s = s + x % 7"),
+			}),
+			new Assign("sums[i] = s"),
+		}),
+		new Assign("total = 0"),
+		new Foreach("s", "sums", Comp{ new Assign("total = total + s") }),
+		new Output("total"),
+	});
+
+	Module module;
+	Compiler compiler;
+	if(!compiler.compile(program, module))
+	{
+		std::printf("foreach: %s\n", compiler.error.c_str());
+		return 1;
+	}
+
+	std::printf("%zu of 2 loops compiled to split\n", compiler.split_loops);
+	time("in turn", module, nullptr);
+	for(uint32_t threads = 1; threads <= std::max(4u, std::thread::hardware_concurrency()); threads *= 2)
+	{
+		Scheduler scheduler(threads);
+		std::string label = std::to_string(threads) + " threads";
+		time(label.c_str(), module, &scheduler);
+	}
+}
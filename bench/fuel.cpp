@@ -0,0 +1,105 @@
+#include<algorithm>
+#include<chrono>
+#include<cstdio>
+#include<sstream>
+
+// Diaflow
+#include<compiler.h>
+#include<vm.h>
+
+using namespace Diaflow;
+
+typedef std::vector<std::string> Names;
+
+static double time(const Module& module, TierManager* tiers, bool limited, std::string& result)
+{
+	std::istringstream in;
+	std::ostringstream out;
+	VM vm(module, in, out);
+	vm.tiers = tiers;
+	if(limited)
+	{
+		vm.fuel = uint64_t(1) << 40;
+		vm.max_memory = size_t(1) << 32;
+		vm.max_output = size_t(1) << 30;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	Status status = vm.run();
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+	// The last line printed.
+	result = status == Status::Ok ? out.str() : vm.error + "\n";
+	result = result.substr(result.rfind('\n', result.size() - 2) + 1);
+	return elapsed.count();
+}
+
+// The best of five runs each, taken in turns to see past a noisy machine.
+static void compare(const char* name, const Program& program)
+{
+	for(bool tiered : { false, true })
+	{
+		Module module;
+		Compiler compiler;
+		TierManager tiers(program, module);
+		if(tiered ? !tiers.compile() : !compiler.compile(program, module))
+		{
+			std::printf("%s: %s\n", name, tiered ? tiers.error.c_str() : compiler.error.c_str());
+			return;
+		}
+
+		std::string result;
+		double free = 1e9, limited = 1e9;
+		for(int k = 0; k < 5; k++)
+		{
+			free = std::min(free, time(module, tiered ? &tiers : nullptr, false, result));
+			limited = std::min(limited, time(module, tiered ? &tiers : nullptr, true, result));
+		}
+
+		std::printf("%-10s %-11s unlimited %.3fs  limited %.3fs  %+5.1f%%  -> %s", name, tiered ? "tiered" : "interpreted",
+			free, limited, 100 * (limited / free - 1), result.c_str());
+	}
+}
+
+int main()
+{
+	Program fib;
+	fib["fib"] = std::make_pair(Args{ "n" }, Comp
+	{
+		new If("n < 2", Comp{ new Return("n") }, Comp{}),
+		new Call("fib", Names{ "n - 1" }, "a"),
+		new Call("fib", Names{ "n - 2" }, "b"),
+		new Return("a + b"),
+	});
+	fib["main"] = std::make_pair(Args(), Comp{ new Call("fib", Names{ "30" }, "x"), new Output("x") });
+
+	Program loops;
+	loops["main"] = std::make_pair(Args(), Comp
+	{
+		new Assign("s = 0"),
+		new For("i = 0", "i < 3000", "i++", Comp
+		{
+			new For("j = 0", "j < 3000", "j++", Comp{ new Assign("s = (s + i * j) % 1000003") }),
+		}),
+		new Output("s"),
+	});
+
+	Program strings;
+	strings["main"] = std::make_pair(Args(), Comp
+	{
+		new Assign("a = []"),
+		new For("i = 0", "i < 300000", "i++", Comp
+		{
+			new Assign("s = \"item \" + i"),
+			new Assign("n = push(a, s)"),
+		}),
+		new For("i = 0", "i < 200000", "i++", Comp{ new Output("a[i]") }),
+		new Output("len(a)"),
+	});
+
+	// Limited runs count the same steps as the others, and fail when the
+	// count ends; they are to cost no more.
+	compare("fib", fib);
+	compare("loops", loops);
+	compare("strings", strings);
+}
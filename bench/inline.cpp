@@ -0,0 +1,68 @@
+#include<chrono>
+#include<cstdio>
+#include<sstream>
+
+// Diaflow
+#include<compiler.h>
+#include<vm.h>
+
+using namespace Diaflow;
+
+// Runs one program compiled with and without inlining, printing the time,
+// the calls inlined and the output of each.
+static void compare(const char* name, const Program& program)
+{
+	for(int inlined = 0; inlined < 2; inlined++)
+	{
+		Module module;
+		Compiler compiler;
+		compiler.inline_calls = inlined;
+		if(!compiler.compile(program, module))
+		{
+			std::printf("%s: %s\n", name, compiler.error.c_str());
+			return;
+		}
+
+		std::istringstream in;
+		std::ostringstream out;
+		VM vm(module, in, out);
+
+		auto start = std::chrono::steady_clock::now();
+		Status status = vm.run();
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+		std::string result = status == Status::Ok ? out.str() : vm.error + "\n";
+		std::printf("%-24s %-8s %.3fs  inlined %zu, specialized %zu  -> %s", name, inlined ? "inline" : "calls", elapsed.count(),
+			compiler.inlined_calls, compiler.specialized_calls, result.c_str());
+	}
+}
+
+int main()
+{
+	Program helpers;
+	helpers["square"] = std::make_pair(Args{ "x" }, Comp{ new Return("x * x") });
+	helpers["clamp"] = std::make_pair(Args{ "v", "lo", "hi" }, Comp
+	{
+		new If("v < lo", Comp{ new Return("lo") }, Comp{}),
+		new If("v > hi", Comp{ new Return("hi") }, Comp{}),
+		new Return("v"),
+	});
+	helpers["norm"] = std::make_pair(Args{ "a", "b" }, Comp
+	{
+		new Call("square", { "a" }, "p"),
+		new Call("square", { "b" }, "q"),
+		new Return("p + q"),
+	});
+	helpers["main"] = std::make_pair(Args(), Comp
+	{
+		new Assign("s = 0"),
+		new For("i = 0", "i < 3000000", "i++", Comp
+		{
+			new Call("norm", { "i % 100", "3" }, "n"),
+			new Call("clamp", { "n", "10", "5000" }, "c"),
+			new Assign("s = s + c"),
+		}),
+		new Output("s"),
+	});
+	compare("helper chain", helpers);
+}
@@ -0,0 +1,126 @@
+#include<algorithm>
+#include<chrono>
+#include<cstdio>
+#include<cstdlib>
+#include<fstream>
+
+#include<fcntl.h>
+#include<unistd.h>
+
+// Diaflow
+#include<compiler.h>
+#include<streams.h>
+#include<transpiler.h>
+#include<vm.h>
+
+using namespace Diaflow;
+
+static const char* input_path = "/tmp/diaflow_bench_io.txt";
+
+// The best of five runs in the VM, each on streams `open` makes afresh.
+template<typename Open>
+static void time(const char* label, const Module& module, Open open)
+{
+	double best = 1e9;
+	std::string error;
+	for(int k = 0; k < 5; k++)
+	{
+		open([&](std::istream& in, std::ostream& out)
+		{
+			VM vm(module, in, out);
+			auto start = std::chrono::steady_clock::now();
+			Status status = vm.run();
+			std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+			best = std::min(best, elapsed.count());
+			if(status != Status::Ok)
+				error = vm.error;
+		});
+	}
+
+	std::printf("%-32s %.3fs  %s\n", label, best, error.empty() ? "ok" : error.c_str());
+}
+
+int main()
+{
+	// Reads a million numbers, one per line, and prints every one scaled,
+	// as a graded program goes through its test input.
+	size_t count = 1000000;
+	{
+		std::ofstream file(input_path);
+		for(size_t k = 0; k < count; k++)
+			file << (k % 3 ? std::to_string(k * 7919 % 100003) : std::to_string(k * 0.25)) << '\n';
+	}
+
+	Program program;
+	program["main"] = std::make_pair(Args(), Comp
+	{
+		new Assign("x = 0"),
+		new Input("x"),
+		new While("x != nil", Comp
+		{
+			new Output("x * 3"),
+			new Input("x"),
+		}),
+	});
+
+	Module module;
+	Compiler compiler;
+	if(!compiler.compile(program, module))
+	{
+		std::printf("io: %s\n", compiler.error.c_str());
+		return 1;
+	}
+
+	// Flushing after every line, as std::endl does.
+	time("iostreams, flushed every line", module, [](auto run)
+	{
+		std::ifstream in(input_path);
+		std::ofstream out("/dev/null");
+		out << std::unitbuf;
+		run(in, out);
+	});
+
+	time("iostreams", module, [](auto run)
+	{
+		std::ifstream in(input_path);
+		std::ofstream out("/dev/null");
+		run(in, out);
+	});
+
+	time("FileInput and FileOutput", module, [](auto run)
+	{
+		FileInput input;
+		input.open(input_path);
+		int fd = open("/dev/null", O_WRONLY);
+		{
+			FileOutput output(fd);
+			std::istream in(&input);
+			std::ostream out(&output);
+			run(in, out);
+		}
+
+		close(fd);
+	});
+
+	// An exported program reads and prints through the same streams with
+	// no interpreter around them, which is where their cost shows.
+	Transpiler transpiler;
+	if(!transpiler.build(program, "bin/aot_io.cpp", "bin/aot_io"))
+		std::printf("io: %s\n", transpiler.error.c_str());
+	else
+	{
+		double best = 1e9;
+		int code = 0;
+		for(int k = 0; k < 5; k++)
+		{
+			auto start = std::chrono::steady_clock::now();
+			code = std::system((std::string("bin/aot_io ") + input_path + " > /dev/null").c_str());
+			std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+			best = std::min(best, elapsed.count());
+		}
+
+		std::printf("%-32s %.3fs  %s\n", "exported program", best, code == 0 ? "ok" : "failed");
+	}
+
+	std::remove(input_path);
+}
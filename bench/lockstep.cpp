@@ -0,0 +1,99 @@
+#include<chrono>
+#include<cstdio>
+#include<string>
+
+// Diaflow
+#include<batch.h>
+#include<compiler.h>
+#include<lockstep.h>
+
+using namespace Diaflow;
+
+static void compare(const char* name, const Program& program, const std::vector<std::string>& inputs)
+{
+	Module module;
+	Compiler compiler;
+	if(!compiler.compile(program, module))
+	{
+		std::printf("%s: %s\n", name, compiler.error.c_str());
+		return;
+	}
+
+	Scheduler scheduler(1);
+	Batch batch(module, scheduler);
+	auto start = std::chrono::steady_clock::now();
+	batch.run(inputs);
+	std::chrono::duration<double> scalar = std::chrono::steady_clock::now() - start;
+
+	Lockstep lockstep(module);
+	start = std::chrono::steady_clock::now();
+	lockstep.run(inputs);
+	std::chrono::duration<double> lanes = std::chrono::steady_clock::now() - start;
+
+	size_t mismatched = 0;
+	for(size_t k = 0; k < inputs.size(); k++)
+		mismatched += batch.runs[k].output != lockstep.runs[k].output || batch.runs[k].error != lockstep.runs[k].error;
+
+	std::printf("%-14s scalar %.3fs  lockstep %.3fs  %5zu in lanes  %5zu on VMs  %zu mismatched%s%s\n", name, scalar.count(), lanes.count(),
+		lockstep.lockstep_runs, lockstep.scalar_runs, mismatched, lockstep.unsupported.empty() ? "" : "  unsupported: ", lockstep.unsupported.c_str());
+}
+
+int main()
+{
+	// Every input takes the same path: a fixed number of steps of a damped
+	// oscillator and an integer generator seeded from the input.
+	Program simulation;
+	simulation["main"] = std::make_pair(Args(), Comp
+	{
+		new Input("seed"),
+		new Assign("x = seed * 1.0"),
+		new Assign("v = 0.0"),
+		new Assign("r = seed"),
+		new For("i = 0", "i < 20000", "i++", Comp
+		{
+			new Assign("a = 0.0 - x * 0.5 - v * 0.01"),
+			new Assign("v = v + a * 0.01"),
+			new Assign("x = x + v * 0.01"),
+			new Assign("r = (r * 1103 + 12345) % 65536"),
+		}),
+		new Output("x"),
+		new Output("r"),
+	});
+
+	std::vector<std::string> seeds;
+	for(size_t k = 0; k < 2000; k++)
+		seeds.push_back(std::to_string(k) + "\n");
+
+	compare("simulation", simulation, seeds);
+
+	// Loop counts differ from input to input, so lanes split off.
+	Program collatz;
+	collatz["main"] = std::make_pair(Args(), Comp
+	{
+		new Input("n"),
+		new Assign("steps = 0"),
+		new While("n != 1", Comp
+		{
+			new If("n % 2 == 0", Comp{ new Assign("n = n / 2") }, Comp{ new Assign("n = 3 * n + 1") }),
+			new Assign("steps = steps + 1"),
+		}),
+		new Output("steps"),
+	});
+
+	std::vector<std::string> starts;
+	for(size_t k = 0; k < 2000; k++)
+		starts.push_back(std::to_string(1000 + k) + "\n");
+
+	compare("collatz", collatz, starts);
+
+	// Faults in some lanes: they leave the group and fail on a VM.
+	Program faults;
+	faults["main"] = std::make_pair(Args(), Comp
+	{
+		new Input("d"),
+		new Assign("s = 0"),
+		new For("i = 0", "i < 1000", "i++", Comp{ new Assign("s = s + i / (d % 5)") }),
+		new Output("s"),
+	});
+	compare("faults", faults, seeds);
+}
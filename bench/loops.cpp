@@ -0,0 +1,78 @@
+#include<chrono>
+#include<cstdio>
+#include<sstream>
+
+// Diaflow
+#include<compiler.h>
+#include<vm.h>
+
+using namespace Diaflow;
+
+// Runs one program compiled with and without the loop optimizations,
+// printing the time, code size and output of each.
+static void compare(const char* name, const Program& program)
+{
+	for(int optimized = 0; optimized < 2; optimized++)
+	{
+		Module module;
+		Compiler compiler;
+		compiler.optimize_loops = optimized;
+		if(!compiler.compile(program, module))
+		{
+			std::printf("%s: %s\n", name, compiler.error.c_str());
+			return;
+		}
+
+		size_t size = 0;
+		for(const Function& function : module.functions)
+			size += function.code.size();
+
+		std::istringstream in;
+		std::ostringstream out;
+		VM vm(module, in, out);
+
+		auto start = std::chrono::steady_clock::now();
+		Status status = vm.run();
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+		std::string result = status == Status::Ok ? out.str() : vm.error + "\n";
+		std::printf("%-24s %-10s %.3fs  %zu instructions  -> %s", name, optimized ? "loops" : "plain", elapsed.count(), size, result.c_str());
+	}
+}
+
+int main()
+{
+	Program nested;
+	nested["main"] = std::make_pair(Args(), Comp
+	{
+		new Assign("w = 640"),
+		new Assign("scale = 3"),
+		new Assign("s = 0"),
+		new For("y = 0", "y < 2000", "y++", Comp
+		{
+			new For("x = 0", "x < 2000", "x++", Comp{ new Assign("s = s + (y * 640 + x) % 7 + w * scale") }),
+		}),
+		new Output("s"),
+	});
+	compare("nested counted", nested);
+
+	Program doubles;
+	doubles["main"] = std::make_pair(Args(), Comp
+	{
+		new Assign("k = 0.75"),
+		new Assign("x = 0.0"),
+		new Assign("i = 0"),
+		new While("i < 10000000", Comp{ new Assign("x = x * 0.5 + k * 2.0 + i"), new Assign("i = i + 1") }),
+		new Output("x"),
+	});
+	compare("invariant doubles", doubles);
+
+	Program strided;
+	strided["main"] = std::make_pair(Args(), Comp
+	{
+		new Assign("s = 0"),
+		new For("i = 0", "i < 4000000", "i += 2", Comp{ new Assign("s = s + i * 12 - 5") }),
+		new Output("s"),
+	});
+	compare("strided unrolled", strided);
+}
@@ -0,0 +1,77 @@
+#include<chrono>
+#include<cstdio>
+#include<sstream>
+
+// Diaflow
+#include<compiler.h>
+#include<vm.h>
+
+using namespace Diaflow;
+
+typedef std::vector<std::string> Names;
+
+static void time(const char* name, const Program& program, bool memoize)
+{
+	Module module;
+	Compiler compiler;
+	if(!compiler.compile(program, module))
+	{
+		std::printf("%s: %s\n", name, compiler.error.c_str());
+		return;
+	}
+
+	std::istringstream in;
+	std::ostringstream out;
+	VM vm(module, in, out);
+	vm.memoize = memoize;
+
+	auto start = std::chrono::steady_clock::now();
+	Status status = vm.run();
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+	std::string result = status == Status::Ok ? out.str() : vm.error + "\n";
+	std::printf("%-16s %-9s %.4fs  -> %s%s", name, memoize ? "memoized" : "plain", elapsed.count(), result.c_str(), vm.memo_report().c_str());
+}
+
+int main()
+{
+	Program fib;
+	fib["fib"] = std::make_pair(Args{ "n" }, Comp
+	{
+		new If("n < 2", Comp{ new Return("n") }, Comp{}),
+		new Call("fib", Names{ "n - 1" }, "a"),
+		new Call("fib", Names{ "n - 2" }, "b"),
+		new Return("a + b"),
+	});
+	fib["main"] = std::make_pair(Args(), Comp{ new Call("fib", Names{ "32" }, "x"), new Output("x") });
+	time("fib 32", fib, false);
+	time("fib 32", fib, true);
+
+	Program binomial;
+	binomial["choose"] = std::make_pair(Args{ "n", "k" }, Comp
+	{
+		new If("k == 0 || k == n", Comp{ new Return("1") }, Comp{}),
+		new Call("choose", Names{ "n - 1", "k - 1" }, "a"),
+		new Call("choose", Names{ "n - 1", "k" }, "b"),
+		new Return("a + b"),
+	});
+	binomial["main"] = std::make_pair(Args(), Comp{ new Call("choose", Names{ "26", "13" }, "x"), new Output("x") });
+	time("choose 26 13", binomial, false);
+	time("choose 26 13", binomial, true);
+
+	// Could print, so it is not pure and every call runs.
+	Program logged;
+	logged["square"] = std::make_pair(Args{ "n" }, Comp
+	{
+		new If("n < 0", Comp{ new Output("n") }, Comp{}),
+		new Return("n * n"),
+	});
+	logged["main"] = std::make_pair(Args(), Comp
+	{
+		new Assign("s = 0"),
+		new For("i = 1", "i < 1000000", "i++", Comp{ new Call("square", Names{ "i % 100" }, "x"), new Assign("s = s + x") }),
+		new Output("s"),
+	});
+	time("impure squares", logged, false);
+	time("impure squares", logged, true);
+}
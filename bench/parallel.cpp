@@ -0,0 +1,124 @@
+#include<chrono>
+#include<cstdio>
+#include<sstream>
+#include<thread>
+
+// Diaflow
+#include<compiler.h>
+#include<scheduler.h>
+#include<vm.h>
+
+using namespace Diaflow;
+
+typedef std::vector<std::string> Names;
+
+// Merge sort whose halves sort in the two branches of a Parallel block,
+// down to runs of `cutoff` sorted by insertion in one branch. Branches
+// may not store into an array they share, so each sorts into an array of
+// its own and the parent merges the two.
+static Program merge_sort(size_t count, size_t cutoff)
+{
+	Program program;
+	program["sort"] = std::make_pair(Args{ "a", "lo", "hi" }, Comp
+	{
+		new Assign("out = []"),
+		new If("hi - lo <= " + std::to_string(cutoff), Comp
+		{
+			new For("i = lo", "i < hi", "i++", Comp
+			{
+				new Assign("v = a[i]"),
+				new Assign("push(out, v)"),
+				new Assign("j = i - lo - 1"),
+				new While("j >= 0 && out[j] > v", Comp{ new Assign("out[j + 1] = out[j]"), new Assign("j--") }),
+				new Assign("out[j + 1] = v"),
+			}),
+			new Return("out"),
+		}, Comp{}),
+		new Assign("mid = (lo + hi) / 2"),
+		new Parallel(std::vector<Comp>
+		{
+			Comp{ new Call("sort", Names{ "a", "lo", "mid" }, "left") },
+			Comp{ new Call("sort", Names{ "a", "mid", "hi" }, "right") },
+		}),
+		new Assign("i = 0"),
+		new Assign("j = 0"),
+		new For("k = lo", "k < hi", "k++", Comp
+		{
+			new If("j >= len(right) || (i < len(left) && left[i] <= right[j])", Comp{ new Assign("push(out, left[i])"), new Assign("i++") }, Comp{ new Assign("push(out, right[j])"), new Assign("j++") }),
+		}),
+		new Return("out"),
+	});
+	program["main"] = std::make_pair(Args(), Comp
+	{
+		new Assign("a = []"),
+		new Assign("x = 12345"),
+		new For("i = 0", "i < " + std::to_string(count), "i++", Comp
+		{
+			new Assign("x = (x * 75 + 74) % 65537"),
+			new Assign("a[i] = x"),
+		}),
+		new Call("sort", Names{ "a", "0", "len(a)" }, "a"),
+		new Assign("sorted = true"),
+		new For("i = 1", "i < len(a)", "i++", Comp{ new If("a[i - 1] > a[i]", Comp{ new Assign("sorted = false") }, Comp{}) }),
+		new Output("sorted"),
+		new Output("a[0] + a[len(a) - 1]"),
+	});
+	return program;
+}
+
+static void time(const char* label, const Module& module, Scheduler* scheduler)
+{
+	std::istringstream in;
+	std::ostringstream out;
+	VM vm(module, in, out);
+	vm.scheduler = scheduler;
+
+	auto start = std::chrono::steady_clock::now();
+	Status status = vm.run();
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+	std::string result = status == Status::Ok ? out.str() : vm.error + "\n";
+	for(char& c : result)
+		c = c == '\n' ? ' ' : c;
+
+	std::printf("%-12s %.3fs  %llu forks  -> %s\n", label, elapsed.count(), static_cast<unsigned long long>(vm.forks), result.c_str());
+	if(scheduler)
+		std::printf("%s", scheduler->report().c_str());
+}
+
+int main()
+{
+	Program program = merge_sort(200000, 64);
+
+	// The chart saved and loaded back as the editor would.
+	std::string path = "/tmp/diaflow_bench_parallel.xml";
+	if(FILE* file = std::fopen(path.c_str(), "w"))
+	{
+		std::fputs(program.xml_string().c_str(), file);
+		std::fclose(file);
+	}
+
+	bool corrupted = false;
+	Program loaded(path, &corrupted);
+	if(corrupted)
+	{
+		std::printf("%s: could not be loaded back\n", path.c_str());
+		return 1;
+	}
+
+	Module module;
+	Compiler compiler;
+	if(!compiler.compile(loaded, module))
+	{
+		std::printf("merge sort: %s\n", compiler.error.c_str());
+		return 1;
+	}
+
+	time("in turn", module, nullptr);
+	for(uint32_t threads = 1; threads <= std::max(4u, std::thread::hardware_concurrency()); threads *= 2)
+	{
+		Scheduler scheduler(threads);
+		std::string label = std::to_string(threads) + " threads";
+		time(label.c_str(), module, &scheduler);
+	}
+}
@@ -0,0 +1,100 @@
+#include<chrono>
+#include<cstdio>
+#include<sstream>
+
+// Diaflow
+#include<compiler.h>
+#include<vm.h>
+
+using namespace Diaflow;
+
+static bool run(const char* name, const char* label, const Program& program, bool instrument, Profile* counting, const Profile* guide)
+{
+	Module module;
+	Compiler compiler;
+	compiler.instrument = instrument;
+	compiler.profile = guide;
+	if(!compiler.compile(program, module))
+	{
+		std::printf("%s: %s\n", name, compiler.error.c_str());
+		return false;
+	}
+
+	std::istringstream in;
+	std::ostringstream out;
+	VM vm(module, in, out);
+	vm.profile = counting;
+
+	auto start = std::chrono::steady_clock::now();
+	Status status = vm.run();
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+	std::string result = status == Status::Ok ? out.str() : vm.error + "\n";
+	std::printf("%-20s %-12s %.3fs  %zu outlined  -> %s", name, label, elapsed.count(), compiler.outlined_blocks, result.c_str());
+	return true;
+}
+
+// Runs a program once counting its branches, saves and reloads the profile
+// as the editor would next to the chart, then compares the optimized compile
+// with and without it.
+static void compare(const char* name, const Program& program)
+{
+	Profile profile;
+	if(!run(name, "counting", program, true, &profile, nullptr))
+		return;
+
+	std::string path = "/tmp/diaflow_bench.profile";
+	Profile saved;
+	if(!profile.save(path) || !saved.load(path))
+	{
+		std::printf("%s: %s%s\n", name, profile.error.c_str(), saved.error.c_str());
+		return;
+	}
+
+	run(name, "plain", program, false, nullptr, nullptr);
+	run(name, "profiled", program, false, nullptr, &saved);
+}
+
+int main()
+{
+	Program skewed;
+	skewed["main"] = std::make_pair(Args(), Comp
+	{
+		new Assign("s = 0"),
+		new Assign("errors = 0"),
+		new For("i = 0", "i < 5000000", "i++", Comp
+		{
+			new If("i % 100000 == 99999", Comp
+			{
+				new Assign("errors = errors + 1"),
+				new Assign("s = s % 1000"),
+			}, Comp
+			{
+				new Assign("s = s + i % 7"),
+			}),
+			new If("i % 16 != 0", Comp{}, Comp{ new Assign("s = s + 1") }),
+		}),
+		new Output("s + errors"),
+	});
+	compare("skewed ifs", skewed);
+
+	Program states;
+	states["main"] = std::make_pair(Args(), Comp
+	{
+		new Assign("s = 0"),
+		new For("i = 0", "i < 5000000", "i++", Comp
+		{
+			new Assign("v = \"go\""),
+			new If("i % 16 == 0", Comp{ new Assign("v = \"pause\"") }, Comp{}),
+			new If("i % 64 == 0", Comp{ new Assign("v = \"stop\"") }, Comp{}),
+			new Switch("v", Cases
+			{
+				Case("\"stop\"", Comp{ new Assign("s = s - 3"), new Break() }),
+				Case("\"pause\"", Comp{ new Assign("s = s + 2"), new Break() }),
+				Case("\"go\"", Comp{ new Assign("s = s + 1"), new Break() }),
+			}),
+		}),
+		new Output("s"),
+	});
+	compare("skewed switch", states);
+}
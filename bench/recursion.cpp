@@ -0,0 +1,85 @@
+#include<algorithm>
+#include<chrono>
+#include<cstdio>
+#include<sstream>
+
+// Diaflow
+#include<compiler.h>
+#include<vm.h>
+
+using namespace Diaflow;
+
+typedef std::vector<std::string> Names;
+
+static void time(const char* name, const Program& program, bool tiered, uint32_t depth)
+{
+	Module module;
+	Compiler compiler;
+	TierManager tiers(program, module);
+	if(tiered ? !tiers.compile() : !compiler.compile(program, module))
+	{
+		std::printf("%s: %s\n", name, tiered ? tiers.error.c_str() : compiler.error.c_str());
+		return;
+	}
+
+	std::istringstream in;
+	std::ostringstream out;
+	VM vm(module, in, out);
+	vm.max_depth = depth;
+	if(tiered)
+		vm.tiers = &tiers;
+
+	auto start = std::chrono::steady_clock::now();
+	Status status = vm.run();
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+	size_t tail_calls = 0;
+	for(const Function& function : module.functions)
+		tail_calls += std::count_if(function.code.begin(), function.code.end(), [](const Instr& i) { return i.op == Opcode::TailCall; });
+
+	std::string result = status == Status::Ok ? out.str() : vm.error + "\n";
+	std::printf("%-22s %-11s depth %-8u %.3fs  %zu tail calls  -> %s", name, tiered ? "tiered" : "interpreted", depth, elapsed.count(), tail_calls, result.c_str());
+}
+
+static void compare(const char* name, const Program& program, uint32_t depth)
+{
+	time(name, program, false, depth);
+	time(name, program, true, depth);
+}
+
+int main()
+{
+	Program fib;
+	fib["fib"] = std::make_pair(Args{ "n" }, Comp
+	{
+		new If("n < 2", Comp{ new Return("n") }, Comp{}),
+		new Call("fib", Names{ "n - 1" }, "a"),
+		new Call("fib", Names{ "n - 2" }, "b"),
+		new Return("a + b"),
+	});
+	fib["main"] = std::make_pair(Args(), Comp{ new Call("fib", Names{ "30" }, "x"), new Output("x") });
+	compare("fib 30", fib, 10000);
+
+	// Counts down in tail calls, which run in one frame at any depth limit.
+	Program countdown;
+	countdown["loop"] = std::make_pair(Args{ "n", "acc" }, Comp
+	{
+		new If("n == 0", Comp{ new Return("acc") }, Comp{}),
+		new Call("loop", Names{ "n - 1", "acc + n % 7" }, "r"),
+		new Return("r"),
+	});
+	countdown["main"] = std::make_pair(Args(), Comp{ new Call("loop", Names{ "2000000", "0" }, "x"), new Output("x") });
+	compare("tail countdown 2M", countdown, 10000);
+
+	// Recursion far deeper than the C++ stack would hold.
+	Program sum;
+	sum["sum"] = std::make_pair(Args{ "n" }, Comp
+	{
+		new If("n == 0", Comp{ new Return("0") }, Comp{}),
+		new Call("sum", Names{ "n - 1" }, "r"),
+		new Return("n + r"),
+	});
+	sum["main"] = std::make_pair(Args(), Comp{ new Call("sum", Names{ "1000000" }, "x"), new Output("x") });
+	compare("deep sum 1M", sum, 10000);
+	compare("deep sum 1M", sum, 2000000);
+}
@@ -0,0 +1,64 @@
+#include<chrono>
+#include<cstdio>
+#include<sstream>
+#include<thread>
+
+// Diaflow
+#include<compiler.h>
+#include<runner.h>
+#include<vm.h>
+
+using namespace Diaflow;
+
+int main()
+{
+	// Prints two million numbered lines, as a runaway program might.
+	Program program;
+	program["main"] = std::make_pair(Args(), Comp
+	{
+		new For("i = 0", "i < 2000000", "i++", Comp{ new Output("\"line \" + i") }),
+	});
+
+	Module module;
+	Compiler compiler;
+	if(!compiler.compile(program, module))
+	{
+		std::printf("runner: %s\n", compiler.error.c_str());
+		return 1;
+	}
+
+	{
+		std::istringstream in;
+		std::ostringstream out;
+		VM vm(module, in, out);
+		auto start = std::chrono::steady_clock::now();
+		vm.run();
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		std::printf("%-28s %.3fs  %zu bytes\n", "into a string", elapsed.count(), out.str().size());
+	}
+
+	// The editor's side: one drain per frame at 60 frames a second, keeping
+	// only the last megabyte as its console does.
+	{
+		Runner runner(module);
+		std::string console;
+		size_t bytes = 0, frames = 0;
+		auto start = std::chrono::steady_clock::now();
+		runner.start();
+		for(bool finished = false; !finished; frames++)
+		{
+			finished = runner.finished();
+			size_t before = console.size();
+			runner.drain(console);
+			bytes += console.size() - before;
+			if(console.size() > (1 << 20))
+				console.erase(0, console.size() - (1 << 20));
+
+			if(!finished)
+				std::this_thread::sleep_for(std::chrono::microseconds(16667));
+		}
+
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		std::printf("%-28s %.3fs  %zu bytes in %zu frames\n", "through a Runner at 60 fps", elapsed.count(), bytes, frames);
+	}
+}
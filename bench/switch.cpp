@@ -0,0 +1,78 @@
+#include<chrono>
+#include<cstdio>
+#include<sstream>
+
+// Diaflow
+#include<compiler.h>
+#include<vm.h>
+
+using namespace Diaflow;
+
+// A state machine stepping through `states` cases of a switch, labelled by
+// ints or by strings. With `variable`, the first label is a local read from
+// input, so every label is compared in turn as before tables.
+static Program machine(size_t states, bool strings, bool variable)
+{
+	Cases cases;
+	if(variable)
+		cases.emplace_back("never", Comp{ new Break() });
+
+	for(size_t k = 0; k < states; k++)
+	{
+		std::string label = strings ? "\"state" + std::to_string(k) + "\"" : std::to_string(k);
+		cases.emplace_back(label, Comp{ new Assign("acc = acc + " + std::to_string(k % 13)), new Break() });
+	}
+
+	std::string subject = strings ? "names[s]" : "s";
+	Program program;
+	program["main"] = std::make_pair(Args(), Comp
+	{
+		new Input("never"),
+		new Assign("names = []"),
+		new For("k = 0", "k < " + std::to_string(states), "k++", Comp{ new Assign("names[k] = \"state\" + k") }),
+		new Assign("acc = 0"),
+		new Assign("s = 0"),
+		new For("i = 0", "i < 2000000", "i++", Comp
+		{
+			new Switch(subject, cases),
+			new Assign("s = (s * 7 + 3) % " + std::to_string(states)),
+		}),
+		new Output("acc"),
+	});
+	return program;
+}
+
+static void compare(const char* name, size_t states, bool strings)
+{
+	for(int variable = 1; variable >= 0; variable--)
+	{
+		Program program = machine(states, strings, variable);
+		Module module;
+		Compiler compiler;
+		if(!compiler.compile(program, module))
+		{
+			std::printf("%s: %s\n", name, compiler.error.c_str());
+			return;
+		}
+
+		std::istringstream in("none\n");
+		std::ostringstream out;
+		VM vm(module, in, out);
+
+		auto start = std::chrono::steady_clock::now();
+		Status status = vm.run();
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+		std::string result = status == Status::Ok ? out.str() : vm.error + "\n";
+		std::printf("%-16s %4zu cases  %-10s %.3fs  -> %s", name, states, variable ? "sequential" : "table", elapsed.count(), result.c_str());
+	}
+}
+
+int main()
+{
+	for(size_t states : { 8, 64, 512 })
+	{
+		compare("int labels", states, false);
+		compare("string labels", states, true);
+	}
+}
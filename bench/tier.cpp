@@ -0,0 +1,74 @@
+#include<chrono>
+#include<cstdio>
+#include<sstream>
+
+// Diaflow
+#include<compiler.h>
+#include<tier.h>
+#include<vm.h>
+
+using namespace Diaflow;
+
+// Runs one program interpreted and tiered, printing the time and output of
+// each so the tiers can be compared for speed and for agreement.
+static void compare(const char* name, const Program& program)
+{
+	for(int tiered = 0; tiered < 2; tiered++)
+	{
+		Module module;
+		Compiler compiler;
+		TierManager tiers(program, module);
+		if(!(tiered ? tiers.compile() : compiler.compile(program, module)))
+		{
+			std::printf("%s: %s%s\n", name, compiler.error.c_str(), tiers.error.c_str());
+			return;
+		}
+
+		std::istringstream in;
+		std::ostringstream out;
+		VM vm(module, in, out);
+		if(tiered)
+			vm.tiers = &tiers;
+
+		auto start = std::chrono::steady_clock::now();
+		Status status = vm.run();
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+		std::string result = status == Status::Ok ? out.str() : vm.error + "\n";
+		std::printf("%-24s %-12s %.3fs  promotions %llu, replacements %llu  -> %s", name, tiered ? (Jit::supported() ? "tiered+jit" : "tiered") : "interpreted",
+			elapsed.count(), static_cast<unsigned long long>(vm.promotions), static_cast<unsigned long long>(vm.replacements), result.c_str());
+	}
+}
+
+int main()
+{
+	Program loop;
+	loop["main"] = std::make_pair(Args(), Comp
+	{
+		new Assign("s = 0"),
+		new Assign("i = 0"),
+		new While("i < 20000000", Comp{ new Assign("s = s + i % 7"), new Assign("i = i + 1") }),
+		new Output("s"),
+	});
+	compare("int loop", loop);
+
+	Program doubles;
+	doubles["main"] = std::make_pair(Args(), Comp
+	{
+		new Assign("x = 0.0"),
+		new For("i = 0", "i < 10000000", "i++", Comp{ new Assign("x = x * 0.5 + 1.25") }),
+		new Output("x"),
+	});
+	compare("double loop", doubles);
+
+	Program calls;
+	calls["fib"] = std::make_pair(Args{ "n" }, Comp
+	{
+		new If("n < 2", Comp{ new Return("n") }, Comp{}),
+		new Call("fib", { "n - 1" }, "a"),
+		new Call("fib", { "n - 2" }, "b"),
+		new Return("a + b"),
+	});
+	calls["main"] = std::make_pair(Args(), Comp{ new Call("fib", { "27" }, "r"), new Output("r") });
+	compare("recursive calls", calls);
+}
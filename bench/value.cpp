@@ -0,0 +1,143 @@
+#include<chrono>
+#include<cstdio>
+#include<sstream>
+
+// Diaflow
+#include<value.h>
+#include<ops.h>
+#include<compiler.h>
+#include<vm.h>
+
+using namespace Diaflow;
+
+template<typename F>
+static void measure(const char* name, size_t iterations, F body)
+{
+	auto start = std::chrono::steady_clock::now();
+	body();
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	std::printf("%-32s %8.2f Mops/s  (%.3fs)\n", name, iterations / elapsed.count() / 1e6, elapsed.count());
+}
+
+static void program(const char* name, size_t iterations, Comp body)
+{
+	Program program;
+	program["main"] = std::make_pair(Args(), body);
+
+	Module module;
+	Compiler compiler;
+	if(!compiler.compile(program, module))
+	{
+		std::printf("%s: %s\n", name, compiler.error.c_str());
+		return;
+	}
+
+	std::istringstream in;
+	std::ostringstream out;
+	VM vm(module, in, out);
+	measure(name, iterations, [&]() { vm.run(); });
+	std::printf("%-32s %8zu heap bytes\n", "", vm.heap.bytes);
+}
+
+int main()
+{
+	const size_t n = 20000000;
+	Heap heap;
+	Strings strings;
+
+	measure("ops: int add", n, [&]()
+	{
+		Value sum = Value::integer(0);
+		Value one = Value::integer(1);
+		for(size_t i = 0; i < n; i++)
+			add(sum, one, sum, heap);
+
+		std::printf("%-32s %lld\n", "", static_cast<long long>(sum.as_int()));
+	});
+
+	measure("ops: double add", n, [&]()
+	{
+		Value sum = Value::number(0.0);
+		Value step = Value::number(0.5);
+		for(size_t i = 0; i < n; i++)
+			add(sum, step, sum, heap);
+
+		std::printf("%-32s %g\n", "", sum.as_double());
+	});
+
+	measure("ops: int compare", n, [&]()
+	{
+		Value limit = Value::integer(n / 2);
+		size_t below = 0;
+		for(size_t i = 0; i < n; i++)
+		{
+			Value result;
+			less(Value::integer(i), limit, result);
+			below += result.as_bool();
+		}
+
+		std::printf("%-32s %zu\n", "", below);
+	});
+
+	measure("ops: interned string equality", n, [&]()
+	{
+		Value a = strings.intern("a rather long string");
+		Value b = strings.intern("another rather long string");
+		size_t same = 0;
+		for(size_t i = 0; i < n; i++)
+			same += equal(i & 1 ? a : b, a);
+
+		std::printf("%-32s %zu\n", "", same);
+	});
+
+	const size_t concats = 2000000;
+	measure("ops: small string concat", concats, [&]()
+	{
+		Value x = Value::small_string("abc");
+		Value y = Value::small_string("de");
+		Value r;
+		for(size_t i = 0; i < concats; i++)
+			concat(x, y, r, heap);
+
+		std::printf("%-32s %zu heap bytes\n", "", heap.bytes);
+	});
+
+	measure("ops: long string concat", concats, [&]()
+	{
+		Value x = strings.intern("the quick brown fox ");
+		Value y = strings.intern("jumps over the lazy dog");
+		Value r;
+		for(size_t i = 0; i < concats; i++)
+			concat(x, y, r, heap);
+
+		std::printf("%-32s %zu heap bytes\n", "", heap.bytes);
+	});
+
+	const size_t loops = 10000000;
+	program("vm: int arithmetic loop", loops, Comp
+	{
+		new Assign("s = 0"),
+		new For("i = 0", "i < 10000000", "i++", Comp{ new Assign("s = s + i * 2 - 1") }),
+	});
+
+	program("vm: double arithmetic loop", loops, Comp
+	{
+		new Assign("s = 0.0"),
+		new For("i = 0", "i < 10000000", "i++", Comp{ new Assign("s = s + 0.5") }),
+	});
+
+	program("vm: while cond compare", loops, Comp
+	{
+		new Assign("i = 0"),
+		new Assign("n = 10000000"),
+		new While("i < n && i != -1", Comp{ new Assign("i++") }),
+	});
+
+	program("vm: string equality cond", loops, Comp
+	{
+		new Assign("a = \"some long identifier\""),
+		new Assign("b = \"short\""),
+		new Assign("hits = 0"),
+		new For("i = 0", "i < 10000000", "i++", Comp{ new If("a == b", Comp{ new Assign("hits++") }, Comp{}) }),
+	});
+}
@@ -0,0 +1,300 @@
+#pragma once
+#include<cstdint>
+#include<cstdlib>
+#include<initializer_list>
+#include<iostream>
+#include<string>
+
+// Diaflow
+#include<value.h>
+#include<ops.h>
+#include<streams.h>
+
+// Runtime of the C++ programs written by Transpiler. It is header-only, so a
+// generated program builds from these headers alone. Operations take their
+// operands as braced lists, which C++ evaluates left to right like the
+// interpreter does, and end the program with the interpreter's message when
+// they fail.
+namespace Diaflow::Aot
+{
+	using Diaflow::Value;
+	using Diaflow::Builtin;
+	using Diaflow::equal;
+	using Diaflow::truthy;
+
+	typedef std::initializer_list<Value> Operands;
+
+	struct Runtime
+	{
+		static constexpr int64_t max_depth = 10000;
+
+		Heap heap;
+		Strings strings;
+		std::string line;
+		const char* function = "";
+		int64_t depth = -1;
+		// Standard output, written when its buffer fills, when the program
+		// waits for input and at exit.
+		FileOutput output{ 1 };
+		FileInput input{ 0 };
+
+		Runtime()
+		{
+			input.tie(&output);
+		}
+	};
+
+	inline Runtime& runtime()
+	{
+		static Runtime rt;
+		return rt;
+	}
+
+	[[noreturn]] inline void exit_with(const std::string& error)
+	{
+		runtime().output.pubsync();
+		std::cerr << error << std::endl;
+		std::exit(1);
+	}
+
+	[[noreturn]] inline void fail(Fault fault, const char* op = nullptr, Operands operands = {})
+	{
+		std::string error = "in function '" + std::string(runtime().function) + "': " + fault_message(fault);
+		if(fault == Fault::Type && op && operands.size())
+		{
+			error += std::string(" (") + op;
+			for(const Value* it = operands.begin(); it != operands.end(); it++)
+				error += std::string(it == operands.begin() ? " " : ", ") + type_name(it->type());
+
+			error += ")";
+		}
+
+		exit_with(error);
+	}
+
+	// Lives for the duration of one call of a generated function.
+	class Frame
+	{
+	public:
+		explicit Frame(const char* name)
+			: caller(runtime().function)
+		{
+			Runtime& rt = runtime();
+			if(rt.depth + 1 >= Runtime::max_depth)
+				exit_with("in function '" + std::string(rt.function) + "': call stack exhausted");
+
+			rt.depth++;
+			rt.function = name;
+		}
+
+		~Frame()
+		{
+			runtime().depth--;
+			runtime().function = caller;
+		}
+
+		Frame(const Frame&) = delete;
+		Frame& operator=(const Frame&) = delete;
+
+	private:
+		const char* caller;
+	};
+
+	inline Value text(std::string_view s)
+	{
+		return runtime().strings.intern(s);
+	}
+
+	inline Value checked(Fault fault, Value result, const char* op, Operands operands)
+	{
+		if(fault != Fault::None)
+			fail(fault, op, operands);
+
+		return result;
+	}
+
+	inline Value add(Operands o)
+	{
+		Value r;
+		return checked(Diaflow::add(o.begin()[0], o.begin()[1], r, runtime().heap), r, "add", o);
+	}
+
+	inline Value sub(Operands o)
+	{
+		Value r;
+		return checked(Diaflow::sub(o.begin()[0], o.begin()[1], r), r, "sub", o);
+	}
+
+	inline Value mul(Operands o)
+	{
+		Value r;
+		return checked(Diaflow::mul(o.begin()[0], o.begin()[1], r), r, "mul", o);
+	}
+
+	inline Value div(Operands o)
+	{
+		Value r;
+		return checked(Diaflow::div(o.begin()[0], o.begin()[1], r), r, "div", o);
+	}
+
+	inline Value mod(Operands o)
+	{
+		Value r;
+		return checked(Diaflow::mod(o.begin()[0], o.begin()[1], r), r, "mod", o);
+	}
+
+	inline Value eq(Operands o)
+	{
+		return Value::boolean(equal(o.begin()[0], o.begin()[1]));
+	}
+
+	inline Value ne(Operands o)
+	{
+		return Value::boolean(!equal(o.begin()[0], o.begin()[1]));
+	}
+
+	inline Value lt(Operands o)
+	{
+		Value r;
+		return checked(less(o.begin()[0], o.begin()[1], r), r, "lt", o);
+	}
+
+	inline Value le(Operands o)
+	{
+		Value r;
+		return checked(less_equal(o.begin()[0], o.begin()[1], r), r, "le", o);
+	}
+
+	// a > b and a >= b are b < a and b <= a, as in the interpreter.
+	inline Value gt(Operands o)
+	{
+		return lt({ o.begin()[1], o.begin()[0] });
+	}
+
+	inline Value ge(Operands o)
+	{
+		return le({ o.begin()[1], o.begin()[0] });
+	}
+
+	inline Value negate(Value x)
+	{
+		Value r;
+		return checked(neg(x, r), r, "neg", { x });
+	}
+
+	inline Value logical_not(Value x)
+	{
+		return Value::boolean(!truthy(x));
+	}
+
+	template<typename Rhs>
+	inline Value logical_and(Value x, Rhs rhs)
+	{
+		return truthy(x) ? rhs() : x;
+	}
+
+	template<typename Rhs>
+	inline Value logical_or(Value x, Rhs rhs)
+	{
+		return truthy(x) ? x : rhs();
+	}
+
+	inline Value index(Operands o)
+	{
+		Value r;
+		return checked(Diaflow::index(o.begin()[0], o.begin()[1], r, runtime().heap), r, "index", o);
+	}
+
+	inline void set_index(Operands o)
+	{
+		Fault fault = Diaflow::set_index(o.begin()[0], o.begin()[1], o.begin()[2], runtime().heap);
+		if(fault != Fault::None)
+			fail(fault, "setindex", { o.begin()[0], o.begin()[1] });
+	}
+
+	inline Value array(Operands items)
+	{
+		Value array = runtime().heap.array(items.size());
+		array.as_object<ArrayObject>()->items.assign(items.begin(), items.end());
+		return array;
+	}
+
+	inline Value map(Operands pairs)
+	{
+		Value map = runtime().heap.map();
+		auto& items = map.as_object<MapObject>()->items;
+		for(const Value* it = pairs.begin(); it != pairs.end(); it += 2)
+			items.insert_or_assign(it[0], it[1]);
+
+		runtime().heap.grow(pairs.size() * 2 * sizeof(Value));
+		return map;
+	}
+
+	inline Value builtin(Builtin which, Operands args)
+	{
+		Value r;
+		return checked(Diaflow::builtin(which, args.begin(), r, runtime().heap), r, "builtin", args);
+	}
+
+	inline Value input()
+	{
+		std::string_view text;
+		if(!runtime().input.line(text))
+			return Value::nil();
+
+		return parse_input(text, runtime().heap);
+	}
+
+	inline void output(Value x, bool newline)
+	{
+		Runtime& rt = runtime();
+		rt.line.clear();
+		format(x, rt.line);
+		if(newline)
+			rt.line += '\n';
+
+		rt.output.sputn(rt.line.data(), rt.line.size());
+	}
+
+	// The state of one Foreach.
+	class Iteration
+	{
+	public:
+		explicit Iteration(Value collection)
+			: collection(collection)
+		{}
+
+		bool next(Value& item)
+		{
+			bool done;
+			Value before = collection;
+			Fault fault = iterate(collection, position, item, done, runtime().heap);
+			if(fault != Fault::None)
+				fail(fault, "iter", { before });
+
+			return !done;
+		}
+
+	private:
+		Value collection;
+		Value position = Value::integer(0);
+	};
+
+	// Reads standard input, or the file named by the first argument.
+	inline bool start(int argc, char** argv)
+	{
+		if(argc > 1 && !runtime().input.open(argv[1]))
+		{
+			std::cerr << "cannot open '" << argv[1] << "'" << std::endl;
+			return false;
+		}
+
+		return true;
+	}
+
+	inline int finish()
+	{
+		runtime().output.pubsync();
+		return 0;
+	}
+}
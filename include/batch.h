@@ -0,0 +1,56 @@
+#pragma once
+#include<string>
+#include<vector>
+
+// Diaflow
+#include<bytecode.h>
+#include<scheduler.h>
+#include<vm.h>
+
+namespace Diaflow
+{
+	// Runs one compiled Module over many inputs at once, as when grading a
+	// program against every test case. Each input is one run on a VM of its
+	// own, with its own frames, heap, globals and I/O streams; the Module is
+	// only read, every VM quickening a private copy of the code. The runs
+	// are tasks on the application's Scheduler.
+	class Batch
+	{
+	public:
+		struct Run
+		{
+			Status status = Status::Ok;
+			std::string output;
+			std::string error;
+			Limit limit = Limit::None;
+			double seconds = 0;
+			uint32_t worker = 0;
+		};
+
+		uint32_t max_depth = 10000;
+		// Limits of every run, as VM takes them.
+		uint64_t fuel = UINT64_MAX;
+		size_t max_memory = SIZE_MAX;
+		size_t max_output = SIZE_MAX;
+		bool memoize = false;
+		// One per input of the last run, in input order.
+		std::vector<Run> runs;
+		// Wall-clock time of the last run, and per worker the runs it did
+		// and the time it spent in them.
+		double seconds = 0;
+		std::vector<size_t> worker_runs;
+		std::vector<double> worker_seconds;
+
+		Batch(const Module& module, Scheduler& scheduler);
+
+		// Runs the program once per input, each read as its standard input.
+		// Returns whether every run ended without error.
+		bool run(const std::vector<std::string>& inputs);
+		// Throughput, per-run times and the share of every worker.
+		std::string summary() const;
+
+	private:
+		const Module& module;
+		Scheduler& scheduler;
+	};
+}
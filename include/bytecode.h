@@ -0,0 +1,197 @@
+#pragma once
+#include<cstdint>
+#include<string>
+#include<vector>
+#include<unordered_map>
+
+// Diaflow
+#include<value.h>
+
+namespace Diaflow
+{
+	// Register bytecode. Every function works on a window of registers: the
+	// parameters first, then the other locals, then temporaries. Unless noted
+	// otherwise `a` is the destination register and `b`, `c` are sources.
+	enum class Opcode : uint8_t
+	{
+		Nop,
+		Move,         // a = b
+		LoadK,        // a = constants[b]
+		GetGlobal,    // a = globals[b]
+		SetGlobal,    // globals[a] = b
+		Add, Sub, Mul, Div, Mod,
+		Neg, Not,     // a = op b
+		Eq, Ne, Lt, Le,
+		AddI, SubI, MulI, DivI, ModI, // b and c are known to be ints
+		AddD, SubD, MulD, DivD,       // b and c are known to be doubles
+		EqI, NeI, LtI, LeI,
+		EqD, NeD, LtD, LeD,
+		EqS, NeS, Concat,             // b and c are known to be strings
+		Jump,         // pc = b
+		Switch,       // pc = where switches[b] sends a
+		Loop,         // head of source loop a, reached once per iteration
+		JumpIf,       // if a is truthy, pc = b
+		JumpIfNot,    // if a is falsy, pc = b
+		Index,        // a = b[c]
+		SetIndex,     // a[b] = c
+		NewArray,     // a = [b .. b+c)
+		NewMap,       // a = {b: b+1, ...} with c pairs
+		Builtin,      // a = builtin b over registers a .. a+c
+		Iter,         // a = next item of c (index in c+1), or pc = b when done
+		Call,         // a = functions[b](a .. a+c)
+		TailCall,     // return functions[b](a .. a+c), in place of this frame
+		Return,       // return a
+		Input,        // a = next input line
+		Output,       // print a, with a newline if b
+		Count,        // add one to branch counter b
+		Fork,         // run the branches of forks[b] at once, then pc = its join
+		Join,         // end of a branch of a Fork
+		Split,        // run the Foreach over a in slices of splits[b] at once, then pc = its exit, or go on
+		Defer,        // a[b] = c, or logged for later in a slice of a Split deferring stores to a
+		DeferPush,    // push(a, c), or logged for later as Defer
+		Done,         // end of a slice of splits[b]
+		Channel,      // channels[b] = a new channel holding up to a values
+		Send,         // put a into channels[b], waiting while it is full
+		Receive,      // a = the oldest value of channels[b], waiting while it is empty
+	};
+
+	struct Instr
+	{
+		// A specialized op quickened at run time keeps checking its operand
+		// types and reverts to the generic op if they ever change.
+		static constexpr uint8_t guarded = 1;
+
+		Opcode op;
+		uint8_t flags = 0;
+		uint16_t a;
+		uint32_t b;
+		uint32_t c;
+
+		Instr(Opcode op, uint32_t a = 0, uint32_t b = 0, uint32_t c = 0)
+			: op(op), a(static_cast<uint16_t>(a)), b(b), c(c)
+		{}
+	};
+
+	static_assert(sizeof(Instr) == 12, "Instr should stay three words wide");
+
+	const char* opcode_name(Opcode op);
+
+	// The generic op a type-specialized one stands in for.
+	inline Opcode generic_opcode(Opcode op)
+	{
+		switch(op)
+		{
+			case Opcode::AddI: case Opcode::AddD: case Opcode::Concat: return Opcode::Add;
+			case Opcode::SubI: case Opcode::SubD: return Opcode::Sub;
+			case Opcode::MulI: case Opcode::MulD: return Opcode::Mul;
+			case Opcode::DivI: case Opcode::DivD: return Opcode::Div;
+			case Opcode::ModI: return Opcode::Mod;
+			case Opcode::EqI: case Opcode::EqD: case Opcode::EqS: return Opcode::Eq;
+			case Opcode::NeI: case Opcode::NeD: case Opcode::NeS: return Opcode::Ne;
+			case Opcode::LtI: case Opcode::LtD: return Opcode::Lt;
+			case Opcode::LeI: case Opcode::LeD: return Opcode::Le;
+			default: return op;
+		}
+	}
+
+	// Code the compiler spliced in from the body of another function, which
+	// faults in that range are reported from.
+	struct Inlined
+	{
+		uint32_t begin;
+		uint32_t end;
+		std::string name;
+	};
+
+	// Where a Switch goes for each of its constant labels. Int labels close
+	// together index a dense table from `low`; any other labels hash into
+	// `slots` without collisions, the hash first picking a bucket and then
+	// the seed that bucket's labels were placed with. A subject matching
+	// none goes to the last target.
+	struct SwitchTable
+	{
+		static constexpr uint32_t none = UINT32_MAX;
+
+		std::vector<uint32_t> targets;
+		int64_t low = 0;
+		std::vector<uint32_t> dense;
+		uint32_t bucket_shift = 0;
+		uint32_t shift = 0;
+		std::vector<uint64_t> seeds;
+		std::vector<Value> keys;
+		std::vector<uint32_t> slots;
+
+		// The index into `targets` of where `subject` goes.
+		uint32_t find(const Value& subject) const;
+		size_t bucket(const Value& key) const;
+		size_t slot(const Value& key, uint64_t seed) const;
+	};
+
+	// The branches of a Parallel block: where each starts, where the code
+	// after the block starts, and the local registers each branch assigns,
+	// which are copied back once all have finished.
+	struct ForkTable
+	{
+		std::vector<uint32_t> branches;
+		uint32_t join = 0;
+		std::vector<std::vector<uint32_t>> writes;
+	};
+
+	// A Foreach whose iterations are independent: where a slice starts, on
+	// its own copy of the frame with the collection register holding the
+	// slice, where the code after the loop starts, the registers of the
+	// containers its stores to wait for and the local registers it assigns,
+	// copied back from the last slice that assigned each.
+	struct SplitTable
+	{
+		uint32_t start = 0;
+		uint32_t exit = 0;
+		std::vector<uint32_t> deferred;
+		std::vector<uint32_t> writes;
+	};
+
+	struct Function
+	{
+		// Marks a loop the optimizer removed from this function's code.
+		static constexpr uint32_t no_loop = UINT32_MAX;
+
+		std::string name;
+		uint32_t params = 0;
+		uint32_t registers = 0;
+		std::vector<Instr> code;
+		std::vector<Value> constants;
+		std::vector<std::string> locals;
+		std::vector<uint32_t> loops; // pc of the Loop op of every source loop
+		std::vector<Inlined> inlined;
+		std::vector<SwitchTable> switches;
+		std::vector<ForkTable> forks;
+		std::vector<SplitTable> splits;
+		uint32_t counters = 0; // branch counters, when compiled to count
+		bool pure = false; // its result depends on its arguments alone
+		bool waits = false; // it or a function it calls sends or receives
+		uint32_t generic_ops = 0;
+		uint32_t specialized_ops = 0;
+
+		// The function whose code runs at `pc`: the innermost one inlined
+		// there, or this one.
+		const std::string& name_at(size_t pc) const;
+	};
+
+	class Module
+	{
+	public:
+		Strings strings;
+		std::vector<Function> functions;
+		std::unordered_map<std::string, uint32_t> function_index;
+		std::vector<std::string> globals;
+		std::vector<std::string> channels;
+		uint32_t entry = 0;
+
+		Module() = default;
+		Module(const Module&) = delete;
+		Module& operator=(const Module&) = delete;
+
+		std::string disassemble() const;
+		std::string specialization_report() const;
+	};
+}
@@ -0,0 +1,180 @@
+#pragma once
+#include<cstdint>
+#include<string>
+#include<vector>
+
+// Diaflow
+#include<flow.h>
+
+namespace Diaflow
+{
+	// A straight-line statement of a basic block and the rule its source
+	// string is parsed with.
+	enum class StepKind : uint8_t
+	{
+		Statement, // Assign, or the init and inc of a For
+		Input,     // the target of an Input or a Receive
+		Output,    // also what a Send sends and a Channel's capacity
+		Call,      // source is null, the Call block holds the arguments
+		Iterable,  // the collection a Foreach walks, evaluated once
+		Subject,   // the expression a Switch compares its labels with
+	};
+
+	struct Step
+	{
+		StepKind kind;
+		const Block* block;
+		const std::string* source;
+	};
+
+	// How control leaves a basic block.
+	enum class Exit : uint8_t
+	{
+		Jump,   // to succs[0]
+		Branch, // on source: succs[0] when truthy, succs[1] otherwise
+		Case,   // source against the Switch subject: succs[0] when equal, succs[1] otherwise
+		Next,   // Foreach: succs[0] with the next item in source, succs[1] when done
+		Return, // source, or nil when null, to the exit block
+		End,    // the exit block itself
+	};
+
+	template<typename T>
+	struct Slice
+	{
+		T* first;
+		T* last;
+
+		inline T* begin() const { return first; }
+		inline T* end() const { return last; }
+		inline size_t size() const { return static_cast<size_t>(last - first); }
+		inline T& operator[](size_t i) const { return first[i]; }
+	};
+
+	struct BasicBlock
+	{
+		static constexpr uint32_t none = UINT32_MAX;
+
+		Exit exit = Exit::Jump;
+		// The block that owns the exit: the If, loop, Switch, Break, Continue
+		// or Return it came from. Null for plain fall-through.
+		const Block* block = nullptr;
+		const std::string* source = nullptr;
+		uint32_t succs[2] = { none, none };
+
+		// Set on the block a source loop starts at.
+		const Block* loop_block = nullptr;
+
+		// Filled in by Cfg::build, all none for unreachable blocks.
+		uint32_t rpo = none;
+		uint32_t idom = none;
+		uint32_t loop = none;
+
+		inline uint32_t successors() const
+		{
+			return succs[0] == none ? 0 : succs[1] == none ? 1 : 2;
+		}
+
+	private:
+		friend class Cfg;
+
+		uint32_t first_step = 0, steps = 0;
+		uint32_t first_pred = 0, preds = 0;
+		uint32_t first_child = 0, children = 0;
+		uint32_t pre = 0, post = 0;
+	};
+
+	// A natural loop: a head and everything that reaches one of its back
+	// edges without passing through the head.
+	struct NaturalLoop
+	{
+		uint32_t head;
+		uint32_t parent = BasicBlock::none;
+		uint32_t depth = 1;
+		// The While, DoWhile, For or Foreach the loop was written as.
+		const Block* block = nullptr;
+	};
+
+	// Control-flow graph of one function body. Blocks are numbered in order of
+	// creation with the entry first and the exit second; Break, Continue,
+	// Return and Switch fall-through become ordinary edges. Dominators and
+	// loops only cover blocks reachable from the entry, and so do the
+	// predecessor lists. All storage is flat and kept across builds, so
+	// rebuilding after an edit allocates nothing once it has warmed up.
+	class Cfg
+	{
+	public:
+		static constexpr uint32_t entry = 0;
+		static constexpr uint32_t exit = 1;
+
+		std::vector<BasicBlock> blocks;
+		// Reachable blocks in reverse postorder.
+		std::vector<uint32_t> order;
+		// Innermost loops first, so a loop always comes before its parent.
+		std::vector<NaturalLoop> loops;
+		std::string error;
+
+		bool build(const Comp& body);
+
+		inline Slice<const Step> steps(uint32_t block) const
+		{
+			const Step* first = step_list.data() + blocks[block].first_step;
+			return { first, first + blocks[block].steps };
+		}
+
+		inline Slice<const uint32_t> preds(uint32_t block) const
+		{
+			const uint32_t* first = pred_list.data() + blocks[block].first_pred;
+			return { first, first + blocks[block].preds };
+		}
+
+		// Blocks immediately dominated by `block`.
+		inline Slice<const uint32_t> children(uint32_t block) const
+		{
+			const uint32_t* first = child_list.data() + blocks[block].first_child;
+			return { first, first + blocks[block].children };
+		}
+
+		inline bool reachable(uint32_t block) const
+		{
+			return blocks[block].rpo != BasicBlock::none;
+		}
+
+		// Whether every path from the entry to `b` passes through `a`.
+		inline bool dominates(uint32_t a, uint32_t b) const
+		{
+			return reachable(a) && reachable(b) && blocks[a].pre <= blocks[b].pre && blocks[b].post <= blocks[a].post;
+		}
+
+		inline uint32_t loop_depth(uint32_t block) const
+		{
+			return blocks[block].loop == BasicBlock::none ? 0 : loops[blocks[block].loop].depth;
+		}
+
+	private:
+		struct Target
+		{
+			uint32_t breaks;
+			uint32_t continues;
+			bool loop;
+		};
+
+		std::vector<Step> step_list;
+		std::vector<uint32_t> pred_list;
+		std::vector<uint32_t> child_list;
+		std::vector<Target> targets;
+		std::vector<uint32_t> stack;
+		uint32_t current = BasicBlock::none;
+
+		uint32_t make();
+		void start(uint32_t block);
+		void step(StepKind kind, const Block* block, const std::string* source);
+		void end(Exit exit, const Block* block, const std::string* source, uint32_t to, uint32_t otherwise = BasicBlock::none);
+		void fall(uint32_t to);
+		bool comp(const Comp& body);
+
+		void number();
+		void link();
+		void dominators();
+		void find_loops();
+	};
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include<string>
+#include<vector>
+
+// Diaflow
+#include<flow.h>
+#include<bytecode.h>
+#include<profile.h>
+
+namespace Diaflow
+{
+	// Something the compiler noticed about a block of the chart that the
+	// editor may point out, though the program still compiles.
+	struct Diagnostic
+	{
+		std::string function;
+		const Block* block;
+		std::string message;
+	};
+
+	// Translates a Program into a bytecode Module. The Program is only read.
+	class Compiler
+	{
+	public:
+		std::string error;
+		// Without it no types are inferred and every operator is emitted
+		// generic: quick to produce, and quickening still specializes it.
+		bool optimize = true;
+		// Part of the optimized compile: invariant values are computed once
+		// before their loop, multiples of a counted loop's variable advance
+		// by addition and short counted loops are unrolled.
+		bool optimize_loops = true;
+		// Also part of it: calls to small functions without loops compile
+		// to the callee's body, specialized to the arguments that are
+		// constant.
+		bool inline_calls = true;
+		// Emits a Count op on every way out of a branch, for the VM to add to
+		// its Profile. It keeps calls from being inlined, so that each count
+		// lands in the function the branch belongs to.
+		bool instrument = false;
+		// Foreach loops whose iterations are independent get a Split op,
+		// which runs slices of the collection at once on a VM with a
+		// Scheduler. Code compiled to count gets none.
+		bool parallel_loops = true;
+		// Counts from earlier runs for the optimized compile. The side of an
+		// If taken more often falls through and a side hardly ever taken
+		// moves after the function's return, switch labels tested in turn
+		// are tested most frequent first, and loops that were never entered
+		// get no code hoisted before them or unrolled.
+		const Profile* profile = nullptr;
+		// What constant propagation removed from the program in the last
+		// optimized compile: basic blocks that can never run, and expressions
+		// replaced by their value.
+		size_t dead_blocks = 0;
+		size_t folded_exprs = 0;
+		// Calls it inlined, and how many of those with constant arguments.
+		size_t inlined_calls = 0;
+		size_t specialized_calls = 0;
+		// If sides the profile showed hardly ever taken, which it moved out
+		// of line.
+		size_t outlined_blocks = 0;
+		// Calls whose result the function returns right away, compiled to
+		// reuse the caller's frame.
+		size_t tail_calls = 0;
+		// Ops dropped from the finished code as unreachable or as jumps to
+		// the next op.
+		size_t dropped_ops = 0;
+		// Foreach loops compiled to run in slices.
+		size_t split_loops = 0;
+		// Blocks of the last compile that can never run because one before
+		// them always leaves, one per run of them.
+		std::vector<Diagnostic> diagnostics;
+
+		bool compile(const Program& program, Module& module);
+		// Compiles another tier of an already compiled module into
+		// `functions`, sharing its function table, globals and strings.
+		bool compile(const Program& program, Module& module, std::vector<Function>& functions);
+	};
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include<string>
+#include<string_view>
+#include<vector>
+#include<deque>
+
+// Diaflow
+#include<value.h>
+#include<ops.h>
+
+namespace Diaflow
+{
+	// Parsed form of the expression strings stored in blocks. The grammar is
+	// C-like: literals (ints, doubles, "strings", true, false, nil, [arrays] and
+	// {key: value} maps), locals, @globals, indexing, builtin calls, the usual
+	// arithmetic, comparison and logical operators, and in statement position
+	// the assignments =, +=, -=, *=, /=, %=, ++ and --.
+	enum class ExprKind : uint8_t
+	{
+		Literal, Local, Global, Unary, Binary, Index, Array, Map, Builtin, Assign
+	};
+
+	enum class UnaryOp : uint8_t
+	{
+		Neg, Not
+	};
+
+	enum class BinaryOp : uint8_t
+	{
+		Add, Sub, Mul, Div, Mod, Eq, Ne, Lt, Le, Gt, Ge, And, Or
+	};
+
+	struct Expr
+	{
+		ExprKind kind;
+		uint8_t op = 0;
+		Value value;
+		std::string name;
+		std::vector<Expr*> args;
+
+		Expr(ExprKind kind)
+			: kind(kind)
+		{}
+
+		inline UnaryOp unary() const { return static_cast<UnaryOp>(op); }
+		inline BinaryOp binary() const { return static_cast<BinaryOp>(op); }
+		inline Builtin builtin() const { return static_cast<Builtin>(op); }
+	};
+
+	// Arena owning every node parsed for one compilation.
+	class ExprPool
+	{
+	public:
+		Expr* make(ExprKind kind)
+		{
+			return &nodes.emplace_back(kind);
+		}
+
+		size_t size() const
+		{
+			return nodes.size();
+		}
+
+	private:
+		std::deque<Expr> nodes;
+	};
+
+	class Parser
+	{
+	public:
+		Parser(ExprPool& pool, Strings& strings)
+			: pool(pool), strings(strings)
+		{}
+
+		// A value-producing expression; assignments are rejected.
+		Expr* expression(std::string_view source, std::string* error = nullptr);
+
+		// An expression in statement position, where assignments are allowed.
+		Expr* statement(std::string_view source, std::string* error = nullptr);
+
+		// Something that can be assigned to: a local, a global or an index.
+		Expr* target(std::string_view source, std::string* error = nullptr);
+
+	private:
+		ExprPool& pool;
+		Strings& strings;
+	};
+}
@@ -63,7 +63,7 @@ namespace Diaflow
 
 		void xml(tinyxml2::XMLElement* parent) override
 		{
-			tinyxml2::XMLElement* output = parent->InsertNewChildElement(newline ? "out" : "outln");
+			tinyxml2::XMLElement* output = parent->InsertNewChildElement(newline ? "outln" : "out");
 			output->SetAttribute("expr", expr.c_str());
 		}
 	};
@@ -322,6 +322,107 @@ namespace Diaflow
 		}
 	};
 
+	// Branches that run at the same time, each on a copy of the locals as
+	// they were before the block, and all finish before the block does.
+	// Locals a branch assigns are copied back afterwards, so a local one
+	// branch assigns must not be used by another, and branches may not read
+	// input, assign globals or leave the block. Arrays and maps are shared
+	// rather than copied, so a branch stores into one only through a local
+	// that holds one the function made itself and that no other branch
+	// uses, and calls no function that stores into one it did not make.
+	// Output is held back and printed branch by branch, in order.
+	class Parallel : public Block
+	{
+	public:
+		std::vector<Comp> branches;
+
+		Parallel(const std::vector<Comp>& branches)
+			: branches(branches)
+		{}
+
+		inline void xml(tinyxml2::XMLElement* parent)
+		{
+			tinyxml2::XMLElement* element = parent->InsertNewChildElement("parallel");
+			for(const Comp& body : branches)
+			{
+				tinyxml2::XMLElement* branch_element = element->InsertNewChildElement("branch");
+				for(Block* block : body)
+					block->xml(branch_element);
+			}
+		}
+
+		~Parallel()
+		{
+			for(const Comp& body : branches)
+			{
+				for(Block* block : body)
+					delete block;
+			}
+		}
+	};
+
+	// Makes the channel `name` anew and empty, holding up to `capacity`
+	// values. Channels are named across the whole program, like globals,
+	// and carry values between the branches of a Parallel block, which may
+	// send and receive but not make them.
+	class Channel : public Block
+	{
+	public:
+		std::string name;
+		std::string capacity;
+
+		Channel(const std::string& name, const std::string& capacity)
+			: name(name), capacity(capacity)
+		{}
+
+		inline void xml(tinyxml2::XMLElement* parent)
+		{
+			tinyxml2::XMLElement* element = parent->InsertNewChildElement("channel");
+			element->SetAttribute("name", name.c_str());
+			element->SetAttribute("capacity", capacity.c_str());
+		}
+	};
+
+	// Puts the value of `expr` into a channel, waiting while it is full.
+	// An array or map sent is shared with whoever receives it.
+	class Send : public Block
+	{
+	public:
+		std::string channel;
+		std::string expr;
+
+		Send(const std::string& channel, const std::string& expr)
+			: channel(channel), expr(expr)
+		{}
+
+		inline void xml(tinyxml2::XMLElement* parent)
+		{
+			tinyxml2::XMLElement* element = parent->InsertNewChildElement("send");
+			element->SetAttribute("channel", channel.c_str());
+			element->SetAttribute("expr", expr.c_str());
+		}
+	};
+
+	// Takes the oldest value out of a channel into the target `expr`,
+	// waiting while it is empty.
+	class Receive : public Block
+	{
+	public:
+		std::string channel;
+		std::string expr;
+
+		Receive(const std::string& channel, const std::string& expr)
+			: channel(channel), expr(expr)
+		{}
+
+		inline void xml(tinyxml2::XMLElement* parent)
+		{
+			tinyxml2::XMLElement* element = parent->InsertNewChildElement("receive");
+			element->SetAttribute("channel", channel.c_str());
+			element->SetAttribute("expr", expr.c_str());
+		}
+	};
+
 	class Program
 	{
 	public:
@@ -345,14 +446,22 @@ namespace Diaflow
 
 			for(tinyxml2::XMLElement* func = root->FirstChildElement("func"); func != nullptr; func = func->NextSiblingElement("func"))
 			{
-				std::string name = func->Attribute("name");
-				Args args;
+				const char* name = func->Attribute("name");
+				tinyxml2::XMLElement* body_element = func->FirstChildElement("body");
+				if(!name || !body_element)
+				{
+					if(corrupted)
+						*corrupted = true;
 
+					return;
+				}
+
+				Args args;
 				for(tinyxml2::XMLElement* arg = func->FirstChildElement("arg"); arg != nullptr; arg = arg->NextSiblingElement("arg"))
-					args.push_back(arg->Attribute("name"));
+					args.push_back(arg->Attribute("name") ? arg->Attribute("name") : "");
 
 				Comp body;
-				for(tinyxml2::XMLElement* element = func->FirstChildElement(); element != nullptr; element = element->NextSiblingElement())
+				for(tinyxml2::XMLElement* element = body_element->FirstChildElement(); element != nullptr; element = element->NextSiblingElement())
 				{
 					Block* block = Program::parse(element);
 					if(!block)
@@ -373,7 +482,9 @@ namespace Diaflow
 					}
 
 					body.push_back(block);
-				};
+				}
+
+				funcs[name] = std::make_pair(args, body);
 			}
 		}
 
@@ -475,7 +586,7 @@ namespace Diaflow
 				Comp body;
 				for(tinyxml2::XMLElement* child_element = element->FirstChildElement(); child_element != nullptr; child_element = child_element->NextSiblingElement())
 				{
-					Block* block = Program::parse(element);
+					Block* block = Program::parse(child_element);
 					if(!block)
 					{
 						for(Block* block : body)
@@ -499,7 +610,7 @@ namespace Diaflow
 				Comp body;
 				for(tinyxml2::XMLElement* child_element = element->FirstChildElement(); child_element != nullptr; child_element = child_element->NextSiblingElement())
 				{
-					Block* block = Program::parse(element);
+					Block* block = Program::parse(child_element);
 					if(!block)
 					{
 						for(Block* block : body)
@@ -531,7 +642,7 @@ namespace Diaflow
 				Comp body;
 				for(tinyxml2::XMLElement* child_element = element->FirstChildElement(); child_element != nullptr; child_element = child_element->NextSiblingElement())
 				{
-					Block* block = Program::parse(element);
+					Block* block = Program::parse(child_element);
 					if(!block)
 					{
 						for(Block* block : body)
@@ -559,7 +670,7 @@ namespace Diaflow
 				Comp body;
 				for(tinyxml2::XMLElement* child_element = element->FirstChildElement(); child_element != nullptr; child_element = child_element->NextSiblingElement())
 				{
-					Block* block = Program::parse(element);
+					Block* block = Program::parse(child_element);
 					if(!block)
 					{
 						for(Block* block : body)
@@ -624,6 +735,62 @@ namespace Diaflow
 
 					cases.push_back(std::make_pair(case_expr, body));
 				}
+
+				return new Switch(expr, cases);
+			}
+
+			if(type == "parallel")
+			{
+				std::vector<Comp> branches;
+				auto discard = [&branches]()
+				{
+					for(const Comp& body : branches)
+					{
+						for(Block* block : body)
+							delete block;
+					}
+				};
+
+				for(tinyxml2::XMLElement* branch_element = element->FirstChildElement("branch"); branch_element != nullptr; branch_element = branch_element->NextSiblingElement("branch"))
+				{
+					branches.emplace_back();
+					for(tinyxml2::XMLElement* child_element = branch_element->FirstChildElement(); child_element != nullptr; child_element = child_element->NextSiblingElement())
+					{
+						Block* block = Program::parse(child_element);
+						if(!block)
+						{
+							discard();
+							return nullptr;
+						}
+
+						branches.back().push_back(block);
+					}
+				}
+
+				return new Parallel(branches);
+			}
+
+			if(type == "channel")
+			{
+				const char* name = element->Attribute("name");
+				const char* capacity = element->Attribute("capacity");
+				if(!name || !capacity)
+					return nullptr;
+
+				return new Channel(name, capacity);
+			}
+
+			if(type == "send" || type == "receive")
+			{
+				const char* channel = element->Attribute("channel");
+				const char* expr = element->Attribute("expr");
+				if(!channel || !expr)
+					return nullptr;
+
+				if(type == "send")
+					return new Send(channel, expr);
+
+				return new Receive(channel, expr);
 			}
 
 			if(type == "break")
@@ -635,6 +802,9 @@ namespace Diaflow
 			if(type == "call")
 			{
 				const char* name = element->Attribute("name");
+				if(!name)
+					return nullptr;
+
 				const char* retvar = element->Attribute("retvar");
 
 				std::vector<std::string> args;
@@ -650,7 +820,7 @@ namespace Diaflow
 					args.push_back(expr);
 				}
 
-				return new Call(name, args, retvar);
+				return new Call(name, args, retvar ? retvar : "");
 			}
 
 			if(type == "return")
@@ -682,9 +852,8 @@ namespace Diaflow
 			return funcs[func];
 		}
 
-		tinyxml2::XMLDocument xml()
+		void xml(tinyxml2::XMLDocument& doc)
 		{
-			tinyxml2::XMLDocument doc;
 			tinyxml2::XMLElement* root = doc.NewElement("prog");
 			doc.InsertEndChild(root);
 
@@ -702,13 +871,12 @@ namespace Diaflow
 				for(Block* block : body)
 					block->xml(body_element);
 			}
-
-			return doc.ToDocument();
 		}
 
 		std::string xml_string()
 		{
-			tinyxml2::XMLDocument doc = xml();
+			tinyxml2::XMLDocument doc;
+			xml(doc);
 			tinyxml2::XMLPrinter printer;
 			doc.Print(&printer);
 			return printer.CStr();
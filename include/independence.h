@@ -0,0 +1,39 @@
+#pragma once
+#include<string>
+#include<vector>
+#include<unordered_map>
+
+// Diaflow
+#include<parsed.h>
+
+namespace Diaflow
+{
+	// A Foreach whose iterations do not depend on one another, so that
+	// slices of its collection may run at once, each on its own copy of the
+	// frame.
+	struct IndependentLoop
+	{
+		// Locals the body assigns, its variable included. An iteration reads
+		// none of them before assigning it.
+		std::vector<std::string> assigned;
+		// Confined locals the body stores into by index or pushes onto but
+		// never reads or assigns. Their stores and pushes can wait and be
+		// made in iteration order once the slices are done.
+		std::vector<std::string> deferred;
+	};
+
+	// Finds the independent Foreach loops of every function. The body of one
+	// reads no input, does not return, break out of it or run a Parallel
+	// block, uses no channel, assigns no global, stores and pushes only into
+	// its deferred locals and calls no function that reads input, assigns a
+	// global, uses a channel or stores into an array or map at all. Printing
+	// is allowed: each slice prints into a buffer of its own and the buffers
+	// are printed in order.
+	class Independence
+	{
+	public:
+		std::vector<std::unordered_map<const Block*, IndependentLoop>> functions;
+
+		void run(const std::vector<ParsedFunction>& parsed, const std::unordered_map<std::string, uint32_t>& index);
+	};
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include<cstdint>
+#include<string>
+#include<vector>
+
+// Diaflow
+#include<value.h>
+#include<bytecode.h>
+
+namespace Diaflow
+{
+	class VM;
+
+	// The frame native code runs on.
+	struct NativeFrame
+	{
+		VM* vm;
+		Value* registers;
+		Value* globals;
+		Value* result;
+		uint32_t entry;
+		uint32_t depth;
+		// The VM's steps left, counted down at every loop head.
+		uint64_t* steps;
+	};
+
+	// Runs one frame to its Return and gives 0, or 1 after an error. Starts
+	// at pc `entry`, which is 0 or the pc of a Loop op for on-stack
+	// replacement.
+	typedef uint32_t (*NativeCode)(NativeFrame* frame);
+
+	// Template JIT for x86-64 Linux. Every bytecode op turns into a fixed
+	// sequence of machine code: moves, branches and the int and double ops
+	// run inline, and everything that touches the heap, strings or I/O calls
+	// back into the runtime. Code is written to mmapped memory that becomes
+	// executable once finished, and every function is listed in
+	// /tmp/perf-<pid>.map so perf can symbolize it.
+	class Jit
+	{
+	public:
+		std::string error;
+
+		Jit() = default;
+		~Jit();
+		Jit(const Jit&) = delete;
+		Jit& operator=(const Jit&) = delete;
+
+		static bool supported();
+		// Returns nullptr, with `error` set, when the code cannot be mapped.
+		NativeCode compile(const Function& function);
+
+	private:
+		std::vector<std::pair<void*, size_t>> regions;
+	};
+}
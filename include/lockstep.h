@@ -0,0 +1,59 @@
+#pragma once
+#include<array>
+#include<string>
+#include<vector>
+
+// Diaflow
+#include<bytecode.h>
+#include<batch.h>
+
+namespace Diaflow
+{
+	// Experimental: runs one compiled Module over many inputs `lanes` at a
+	// time, all lanes of a group stepping through the entry function's code
+	// together. Every register holds one value per lane, and the ops
+	// specialized to ints or doubles are loops over the lanes the C++
+	// compiler turns into vector instructions, SSE or AVX2 as targeted.
+	//
+	// A lane leaves its group when it faults, when an int it computes grows
+	// past the range of ints, or when it goes the other way than most of
+	// the group at a branch, and is run again from the start
+	// on a VM of its own. Programs whose entry function calls, indexes or
+	// loops over collections run on VMs throughout. So does every lane of a
+	// group that used up its fuel or memory, and a lane printing too much,
+	// for the VM to stop where the limit is.
+	class Lockstep
+	{
+	public:
+		static constexpr size_t lanes = 8;
+
+		uint32_t max_depth = 10000;
+		// Limits of every run, as VM takes them.
+		uint64_t fuel = UINT64_MAX;
+		size_t max_memory = SIZE_MAX;
+		size_t max_output = SIZE_MAX;
+		// One per input of the last run, in input order.
+		std::vector<Batch::Run> runs;
+		// Runs of the last run that went to the end in their group, and
+		// runs that went on a VM instead.
+		size_t lockstep_runs = 0;
+		size_t scalar_runs = 0;
+		// Why the entry function cannot run in lanes, or empty.
+		std::string unsupported;
+
+		explicit Lockstep(const Module& module);
+
+		// Runs the program once per input, each read as its standard input.
+		// Returns whether every run ended without error.
+		bool run(const std::vector<std::string>& inputs);
+
+	private:
+		typedef std::array<uint8_t, lanes> Mask;
+
+		const Module& module;
+
+		// Runs inputs [first, first + count) in lanes, adding those that
+		// left the group to `scalar`.
+		void group(const std::vector<std::string>& inputs, size_t first, size_t count, std::vector<size_t>& scalar);
+	};
+}
@@ -0,0 +1,542 @@
+#pragma once
+#include<charconv>
+#include<cmath>
+#include<cerrno>
+#include<cctype>
+#include<cstdlib>
+#include<string>
+#include<string_view>
+
+// Diaflow
+#include<value.h>
+
+namespace Diaflow
+{
+	// Generic operations on values. They never throw; a failed operation
+	// reports why through its Fault and leaves `out` untouched.
+	enum class Fault : uint8_t
+	{
+		None, Type, Overflow, DivideByZero, Index, Key
+	};
+
+	enum class Builtin : uint8_t
+	{
+		Len, Str, Int, Float, Push, Abs, Sqrt, Floor
+	};
+
+	inline const char* fault_message(Fault fault)
+	{
+		switch(fault)
+		{
+			case Fault::None: return "no error";
+			case Fault::Type: return "operand types do not match the operation";
+			case Fault::Overflow: return "integer overflow";
+			case Fault::DivideByZero: return "division by zero";
+			case Fault::Index: return "index out of range";
+			case Fault::Key: return "key not found";
+		}
+
+		return "unknown error";
+	}
+
+	inline Fault concat(const Value& a, const Value& b, Value& out, Heap& heap)
+	{
+		if(a.is_string() && b.is_string())
+		{
+			std::string_view x = string_view(a), y = string_view(b);
+			if(x.size() + y.size() <= Value::small_string_max)
+			{
+				char buffer[Value::small_string_max];
+				std::memcpy(buffer, x.data(), x.size());
+				std::memcpy(buffer + x.size(), y.data(), y.size());
+				out = heap.string(std::string_view(buffer, x.size() + y.size()));
+				return Fault::None;
+			}
+		}
+
+		std::string result;
+		format(a, result);
+		format(b, result);
+		out = heap.string(result);
+		return Fault::None;
+	}
+
+	inline Fault add(const Value& a, const Value& b, Value& out, Heap& heap)
+	{
+		if(a.is_int() && b.is_int())
+		{
+			out = Value::widened(a.as_int() + b.as_int());
+			return Fault::None;
+		}
+
+		if(a.is_number() && b.is_number())
+		{
+			out = Value::number(a.as_number() + b.as_number());
+			return Fault::None;
+		}
+
+		if(a.is_string() || b.is_string())
+			return concat(a, b, out, heap);
+
+		return Fault::Type;
+	}
+
+	inline Fault sub(const Value& a, const Value& b, Value& out)
+	{
+		if(a.is_int() && b.is_int())
+		{
+			out = Value::widened(a.as_int() - b.as_int());
+			return Fault::None;
+		}
+
+		if(a.is_number() && b.is_number())
+		{
+			out = Value::number(a.as_number() - b.as_number());
+			return Fault::None;
+		}
+
+		return Fault::Type;
+	}
+
+	inline Fault mul(const Value& a, const Value& b, Value& out)
+	{
+		if(a.is_int() && b.is_int())
+		{
+			int64_t r;
+			if(__builtin_mul_overflow(a.as_int(), b.as_int(), &r))
+				out = Value::number(a.as_number() * b.as_number());
+			else
+				out = Value::widened(r);
+
+			return Fault::None;
+		}
+
+		if(a.is_number() && b.is_number())
+		{
+			out = Value::number(a.as_number() * b.as_number());
+			return Fault::None;
+		}
+
+		return Fault::Type;
+	}
+
+	// Integer division truncates towards zero, as in C.
+	inline Fault div(const Value& a, const Value& b, Value& out)
+	{
+		if(a.is_int() && b.is_int())
+		{
+			if(b.as_int() == 0)
+				return Fault::DivideByZero;
+
+			out = Value::widened(a.as_int() / b.as_int());
+			return Fault::None;
+		}
+
+		if(a.is_number() && b.is_number())
+		{
+			out = Value::number(a.as_number() / b.as_number());
+			return Fault::None;
+		}
+
+		return Fault::Type;
+	}
+
+	inline Fault mod(const Value& a, const Value& b, Value& out)
+	{
+		if(a.is_int() && b.is_int())
+		{
+			if(b.as_int() == 0)
+				return Fault::DivideByZero;
+
+			out = Value::integer(a.as_int() % b.as_int());
+			return Fault::None;
+		}
+
+		if(a.is_number() && b.is_number())
+		{
+			out = Value::number(std::fmod(a.as_number(), b.as_number()));
+			return Fault::None;
+		}
+
+		return Fault::Type;
+	}
+
+	inline Fault neg(const Value& a, Value& out)
+	{
+		if(a.is_int())
+		{
+			out = Value::widened(-a.as_int());
+			return Fault::None;
+		}
+
+		if(a.is_double())
+		{
+			out = Value::number(-a.as_double());
+			return Fault::None;
+		}
+
+		return Fault::Type;
+	}
+
+	// Three-way comparison for the ordering operators. Numbers compare with
+	// numbers and strings with strings; anything else is a type error.
+	inline Fault compare(const Value& a, const Value& b, int& out)
+	{
+		if(a.is_int() && b.is_int())
+		{
+			out = (a.as_int() > b.as_int()) - (a.as_int() < b.as_int());
+			return Fault::None;
+		}
+
+		if(a.is_number() && b.is_number())
+		{
+			double x = a.as_number(), y = b.as_number();
+			if(x != x || y != y)
+				out = 2;
+			else
+				out = (x > y) - (x < y);
+
+			return Fault::None;
+		}
+
+		if(a.is_string() && b.is_string())
+		{
+			int c = string_view(a).compare(string_view(b));
+			out = (c > 0) - (c < 0);
+			return Fault::None;
+		}
+
+		return Fault::Type;
+	}
+
+	inline Fault less(const Value& a, const Value& b, Value& out)
+	{
+		int c;
+		Fault fault = compare(a, b, c);
+		if(fault == Fault::None)
+			out = Value::boolean(c == -1);
+
+		return fault;
+	}
+
+	inline Fault less_equal(const Value& a, const Value& b, Value& out)
+	{
+		int c;
+		Fault fault = compare(a, b, c);
+		if(fault == Fault::None)
+			out = Value::boolean(c == -1 || c == 0);
+
+		return fault;
+	}
+
+	inline Fault length(const Value& a, Value& out)
+	{
+		if(a.is_string())
+			out = Value::integer(static_cast<int64_t>(string_view(a).size()));
+		else if(a.is_array())
+			out = Value::integer(static_cast<int64_t>(a.as_object<ArrayObject>()->items.size()));
+		else if(a.is_map())
+			out = Value::integer(static_cast<int64_t>(a.as_object<MapObject>()->items.size()));
+		else
+			return Fault::Type;
+
+		return Fault::None;
+	}
+
+	inline Fault index(const Value& container, const Value& key, Value& out, Heap& heap)
+	{
+		if(container.is_array())
+		{
+			if(!key.is_int())
+				return Fault::Type;
+
+			std::vector<Value>& items = container.as_object<ArrayObject>()->items;
+			int64_t i = key.as_int();
+			if(i < 0 || static_cast<size_t>(i) >= items.size())
+				return Fault::Index;
+
+			out = items[i];
+			return Fault::None;
+		}
+
+		if(container.is_map())
+		{
+			auto& items = container.as_object<MapObject>()->items;
+			auto it = items.find(key);
+			if(it == items.end())
+				return Fault::Key;
+
+			out = it->second;
+			return Fault::None;
+		}
+
+		if(container.is_string())
+		{
+			if(!key.is_int())
+				return Fault::Type;
+
+			std::string_view s = string_view(container);
+			int64_t i = key.as_int();
+			if(i < 0 || static_cast<size_t>(i) >= s.size())
+				return Fault::Index;
+
+			out = heap.string(s.substr(i, 1));
+			return Fault::None;
+		}
+
+		return Fault::Type;
+	}
+
+	// Arrays grow by one when assigning just past their end.
+	inline Fault set_index(const Value& container, const Value& key, const Value& value, Heap& heap)
+	{
+		if(container.is_array())
+		{
+			if(!key.is_int())
+				return Fault::Type;
+
+			std::vector<Value>& items = container.as_object<ArrayObject>()->items;
+			int64_t i = key.as_int();
+			if(i < 0 || static_cast<size_t>(i) > items.size())
+				return Fault::Index;
+
+			if(static_cast<size_t>(i) == items.size())
+			{
+				items.push_back(value);
+				heap.grow(sizeof(Value));
+			}
+			else
+				items[i] = value;
+
+			return Fault::None;
+		}
+
+		if(container.is_map())
+		{
+			auto& items = container.as_object<MapObject>()->items;
+			auto [it, inserted] = items.insert_or_assign(key, value);
+			(void)it;
+			if(inserted)
+				heap.grow(4 * sizeof(Value));
+
+			return Fault::None;
+		}
+
+		return Fault::Type;
+	}
+
+	// Read the whole of `text` as an integer or as a double, as strtoll and
+	// strtod would, an integer too large for an int giving a double.
+	// std::from_chars reads the usual forms without a copy or the locale;
+	// the rest, such as leading blanks, a '+' or numbers out of range, go to
+	// the C library.
+	inline bool parse_int(std::string_view text, Value& out)
+	{
+		int64_t i;
+		std::from_chars_result read = std::from_chars(text.data(), text.data() + text.size(), i);
+		if(read.ec == std::errc() && read.ptr == text.data() + text.size())
+		{
+			out = Value::widened(i);
+			return true;
+		}
+
+		std::string s(text);
+		char* end;
+		errno = 0;
+		long long l = std::strtoll(s.c_str(), &end, 10);
+		if(s.empty() || *end)
+			return false;
+
+		out = errno == ERANGE ? Value::number(std::strtod(s.c_str(), nullptr)) : Value::widened(l);
+		return true;
+	}
+
+	inline bool parse_double(std::string_view text, double& out)
+	{
+		double d;
+		std::from_chars_result read = std::from_chars(text.data(), text.data() + text.size(), d);
+		if(read.ec == std::errc() && read.ptr == text.data() + text.size())
+		{
+			out = d;
+			return true;
+		}
+
+		std::string s(text);
+		char* end;
+		d = std::strtod(s.c_str(), &end);
+		if(s.empty() || *end)
+			return false;
+
+		out = d;
+		return true;
+	}
+
+	inline Fault builtin(Builtin which, const Value* args, Value& out, Heap& heap)
+	{
+		const Value& x = args[0];
+		switch(which)
+		{
+			case Builtin::Len:
+				return length(x, out);
+
+			case Builtin::Str:
+			{
+				if(x.is_string())
+				{
+					out = x;
+					return Fault::None;
+				}
+
+				std::string s;
+				format(x, s);
+				out = heap.string(s);
+				return Fault::None;
+			}
+
+			case Builtin::Int:
+			{
+				if(x.is_int())
+					out = x;
+				else if(x.is_bool())
+					out = Value::integer(x.as_bool());
+				else if(x.is_double())
+				{
+					double d = std::trunc(x.as_double());
+					if(!std::isfinite(d))
+						return Fault::Overflow;
+
+					out = d >= Value::int_min && d <= Value::int_max ? Value::integer(static_cast<int64_t>(d)) : Value::number(d);
+				}
+				else if(x.is_string())
+				{
+					if(!parse_int(string_view(x), out))
+						return Fault::Type;
+				}
+				else
+					return Fault::Type;
+
+				return Fault::None;
+			}
+
+			case Builtin::Float:
+			{
+				if(x.is_number())
+					out = Value::number(x.as_number());
+				else if(x.is_string())
+				{
+					double d;
+					if(!parse_double(string_view(x), d))
+						return Fault::Type;
+
+					out = Value::number(d);
+				}
+				else
+					return Fault::Type;
+
+				return Fault::None;
+			}
+
+			case Builtin::Push:
+			{
+				if(!x.is_array())
+					return Fault::Type;
+
+				x.as_object<ArrayObject>()->items.push_back(args[1]);
+				heap.grow(sizeof(Value));
+				out = Value::nil();
+				return Fault::None;
+			}
+
+			case Builtin::Abs:
+				if(x.is_int() && x.as_int() < 0)
+					return neg(x, out);
+
+				if(x.is_int())
+				{
+					out = x;
+					return Fault::None;
+				}
+
+				if(!x.is_double())
+					return Fault::Type;
+
+				out = Value::number(std::fabs(x.as_double()));
+				return Fault::None;
+
+			case Builtin::Sqrt:
+			case Builtin::Floor:
+				if(!x.is_number())
+					return Fault::Type;
+
+				out = Value::number(which == Builtin::Sqrt ? std::sqrt(x.as_number()) : std::floor(x.as_number()));
+				return Fault::None;
+		}
+
+		return Fault::Type;
+	}
+
+	// One step of a Foreach: the item at `position` goes to `item` and the
+	// position advances, or `done` is set once the collection is exhausted.
+	// Maps are iterated over a snapshot of their keys, taken on the first
+	// step.
+	inline Fault iterate(Value& collection, Value& position, Value& item, bool& done, Heap& heap)
+	{
+		int64_t n = position.as_int();
+		if(collection.is_map())
+		{
+			Value keys = heap.array(collection.as_object<MapObject>()->items.size());
+			for(auto& [key, _] : collection.as_object<MapObject>()->items)
+				keys.as_object<ArrayObject>()->items.push_back(key);
+
+			collection = keys;
+		}
+
+		if(collection.is_array())
+		{
+			std::vector<Value>& items = collection.as_object<ArrayObject>()->items;
+			done = static_cast<size_t>(n) >= items.size();
+			if(!done)
+				item = items[n];
+		}
+		else if(collection.is_string())
+		{
+			std::string_view s = string_view(collection);
+			done = static_cast<size_t>(n) >= s.size();
+			if(!done)
+				item = heap.string(s.substr(n, 1));
+		}
+		else if(collection.is_int())
+		{
+			done = n >= collection.as_int();
+			if(!done)
+				item = Value::integer(n);
+		}
+		else
+			return Fault::Type;
+
+		if(!done)
+			position = Value::integer(n + 1);
+
+		return Fault::None;
+	}
+
+	// Interprets an input line as an int, a double or, failing both, a string.
+	inline Value parse_input(std::string_view text, Heap& heap)
+	{
+		while(!text.empty() && std::isspace(static_cast<unsigned char>(text.back())))
+			text.remove_suffix(1);
+
+		while(!text.empty() && std::isspace(static_cast<unsigned char>(text.front())))
+			text.remove_prefix(1);
+
+		Value i;
+		double d;
+		if(parse_int(text, i))
+			return i;
+
+		if(parse_double(text, d))
+			return Value::number(d);
+
+		return heap.string(text);
+	}
+}
@@ -0,0 +1,106 @@
+#pragma once
+#include<string>
+#include<vector>
+#include<unordered_map>
+#include<unordered_set>
+
+// Diaflow
+#include<flow.h>
+#include<expr.h>
+
+namespace Diaflow
+{
+	// The expressions of one function, parsed once and looked up by the block
+	// string they came from, plus the register given to every local it names.
+	// Parameters take the first registers, other locals follow in order of
+	// first appearance. Loops are numbered in source order, so every tier
+	// compiled from the function agrees on which loop is which, and each
+	// Foreach keeps its collection and position in two registers reserved
+	// after the locals, so the tiers agree on those too. Branches are
+	// numbered in source order as well, which lets a profile of one compile
+	// guide the next: an If and a loop with a condition take two counters,
+	// for the condition true and false, and a Switch one per case and one
+	// for none.
+	class ParsedFunction
+	{
+	public:
+		std::string name;
+		const Args* args = nullptr;
+		const Comp* body = nullptr;
+		std::unordered_map<std::string, uint32_t> locals;
+		std::unordered_map<const Block*, uint32_t> loops;
+		std::unordered_map<const Block*, uint32_t> iterators;
+		std::unordered_map<const Block*, uint32_t> branches; // first counter
+		uint32_t counters = 0;
+		// Whether it reads input, prints or names a global anywhere, and every
+		// Call block in it.
+		bool effects = false;
+		std::vector<const Call*> calls;
+		// Whether it has a Parallel block, and the calls made from inside
+		// one, which may not reach a function that reads input, assigns a
+		// global, makes a channel or stores into an array or map other than
+		// through a confined local: one marked `unshareable`.
+		bool parallel = false;
+		std::vector<const Call*> forked;
+		bool unshareable = false;
+		// Whether it stores into an array or map, by an indexed assignment or
+		// push(), and the locals that only ever refer to an array or map it
+		// made itself: other than by index they are only assigned [] or {}
+		// literals, passed to len() or as what push() adds to, iterated by a
+		// Foreach, printed and returned, and they are not parameters.
+		bool stores = false;
+		std::unordered_set<std::string> confined;
+		// Whether it sends or receives on a channel, which may wait.
+		bool waits = false;
+		// Blocks after one that always leaves their Comp: a Break, Continue
+		// or Return, or an If both sides of which leave. `unreachable` holds
+		// all of them but comments, `stranded` the first of every run.
+		std::unordered_set<const Block*> unreachable;
+		std::vector<const Block*> stranded;
+		std::string error;
+
+		bool parse(const std::string& name, const Args& args, const Comp& body, Parser& parser);
+
+		inline Expr* operator[](const std::string& source) const
+		{
+			auto it = exprs.find(&source);
+			return it != exprs.end() ? it->second : nullptr;
+		}
+
+		inline uint32_t local(const std::string& name) const
+		{
+			return locals.at(name);
+		}
+
+		// The first of the two registers holding the state of a Foreach.
+		inline uint32_t iterator(const Block* loop) const
+		{
+			return static_cast<uint32_t>(locals.size() + 2 * iterators.at(loop));
+		}
+
+		// Registers taken by locals and Foreach state; temporaries follow.
+		inline uint32_t registers() const
+		{
+			return static_cast<uint32_t>(locals.size() + 2 * iterators.size());
+		}
+
+	private:
+		std::unordered_map<const std::string*, Expr*> exprs;
+		// The expressions of Output and Return blocks, what every indexed
+		// assignment and push() stores into, and the locals stored into in
+		// a Parallel branch.
+		std::unordered_set<const Expr*> whole;
+		std::vector<const Expr*> bases;
+		std::unordered_set<std::string> branch_stores;
+		Parser* parser = nullptr;
+
+		void declare(const Expr* expr);
+		void escape(const Expr* expr, std::unordered_set<std::string>& escaped) const;
+		bool scan(const Comp& body);
+		bool sweep(const Comp& body);
+		bool isolate(const Comp& body, uint32_t loops, bool breakable, std::unordered_set<std::string>& written, std::unordered_set<std::string>& used);
+		bool isolate(const Expr* expr, std::unordered_set<std::string>& written, std::unordered_set<std::string>& used);
+		bool change(const Expr* base, std::unordered_set<std::string>& written);
+		bool parse(const std::string& source, Expr* (Parser::*rule)(std::string_view, std::string*));
+	};
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include<cstdint>
+#include<map>
+#include<string>
+#include<vector>
+
+namespace Diaflow
+{
+	// How often each way out of every branch of a program was taken, summed
+	// over the runs that counted into it. Counters are kept per function, in
+	// the order ParsedFunction numbers its branches, and saved next to the
+	// chart so the next compile of that chart can lay out its hot paths.
+	// A function whose number of counters changed since was edited, and its
+	// old counts are ignored and then replaced.
+	class Profile
+	{
+	public:
+		std::map<std::string, std::vector<uint64_t>> functions;
+		std::string error;
+
+		// Where the profile of the chart saved at `chart` is kept.
+		static std::string path(const std::string& chart);
+
+		// Adds the counts saved at `path` to the profile.
+		bool load(const std::string& path);
+		bool save(const std::string& path);
+
+		// The counters of function `name`, if it has `slots` of them.
+		const std::vector<uint64_t>* find(const std::string& name, size_t slots) const;
+		// The `slots` counters a run adds to for function `name`.
+		uint64_t* counters(const std::string& name, size_t slots);
+	};
+}
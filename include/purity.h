@@ -0,0 +1,22 @@
+#pragma once
+#include<string>
+#include<vector>
+#include<unordered_map>
+
+// Diaflow
+#include<parsed.h>
+
+namespace Diaflow
+{
+	// Finds the pure functions: those without Input or Output that never
+	// name a global and call only pure functions. Called with arguments that
+	// are not arrays or maps, a pure function gives the same result for the
+	// same arguments and changes nothing its caller can see.
+	class Purity
+	{
+	public:
+		std::vector<bool> functions;
+
+		void run(const std::vector<ParsedFunction>& parsed, const std::unordered_map<std::string, uint32_t>& index);
+	};
+}
@@ -0,0 +1,217 @@
+#pragma once
+#include<algorithm>
+#include<atomic>
+#include<cstddef>
+#include<cstdint>
+#include<memory>
+
+namespace Diaflow
+{
+	// A queue of at most `capacity` values that any number of threads push
+	// to and pop from at once without a lock. Every cell carries a sequence
+	// number telling whether it waits to be written or read at the position
+	// a thread claims, so that claiming a position is one compare and swap
+	// and neither end waits for the other. Neither call ever blocks: a push
+	// to a full queue and a pop from an empty one give false.
+	template<typename T>
+	class BoundedQueue
+	{
+	public:
+		explicit BoundedQueue(size_t capacity)
+			: capacity(capacity), mask(cells_for(capacity) - 1), cells(new Cell[mask + 1])
+		{
+			for(size_t k = 0; k <= mask; k++)
+				cells[k].sequence.store(k, std::memory_order_relaxed);
+		}
+
+		BoundedQueue(const BoundedQueue&) = delete;
+		BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+		bool push(const T& value)
+		{
+			size_t position = tail.load(std::memory_order_relaxed);
+			for(;;)
+			{
+				Cell& cell = cells[position & mask];
+				size_t sequence = cell.sequence.load(std::memory_order_acquire);
+				intptr_t difference = static_cast<intptr_t>(sequence - position);
+				if(difference == 0)
+				{
+					// The cells round up to a power of two, and are never
+					// filled past the capacity asked for.
+					if(position - head.load(std::memory_order_acquire) >= capacity)
+						return false;
+
+					if(tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+					{
+						cell.value = value;
+						cell.sequence.store(position + 1, std::memory_order_release);
+						return true;
+					}
+				}
+				else if(difference < 0)
+					return false;
+				else
+					position = tail.load(std::memory_order_relaxed);
+			}
+		}
+
+		bool pop(T& value)
+		{
+			size_t position = head.load(std::memory_order_relaxed);
+			for(;;)
+			{
+				Cell& cell = cells[position & mask];
+				size_t sequence = cell.sequence.load(std::memory_order_acquire);
+				intptr_t difference = static_cast<intptr_t>(sequence - (position + 1));
+				if(difference == 0)
+				{
+					if(head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+					{
+						value = cell.value;
+						cell.sequence.store(position + mask + 1, std::memory_order_release);
+						return true;
+					}
+				}
+				else if(difference < 0)
+					return false;
+				else
+					position = head.load(std::memory_order_relaxed);
+			}
+		}
+
+		// How many values were ever pushed and popped.
+		uint64_t pushed() const
+		{
+			return tail.load(std::memory_order_acquire);
+		}
+
+		uint64_t popped() const
+		{
+			return head.load(std::memory_order_acquire);
+		}
+
+		// Visits the values waiting, oldest first, while no thread pushes or
+		// pops.
+		template<typename F>
+		void each(F visit) const
+		{
+			size_t end = tail.load(std::memory_order_acquire);
+			for(size_t position = head.load(std::memory_order_acquire); position != end; position++)
+				visit(cells[position & mask].value);
+		}
+
+	private:
+		struct Cell
+		{
+			std::atomic<size_t> sequence;
+			T value;
+		};
+
+		// At least two, as a single cell could not tell a full queue from an
+		// empty one by its sequence.
+		static size_t cells_for(size_t capacity)
+		{
+			size_t count = 2;
+			while(count < capacity)
+				count *= 2;
+
+			return count;
+		}
+
+		const size_t capacity;
+		const size_t mask;
+		std::unique_ptr<Cell[]> cells;
+		// Each end on a cache line of its own, so producers and consumers do
+		// not invalidate each other's.
+		alignas(64) std::atomic<size_t> head{ 0 };
+		alignas(64) std::atomic<size_t> tail{ 0 };
+	};
+
+	// A queue of at least `capacity` values, rounded up to a power of two,
+	// between exactly one thread that pushes and one that pops. Each side
+	// writes only its own index and keeps the last it saw of the other's,
+	// so that it reads the other side's cache line only when its own view
+	// says the queue is full or empty. Values move many at a time.
+	template<typename T>
+	class RingBuffer
+	{
+	public:
+		explicit RingBuffer(size_t capacity)
+			: mask(size_for(capacity) - 1), items(new T[mask + 1])
+		{}
+
+		RingBuffer(const RingBuffer&) = delete;
+		RingBuffer& operator=(const RingBuffer&) = delete;
+
+		// Pushes as many of the `count` values as there is room for, and
+		// gives how many.
+		size_t push(const T* values, size_t count)
+		{
+			size_t position = tail.load(std::memory_order_relaxed);
+			if(position + count - seen_head > mask + 1)
+				seen_head = head.load(std::memory_order_acquire);
+
+			count = std::min(count, mask + 1 - (position - seen_head));
+			for(size_t k = 0; k < count; k++)
+				items[(position + k) & mask] = values[k];
+
+			tail.store(position + count, std::memory_order_release);
+			return count;
+		}
+
+		bool push(T value)
+		{
+			size_t position = tail.load(std::memory_order_relaxed);
+			if(position - seen_head > mask)
+			{
+				seen_head = head.load(std::memory_order_acquire);
+				if(position - seen_head > mask)
+					return false;
+			}
+
+			items[position & mask] = std::move(value);
+			tail.store(position + 1, std::memory_order_release);
+			return true;
+		}
+
+		// Pops up to `count` values into `values`, and gives how many.
+		size_t pop(T* values, size_t count)
+		{
+			size_t position = head.load(std::memory_order_relaxed);
+			if(seen_tail - position < count)
+				seen_tail = tail.load(std::memory_order_acquire);
+
+			count = std::min(count, seen_tail - position);
+			for(size_t k = 0; k < count; k++)
+				values[k] = std::move(items[(position + k) & mask]);
+
+			head.store(position + count, std::memory_order_release);
+			return count;
+		}
+
+		bool pop(T& value)
+		{
+			return pop(&value, 1) == 1;
+		}
+
+	private:
+		static size_t size_for(size_t capacity)
+		{
+			size_t size = 1;
+			while(size < capacity)
+				size *= 2;
+
+			return size;
+		}
+
+		const size_t mask;
+		std::unique_ptr<T[]> items;
+		// The consumer's index and its view of the producer's, then the
+		// producer's.
+		alignas(64) std::atomic<size_t> head{ 0 };
+		size_t seen_tail = 0;
+		alignas(64) std::atomic<size_t> tail{ 0 };
+		size_t seen_head = 0;
+	};
+}
@@ -0,0 +1,102 @@
+#pragma once
+#include<atomic>
+#include<istream>
+#include<ostream>
+#include<streambuf>
+#include<string>
+#include<thread>
+#include<vector>
+
+// Diaflow
+#include<bytecode.h>
+#include<queue.h>
+#include<scheduler.h>
+#include<vm.h>
+
+namespace Diaflow
+{
+	// Runs a compiled Module on a thread of its own, for the editor to stay
+	// responsive however long the run. What the program prints reaches the
+	// editor through one RingBuffer, and the lines the editor posts reach
+	// Input blocks through another, so neither thread ever takes a lock or
+	// waits on the other's frame rate. The VM prints into a buffer of its
+	// own, handed over when it fills, after every slice and before waiting
+	// for a line, so that the editor takes the output in a few batches per
+	// frame however many lines there are.
+	//
+	// The run goes in slices so that it can be stopped: whatever tier the
+	// functions reach, none runs native code.
+	class Runner
+	{
+	public:
+		static constexpr uint64_t slice_steps = 1 << 16;
+
+		Runner(const Module& module, Scheduler* scheduler = nullptr);
+		~Runner();
+		Runner(const Runner&) = delete;
+		Runner& operator=(const Runner&) = delete;
+
+		void start();
+		// Ends the run at the end of its slice, or while it waits for a
+		// line, and waits for the thread.
+		void stop();
+		bool finished() const;
+		// Whether the program waits for the editor to post a line.
+		bool waiting() const;
+		// How the run ended, once finished: Error with `error` set when it
+		// failed or was stopped.
+		Status status() const;
+		const std::string& error() const;
+
+		// On the editor's thread: appends what the program printed since the
+		// last call to `text`, and gives the program a line of input.
+		void drain(std::string& text);
+		bool post(std::string line);
+
+	private:
+		// The ends of the rings on the VM's side.
+		class Sink : public std::streambuf
+		{
+		public:
+			Sink(Runner& runner);
+
+		protected:
+			int_type overflow(int_type c) override;
+			int sync() override;
+
+		private:
+			Runner& runner;
+			std::vector<char> buffer;
+		};
+
+		class Source : public std::streambuf
+		{
+		public:
+			Source(Runner& runner);
+
+		protected:
+			int_type underflow() override;
+
+		private:
+			Runner& runner;
+			std::string line;
+		};
+
+		const Module& module;
+		Scheduler* scheduler;
+		RingBuffer<char> printed;
+		RingBuffer<std::string> lines;
+		Sink sink;
+		Source source;
+		std::ostream out;
+		std::istream in;
+		std::thread thread;
+		std::atomic<bool> stopping{ false };
+		std::atomic<bool> done{ false };
+		std::atomic<bool> reading{ false };
+		Status result = Status::Ok;
+		std::string message;
+
+		void run();
+	};
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include<optional>
+#include<vector>
+#include<unordered_map>
+#include<unordered_set>
+
+// Diaflow
+#include<value.h>
+#include<parsed.h>
+
+namespace Diaflow
+{
+	struct FunctionConstants
+	{
+		// Expressions that yield the same value every time they run.
+		std::unordered_map<const Expr*, Value> values;
+		// Blocks that never run.
+		std::unordered_set<const Block*> dead;
+		// The case a Switch always enters, or the number of cases when it
+		// always skips them all.
+		std::unordered_map<const Block*, size_t> switches;
+		// Locals a read can find before anything was assigned to them, which
+		// hold nil then.
+		std::vector<bool> unassigned;
+		// Basic blocks that never run and expressions replaced by a constant.
+		size_t dead_blocks = 0;
+		size_t folded = 0;
+
+		inline bool value(const Expr* expr, Value& out) const
+		{
+			auto it = values.find(expr);
+			if(it == values.end())
+				return false;
+
+			out = it->second;
+			return true;
+		}
+	};
+
+	// Sparse conditional constant propagation (Wegman and Zadeck) over the SSA
+	// form of every function. Locals start out unknown and only lose
+	// precision, and a block is only evaluated once an executable edge
+	// reaches it, so a branch on a constant leaves the other side dead even
+	// when that side would have spoiled the constant. Only scalars, interned
+	// and small strings are tracked; globals, containers, inputs and call
+	// results are never constant, and an operation that would fail at run
+	// time is left for the run to fail.
+	class ConstantPropagation
+	{
+	public:
+		std::vector<FunctionConstants> functions;
+		size_t dead_blocks = 0;
+		size_t folded = 0;
+
+		void run(const std::vector<ParsedFunction>& parsed);
+		// Propagates through one function again as if called with the
+		// arguments given; the missing ones stay unknown.
+		FunctionConstants specialize(const ParsedFunction& parsed, const std::vector<std::optional<Value>>& args) const;
+	};
+}
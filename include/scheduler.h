@@ -0,0 +1,95 @@
+#pragma once
+#include<atomic>
+#include<chrono>
+#include<condition_variable>
+#include<cstdint>
+#include<deque>
+#include<functional>
+#include<memory>
+#include<mutex>
+#include<string>
+#include<thread>
+#include<vector>
+
+namespace Diaflow
+{
+	// The one pool of threads the application runs work on. Every worker
+	// keeps a deque of tasks: it pushes and pops at the back, and a worker
+	// with nothing left steals from the front of another's. Worker 0 is
+	// whichever thread submits from outside the pool; it has no thread of
+	// its own and runs tasks only while it waits on a Group, so a pool of
+	// `workers()` never keeps more than that many threads busy.
+	class Scheduler
+	{
+	public:
+		// Tasks whose completion one caller waits for together.
+		class Group
+		{
+		public:
+			Group() = default;
+			Group(const Group&) = delete;
+			Group& operator=(const Group&) = delete;
+
+		private:
+			friend class Scheduler;
+			std::atomic<size_t> pending{ 0 };
+		};
+
+		// What a worker did since the pool started.
+		struct Utilization
+		{
+			uint64_t tasks = 0;
+			uint64_t steals = 0;
+			double busy = 0;
+		};
+
+		// One worker per hardware thread when `threads` is 0.
+		explicit Scheduler(uint32_t threads = 0);
+		~Scheduler();
+		Scheduler(const Scheduler&) = delete;
+		Scheduler& operator=(const Scheduler&) = delete;
+
+		size_t workers() const;
+		// The worker the calling thread is, 0 outside the pool.
+		size_t worker() const;
+
+		void submit(Group& group, std::function<void()> task);
+		// Runs tasks, its group's or any other, until all of `group` are done.
+		void wait(Group& group);
+		// Calls `f(k)` for every k in [begin, end), in tasks of `grain`
+		// indices, and returns once all are done.
+		void parallel_for(size_t begin, size_t end, size_t grain, const std::function<void(size_t)>& f);
+
+		std::vector<Utilization> utilization() const;
+		// Tasks, steals and busy share of every worker.
+		std::string report() const;
+
+	private:
+		struct Task
+		{
+			std::function<void()> run;
+			Group* group;
+		};
+
+		struct Worker
+		{
+			std::mutex lock;
+			std::deque<Task> tasks;
+			std::atomic<uint64_t> done{ 0 };
+			std::atomic<uint64_t> steals{ 0 };
+			std::atomic<uint64_t> busy{ 0 }; // nanoseconds
+		};
+
+		std::vector<std::unique_ptr<Worker>> queues;
+		std::vector<std::thread> threads;
+		std::chrono::steady_clock::time_point started;
+		std::mutex sleep;
+		std::condition_variable wake;
+		std::atomic<size_t> queued{ 0 };
+		std::atomic<bool> stopping{ false };
+
+		bool take(size_t self, Task& task);
+		void execute(size_t self, Task& task);
+		void loop(size_t self);
+	};
+}
@@ -0,0 +1,124 @@
+#pragma once
+#include<cstdint>
+#include<unordered_map>
+#include<vector>
+
+// Diaflow
+#include<cfg.h>
+#include<parsed.h>
+
+namespace Diaflow
+{
+	// Visits, in execution order, what a basic block does with values:
+	// `read(expr)` for every expression it evaluates and `write(site, local,
+	// value)` for every local it assigns. `value` is the expression assigned,
+	// which the callback evaluates itself, or null when the value comes from
+	// outside: an Input, the result of a Call, the item of a Foreach. `site`
+	// is the expression the assignment was parsed into.
+	template<typename Read, typename Write>
+	void for_each_access(const Cfg& cfg, const ParsedFunction& parsed, uint32_t block, Read read, Write write)
+	{
+		auto assign = [&](const Expr* site, const Expr* target, const Expr* value)
+		{
+			if(target->kind == ExprKind::Local)
+			{
+				write(site, parsed.local(target->name), value);
+				return;
+			}
+
+			if(target->kind == ExprKind::Index)
+				read(target);
+
+			if(value)
+				read(value);
+		};
+
+		for(const Step& step : cfg.steps(block))
+		{
+			switch(step.kind)
+			{
+				case StepKind::Statement:
+				{
+					const Expr* expr = parsed[*step.source];
+					if(expr->kind == ExprKind::Assign)
+						assign(expr, expr->args[0], expr->args[1]);
+					else
+						read(expr);
+
+					break;
+				}
+
+				case StepKind::Input:
+				{
+					const Expr* target = parsed[*step.source];
+					assign(target, target, nullptr);
+					break;
+				}
+
+				case StepKind::Call:
+				{
+					const Call* call = static_cast<const Call*>(step.block);
+					for(const std::string& arg : call->args)
+						read(parsed[arg]);
+
+					if(!call->retvar.empty())
+					{
+						const Expr* target = parsed[call->retvar];
+						assign(target, target, nullptr);
+					}
+
+					break;
+				}
+
+				default:
+					read(parsed[*step.source]);
+					break;
+			}
+		}
+
+		const BasicBlock& b = cfg.blocks[block];
+		if(b.exit == Exit::Next)
+		{
+			const Expr* target = parsed[*b.source];
+			assign(target, target, nullptr);
+		}
+		else if(b.source)
+			read(parsed[*b.source]);
+	}
+
+	struct Phi
+	{
+		uint32_t local;
+		uint32_t value;
+		// The incoming value from each predecessor, in the order of
+		// Cfg::preds.
+		std::vector<uint32_t> args;
+	};
+
+	// Minimal SSA form of the locals of one function. Values are numbered
+	// densely; the first ones are the locals as the function starts, which
+	// are the arguments and then nil for everything else. Phis sit on the
+	// iterated dominance frontier of each local's assignments.
+	class Ssa
+	{
+	public:
+		// Local and defining block of every value.
+		std::vector<uint32_t> locals;
+		std::vector<uint32_t> blocks;
+		std::vector<std::vector<Phi>> phis;
+		// The value every local read sees, by the Local expression.
+		std::unordered_map<const Expr*, uint32_t> uses;
+		// The value every assignment creates, by its site.
+		std::unordered_map<const Expr*, uint32_t> defs;
+
+		void build(const Cfg& cfg, const ParsedFunction& parsed);
+
+		inline uint32_t size() const
+		{
+			return static_cast<uint32_t>(locals.size());
+		}
+
+	private:
+		uint32_t make(uint32_t local, uint32_t block);
+	};
+}
@@ -0,0 +1,264 @@
+#pragma once
+#include<algorithm>
+#include<cerrno>
+#include<cstring>
+#include<streambuf>
+#include<string>
+#include<string_view>
+#include<vector>
+
+#if defined(_WIN32)
+#include<fcntl.h>
+#include<io.h>
+#else
+#include<fcntl.h>
+#include<sys/mman.h>
+#include<sys/stat.h>
+#include<sys/uio.h>
+#include<unistd.h>
+#endif
+
+// Standard input and output of a run without iostreams' costs. Both are
+// header-only like aot.h, which prints through them, and are streambufs so
+// that a VM takes them as its streams unchanged.
+namespace Diaflow
+{
+	// Writes to a file descriptor through a buffer that reaches the kernel
+	// only when it fills, on pubsync() and when destroyed. A write that does
+	// not fit goes out together with the buffer in one writev, uncopied.
+	class FileOutput : public std::streambuf
+	{
+	public:
+		explicit FileOutput(int fd = 1, size_t size = 1 << 16)
+			: fd(fd), buffer(size)
+		{
+			setp(buffer.data(), buffer.data() + buffer.size());
+		}
+
+		~FileOutput() override
+		{
+			sync();
+		}
+
+		FileOutput(const FileOutput&) = delete;
+		FileOutput& operator=(const FileOutput&) = delete;
+
+		// Whether a write failed, after which output is dropped.
+		bool failed() const
+		{
+			return broken;
+		}
+
+	protected:
+		int_type overflow(int_type c) override
+		{
+			if(traits_type::eq_int_type(c, traits_type::eof()))
+				return sync() == 0 ? traits_type::not_eof(c) : traits_type::eof();
+
+			char byte = traits_type::to_char_type(c);
+			return send(&byte, 1) ? c : traits_type::eof();
+		}
+
+		std::streamsize xsputn(const char* s, std::streamsize n) override
+		{
+			if(n <= epptr() - pptr())
+			{
+				std::memcpy(pptr(), s, n);
+				pbump(static_cast<int>(n));
+				return n;
+			}
+
+			return send(s, n) ? n : 0;
+		}
+
+		int sync() override
+		{
+			return send(nullptr, 0) ? 0 : -1;
+		}
+
+	private:
+		int fd;
+		std::vector<char> buffer;
+		bool broken = false;
+
+		// Writes what the buffer holds and then `size` bytes of `extra`.
+		bool send(const char* extra, size_t size)
+		{
+			const char* pending = pbase();
+			size_t held = pptr() - pbase();
+			setp(buffer.data(), buffer.data() + buffer.size());
+			while(!broken && held + size > 0)
+			{
+#if defined(_WIN32)
+				int written = held ? _write(fd, pending, static_cast<unsigned>(held)) : _write(fd, extra, static_cast<unsigned>(size));
+#else
+				iovec pieces[2] = { { const_cast<char*>(pending), held }, { const_cast<char*>(extra), size } };
+				ssize_t written = held ? writev(fd, pieces, 2) : write(fd, extra, size);
+#endif
+				if(written <= 0)
+				{
+					broken = written == 0 || errno != EINTR;
+					continue;
+				}
+
+				size_t from_held = std::min(held, static_cast<size_t>(written));
+				pending += from_held;
+				held -= from_held;
+				extra += written - from_held;
+				size -= written - from_held;
+			}
+
+			return !broken;
+		}
+	};
+
+	// Reads a file descriptor a block at a time, or maps it whole when it is
+	// a regular file, and hands out its lines as views into the block. Input
+	// that can make a read wait first flushes the output tied to it, so that
+	// a prompt shows before the program waits for its answer.
+	class FileInput : public std::streambuf
+	{
+	public:
+		explicit FileInput(int fd = 0, size_t size = 1 << 16)
+			: size(size)
+		{
+			attach(fd, false);
+		}
+
+		~FileInput() override
+		{
+			detach();
+		}
+
+		FileInput(const FileInput&) = delete;
+		FileInput& operator=(const FileInput&) = delete;
+
+		// Reads the file at `path` instead, from its start.
+		bool open(const std::string& path)
+		{
+			int file = ::open(path.c_str(), O_RDONLY);
+			if(file < 0)
+				return false;
+
+			detach();
+			attach(file, true);
+			return true;
+		}
+
+		void tie(std::streambuf* output)
+		{
+			tied = output;
+		}
+
+		// The next line without its newline, valid until the next read.
+		// Gives false at the end of the input.
+		bool line(std::string_view& text)
+		{
+			for(;;)
+			{
+				char* begin = gptr();
+				void* found = begin < egptr() ? std::memchr(begin, '\n', egptr() - begin) : nullptr;
+				if(found)
+				{
+					char* newline = static_cast<char*>(found);
+					text = std::string_view(begin, newline - begin);
+					setg(eback(), newline + 1, egptr());
+					return true;
+				}
+
+				if(!fill())
+				{
+					text = std::string_view(gptr(), egptr() - gptr());
+					setg(eback(), egptr(), egptr());
+					return !text.empty();
+				}
+			}
+		}
+
+	protected:
+		int_type underflow() override
+		{
+			if(gptr() < egptr() || fill())
+				return traits_type::to_int_type(*gptr());
+
+			return traits_type::eof();
+		}
+
+	private:
+		int fd = -1;
+		bool owned = false;
+		size_t size;
+		std::vector<char> buffer;
+		char* mapped = nullptr;
+		size_t mapped_size = 0;
+		std::streambuf* tied = nullptr;
+
+		void attach(int file, bool own)
+		{
+			fd = file;
+			owned = own;
+			setg(nullptr, nullptr, nullptr);
+#if !defined(_WIN32)
+			struct stat info;
+			off_t offset = lseek(fd, 0, SEEK_CUR);
+			if(fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && offset >= 0 && offset < info.st_size)
+			{
+				void* region = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+				if(region != MAP_FAILED)
+				{
+					madvise(region, info.st_size, MADV_SEQUENTIAL);
+					mapped = static_cast<char*>(region);
+					mapped_size = info.st_size;
+					setg(mapped, mapped + offset, mapped + mapped_size);
+				}
+			}
+#endif
+		}
+
+		void detach()
+		{
+#if !defined(_WIN32)
+			if(mapped)
+				munmap(mapped, mapped_size);
+#endif
+			mapped = nullptr;
+			if(owned)
+				close(fd);
+		}
+
+		// Keeps what is left unread at the front of the buffer and reads as
+		// much as fits after it, growing the buffer when a line fills it.
+		bool fill()
+		{
+			if(mapped)
+				return false;
+
+			size_t kept = 0;
+			if(gptr() < egptr())
+			{
+				kept = egptr() - gptr();
+				std::memmove(buffer.data(), gptr(), kept);
+			}
+
+			if(buffer.size() < std::max(size, 2 * kept))
+				buffer.resize(std::max(size, 2 * kept));
+
+			if(tied)
+				tied->pubsync();
+
+			for(;;)
+			{
+#if defined(_WIN32)
+				int count = _read(fd, buffer.data() + kept, static_cast<unsigned>(buffer.size() - kept));
+#else
+				ssize_t count = read(fd, buffer.data() + kept, buffer.size() - kept);
+#endif
+				if(count < 0 && errno == EINTR)
+					continue;
+
+				setg(buffer.data(), buffer.data(), buffer.data() + kept + std::max<decltype(count)>(count, 0));
+				return count > 0;
+			}
+		}
+	};
+}
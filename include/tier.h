@@ -0,0 +1,67 @@
+#pragma once
+#include<string>
+#include<vector>
+
+// Diaflow
+#include<flow.h>
+#include<bytecode.h>
+#include<jit.h>
+#include<profile.h>
+
+namespace Diaflow
+{
+	enum class Tier : uint8_t
+	{
+		Baseline, Optimized, Native
+	};
+
+	constexpr size_t tier_count = 3;
+
+	// Decides what code each function of a program runs. Everything starts
+	// as baseline bytecode. A function called `call_threshold` times moves
+	// up a tier for its next call, and a loop that takes `loop_threshold`
+	// back edges moves its running frame up through on-stack replacement.
+	// The optimized tier is compiled for the whole program the first time
+	// any function asks for it; native code is generated from it one
+	// function at a time, where the JIT is supported. Counters add up over
+	// every run sharing the manager. With a Profile attached, the baseline
+	// tier counts its branches into it and the optimized tier is laid out
+	// by everything counted until it is compiled.
+	class TierManager
+	{
+	public:
+		struct Counters
+		{
+			uint64_t calls = 0;
+			std::vector<uint64_t> backedges;
+		};
+
+		uint64_t call_threshold = 1000;
+		uint64_t loop_threshold = 10000;
+		bool native = true;
+		Profile* profile = nullptr;
+		std::vector<Counters> counters;
+		std::string error;
+
+		TierManager(const Program& program, Module& module);
+
+		// Compiles the baseline tier into the module.
+		bool compile();
+		Tier top() const;
+		// The code of function `index` at `tier`, or nullptr when that tier
+		// could not be compiled.
+		const Function* function(uint32_t index, Tier tier);
+		// Machine code for the optimized bytecode of function `index`, once
+		// the native tier was requested for it.
+		NativeCode native_code(uint32_t index) const;
+
+	private:
+		const Program& program;
+		Module& module;
+		std::vector<Function> optimized;
+		bool attempted = false;
+		Jit jit;
+		std::vector<NativeCode> natives;
+		std::vector<bool> jitted;
+	};
+}
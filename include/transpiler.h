@@ -0,0 +1,31 @@
+#pragma once
+#include<string>
+
+// Diaflow
+#include<flow.h>
+
+namespace Diaflow
+{
+	// Exports a Program as a standalone C++17 program on top of the runtime
+	// in aot.h. Every block becomes the C++ statement it reads as: If, While,
+	// DoWhile and For map onto their C++ namesakes, Switch onto a switch with
+	// the same fall-through, Foreach onto a for over an Iteration. A call of
+	// the function it is in whose result is returned at once jumps back to
+	// its top instead, as the VM runs it in the same frame. Errors stop the
+	// program with the message the interpreter would give, so the export
+	// doubles as an oracle for the VM.
+	class Transpiler
+	{
+	public:
+		std::string error;
+		std::string compiler = "c++";
+		std::string flags = "-std=c++17 -O2";
+		// Directory holding aot.h and the headers it includes.
+		std::string include_dir = "include";
+
+		bool translate(const Program& program, std::string& out);
+		// Writes the translation of `program` to `source` and builds it into
+		// the executable `binary` with the system compiler.
+		bool build(const Program& program, const std::string& source, const std::string& binary);
+	};
+}
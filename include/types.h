@@ -0,0 +1,55 @@
+#pragma once
+#include<string>
+#include<vector>
+#include<unordered_map>
+
+// Diaflow
+#include<value.h>
+#include<parsed.h>
+
+namespace Diaflow
+{
+	// A set of runtime types a value may have, one bit per Type. The empty set
+	// means no value reaches that point (yet).
+	typedef uint8_t Types;
+
+	constexpr Types types_of(Type type)
+	{
+		return static_cast<Types>(1u << static_cast<unsigned>(type));
+	}
+
+	constexpr Types any_type = 0x7F;
+	constexpr Types number_types = types_of(Type::Int) | types_of(Type::Double);
+	constexpr Types input_types = types_of(Type::Nil) | number_types | types_of(Type::String);
+
+	inline bool only(Types types, Type type)
+	{
+		return types == types_of(type);
+	}
+
+	struct FunctionTypes
+	{
+		std::vector<Types> params;
+		Types result = 0;
+		std::unordered_map<const Expr*, Types> exprs;
+
+		inline Types operator[](const Expr* expr) const
+		{
+			auto it = exprs.find(expr);
+			return it != exprs.end() ? it->second : any_type;
+		}
+	};
+
+	// Flow-sensitive type inference over the Comp of every function. Locals
+	// are tracked per program point, seeded from literals, the values Input
+	// can produce and the inferred return types of callees; parameter types
+	// are the union over all call sites. Globals and container elements are
+	// not tracked and may hold anything.
+	class TypeInference
+	{
+	public:
+		std::vector<FunctionTypes> functions;
+
+		void infer(const std::vector<ParsedFunction>& parsed, const std::unordered_map<std::string, uint32_t>& index);
+	};
+}
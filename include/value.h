@@ -0,0 +1,624 @@
+#pragma once
+#include<algorithm>
+#include<charconv>
+#include<cstdint>
+#include<cstring>
+#include<cmath>
+#include<cstdio>
+#include<string>
+#include<string_view>
+#include<vector>
+#include<deque>
+#include<unordered_map>
+
+#if !defined(__BYTE_ORDER__) || __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "Diaflow values assume a little-endian target"
+#endif
+
+namespace Diaflow
+{
+	// Values are NaN-boxed into 64 bits. Any bit pattern outside the negative
+	// quiet NaN range is a plain double. Inside it, bits 48-50 hold a tag and
+	// the low 48 bits the payload: a signed integer, a bool, up to six bytes of
+	// string or an object pointer. NaNs produced by arithmetic are canonicalized
+	// to positive NaN so they can never be mistaken for a tag. Integers past 48
+	// bits, from arithmetic, literals or input, are held as doubles instead.
+	enum class Tag : uint8_t
+	{
+		Nil, Bool, Int, SmallString, Interned, String, Array, Map
+	};
+
+	enum class Type : uint8_t
+	{
+		Nil, Bool, Int, Double, String, Array, Map
+	};
+
+	inline const char* type_name(Type type)
+	{
+		static const char* names[] = { "nil", "bool", "int", "double", "string", "array", "map" };
+		return names[static_cast<int>(type)];
+	}
+
+	class Value
+	{
+	public:
+		static constexpr uint64_t box_mask = 0xFFF8000000000000ull;
+		static constexpr uint64_t payload_mask = 0x0000FFFFFFFFFFFFull;
+		static constexpr uint64_t canonical_nan = 0x7FF8000000000000ull;
+		static constexpr int64_t int_max = (int64_t(1) << 47) - 1;
+		static constexpr int64_t int_min = -(int64_t(1) << 47);
+		static constexpr size_t small_string_max = 6;
+
+		uint64_t bits;
+
+		constexpr Value()
+			: bits(boxed(Tag::Nil, 0))
+		{}
+
+		static constexpr uint64_t boxed(Tag tag, uint64_t payload)
+		{
+			return box_mask | (uint64_t(tag) << 48) | (payload & payload_mask);
+		}
+
+		static constexpr uint16_t header(Tag tag)
+		{
+			return static_cast<uint16_t>(0xFFF8 | static_cast<uint16_t>(tag));
+		}
+
+		static constexpr Value from_bits(uint64_t bits)
+		{
+			Value value;
+			value.bits = bits;
+			return value;
+		}
+
+		static constexpr Value nil()
+		{
+			return Value();
+		}
+
+		static constexpr Value boolean(bool b)
+		{
+			return from_bits(boxed(Tag::Bool, b ? 1 : 0));
+		}
+
+		static constexpr bool fits_int(int64_t i)
+		{
+			return i >= int_min && i <= int_max;
+		}
+
+		// The caller guarantees fits_int(i).
+		static constexpr Value integer(int64_t i)
+		{
+			return from_bits(boxed(Tag::Int, static_cast<uint64_t>(i)));
+		}
+
+		static Value number(double d)
+		{
+			uint64_t bits;
+			std::memcpy(&bits, &d, sizeof(bits));
+			if(d != d)
+				bits = canonical_nan;
+
+			return from_bits(bits);
+		}
+
+		// An int, or the nearest double once it leaves the range ints have.
+		static Value widened(int64_t i)
+		{
+			return fits_int(i) ? integer(i) : number(static_cast<double>(i));
+		}
+
+		static bool fits_small_string(std::string_view s)
+		{
+			return s.size() <= small_string_max && std::memchr(s.data(), 0, s.size()) == nullptr;
+		}
+
+		// The caller guarantees fits_small_string(s).
+		static Value small_string(std::string_view s)
+		{
+			uint64_t payload = 0;
+			std::memcpy(&payload, s.data(), s.size());
+			return from_bits(boxed(Tag::SmallString, payload));
+		}
+
+		static Value object(Tag tag, const void* pointer)
+		{
+			return from_bits(boxed(tag, reinterpret_cast<uintptr_t>(pointer)));
+		}
+
+		inline bool is_double() const
+		{
+			return (bits & box_mask) != box_mask;
+		}
+
+		inline bool is(Tag tag) const
+		{
+			return (bits >> 48) == header(tag);
+		}
+
+		inline Tag tag() const
+		{
+			return static_cast<Tag>((bits >> 48) & 7);
+		}
+
+		inline bool is_nil() const { return is(Tag::Nil); }
+		inline bool is_bool() const { return is(Tag::Bool); }
+		inline bool is_int() const { return is(Tag::Int); }
+		inline bool is_number() const { return is_double() || is_int(); }
+		inline bool is_array() const { return is(Tag::Array); }
+		inline bool is_map() const { return is(Tag::Map); }
+
+		inline bool is_string() const
+		{
+			if(is_double())
+				return false;
+
+			Tag t = tag();
+			return t == Tag::SmallString || t == Tag::Interned || t == Tag::String;
+		}
+
+		inline bool as_bool() const
+		{
+			return bits & 1;
+		}
+
+		inline int64_t as_int() const
+		{
+			return static_cast<int64_t>(bits << 16) >> 16;
+		}
+
+		inline double as_double() const
+		{
+			double d;
+			std::memcpy(&d, &bits, sizeof(d));
+			return d;
+		}
+
+		// Numeric value of an int or a double.
+		inline double as_number() const
+		{
+			return is_int() ? static_cast<double>(as_int()) : as_double();
+		}
+
+		template<typename T>
+		inline T* as_object() const
+		{
+			return reinterpret_cast<T*>(static_cast<uintptr_t>(bits & payload_mask));
+		}
+
+		inline Type type() const
+		{
+			if(is_double())
+				return Type::Double;
+
+			switch(tag())
+			{
+				case Tag::Nil: return Type::Nil;
+				case Tag::Bool: return Type::Bool;
+				case Tag::Int: return Type::Int;
+				case Tag::Array: return Type::Array;
+				case Tag::Map: return Type::Map;
+				default: return Type::String;
+			}
+		}
+
+		inline bool operator==(const Value& other) const { return bits == other.bits; }
+		inline bool operator!=(const Value& other) const { return bits != other.bits; }
+	};
+
+	static_assert(sizeof(Value) == 8, "Value must stay 64 bits wide");
+
+	class Object
+	{
+	public:
+		// Set while the heap it is on is collected, once something still
+		// reaches it.
+		bool marked = false;
+
+		virtual ~Object() = default;
+		// The bytes the heap counts for it.
+		virtual size_t size() const = 0;
+	};
+
+	class StringObject : public Object
+	{
+	public:
+		std::string str;
+		size_t hash;
+
+		StringObject(std::string str)
+			: str(std::move(str)), hash(std::hash<std::string_view>()(this->str))
+		{}
+
+		size_t size() const override
+		{
+			return sizeof(StringObject) + str.size();
+		}
+	};
+
+	// Small strings live inside the Value itself, so the view is only valid
+	// while `value` is.
+	inline std::string_view string_view(const Value& value)
+	{
+		if(value.is(Tag::SmallString))
+		{
+			const char* chars = reinterpret_cast<const char*>(&value.bits);
+			size_t length = 0;
+			while(length < Value::small_string_max && chars[length])
+				length++;
+
+			return std::string_view(chars, length);
+		}
+
+		return value.as_object<StringObject>()->str;
+	}
+
+	struct ValueHash
+	{
+		size_t operator()(const Value& value) const
+		{
+			if(value.is_string())
+			{
+				if(value.is(Tag::SmallString))
+					return std::hash<std::string_view>()(string_view(value));
+
+				return value.as_object<StringObject>()->hash;
+			}
+
+			if(value.is_number())
+				return std::hash<double>()(value.as_number());
+
+			return std::hash<uint64_t>()(value.bits);
+		}
+	};
+
+	inline bool equal(const Value& a, const Value& b)
+	{
+		if(a.bits == b.bits)
+			return !a.is_double() || a.as_double() == a.as_double();
+
+		if(a.is_number() && b.is_number())
+			return a.as_number() == b.as_number();
+
+		if(a.is_string() && b.is_string())
+		{
+			if(a.is(Tag::Interned) && b.is(Tag::Interned))
+				return false;
+
+			return string_view(a) == string_view(b);
+		}
+
+		return false;
+	}
+
+	struct ValueEqual
+	{
+		bool operator()(const Value& a, const Value& b) const
+		{
+			return equal(a, b);
+		}
+	};
+
+	class ArrayObject : public Object
+	{
+	public:
+		std::vector<Value> items;
+
+		size_t size() const override
+		{
+			return sizeof(ArrayObject) + items.size() * sizeof(Value);
+		}
+	};
+
+	class MapObject : public Object
+	{
+	public:
+		std::unordered_map<Value, Value, ValueHash, ValueEqual> items;
+
+		size_t size() const override
+		{
+			return sizeof(MapObject) + items.size() * 4 * sizeof(Value);
+		}
+	};
+
+	// Interned strings are created at compile time and shared read-only by every
+	// run of a module; two interned handles are equal iff they are the same pointer.
+	class Strings
+	{
+	public:
+		Strings() = default;
+		Strings(const Strings&) = delete;
+		Strings& operator=(const Strings&) = delete;
+
+		Value intern(std::string_view s)
+		{
+			if(Value::fits_small_string(s))
+				return Value::small_string(s);
+
+			auto it = index.find(s);
+			if(it != index.end())
+				return Value::object(Tag::Interned, it->second);
+
+			StringObject* object = &storage.emplace_back(std::string(s));
+			index[object->str] = object;
+			return Value::object(Tag::Interned, object);
+		}
+
+		size_t size() const
+		{
+			return storage.size();
+		}
+
+	private:
+		std::deque<StringObject> storage;
+		std::unordered_map<std::string_view, StringObject*> index;
+	};
+
+	// Objects created while a program runs. The VM the heap belongs to may
+	// collect it, marking every object it still reaches and then sweeping the
+	// rest; whatever is left is released together when the heap is destroyed
+	// at the end of the run.
+	class Heap
+	{
+	public:
+		// The bytes of the objects kept by the last collection and of those
+		// made since.
+		size_t bytes = 0;
+		// Once `bytes` passes `limit`, or `due` where the heap is collected,
+		// the steps left in `*alarm` to the VM the heap belongs to move to
+		// `taken`. The VM stops at its next step, and there either collects
+		// and takes them back or ends the run.
+		size_t limit = SIZE_MAX;
+		size_t due = SIZE_MAX;
+		uint64_t* alarm = nullptr;
+		uint64_t taken = 0;
+
+		Heap() = default;
+		Heap(const Heap&) = delete;
+		Heap& operator=(const Heap&) = delete;
+
+		Value string(std::string_view s)
+		{
+			if(Value::fits_small_string(s))
+				return Value::small_string(s);
+
+			grow(sizeof(StringObject) + s.size());
+			return Value::object(Tag::String, adopt(new StringObject(std::string(s))));
+		}
+
+		Value array(size_t reserve = 0)
+		{
+			ArrayObject* array = new ArrayObject();
+			array->items.reserve(reserve);
+			grow(sizeof(ArrayObject) + reserve * sizeof(Value));
+			return Value::object(Tag::Array, adopt(array));
+		}
+
+		Value map()
+		{
+			grow(sizeof(MapObject));
+			return Value::object(Tag::Map, adopt(new MapObject()));
+		}
+
+		// Takes over every object of `other`, as when values made on one
+		// heap outlive it.
+		void absorb(Heap& other)
+		{
+			objects.insert(objects.end(), other.objects.begin(), other.objects.end());
+			other.objects.clear();
+			grow(other.bytes);
+			other.bytes = 0;
+		}
+
+		void grow(size_t size)
+		{
+			bytes += size;
+			if(bytes > std::min(limit, due) && alarm)
+			{
+				taken += *alarm;
+				*alarm = 0;
+			}
+		}
+
+		// Marks what `value` reaches as still in use.
+		void mark(const Value& value)
+		{
+			reach(value);
+			while(!marking.empty())
+			{
+				Value container = marking.back();
+				marking.pop_back();
+				if(container.is_array())
+				{
+					for(const Value& item : container.as_object<ArrayObject>()->items)
+						reach(item);
+				}
+				else
+				{
+					for(const auto& [key, item] : container.as_object<MapObject>()->items)
+					{
+						reach(key);
+						reach(item);
+					}
+				}
+			}
+		}
+
+		// Frees every object left unmarked and counts the bytes of the rest,
+		// the next collection falling due once they have doubled.
+		void sweep()
+		{
+			size_t kept = 0;
+			bytes = 0;
+			for(Object* object : objects)
+			{
+				if(!object->marked)
+				{
+					delete object;
+					continue;
+				}
+
+				object->marked = false;
+				bytes += object->size();
+				objects[kept++] = object;
+			}
+
+			objects.resize(kept);
+			due = std::max(2 * bytes, first_collection);
+		}
+
+		~Heap()
+		{
+			for(Object* object : objects)
+				delete object;
+		}
+
+		static constexpr size_t first_collection = 1 << 22;
+
+	private:
+		std::vector<Object*> objects;
+		std::vector<Value> marking;
+
+		// Interned strings belong to the module, not to any heap.
+		void reach(const Value& value)
+		{
+			if(!value.is(Tag::String) && !value.is_array() && !value.is_map())
+				return;
+
+			Object* object = value.as_object<Object>();
+			if(object->marked)
+				return;
+
+			object->marked = true;
+			if(!value.is(Tag::String))
+				marking.push_back(value);
+		}
+
+		template<typename T>
+		T* adopt(T* object)
+		{
+			objects.push_back(object);
+			return object;
+		}
+	};
+
+	inline bool truthy(const Value& value)
+	{
+		if(value.is_bool())
+			return value.as_bool();
+
+		if(value.is_int())
+			return value.as_int() != 0;
+
+		if(value.is_double())
+			return value.as_double() != 0.0;
+
+		if(value.is_nil())
+			return false;
+
+		if(value.is_string())
+			return !string_view(value).empty();
+
+		return true;
+	}
+
+	// Prints `value` onto `out`. An array or map met again inside itself,
+	// while `open` still holds it, prints as [...] or {...}.
+	inline void format(const Value& value, std::string& out, std::vector<const Object*>& open)
+	{
+		switch(value.type())
+		{
+			case Type::Nil:
+				out += "nil";
+				break;
+
+			case Type::Bool:
+				out += value.as_bool() ? "true" : "false";
+				break;
+
+			case Type::Int:
+			{
+				char buffer[24];
+				out.append(buffer, std::to_chars(buffer, buffer + sizeof(buffer), value.as_int()).ptr);
+				break;
+			}
+
+			// As printf's "%.15g" would, without the locale.
+			case Type::Double:
+			{
+				char buffer[32];
+				char* end = std::to_chars(buffer, buffer + sizeof(buffer), value.as_double(), std::chars_format::general, 15).ptr;
+				out.append(buffer, end);
+				if(std::isfinite(value.as_double()) && std::string_view(buffer, end - buffer).find_first_of(".e") == std::string_view::npos)
+					out += ".0";
+
+				break;
+			}
+
+			case Type::String:
+				out += string_view(value);
+				break;
+
+			case Type::Array:
+			{
+				const ArrayObject* array = value.as_object<ArrayObject>();
+				if(std::find(open.begin(), open.end(), array) != open.end())
+				{
+					out += "[...]";
+					break;
+				}
+
+				open.push_back(array);
+				out += '[';
+				bool first = true;
+				for(const Value& item : array->items)
+				{
+					if(!first)
+						out += ", ";
+
+					first = false;
+					format(item, out, open);
+				}
+
+				out += ']';
+				open.pop_back();
+				break;
+			}
+
+			case Type::Map:
+			{
+				const MapObject* map = value.as_object<MapObject>();
+				if(std::find(open.begin(), open.end(), map) != open.end())
+				{
+					out += "{...}";
+					break;
+				}
+
+				open.push_back(map);
+				out += '{';
+				bool first = true;
+				for(auto& [key, item] : map->items)
+				{
+					if(!first)
+						out += ", ";
+
+					first = false;
+					format(key, out, open);
+					out += ": ";
+					format(item, out, open);
+				}
+
+				out += '}';
+				open.pop_back();
+				break;
+			}
+		}
+	}
+
+	inline void format(const Value& value, std::string& out)
+	{
+		std::vector<const Object*> open;
+		format(value, out, open);
+	}
+}
@@ -0,0 +1,316 @@
+#pragma once
+#include<iostream>
+#include<memory>
+#include<sstream>
+#include<string>
+#include<vector>
+
+// Diaflow
+#include<value.h>
+#include<ops.h>
+#include<bytecode.h>
+#include<tier.h>
+#include<profile.h>
+#include<queue.h>
+#include<scheduler.h>
+#include<streams.h>
+
+namespace Diaflow
+{
+	enum class Status : uint8_t
+	{
+		// Only between a Parallel block and its branches: the branch waits
+		// on a channel and is put aside to go on later.
+		Ok, Error, Blocked,
+		// A run in slices used up its slice, and goes on with resume().
+		Paused
+	};
+
+	// Which of its limits a run went past.
+	enum class Limit : uint8_t
+	{
+		None, Fuel, Memory, Output, Depth
+	};
+
+	// Runs a compiled Module. One VM is one run: globals and the heap start
+	// empty and whatever the program allocated is released with the VM.
+	//
+	// The heap is collected at steps, the loop iterations and calls the VM
+	// counts, and as a Parallel block begins, once what it holds has doubled
+	// since the last collection and before a run past `max_memory` is
+	// stopped, so that the limit counts the bytes the run still reaches.
+	// What the registers of its frames, its globals, caches and channels
+	// reach is kept; a value `call` gave stays valid until the next call.
+	// Branches of a Parallel block and slices of a split loop collect
+	// nothing, and what they allocated is collected with the run once they
+	// return.
+	//
+	// The VM executes a private copy of the bytecode, which it quickens: a
+	// generic arithmetic or comparison op is rewritten in place into its
+	// type-specialized, guarded variant after executing with operands of one
+	// type, and reverted when the guard fails. An op that keeps failing its
+	// guard stays generic for the rest of the run.
+	//
+	// With a TierManager attached the VM runs whatever tier the manager has
+	// promoted each function to, native code included, and moves a frame
+	// stuck in a hot loop to the next tier at that loop's head.
+	//
+	// Code compiled to count its branches adds to the attached Profile, or
+	// else to the TierManager's.
+	//
+	// Interpreted calls do not recurse in C++: frames are kept on the VM's
+	// own stack, their registers in segments that are reused from call to
+	// call and never move, so recursion is bounded by `max_depth` alone. A
+	// tail call reuses the frame of its caller and adds no depth. Native
+	// code calls through the C++ stack, and runs interpreted instead once
+	// `native_nesting` native frames are open there.
+	//
+	// With `memoize`, calls to pure functions with arguments that are not
+	// arrays or maps look their result up first in a cache of `memo_slots`
+	// entries per function, keyed by the exact argument values. Each call
+	// that completes stores its result there unless it is an array or map,
+	// replacing whatever shared its slot. Tail calls, which leave nothing to
+	// store the result on return, bypass the cache.
+	//
+	// Each branch of a Parallel block runs on a VM of its own, as a task on
+	// the attached Scheduler or else one after another, over a copy of the
+	// frame and globals. The branches' output, the locals they assign and
+	// everything they allocated come back once all have finished. Branch
+	// VMs keep the tier every function was at and count no branches.
+	//
+	// A Foreach compiled to split runs the same way in slices of its
+	// collection, at least `split_items` items each, when a Scheduler with
+	// more than one worker is attached. Slices print into buffers of their
+	// own and hold back their stores into the loop's deferred containers;
+	// once all have finished, each slice's stores are made and its output
+	// printed in order, so the run reads as if the loop had gone in turn.
+	//
+	// Channels are bounded queues shared by every VM of a run, which branches
+	// send to and receive from without a lock. A branch that finds its
+	// channel full or empty does not hold a thread: its frames stay where
+	// they are and it returns to its Parallel block, which runs the waiting
+	// branches again, on the Scheduler or in turn, until all have finished.
+	// A round of them in which no value moved and no branch finished is a
+	// deadlock, reported with what each branch waits for, as is waiting
+	// anywhere else, where nothing runs alongside. A branch waiting in a
+	// Parallel block of its own waits in turn in its parent's.
+	//
+	// A run can also go in slices, for a caller that must not wait for it
+	// to end, like the editor between two frames. The interpreter counts
+	// steps, every iteration of a loop and every call, the only places
+	// where a frame runs ops it ran before; once a slice's steps are used
+	// up the run is put aside like a waiting branch, to go on where it
+	// stopped. The branches of a Parallel block run in turn on the slice's
+	// steps and are put aside with it. A loop compiled to split runs in
+	// turn too, with no Scheduler attached, and no function runs native
+	// code, whose frames could not be put aside.
+	//
+	// A program that cannot be trusted to end runs with limits, checked
+	// where slices end so that they cost the interpreter nothing more. Its
+	// `fuel` counts the same steps. Its heap, once past `max_memory` even
+	// when collected, and its printing, once past `max_output`, end the
+	// step count for the run to stop at its next step; printing past the
+	// limit is dropped. Each branch of a Parallel block and each slice of a
+	// split loop may use what the run had left of each when it began. Native
+	// code counts its steps at loop heads and calls alike, and fails at once
+	// when they run out.
+	class VM
+	{
+	public:
+		static constexpr uint8_t quicken_limit = 4;
+		static constexpr uint32_t native_nesting = 256;
+		static constexpr int64_t max_capacity = 1 << 24;
+
+		std::string error;
+		Heap heap;
+		std::vector<Value> globals;
+		uint32_t max_depth = 10000;
+		uint64_t fuel = UINT64_MAX;
+		size_t max_memory = SIZE_MAX;
+		size_t max_output = SIZE_MAX;
+		// The limit the last run failed on, if any.
+		Limit limit = Limit::None;
+		uint64_t quickened = 0;
+		uint64_t dequickened = 0;
+		TierManager* tiers = nullptr;
+		uint64_t promotions = 0;
+		uint64_t replacements = 0;
+		Profile* profile = nullptr;
+		bool memoize = false;
+		uint32_t memo_slots = 4096;
+		// Per function: calls answered from the cache, and calls it could
+		// have answered that ran.
+		std::vector<uint64_t> memo_hits;
+		std::vector<uint64_t> memo_misses;
+		Scheduler* scheduler = nullptr;
+		uint64_t forks = 0;
+		uint32_t split_items = 1024;
+		uint64_t splits = 0;
+		uint64_t collections = 0;
+		// In a run in slices, an Input block with no line waiting in `in`
+		// ends the slice rather than reading nil, setting `awaiting` until
+		// the next slice reads one.
+		bool prompt = false;
+		bool awaiting = false;
+
+		VM(const Module& module, std::istream& in = std::cin, std::ostream& out = std::cout);
+
+		Status run();
+		Status call(uint32_t function, const Value* args, Value& result);
+		// Sets up a run in slices, which resume() goes on with for at most
+		// `steps` steps at a time. It gives Paused until the run ends, and
+		// the run's own status then.
+		void start();
+		Status resume(uint64_t steps);
+		// The function the run in slices stands in.
+		const std::string& position() const;
+		// One line per function the cache was consulted for.
+		std::string memo_report() const;
+
+	private:
+		const Module& module;
+		std::istream& in;
+		std::ostream& out;
+		std::string line;
+		// Input that hands out its lines uncopied, when `in` reads through one.
+		FileInput* lines;
+
+		// One function at one tier, as quickened by this VM.
+		struct Code
+		{
+			const Function* function = nullptr;
+			std::vector<Instr> instrs;
+			std::vector<uint8_t> misses;
+			NativeCode native = nullptr;
+			uint64_t* counters = nullptr;
+		};
+
+		enum class Memo : uint8_t
+		{
+			Off, Hit, Miss
+		};
+
+		// The cached calls of one function: a tag of 0 marks a free slot,
+		// `keys` holds the arguments of slot k from k * params on.
+		struct MemoTable
+		{
+			std::vector<uint64_t> tags;
+			std::vector<Value> keys;
+			std::vector<Value> results;
+		};
+
+		// A caller waiting for its callee to return.
+		struct Frame
+		{
+			static constexpr uint32_t unmemoized = UINT32_MAX;
+
+			uint32_t index;
+			Code* current;
+			Tier level;
+			size_t pc;
+			Value* registers;
+			Value* result;
+			// Where the stack stood before the callee's registers.
+			size_t segment;
+			size_t top;
+			// The function whose cache the callee's result goes to.
+			uint32_t memoized;
+		};
+
+		friend struct JitRuntime;
+
+		std::vector<std::vector<Code>> code;
+		std::vector<Tier> tier;
+		std::vector<Tier> ceiling;
+		std::vector<Frame> frames;
+		std::vector<std::vector<Value>> stack;
+		size_t segment = 0;
+		size_t top = 0;
+		uint32_t nested = 0;
+		std::vector<MemoTable> memos;
+		bool forked = false;
+		// In a slice of a split loop: its table, the depth of the loop's
+		// frame, the containers whose stores wait and the stores waiting,
+		// each with how much of the output came before it.
+		struct Deferred
+		{
+			Value container, key, value;
+			size_t pc;
+			size_t printed;
+		};
+
+		const SplitTable* slice = nullptr;
+		uint32_t slice_depth = 0;
+		std::vector<Value> deferring;
+		std::vector<Deferred> deferred;
+		// Arguments of the memoized calls still running, innermost last.
+		std::vector<Value> pending;
+		// The channels of the run, and whether this VM runs a branch that
+		// can wait on them: then it keeps where it waits in `suspended`,
+		// and the branches of a Parallel block it waits in in `waiting`.
+		std::vector<std::shared_ptr<BoundedQueue<Value>>> channels;
+		bool task = false;
+
+		struct Suspended
+		{
+			uint32_t index;
+			Code* current;
+			size_t pc;
+			Value* registers;
+			Value* result;
+			uint32_t depth;
+		};
+
+		struct Branch
+		{
+			std::ostringstream out;
+			std::unique_ptr<VM> vm;
+			Value* registers = nullptr;
+			Status status = Status::Blocked;
+		};
+
+		Suspended suspended{};
+		std::vector<Branch> waiting;
+		// Steps left in the slice or of the fuel, whichever ends first.
+		uint64_t steps = UINT64_MAX;
+		Value returned;
+		// The fuel left before the steps counted down now, how many those
+		// were and whether the fuel ends with them; the bytes printed.
+		uint64_t fuel_left = UINT64_MAX;
+		uint64_t granted = UINT64_MAX;
+		bool fueled = true;
+		size_t written = 0;
+
+		Code& load(uint32_t index, Tier level);
+		Code& enter(uint32_t index);
+		Code* promote(uint32_t index);
+		Code* interpreted(uint32_t index, Code* current, Tier& level);
+		Value* push(size_t count);
+		Value* grow(Value* registers, size_t count);
+		Status execute(uint32_t index, Code* current, Value* frame, Value& result, uint32_t depth, size_t entry = 0, size_t floor = SIZE_MAX);
+		Status native(const Code& current, Value* frame, Value& result, uint32_t entry, uint32_t depth);
+		Status invoke(const Function& caller, size_t pc, const Instr& i, Value* R, uint32_t depth);
+		Status exhausted(const Function& caller, size_t pc);
+		Status exceeded(const Function& function, size_t pc);
+		Status finished(uint32_t index, Status status, const Value& result);
+		bool reclaim();
+		void restore();
+		void collect(const Value& result);
+		void arm(uint64_t fuel);
+		std::unique_ptr<VM> spawn(std::ostream& output);
+		Status fork(const Function& function, size_t pc, Value* R, uint32_t depth);
+		Status split(const Function& function, size_t pc, Value* R, uint32_t depth, bool& ran);
+		Status defer(const Function& function, size_t pc, Value* R, uint32_t depth);
+		Status make(const Function& function, size_t pc, Value* R);
+		Status exchange(const Function& function, size_t pc, Value* R, bool& waits);
+		uint64_t transfers() const;
+		Memo recall(uint32_t index, const Value* args, Value& result);
+		void remember(uint32_t index, const Value& result);
+		void print(const Value& value, bool newline);
+		void emit(std::string_view text);
+		void quicken(Code& current, size_t pc, const Value& x, const Value& y);
+		void dequicken(Code& current, size_t pc);
+		Status fail(const Function& function, size_t pc, Fault fault, const Value* operands = nullptr, size_t count = 0);
+		Value read();
+	};
+}
@@ -0,0 +1,91 @@
+#include<algorithm>
+#include<chrono>
+#include<cstdio>
+#include<sstream>
+
+// Diaflow
+#include<batch.h>
+
+namespace Diaflow
+{
+	namespace
+	{
+		std::string format(const char* format, double value)
+		{
+			char text[32];
+			std::snprintf(text, sizeof(text), format, value);
+			return text;
+		}
+	}
+
+	Batch::Batch(const Module& module, Scheduler& scheduler)
+		: module(module), scheduler(scheduler)
+	{}
+
+	bool Batch::run(const std::vector<std::string>& inputs)
+	{
+		size_t workers = scheduler.workers();
+		runs.assign(inputs.size(), Run());
+		worker_runs.assign(workers, 0);
+		worker_seconds.assign(workers, 0);
+
+		auto start = std::chrono::steady_clock::now();
+		scheduler.parallel_for(0, inputs.size(), std::max<size_t>(1, inputs.size() / (workers * 16)), [&](size_t input)
+		{
+			auto start = std::chrono::steady_clock::now();
+			size_t worker = scheduler.worker();
+			// A run that waits on a Parallel block may run other inputs on
+			// this worker meanwhile, so nothing per worker holds its output.
+			std::ostringstream out;
+			std::istringstream in(inputs[input]);
+
+			Run& run = runs[input];
+			VM vm(module, in, out);
+			vm.max_depth = max_depth;
+			vm.fuel = fuel;
+			vm.max_memory = max_memory;
+			vm.max_output = max_output;
+			vm.memoize = memoize;
+			vm.scheduler = &scheduler;
+			run.status = vm.run();
+			run.output = out.str();
+			run.error = std::move(vm.error);
+			run.limit = vm.limit;
+			run.worker = static_cast<uint32_t>(worker);
+
+			std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+			run.seconds = elapsed.count();
+			worker_runs[worker]++;
+			worker_seconds[worker] += run.seconds;
+		});
+
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		seconds = elapsed.count();
+		return std::all_of(runs.begin(), runs.end(), [](const Run& run) { return run.status == Status::Ok; });
+	}
+
+	std::string Batch::summary() const
+	{
+		std::vector<double> times;
+		double busy = 0;
+		size_t failed = 0;
+		for(const Run& run : runs)
+		{
+			times.push_back(run.seconds);
+			busy += run.seconds;
+			failed += run.status != Status::Ok;
+		}
+
+		std::string out = std::to_string(runs.size()) + " runs, " + std::to_string(failed) + " failed, " + std::to_string(worker_runs.size()) + " workers\n";
+		if(times.empty())
+			return out;
+
+		std::sort(times.begin(), times.end());
+		out += "wall " + format("%.3f", seconds) + "s, busy " + format("%.3f", busy) + "s, " + format("%.0f", seconds > 0 ? runs.size() / seconds : 0) + " runs/s\n";
+		out += "per run: min " + format("%.6f", times.front()) + "s, median " + format("%.6f", times[times.size() / 2]) + "s, p95 " + format("%.6f", times[times.size() * 95 / 100]) + "s, max " + format("%.6f", times.back()) + "s\n";
+		for(size_t k = 0; k < worker_runs.size(); k++)
+			out += "worker " + std::to_string(k) + ": " + std::to_string(worker_runs[k]) + " runs, " + format("%.3f", worker_seconds[k]) + "s, " + format("%.0f", seconds > 0 ? 100 * worker_seconds[k] / seconds : 0) + "% busy\n";
+
+		return out;
+	}
+}
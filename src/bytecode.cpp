@@ -0,0 +1,183 @@
+#include<cmath>
+
+// Diaflow
+#include<bytecode.h>
+
+namespace Diaflow
+{
+	const char* opcode_name(Opcode op)
+	{
+		switch(op)
+		{
+			case Opcode::Nop: return "nop";
+			case Opcode::Move: return "move";
+			case Opcode::LoadK: return "loadk";
+			case Opcode::GetGlobal: return "getglobal";
+			case Opcode::SetGlobal: return "setglobal";
+			case Opcode::Add: return "add";
+			case Opcode::Sub: return "sub";
+			case Opcode::Mul: return "mul";
+			case Opcode::Div: return "div";
+			case Opcode::Mod: return "mod";
+			case Opcode::Neg: return "neg";
+			case Opcode::Not: return "not";
+			case Opcode::Eq: return "eq";
+			case Opcode::Ne: return "ne";
+			case Opcode::Lt: return "lt";
+			case Opcode::Le: return "le";
+			case Opcode::AddI: return "addi";
+			case Opcode::SubI: return "subi";
+			case Opcode::MulI: return "muli";
+			case Opcode::DivI: return "divi";
+			case Opcode::ModI: return "modi";
+			case Opcode::AddD: return "addd";
+			case Opcode::SubD: return "subd";
+			case Opcode::MulD: return "muld";
+			case Opcode::DivD: return "divd";
+			case Opcode::EqI: return "eqi";
+			case Opcode::NeI: return "nei";
+			case Opcode::LtI: return "lti";
+			case Opcode::LeI: return "lei";
+			case Opcode::EqD: return "eqd";
+			case Opcode::NeD: return "ned";
+			case Opcode::LtD: return "ltd";
+			case Opcode::LeD: return "led";
+			case Opcode::EqS: return "eqs";
+			case Opcode::NeS: return "nes";
+			case Opcode::Concat: return "concat";
+			case Opcode::Jump: return "jump";
+			case Opcode::Switch: return "switch";
+			case Opcode::Loop: return "loop";
+			case Opcode::JumpIf: return "jumpif";
+			case Opcode::JumpIfNot: return "jumpifnot";
+			case Opcode::Index: return "index";
+			case Opcode::SetIndex: return "setindex";
+			case Opcode::NewArray: return "newarray";
+			case Opcode::NewMap: return "newmap";
+			case Opcode::Builtin: return "builtin";
+			case Opcode::Iter: return "iter";
+			case Opcode::Call: return "call";
+			case Opcode::TailCall: return "tailcall";
+			case Opcode::Return: return "return";
+			case Opcode::Input: return "input";
+			case Opcode::Output: return "output";
+			case Opcode::Count: return "count";
+			case Opcode::Fork: return "fork";
+			case Opcode::Join: return "join";
+			case Opcode::Split: return "split";
+			case Opcode::Defer: return "defer";
+			case Opcode::DeferPush: return "deferpush";
+			case Opcode::Done: return "done";
+			case Opcode::Channel: return "channel";
+			case Opcode::Send: return "send";
+			case Opcode::Receive: return "receive";
+		}
+
+		return "?";
+	}
+
+	uint32_t SwitchTable::find(const Value& subject) const
+	{
+		uint32_t miss = static_cast<uint32_t>(targets.size() - 1);
+		if(!dense.empty())
+		{
+			// Labels are ints, and a double equals one only when integral.
+			int64_t key;
+			if(subject.is_int())
+				key = subject.as_int();
+			else if(subject.is_double() && std::fabs(subject.as_double()) < 0x1p52 && std::trunc(subject.as_double()) == subject.as_double())
+				key = static_cast<int64_t>(subject.as_double());
+			else
+				return miss;
+
+			uint64_t index = static_cast<uint64_t>(key) - static_cast<uint64_t>(low);
+			return index < dense.size() ? dense[index] : miss;
+		}
+
+		if(slots.empty())
+			return miss;
+
+		size_t at = slot(subject, seeds[bucket(subject)]);
+		return slots[at] != none && equal(keys[at], subject) ? slots[at] : miss;
+	}
+
+	size_t SwitchTable::bucket(const Value& key) const
+	{
+		return static_cast<size_t>(ValueHash()(key) * 0x9E3779B97F4A7C15ull >> bucket_shift);
+	}
+
+	size_t SwitchTable::slot(const Value& key, uint64_t seed) const
+	{
+		return static_cast<size_t>((ValueHash()(key) ^ seed) * 0xBF58476D1CE4E5B9ull >> shift);
+	}
+
+	const std::string& Function::name_at(size_t pc) const
+	{
+		const Inlined* innermost = nullptr;
+		for(const Inlined& range : inlined)
+		{
+			if(pc >= range.begin && pc < range.end && (!innermost || range.end - range.begin < innermost->end - innermost->begin))
+				innermost = &range;
+		}
+
+		return innermost ? innermost->name : name;
+	}
+
+	std::string Module::disassemble() const
+	{
+		std::string out;
+		for(const Function& function : functions)
+		{
+			out += "func " + function.name + " (params " + std::to_string(function.params) + ", registers " + std::to_string(function.registers) + (function.pure ? ", pure" : "") + ")\n";
+			for(size_t pc = 0; pc < function.code.size(); pc++)
+			{
+				const Instr& instr = function.code[pc];
+				out += "  " + std::to_string(pc) + "\t" + opcode_name(instr.op) + (instr.flags & Instr::guarded ? "?" : "") + "\t" + std::to_string(instr.a) + " " + std::to_string(instr.b) + " " + std::to_string(instr.c);
+				if(instr.op == Opcode::LoadK)
+				{
+					out += "\t; ";
+					format(function.constants[instr.b], out);
+				}
+				else if(instr.op == Opcode::Switch)
+				{
+					const SwitchTable& table = function.switches[instr.b];
+					out += "\t; " + std::to_string(table.targets.size() - 1) + (table.dense.empty() ? " hashed" : " dense") + " cases, else " + std::to_string(table.targets.back());
+				}
+				else if(instr.op == Opcode::Fork)
+				{
+					const ForkTable& table = function.forks[instr.b];
+					out += "\t; " + std::to_string(table.branches.size()) + " branches, join " + std::to_string(table.join);
+				}
+				else if(instr.op == Opcode::Split)
+				{
+					const SplitTable& table = function.splits[instr.b];
+					out += "\t; slices from " + std::to_string(table.start) + ", exit " + std::to_string(table.exit);
+				}
+				else if(instr.op == Opcode::Channel || instr.op == Opcode::Send || instr.op == Opcode::Receive)
+					out += "\t; " + channels[instr.b];
+
+				out += "\n";
+			}
+		}
+
+		return out;
+	}
+
+	// One line per function: how many arithmetic and comparison ops the
+	// compiler could specialize from inferred types.
+	std::string Module::specialization_report() const
+	{
+		std::string out;
+		for(const Function& function : functions)
+		{
+			uint32_t total = function.generic_ops + function.specialized_ops;
+			out += function.name + ": " + std::to_string(function.specialized_ops) + "/" + std::to_string(total) + " ops specialized";
+			if(total)
+				out += " (" + std::to_string(function.specialized_ops * 100 / total) + "%)";
+
+			out += "\n";
+		}
+
+		return out;
+	}
+}
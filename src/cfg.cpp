@@ -0,0 +1,508 @@
+#include<algorithm>
+
+// Diaflow
+#include<cfg.h>
+
+namespace Diaflow
+{
+	bool Cfg::build(const Comp& body)
+	{
+		blocks.clear();
+		order.clear();
+		loops.clear();
+		step_list.clear();
+		targets.clear();
+		error.clear();
+
+		make();
+		make();
+		blocks[exit].exit = Exit::End;
+
+		start(entry);
+		if(!comp(body))
+			return false;
+
+		fall(exit);
+
+		number();
+		link();
+		dominators();
+		find_loops();
+		return true;
+	}
+
+	uint32_t Cfg::make()
+	{
+		blocks.emplace_back();
+		return static_cast<uint32_t>(blocks.size() - 1);
+	}
+
+	void Cfg::start(uint32_t block)
+	{
+		blocks[block].first_step = static_cast<uint32_t>(step_list.size());
+		current = block;
+	}
+
+	void Cfg::step(StepKind kind, const Block* block, const std::string* source)
+	{
+		// Statements after a Break, Continue or Return get a block of their
+		// own that nothing jumps to.
+		if(current == BasicBlock::none)
+			start(make());
+
+		step_list.push_back(Step{ kind, block, source });
+		blocks[current].steps++;
+	}
+
+	void Cfg::end(Exit exit, const Block* block, const std::string* source, uint32_t to, uint32_t otherwise)
+	{
+		if(current == BasicBlock::none)
+			start(make());
+
+		BasicBlock& b = blocks[current];
+		b.exit = exit;
+		b.block = block;
+		b.source = source;
+		b.succs[0] = to;
+		b.succs[1] = otherwise;
+		current = BasicBlock::none;
+	}
+
+	void Cfg::fall(uint32_t to)
+	{
+		if(current != BasicBlock::none)
+			end(Exit::Jump, nullptr, nullptr, to);
+	}
+
+	bool Cfg::comp(const Comp& body)
+	{
+		for(const Block* block : body)
+		{
+			if(auto assign = dynamic_cast<const Assign*>(block))
+				step(StepKind::Statement, block, &assign->expr);
+			else if(auto input = dynamic_cast<const Input*>(block))
+				step(StepKind::Input, block, &input->expr);
+			else if(auto output = dynamic_cast<const Output*>(block))
+				step(StepKind::Output, block, &output->expr);
+			else if(auto made = dynamic_cast<const Channel*>(block))
+				step(StepKind::Output, block, &made->capacity);
+			else if(auto send = dynamic_cast<const Send*>(block))
+				step(StepKind::Output, block, &send->expr);
+			else if(auto receive = dynamic_cast<const Receive*>(block))
+				step(StepKind::Input, block, &receive->expr);
+			else if(dynamic_cast<const Call*>(block))
+				step(StepKind::Call, block, nullptr);
+			else if(auto branch = dynamic_cast<const If*>(block))
+			{
+				uint32_t t = make();
+				uint32_t f = branch->f.empty() ? BasicBlock::none : make();
+				uint32_t join = make();
+				end(Exit::Branch, block, &branch->cond, t, f == BasicBlock::none ? join : f);
+
+				start(t);
+				if(!comp(branch->t))
+					return false;
+
+				fall(join);
+				if(f != BasicBlock::none)
+				{
+					start(f);
+					if(!comp(branch->f))
+						return false;
+
+					fall(join);
+				}
+
+				start(join);
+			}
+			else if(auto loop = dynamic_cast<const While*>(block))
+			{
+				uint32_t head = make(), body = make(), after = make();
+				fall(head);
+				start(head);
+				blocks[head].loop_block = block;
+				end(Exit::Branch, block, &loop->cond, body, after);
+
+				targets.push_back(Target{ after, head, true });
+				start(body);
+				if(!comp(loop->body))
+					return false;
+
+				fall(head);
+				targets.pop_back();
+				start(after);
+			}
+			else if(auto loop = dynamic_cast<const DoWhile*>(block))
+			{
+				uint32_t body = make(), cond = make(), after = make();
+				fall(body);
+				blocks[body].loop_block = block;
+
+				targets.push_back(Target{ after, cond, true });
+				start(body);
+				if(!comp(loop->body))
+					return false;
+
+				fall(cond);
+				targets.pop_back();
+				start(cond);
+				end(Exit::Branch, block, &loop->cond, body, after);
+				start(after);
+			}
+			else if(auto loop = dynamic_cast<const For*>(block))
+			{
+				if(!loop->init.empty())
+					step(StepKind::Statement, block, &loop->init);
+
+				uint32_t head = make(), body = make(), next = make(), after = make();
+				fall(head);
+				start(head);
+				blocks[head].loop_block = block;
+				if(loop->cond.empty())
+					end(Exit::Jump, block, nullptr, body);
+				else
+					end(Exit::Branch, block, &loop->cond, body, after);
+
+				targets.push_back(Target{ after, next, true });
+				start(body);
+				if(!comp(loop->body))
+					return false;
+
+				fall(next);
+				targets.pop_back();
+				start(next);
+				if(!loop->inc.empty())
+					step(StepKind::Statement, block, &loop->inc);
+
+				fall(head);
+				start(after);
+			}
+			else if(auto loop = dynamic_cast<const Foreach*>(block))
+			{
+				step(StepKind::Iterable, block, &loop->iter);
+
+				uint32_t head = make(), body = make(), after = make();
+				fall(head);
+				start(head);
+				blocks[head].loop_block = block;
+				end(Exit::Next, block, &loop->var, body, after);
+
+				targets.push_back(Target{ after, head, true });
+				start(body);
+				if(!comp(loop->body))
+					return false;
+
+				fall(head);
+				targets.pop_back();
+				start(after);
+			}
+			else if(auto branch = dynamic_cast<const Switch*>(block))
+			{
+				step(StepKind::Subject, block, &branch->expr);
+
+				// Labels are tested in order; the first match enters its case
+				// and every case falls through into the next one, as in C.
+				uint32_t first = static_cast<uint32_t>(blocks.size());
+				for(size_t i = 0; i < branch->cases.size(); i++)
+					make();
+
+				uint32_t after = make();
+				uint32_t fallback = after;
+				for(size_t i = 0; i < branch->cases.size(); i++)
+				{
+					const std::string& label = branch->cases[i].first;
+					if(label == "default")
+					{
+						fallback = first + static_cast<uint32_t>(i);
+						continue;
+					}
+
+					uint32_t next = make();
+					end(Exit::Case, block, &label, first + static_cast<uint32_t>(i), next);
+					start(next);
+				}
+
+				fall(fallback);
+
+				// A continue inside a switch belongs to the enclosing loop.
+				uint32_t continues = BasicBlock::none;
+				for(auto it = targets.rbegin(); it != targets.rend(); it++)
+				{
+					if(it->loop)
+					{
+						continues = it->continues;
+						break;
+					}
+				}
+
+				targets.push_back(Target{ after, continues, false });
+				for(size_t i = 0; i < branch->cases.size(); i++)
+				{
+					start(first + static_cast<uint32_t>(i));
+					if(!comp(branch->cases[i].second))
+						return false;
+
+					fall(i + 1 < branch->cases.size() ? first + static_cast<uint32_t>(i) + 1 : after);
+				}
+
+				targets.pop_back();
+				start(after);
+			}
+			else if(dynamic_cast<const Break*>(block))
+			{
+				if(targets.empty())
+				{
+					error = "'break': not inside a loop or switch";
+					return false;
+				}
+
+				end(Exit::Jump, block, nullptr, targets.back().breaks);
+			}
+			else if(dynamic_cast<const Continue*>(block))
+			{
+				if(targets.empty() || targets.back().continues == BasicBlock::none)
+				{
+					error = "'continue': not inside a loop";
+					return false;
+				}
+
+				end(Exit::Jump, block, nullptr, targets.back().continues);
+			}
+			else if(auto ret = dynamic_cast<const Return*>(block))
+				end(Exit::Return, block, ret->expr.empty() ? nullptr : &ret->expr, exit);
+			else if(auto parallel = dynamic_cast<const Parallel*>(block))
+			{
+				// Branches never leave the block and none uses what another
+				// assigns, so running them in turn stands for running them
+				// at once.
+				for(const Comp& branch : parallel->branches)
+				{
+					if(!comp(branch))
+						return false;
+				}
+			}
+			else if(!dynamic_cast<const Comment*>(block))
+			{
+				error = "'?': unsupported block type";
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	// Depth-first search from the entry, numbering reachable blocks in
+	// reverse postorder. `pre` holds the next successor to visit meanwhile.
+	void Cfg::number()
+	{
+		for(BasicBlock& block : blocks)
+		{
+			block.rpo = BasicBlock::none;
+			block.idom = BasicBlock::none;
+			block.loop = BasicBlock::none;
+		}
+
+		stack.clear();
+		stack.push_back(entry);
+		blocks[entry].rpo = 0;
+		blocks[entry].pre = 0;
+		while(!stack.empty())
+		{
+			BasicBlock& block = blocks[stack.back()];
+			if(block.pre < block.successors())
+			{
+				uint32_t next = block.succs[block.pre++];
+				if(blocks[next].rpo == BasicBlock::none)
+				{
+					blocks[next].rpo = 0;
+					blocks[next].pre = 0;
+					stack.push_back(next);
+				}
+			}
+			else
+			{
+				order.push_back(stack.back());
+				stack.pop_back();
+			}
+		}
+
+		std::reverse(order.begin(), order.end());
+		for(size_t i = 0; i < order.size(); i++)
+			blocks[order[i]].rpo = static_cast<uint32_t>(i);
+	}
+
+	void Cfg::link()
+	{
+		for(BasicBlock& block : blocks)
+			block.preds = 0;
+
+		for(uint32_t b : order)
+		{
+			for(uint32_t i = 0; i < blocks[b].successors(); i++)
+				blocks[blocks[b].succs[i]].preds++;
+		}
+
+		uint32_t total = 0;
+		for(BasicBlock& block : blocks)
+		{
+			block.first_pred = total;
+			total += block.preds;
+			block.preds = 0;
+		}
+
+		pred_list.resize(total);
+		for(uint32_t b : order)
+		{
+			for(uint32_t i = 0; i < blocks[b].successors(); i++)
+			{
+				BasicBlock& next = blocks[blocks[b].succs[i]];
+				pred_list[next.first_pred + next.preds++] = b;
+			}
+		}
+	}
+
+	// Cooper, Harvey and Kennedy's iterative scheme: walk the blocks in
+	// reverse postorder intersecting the dominators of processed predecessors
+	// until nothing changes, which takes two or three passes over a graph made
+	// from structured code. The tree is then numbered in depth-first order so
+	// dominance queries are two comparisons.
+	void Cfg::dominators()
+	{
+		auto intersect = [this](uint32_t a, uint32_t b)
+		{
+			while(a != b)
+			{
+				while(blocks[a].rpo > blocks[b].rpo)
+					a = blocks[a].idom;
+
+				while(blocks[b].rpo > blocks[a].rpo)
+					b = blocks[b].idom;
+			}
+
+			return a;
+		};
+
+		blocks[entry].idom = entry;
+		for(bool changed = true; changed; )
+		{
+			changed = false;
+			for(size_t i = 1; i < order.size(); i++)
+			{
+				uint32_t b = order[i];
+				uint32_t idom = BasicBlock::none;
+				for(uint32_t pred : preds(b))
+				{
+					if(blocks[pred].idom != BasicBlock::none)
+						idom = idom == BasicBlock::none ? pred : intersect(pred, idom);
+				}
+
+				if(blocks[b].idom != idom)
+				{
+					blocks[b].idom = idom;
+					changed = true;
+				}
+			}
+		}
+
+		blocks[entry].idom = BasicBlock::none;
+
+		for(BasicBlock& block : blocks)
+			block.children = 0;
+
+		for(size_t i = 1; i < order.size(); i++)
+			blocks[blocks[order[i]].idom].children++;
+
+		uint32_t total = 0;
+		for(BasicBlock& block : blocks)
+		{
+			block.first_child = total;
+			total += block.children;
+			block.children = 0;
+		}
+
+		child_list.resize(total);
+		for(size_t i = 1; i < order.size(); i++)
+		{
+			BasicBlock& parent = blocks[blocks[order[i]].idom];
+			child_list[parent.first_child + parent.children++] = order[i];
+		}
+
+		// `post` counts the children visited until the block is finished.
+		uint32_t clock = 0;
+		stack.clear();
+		stack.push_back(entry);
+		blocks[entry].pre = clock++;
+		blocks[entry].post = 0;
+		while(!stack.empty())
+		{
+			BasicBlock& block = blocks[stack.back()];
+			if(block.post < block.children)
+			{
+				uint32_t child = child_list[block.first_child + block.post++];
+				blocks[child].pre = clock++;
+				blocks[child].post = 0;
+				stack.push_back(child);
+			}
+			else
+			{
+				block.post = clock++;
+				stack.pop_back();
+			}
+		}
+	}
+
+	// Heads are visited from the last in reverse postorder to the first, so
+	// inner loops are found before the loops around them. Each loop walks
+	// backwards from its back edges; a block already claimed by an inner loop
+	// stands for that whole loop, which becomes a child of the current one.
+	void Cfg::find_loops()
+	{
+		for(auto head = order.rbegin(); head != order.rend(); head++)
+		{
+			uint32_t h = *head;
+			stack.clear();
+			for(uint32_t pred : preds(h))
+			{
+				if(dominates(h, pred))
+					stack.push_back(pred);
+			}
+
+			if(stack.empty())
+				continue;
+
+			uint32_t loop = static_cast<uint32_t>(loops.size());
+			loops.push_back(NaturalLoop{ h, BasicBlock::none, 1, blocks[h].loop_block });
+			blocks[h].loop = loop;
+			while(!stack.empty())
+			{
+				uint32_t b = stack.back();
+				stack.pop_back();
+				if(blocks[b].loop == BasicBlock::none)
+				{
+					blocks[b].loop = loop;
+					for(uint32_t pred : preds(b))
+						stack.push_back(pred);
+
+					continue;
+				}
+
+				uint32_t inner = blocks[b].loop;
+				while(loops[inner].parent != BasicBlock::none)
+					inner = loops[inner].parent;
+
+				if(inner == loop)
+					continue;
+
+				loops[inner].parent = loop;
+				for(uint32_t pred : preds(loops[inner].head))
+					stack.push_back(pred);
+			}
+		}
+
+		for(size_t i = loops.size(); i-- > 0; )
+		{
+			if(loops[i].parent != BasicBlock::none)
+				loops[i].depth = loops[loops[i].parent].depth + 1;
+		}
+	}
+}
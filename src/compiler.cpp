@@ -0,0 +1,2774 @@
+#include<algorithm>
+#include<functional>
+#include<limits>
+#include<map>
+#include<optional>
+
+// Diaflow
+#include<compiler.h>
+#include<expr.h>
+#include<parsed.h>
+#include<purity.h>
+#include<independence.h>
+#include<sccp.h>
+#include<types.h>
+
+namespace Diaflow
+{
+	namespace
+	{
+		constexpr uint32_t any = std::numeric_limits<uint32_t>::max();
+		constexpr uint32_t max_registers = std::numeric_limits<uint16_t>::max();
+		constexpr size_t max_hoisted = 64;
+		constexpr int64_t unroll = 4;
+		// Statements a callee may have to be inlined, at a call site that runs
+		// once or one inside a loop, and how deep inlined calls may nest.
+		constexpr size_t inline_size = 8;
+		constexpr size_t hot_inline_size = 24;
+		constexpr size_t max_inline_depth = 6;
+		// Instructions past which a function stops growing by inlining.
+		constexpr size_t max_inlined_code = 4096;
+		// Constant labels a Switch needs to dispatch through a table rather
+		// than test them in turn, and the seeds tried per bucket of its hash.
+		constexpr size_t min_switch_table = 4;
+		constexpr uint64_t switch_seeds = 1024;
+		// Times a branch must have run before its profile guides the layout,
+		// and how rarely a side must be taken to be moved out of line.
+		constexpr uint64_t min_profile = 16;
+		constexpr uint64_t cold_ratio = 64;
+
+		struct Loop
+		{
+			std::vector<size_t> breaks;
+			std::vector<size_t> continues;
+			bool loop;
+		};
+
+		// A For whose variable starts at, steps by and stops at constants and
+		// is left alone by the body, so its trip count and range are known.
+		struct Counted
+		{
+			uint32_t reg = 0;
+			int64_t start = 0;
+			int64_t step = 0;
+			int64_t last = 0;
+			int64_t trips = 0;
+			bool unroll = false;
+			// Register holding the last value that still leaves a full
+			// unrolled iteration.
+			uint32_t limit = 0;
+			// Strength-reduced multiples of the variable: the register that
+			// tracks each and the register holding what it grows by per step.
+			std::vector<std::pair<uint32_t, uint32_t>> derived;
+		};
+
+		// An entry into a loop past the code computing its hoisted values.
+		struct Entry
+		{
+			uint32_t loop;
+			size_t head;
+			std::vector<std::pair<const Expr*, uint32_t>> values;
+			std::vector<std::pair<uint64_t, uint32_t>> constants;
+		};
+
+		// A side of an If laid out after the function's return, entered by
+		// the jump at `jump` and going back to `back`. It only ever runs
+		// inside the loops around the If, so it reads what they hoisted.
+		struct Outlined
+		{
+			const Block* branch;
+			uint32_t way;
+			size_t jump;
+			size_t back;
+			uint32_t top;
+			std::unordered_map<const Expr*, uint32_t> hoisted;
+			std::unordered_map<uint64_t, uint32_t> hoisted_constants;
+			std::vector<const Expr*> hoisted_log;
+			std::vector<uint64_t> constants_log;
+		};
+
+		// What the compilers of all functions of one compile share.
+		struct Unit
+		{
+			const std::vector<ParsedFunction>& parsed;
+			const TypeInference& inference;
+			const ConstantPropagation& propagation;
+			const Independence& independence;
+			bool optimize_loops;
+			bool inline_calls;
+			bool instrument;
+			const Profile* profile;
+			// Propagation redone for callees inlined with constant arguments.
+			std::map<std::pair<uint32_t, std::vector<std::optional<uint64_t>>>, FunctionConstants> specialized;
+			size_t inlined = 0;
+			size_t specialized_calls = 0;
+			size_t outlined = 0;
+			size_t tail_calls = 0;
+			size_t merged = 0;
+			size_t split = 0;
+		};
+
+		// Fills the table for distinct constant `labels`, the k-th going to
+		// target k and everything else to the one after them. Fails when the
+		// labels are neither ints close together nor placed without
+		// collisions by any seeds tried.
+		bool switch_table(const std::vector<Value>& labels, SwitchTable& table)
+		{
+			uint32_t miss = static_cast<uint32_t>(labels.size());
+			table.targets.assign(labels.size() + 1, 0);
+
+			bool ints = true;
+			int64_t low = std::numeric_limits<int64_t>::max(), high = std::numeric_limits<int64_t>::min();
+			for(const Value& label : labels)
+			{
+				if(!(ints = label.is_int()))
+					break;
+
+				low = std::min(low, label.as_int());
+				high = std::max(high, label.as_int());
+			}
+
+			if(ints && static_cast<uint64_t>(high - low) < 2 * labels.size() + 8)
+			{
+				table.low = low;
+				table.dense.assign(static_cast<size_t>(high - low + 1), miss);
+				for(uint32_t k = 0; k < labels.size(); k++)
+					table.dense[static_cast<size_t>(labels[k].as_int() - low)] = k;
+
+				return true;
+			}
+
+			// A label not even equal to itself (NaN) can never be taken.
+			std::vector<uint32_t> hashed;
+			for(uint32_t k = 0; k < labels.size(); k++)
+			{
+				if(equal(labels[k], labels[k]))
+					hashed.push_back(k);
+			}
+
+			// Twice as many slots as labels and a quarter as many buckets.
+			uint32_t bits = 1;
+			while((size_t(1) << bits) < 2 * hashed.size())
+				bits++;
+
+			uint32_t bucket_bits = bits > 2 ? bits - 2 : 1;
+			table.bucket_shift = 64 - bucket_bits;
+			std::vector<std::vector<uint32_t>> buckets(size_t(1) << bucket_bits);
+			for(uint32_t k : hashed)
+				buckets[table.bucket(labels[k])].push_back(k);
+
+			// The largest buckets are placed first, while most slots are free.
+			std::vector<size_t> order(buckets.size());
+			for(size_t b = 0; b < order.size(); b++)
+				order[b] = b;
+
+			std::stable_sort(order.begin(), order.end(), [&](size_t x, size_t y) { return buckets[x].size() > buckets[y].size(); });
+
+			for(uint32_t width = bits; width < bits + 3; width++)
+			{
+				table.shift = 64 - width;
+				table.seeds.assign(buckets.size(), 0);
+				table.slots.assign(size_t(1) << width, SwitchTable::none);
+
+				bool perfect = true;
+				for(size_t b : order)
+				{
+					perfect = false;
+					for(uint64_t attempt = 0; attempt < switch_seeds && !perfect; attempt++)
+					{
+						uint64_t seed = attempt * 0xD6E8FEB86659FD93ull;
+						std::vector<size_t> taken;
+						perfect = true;
+						for(uint32_t k : buckets[b])
+						{
+							size_t at = table.slot(labels[k], seed);
+							if(table.slots[at] != SwitchTable::none)
+							{
+								perfect = false;
+								break;
+							}
+
+							table.slots[at] = k;
+							taken.push_back(at);
+						}
+
+						if(perfect)
+							table.seeds[b] = seed;
+						else
+						{
+							for(size_t at : taken)
+								table.slots[at] = SwitchTable::none;
+						}
+					}
+
+					if(!perfect)
+						break;
+				}
+
+				if(perfect)
+				{
+					table.keys.assign(table.slots.size(), Value::nil());
+					for(size_t at = 0; at < table.slots.size(); at++)
+					{
+						if(table.slots[at] != SwitchTable::none)
+							table.keys[at] = labels[table.slots[at]];
+					}
+
+					return true;
+				}
+			}
+
+			table.slots.clear();
+			return false;
+		}
+
+		// Whether a break or continue in `body` leaves it, rather than a loop
+		// or, for a break, a switch inside it.
+		bool escapes(const Comp& body, bool breaks = true)
+		{
+			for(const Block* block : body)
+			{
+				if((breaks && dynamic_cast<const Break*>(block)) || dynamic_cast<const Continue*>(block))
+					return true;
+
+				if(auto branch = dynamic_cast<const If*>(block))
+				{
+					if(escapes(branch->t, breaks) || escapes(branch->f, breaks))
+						return true;
+				}
+				else if(auto branch = dynamic_cast<const Switch*>(block))
+				{
+					for(auto& [_, statements] : branch->cases)
+					{
+						if(escapes(statements, false))
+							return true;
+					}
+				}
+			}
+
+			return false;
+		}
+
+		// Marks the locals `block` may assign, on any iteration if it is a loop.
+		void assignments(const ParsedFunction& parsed, const Block* block, std::vector<bool>& assigned)
+		{
+			auto mark = [&](const Expr* expr)
+			{
+				if(expr->kind == ExprKind::Assign)
+					expr = expr->args[0];
+
+				if(expr->kind == ExprKind::Local)
+					assigned[parsed.local(expr->name)] = true;
+			};
+
+			auto body = [&](const Comp& body)
+			{
+				for(const Block* nested : body)
+					assignments(parsed, nested, assigned);
+			};
+
+			if(auto assign = dynamic_cast<const Assign*>(block))
+				mark(parsed[assign->expr]);
+			else if(auto input = dynamic_cast<const Input*>(block))
+				mark(parsed[input->expr]);
+			else if(auto receive = dynamic_cast<const Receive*>(block))
+				mark(parsed[receive->expr]);
+			else if(auto call = dynamic_cast<const Call*>(block))
+			{
+				if(!call->retvar.empty())
+					mark(parsed[call->retvar]);
+			}
+			else if(auto branch = dynamic_cast<const If*>(block))
+			{
+				body(branch->t);
+				body(branch->f);
+			}
+			else if(auto inner = dynamic_cast<const While*>(block))
+				body(inner->body);
+			else if(auto inner = dynamic_cast<const DoWhile*>(block))
+				body(inner->body);
+			else if(auto inner = dynamic_cast<const For*>(block))
+			{
+				if(!inner->init.empty())
+					mark(parsed[inner->init]);
+
+				if(!inner->inc.empty())
+					mark(parsed[inner->inc]);
+
+				body(inner->body);
+			}
+			else if(auto inner = dynamic_cast<const Foreach*>(block))
+			{
+				mark(parsed[inner->var]);
+				body(inner->body);
+			}
+			else if(auto branch = dynamic_cast<const Switch*>(block))
+			{
+				for(auto& [_, statements] : branch->cases)
+					body(statements);
+			}
+			else if(auto parallel = dynamic_cast<const Parallel*>(block))
+			{
+				for(const Comp& statements : parallel->branches)
+					body(statements);
+			}
+		}
+
+		bool number_types_only(Types types)
+		{
+			return types && !(types & ~number_types);
+		}
+
+		Opcode generic(BinaryOp op)
+		{
+			switch(op)
+			{
+				case BinaryOp::Add: return Opcode::Add;
+				case BinaryOp::Sub: return Opcode::Sub;
+				case BinaryOp::Mul: return Opcode::Mul;
+				case BinaryOp::Div: return Opcode::Div;
+				case BinaryOp::Mod: return Opcode::Mod;
+				case BinaryOp::Eq: return Opcode::Eq;
+				case BinaryOp::Ne: return Opcode::Ne;
+				case BinaryOp::Lt: return Opcode::Lt;
+				default: return Opcode::Le;
+			}
+		}
+
+		// Picks the unguarded variant of an operator when inference proved
+		// both operands to have one and the same type; anything ambiguous keeps
+		// the generic op, which checks types as it runs.
+		Opcode specialize(BinaryOp op, Types a, Types b)
+		{
+			if(only(a, Type::Int) && only(b, Type::Int))
+			{
+				switch(op)
+				{
+					case BinaryOp::Add: return Opcode::AddI;
+					case BinaryOp::Sub: return Opcode::SubI;
+					case BinaryOp::Mul: return Opcode::MulI;
+					case BinaryOp::Div: return Opcode::DivI;
+					case BinaryOp::Mod: return Opcode::ModI;
+					case BinaryOp::Eq: return Opcode::EqI;
+					case BinaryOp::Ne: return Opcode::NeI;
+					case BinaryOp::Lt: return Opcode::LtI;
+					case BinaryOp::Le: return Opcode::LeI;
+					default: break;
+				}
+			}
+
+			if(only(a, Type::Double) && only(b, Type::Double))
+			{
+				switch(op)
+				{
+					case BinaryOp::Add: return Opcode::AddD;
+					case BinaryOp::Sub: return Opcode::SubD;
+					case BinaryOp::Mul: return Opcode::MulD;
+					case BinaryOp::Div: return Opcode::DivD;
+					case BinaryOp::Eq: return Opcode::EqD;
+					case BinaryOp::Ne: return Opcode::NeD;
+					case BinaryOp::Lt: return Opcode::LtD;
+					case BinaryOp::Le: return Opcode::LeD;
+					default: break;
+				}
+			}
+
+			if(only(a, Type::String) && only(b, Type::String))
+			{
+				switch(op)
+				{
+					case BinaryOp::Add: return Opcode::Concat;
+					case BinaryOp::Eq: return Opcode::EqS;
+					case BinaryOp::Ne: return Opcode::NeS;
+					default: break;
+				}
+			}
+
+			return generic(op);
+		}
+
+		bool jumps(const Instr& i)
+		{
+			return i.op == Opcode::Jump || i.op == Opcode::JumpIf || i.op == Opcode::JumpIfNot || i.op == Opcode::Iter;
+		}
+
+		// Tidies the finished code of `function` into fewer, longer basic
+		// blocks: jumps to jumps go straight to where the chain ends, code no
+		// jump or loop entry reaches is dropped, and so are jumps to the op
+		// right after them. Returns how many ops it removed.
+		size_t merge_blocks(Function& function)
+		{
+			std::vector<Instr>& code = function.code;
+			size_t size = code.size();
+			auto thread = [&](uint32_t target)
+			{
+				for(size_t hops = 0; hops < size && target < size && code[target].op == Opcode::Jump && code[target].b != target; hops++)
+					target = code[target].b;
+
+				return target;
+			};
+
+			for(Instr& i : code)
+			{
+				if(jumps(i))
+					i.b = thread(i.b);
+			}
+
+			for(SwitchTable& table : function.switches)
+			{
+				for(uint32_t& target : table.targets)
+					target = thread(target);
+			}
+
+			for(ForkTable& table : function.forks)
+			{
+				for(uint32_t& branch : table.branches)
+					branch = thread(branch);
+
+				table.join = thread(table.join);
+			}
+
+			for(SplitTable& table : function.splits)
+			{
+				table.start = thread(table.start);
+				table.exit = thread(table.exit);
+			}
+
+			std::vector<bool> kept(size, false);
+			std::vector<uint32_t> work{ 0 };
+			for(uint32_t entry : function.loops)
+			{
+				if(entry != Function::no_loop)
+					work.push_back(entry);
+			}
+
+			while(!work.empty())
+			{
+				uint32_t pc = work.back();
+				work.pop_back();
+				for(; pc < size && !kept[pc]; pc++)
+				{
+					kept[pc] = true;
+					const Instr& i = code[pc];
+					if(jumps(i))
+						work.push_back(i.b);
+					else if(i.op == Opcode::Switch)
+						work.insert(work.end(), function.switches[i.b].targets.begin(), function.switches[i.b].targets.end());
+					else if(i.op == Opcode::Fork)
+					{
+						work.insert(work.end(), function.forks[i.b].branches.begin(), function.forks[i.b].branches.end());
+						work.push_back(function.forks[i.b].join);
+					}
+					else if(i.op == Opcode::Split)
+					{
+						work.push_back(function.splits[i.b].start);
+						work.push_back(function.splits[i.b].exit);
+					}
+
+					if(i.op == Opcode::Jump || i.op == Opcode::Switch || i.op == Opcode::Fork || i.op == Opcode::Join || i.op == Opcode::Return || i.op == Opcode::TailCall)
+						break;
+				}
+			}
+
+			// Where running on from each pc first reaches a kept op. Going
+			// backwards, it is known past a forward jump by the time it
+			// decides whether the jump lands there anyway.
+			std::vector<uint32_t> next(size + 1, static_cast<uint32_t>(size));
+			for(size_t pc = size; pc-- > 0;)
+			{
+				const Instr& i = code[pc];
+				bool forward = i.op == Opcode::Jump || i.op == Opcode::JumpIf || i.op == Opcode::JumpIfNot;
+				if(kept[pc] && forward && i.b > pc && next[i.b] == next[pc + 1])
+					kept[pc] = false;
+
+				next[pc] = kept[pc] ? static_cast<uint32_t>(pc) : next[pc + 1];
+			}
+
+			std::vector<uint32_t> moved(size + 1, 0);
+			for(size_t pc = 0; pc < size; pc++)
+				moved[pc + 1] = moved[pc] + (kept[pc] ? 1 : 0);
+
+			auto remap = [&](uint32_t target) { return moved[next[std::min<size_t>(target, size)]]; };
+			size_t removed = 0;
+			for(size_t pc = 0; pc < size; pc++)
+			{
+				if(!kept[pc])
+				{
+					removed++;
+					continue;
+				}
+
+				Instr i = code[pc];
+				if(jumps(i))
+					i.b = remap(i.b);
+
+				code[moved[pc]] = i;
+			}
+
+			code.erase(code.begin() + static_cast<std::ptrdiff_t>(size - removed), code.end());
+			for(SwitchTable& table : function.switches)
+			{
+				for(uint32_t& target : table.targets)
+					target = remap(target);
+			}
+
+			for(ForkTable& table : function.forks)
+			{
+				for(uint32_t& branch : table.branches)
+					branch = remap(branch);
+
+				table.join = remap(table.join);
+			}
+
+			for(SplitTable& table : function.splits)
+			{
+				table.start = remap(table.start);
+				table.exit = remap(table.exit);
+			}
+
+			for(uint32_t& entry : function.loops)
+			{
+				if(entry != Function::no_loop)
+					entry = moved[entry];
+			}
+
+			for(Inlined& range : function.inlined)
+			{
+				range.begin = moved[range.begin];
+				range.end = moved[range.end];
+			}
+
+			return removed;
+		}
+
+		class FunctionCompiler
+		{
+		public:
+			FunctionCompiler(Module& module, Unit& unit, uint32_t index, Function& function)
+				: module(module), unit(unit), parsed(unit.parsed[index]), types(unit.inference.functions[index]), known(unit.propagation.functions[index]), function(function), callers{ index }
+			{}
+
+			// Compiles the body of `callee` into the code of `caller`, its
+			// locals in the registers of `frame`.
+			FunctionCompiler(FunctionCompiler& caller, uint32_t callee, const FunctionConstants& known, uint32_t offset, std::vector<uint32_t> frame, uint32_t result, std::vector<size_t>& returns)
+				: module(caller.module), unit(caller.unit), parsed(unit.parsed[callee]), types(unit.inference.functions[callee]), known(known), function(caller.function),
+				callers(caller.callers), offset(offset), frame(std::move(frame)), result(result), returns(&returns), hot(caller.hot || caller.enclosing_loop()),
+				tail_body(caller.tail)
+			{
+				callers.push_back(callee);
+				constants = std::move(caller.constants);
+				hoisted_constants = caller.hoisted_constants;
+				top = caller.top;
+				max = caller.max;
+			}
+
+			bool compile(std::string& error)
+			{
+				top = max = locals();
+				function.loops.assign(parsed.loops.size(), Function::no_loop);
+				if(!comp(*parsed.body))
+					return fail(error, message);
+
+				uint32_t nil = alloc();
+				emit(Opcode::LoadK, nil, constant(Value::nil()));
+				emit(Opcode::Return, nil);
+				for(size_t k = 0; k < outlined.size(); k++)
+				{
+					Outlined side = std::move(outlined[k]);
+					const If* branch = static_cast<const If*>(side.branch);
+					patch(side.jump, here());
+					top = side.top;
+					hoisted = std::move(side.hoisted);
+					hoisted_constants = std::move(side.hoisted_constants);
+					hoisted_log = std::move(side.hoisted_log);
+					constants_log = std::move(side.constants_log);
+					count(branch, side.way);
+					if(!comp(side.way == 0 ? branch->t : branch->f))
+						return fail(error, message);
+
+					emit(Opcode::Jump, 0, static_cast<uint32_t>(side.back));
+				}
+
+				hoisted.clear();
+				hoisted_constants.clear();
+				hoisted_log.clear();
+				constants_log.clear();
+
+				unit.outlined += outlined.size();
+				for(const Entry& entry : entries)
+					reenter(entry);
+
+				unit.merged += merge_blocks(function);
+
+				if(max > max_registers)
+					return fail(error, "function needs more than " + std::to_string(max_registers) + " registers");
+
+				function.registers = max;
+				function.counters = unit.instrument ? parsed.counters : 0;
+				function.locals.resize(parsed.locals.size());
+				for(auto& [name, reg] : parsed.locals)
+					function.locals[reg] = name;
+
+				return true;
+			}
+
+		private:
+			Module& module;
+			Unit& unit;
+			const ParsedFunction& parsed;
+			const FunctionTypes& types;
+			const FunctionConstants& known;
+			Function& function;
+			// The function being compiled, then every function inlined into
+			// it down to this one. An inlined body has its registers from
+			// `offset` on, apart from parameters it reads in the caller's
+			// registers, and leaves by jumping to the end with its result in
+			// `result`.
+			std::vector<uint32_t> callers;
+			uint32_t offset = 0;
+			std::vector<uint32_t> frame;
+			uint32_t result = 0;
+			std::vector<size_t>* returns = nullptr;
+			bool hot = false;
+			// Whether the call being generated is a tail call, which its
+			// generation clears when it inlines the callee instead. The body
+			// inlined for a tail call returns from the function wherever it
+			// returns, so its calls can be tail calls too.
+			bool tail = false;
+			bool tail_body = false;
+			// What the profile counted for the branches of this function.
+			const std::vector<uint64_t>* counts = unit.profile ? unit.profile->find(parsed.name, parsed.counters) : nullptr;
+			std::vector<Outlined> outlined;
+
+			std::unordered_map<uint64_t, uint32_t> constants;
+			std::vector<Loop> loops;
+			// Values computed before the loops being compiled instead of on
+			// every iteration, by expression and by constant, and how many of
+			// each every open loop found already there.
+			std::unordered_map<const Expr*, uint32_t> hoisted;
+			std::unordered_map<uint64_t, uint32_t> hoisted_constants;
+			std::vector<const Expr*> hoisted_log;
+			std::vector<uint64_t> constants_log;
+			std::vector<std::pair<size_t, size_t>> hoist_marks;
+			std::vector<Entry> entries;
+			// Registers of the containers the split loops being compiled
+			// defer stores to.
+			std::vector<uint32_t> deferring;
+			uint32_t top = 0;
+			uint32_t max = 0;
+			std::string message;
+
+			bool fail(std::string& error, const std::string& what)
+			{
+				error = "in function '" + function.name + "': " + what;
+				return false;
+			}
+
+			bool fail(const std::string& source, const std::string& what)
+			{
+				if(message.empty())
+					message = "'" + source + "': " + what;
+
+				return false;
+			}
+
+			uint32_t local(const std::string& name)
+			{
+				return frame.empty() ? parsed.local(name) : frame[parsed.local(name)];
+			}
+
+			uint32_t locals() const
+			{
+				return offset + parsed.registers();
+			}
+
+			uint32_t global(const std::string& name)
+			{
+				auto it = std::find(module.globals.begin(), module.globals.end(), name);
+				if(it != module.globals.end())
+					return static_cast<uint32_t>(it - module.globals.begin());
+
+				module.globals.push_back(name);
+				return static_cast<uint32_t>(module.globals.size() - 1);
+			}
+
+			uint32_t channel(const std::string& name)
+			{
+				auto it = std::find(module.channels.begin(), module.channels.end(), name);
+				if(it != module.channels.end())
+					return static_cast<uint32_t>(it - module.channels.begin());
+
+				module.channels.push_back(name);
+				return static_cast<uint32_t>(module.channels.size() - 1);
+			}
+
+			uint32_t constant(Value value)
+			{
+				auto it = constants.find(value.bits);
+				if(it != constants.end())
+					return it->second;
+
+				function.constants.push_back(value);
+				return constants[value.bits] = static_cast<uint32_t>(function.constants.size() - 1);
+			}
+
+			uint32_t alloc()
+			{
+				uint32_t reg = top++;
+				max = std::max(max, top);
+				return reg;
+			}
+
+			size_t emit(Opcode op, uint32_t a = 0, uint32_t b = 0, uint32_t c = 0)
+			{
+				function.code.emplace_back(op, a, b, c);
+				return function.code.size() - 1;
+			}
+
+			size_t here() const
+			{
+				return function.code.size();
+			}
+
+			void patch(size_t jump, size_t target)
+			{
+				function.code[jump].b = static_cast<uint32_t>(target);
+			}
+
+			// Opens a loop: the values hoisted out of it, then its Loop op, the
+			// target of every back edge.
+			size_t open_loop(const Block* loop, Counted* counted = nullptr)
+			{
+				uint32_t id = parsed.loops.at(loop);
+				hoist_marks.emplace_back(hoisted_log.size(), constants_log.size());
+				if(unit.optimize_loops && entered(loop))
+					hoist(loop, counted);
+
+				size_t head = emit(Opcode::Loop, id);
+				function.loops[id] = static_cast<uint32_t>(head);
+				if(hoisted_log.empty() && constants_log.empty())
+					return head;
+
+				Entry entry{ id, head, {}, {} };
+				for(const Expr* expr : hoisted_log)
+					entry.values.emplace_back(expr, hoisted.at(expr));
+
+				for(uint64_t bits : constants_log)
+					entry.constants.emplace_back(bits, hoisted_constants.at(bits));
+
+				entries.push_back(std::move(entry));
+				return head;
+			}
+
+			// Lays out the entry another tier switches in at when a loop has
+			// hoisted values, its own or those of the loops around it: it
+			// recomputes them all from the locals and joins the loop, so the
+			// frame carries over as it is.
+			void reenter(const Entry& entry)
+			{
+				top = locals();
+				for(auto& [_, reg] : entry.values)
+					top = std::max(top, reg + 1);
+
+				for(auto& [_, reg] : entry.constants)
+					top = std::max(top, reg + 1);
+
+				max = std::max(max, top);
+				function.loops[entry.loop] = static_cast<uint32_t>(emit(Opcode::Loop, entry.loop));
+				for(auto& [bits, reg] : entry.constants)
+					emit(Opcode::LoadK, reg, constant(Value::from_bits(bits)));
+
+				for(auto& [expr, reg] : entry.values)
+					value(expr, reg);
+
+				emit(Opcode::Jump, 0, static_cast<uint32_t>(entry.head));
+			}
+
+			void hoist(const Block* loop, Counted* counted)
+			{
+				std::vector<bool> assigned(parsed.locals.size(), false);
+				assignments(parsed, loop, assigned);
+
+				// The condition of a While or For runs first thing on every
+				// entry, so what it computes may be hoisted even if it can
+				// fail: it would fail at the same point either way.
+				std::vector<const Expr*> found;
+				bool clean = true;
+				const std::string* cond = nullptr;
+				if(auto head = dynamic_cast<const While*>(loop))
+					cond = &head->cond;
+				else if(auto head = dynamic_cast<const For*>(loop))
+					cond = head->cond.empty() ? nullptr : &head->cond;
+
+				if(cond)
+					invariants(expression(*cond), true, clean, assigned, found);
+
+				each_expression(loop, [&](const Expr* expr)
+				{
+					bool unused = false;
+					invariants(expr, false, unused, assigned, found);
+				});
+
+				size_t count = 0;
+				for(const Expr* expr : found)
+				{
+					if(count == max_hoisted)
+						break;
+
+					Value folded;
+					if(constant_of(expr, folded))
+					{
+						if(!hoisted_constants.count(folded.bits))
+						{
+							hoist_constant(folded);
+							count++;
+						}
+					}
+					else if(!hoisted.count(expr))
+					{
+						uint32_t reg = alloc();
+						value(expr, reg);
+						hoisted[expr] = reg;
+						hoisted_log.push_back(expr);
+						count++;
+					}
+				}
+
+				if(counted)
+					reduce(static_cast<const For*>(loop), *counted);
+			}
+
+			uint32_t hoist_constant(Value value)
+			{
+				auto it = hoisted_constants.find(value.bits);
+				if(it != hoisted_constants.end())
+					return it->second;
+
+				uint32_t reg = alloc();
+				emit(Opcode::LoadK, reg, constant(value));
+				hoisted_constants[value.bits] = reg;
+				constants_log.push_back(value.bits);
+				return reg;
+			}
+
+			void release_hoisted()
+			{
+				auto [exprs, values] = hoist_marks.back();
+				hoist_marks.pop_back();
+				for(size_t i = exprs; i < hoisted_log.size(); i++)
+					hoisted.erase(hoisted_log[i]);
+
+				for(size_t i = values; i < constants_log.size(); i++)
+					hoisted_constants.erase(constants_log[i]);
+
+				hoisted_log.resize(exprs);
+				constants_log.resize(values);
+			}
+
+
+			// Calls `f` with every expression evaluated inside `block`, apart
+			// from the init of a For, which runs before its loop. Assignment
+			// targets are not evaluated, only the container and key of an
+			// indexed one.
+			template<typename F>
+			void each_expression(const Block* block, F f)
+			{
+				auto assigned = [&](const Expr* expr)
+				{
+					const Expr* target = expr->kind == ExprKind::Assign ? expr->args[0] : expr;
+					if(target->kind == ExprKind::Index)
+					{
+						f(target->args[0]);
+						f(target->args[1]);
+					}
+
+					if(expr->kind == ExprKind::Assign)
+						f(expr->args[1]);
+				};
+
+				auto body = [&](const Comp& body)
+				{
+					for(const Block* inner : body)
+					{
+						if(!known.dead.count(inner))
+							each_expression(inner, f);
+					}
+				};
+
+				if(auto assign = dynamic_cast<const Assign*>(block))
+				{
+					const Expr* expr = statement(assign->expr);
+					if(expr->kind == ExprKind::Assign)
+						assigned(expr);
+					else
+						f(expr);
+				}
+				else if(auto input = dynamic_cast<const Input*>(block))
+					assigned(target(input->expr));
+				else if(auto output = dynamic_cast<const Output*>(block))
+					f(expression(output->expr));
+				else if(auto made = dynamic_cast<const Channel*>(block))
+					f(expression(made->capacity));
+				else if(auto send = dynamic_cast<const Send*>(block))
+					f(expression(send->expr));
+				else if(auto receive = dynamic_cast<const Receive*>(block))
+					assigned(target(receive->expr));
+				else if(auto branch = dynamic_cast<const If*>(block))
+				{
+					f(expression(branch->cond));
+					body(branch->t);
+					body(branch->f);
+				}
+				else if(auto loop = dynamic_cast<const While*>(block))
+				{
+					f(expression(loop->cond));
+					body(loop->body);
+				}
+				else if(auto loop = dynamic_cast<const DoWhile*>(block))
+				{
+					body(loop->body);
+					f(expression(loop->cond));
+				}
+				else if(auto loop = dynamic_cast<const For*>(block))
+				{
+					if(!loop->cond.empty())
+						f(expression(loop->cond));
+
+					body(loop->body);
+					if(!loop->inc.empty())
+						assigned(statement(loop->inc));
+				}
+				else if(auto loop = dynamic_cast<const Foreach*>(block))
+				{
+					assigned(target(loop->var));
+					body(loop->body);
+				}
+				else if(auto branch = dynamic_cast<const Switch*>(block))
+				{
+					f(expression(branch->expr));
+					for(auto& [label, statements] : branch->cases)
+					{
+						if(label != "default")
+							f(expression(label));
+
+						body(statements);
+					}
+				}
+				else if(auto call = dynamic_cast<const Call*>(block))
+				{
+					for(const std::string& arg : call->args)
+						f(expression(arg));
+
+					if(!call->retvar.empty())
+						assigned(target(call->retvar));
+				}
+				else if(auto ret = dynamic_cast<const Return*>(block))
+				{
+					if(!ret->expr.empty())
+						f(expression(ret->expr));
+				}
+				else if(auto parallel = dynamic_cast<const Parallel*>(block))
+				{
+					for(const Comp& statements : parallel->branches)
+						body(statements);
+				}
+			}
+
+			// Collects the largest parts of `expr` that are worth computing
+			// once before the loop. Invariant parts qualify when they cannot
+			// fail, and anticipated ones also when nothing evaluated before
+			// them could have failed first.
+			void invariants(const Expr* expr, bool anticipated, bool& clean, const std::vector<bool>& assigned, std::vector<const Expr*>& out)
+			{
+				if(expr->kind == ExprKind::Local)
+					return;
+
+				// Propagation never folds what would fail.
+				Value folded;
+				if(invariant(expr, assigned) && (constant_of(expr, folded) || safe(expr) || (anticipated && clean)))
+				{
+					out.push_back(expr);
+					return;
+				}
+
+				bool logic = expr->kind == ExprKind::Binary && (expr->binary() == BinaryOp::And || expr->binary() == BinaryOp::Or);
+				for(size_t i = 0; i < expr->args.size(); i++)
+					invariants(expr->args[i], anticipated && !(logic && i == 1), clean, assigned, out);
+
+				if(!safe_op(expr))
+					clean = false;
+			}
+
+			bool invariant(const Expr* expr, const std::vector<bool>& assigned)
+			{
+				switch(expr->kind)
+				{
+					case ExprKind::Literal:
+						return true;
+
+					// A container can change under an unchanged local.
+					case ExprKind::Local:
+						return !assigned[parsed.local(expr->name)] && !(types[expr] & (types_of(Type::Array) | types_of(Type::Map)));
+
+					case ExprKind::Unary:
+					case ExprKind::Binary:
+						for(const Expr* arg : expr->args)
+						{
+							if(!invariant(arg, assigned))
+								return false;
+						}
+
+						return true;
+
+					default:
+						return false;
+				}
+			}
+
+			bool safe(const Expr* expr)
+			{
+				if(!safe_op(expr))
+					return false;
+
+				for(const Expr* arg : expr->args)
+				{
+					if(!safe(arg))
+						return false;
+				}
+
+				return true;
+			}
+
+			// Whether the operation itself cannot fail with the operand types
+			// inference proved; ints that overflow become doubles, but an int
+			// may still be divided by zero.
+			bool safe_op(const Expr* expr)
+			{
+				switch(expr->kind)
+				{
+					case ExprKind::Literal:
+					case ExprKind::Local:
+					case ExprKind::Global:
+					case ExprKind::Array:
+					case ExprKind::Map:
+						return true;
+
+					case ExprKind::Unary:
+						return expr->unary() == UnaryOp::Not || number_types_only(types[expr->args[0]]);
+
+					case ExprKind::Binary:
+					{
+						Types a = types[expr->args[0]], b = types[expr->args[1]];
+						bool numbers = number_types_only(a) && number_types_only(b);
+						bool doubles = numbers && (only(a, Type::Double) || only(b, Type::Double));
+						switch(expr->binary())
+						{
+							case BinaryOp::And:
+							case BinaryOp::Or:
+							case BinaryOp::Eq:
+							case BinaryOp::Ne:
+								return true;
+
+							case BinaryOp::Lt:
+							case BinaryOp::Le:
+							case BinaryOp::Gt:
+							case BinaryOp::Ge:
+								return (number_types_only(a) && number_types_only(b)) || (only(a, Type::String) && only(b, Type::String));
+
+							case BinaryOp::Add:
+								return numbers || only(a, Type::String) || only(b, Type::String);
+
+							case BinaryOp::Sub:
+							case BinaryOp::Mul:
+								return numbers;
+
+							default:
+								return doubles;
+						}
+					}
+
+					default:
+						return false;
+				}
+			}
+
+			bool constant_of(const Expr* expr, Value& out)
+			{
+				if(expr->kind == ExprKind::Literal)
+				{
+					out = expr->value;
+					return true;
+				}
+
+				return known.value(expr, out);
+			}
+
+			bool constant_int(const Expr* expr, int64_t& out)
+			{
+				Value value;
+				if(!constant_of(expr, value) || !value.is_int())
+					return false;
+
+				out = value.as_int();
+				return true;
+			}
+
+			// Recognizes `for(v = a; v < b; v += c)` and its variations with
+			// constant a, b and c, and a body that leaves v alone.
+			bool counted_loop(const For* loop, Counted& counted)
+			{
+				if(!unit.optimize_loops || loop->init.empty() || loop->cond.empty() || loop->inc.empty())
+					return false;
+
+				const Expr* init = statement(loop->init);
+				const Expr* cond = expression(loop->cond);
+				const Expr* inc = statement(loop->inc);
+				if(init->kind != ExprKind::Assign || init->args[0]->kind != ExprKind::Local)
+					return false;
+
+				const std::string& name = init->args[0]->name;
+				auto is_var = [&](const Expr* expr) { return expr->kind == ExprKind::Local && expr->name == name; };
+
+				int64_t start, bound, step;
+				if(!constant_int(init->args[1], start) || cond->kind != ExprKind::Binary || !is_var(cond->args[0]) || !constant_int(cond->args[1], bound))
+					return false;
+
+				if(inc->kind != ExprKind::Assign || !is_var(inc->args[0]) || inc->args[1]->kind != ExprKind::Binary)
+					return false;
+
+				const Expr* update = inc->args[1];
+				if(!is_var(update->args[0]) || !constant_int(update->args[1], step))
+					return false;
+
+				if(update->binary() == BinaryOp::Sub)
+					step = -step;
+				else if(update->binary() != BinaryOp::Add)
+					return false;
+
+				std::vector<bool> assigned(parsed.locals.size(), false);
+				for(const Block* block : loop->body)
+					assignments(parsed, block, assigned);
+
+				counted.reg = local(name);
+				if(step == 0 || assigned[counted.reg])
+					return false;
+
+				int64_t trips = 0;
+				switch(cond->binary())
+				{
+					case BinaryOp::Lt:
+						trips = step > 0 && start < bound ? (bound - start + step - 1) / step : 0;
+						break;
+
+					case BinaryOp::Le:
+						trips = step > 0 && start <= bound ? (bound - start) / step + 1 : 0;
+						break;
+
+					case BinaryOp::Gt:
+						trips = step < 0 && start > bound ? (start - bound - step - 1) / -step : 0;
+						break;
+
+					case BinaryOp::Ge:
+						trips = step < 0 && start >= bound ? (start - bound) / -step + 1 : 0;
+						break;
+
+					case BinaryOp::Ne:
+						trips = (bound - start) % step == 0 && (bound - start) / step > 0 ? (bound - start) / step : 0;
+						break;
+
+					default:
+						break;
+				}
+
+				// The variable ends one step past its last value, which must
+				// not overflow either.
+				if(trips <= 0 || !Value::fits_int(start + trips * step))
+					return false;
+
+				counted.start = start;
+				counted.step = step;
+				counted.trips = trips;
+				counted.last = start + (trips - 1) * step;
+
+				size_t size = 0;
+				counted.unroll = trips >= 2 * unroll && entered(loop) && straight(loop->body, false, size);
+				return true;
+			}
+
+			// Whether a body can be laid out several times in a row: no inner
+			// loops, nothing that leaves the iteration early and not too big.
+			bool straight(const Comp& body, bool in_switch, size_t& size)
+			{
+				for(const Block* block : body)
+				{
+					size++;
+					if(dynamic_cast<const Continue*>(block) || (!in_switch && dynamic_cast<const Break*>(block)))
+						return false;
+
+					if(dynamic_cast<const While*>(block) || dynamic_cast<const DoWhile*>(block) || dynamic_cast<const For*>(block) || dynamic_cast<const Foreach*>(block)
+						|| dynamic_cast<const Parallel*>(block))
+						return false;
+
+					if(auto branch = dynamic_cast<const If*>(block))
+					{
+						if(!straight(branch->t, in_switch, size) || !straight(branch->f, in_switch, size))
+							return false;
+					}
+					else if(auto branch = dynamic_cast<const Switch*>(block))
+					{
+						for(auto& [_, statements] : branch->cases)
+						{
+							if(!straight(statements, true, size))
+								return false;
+						}
+					}
+				}
+
+				return size <= 24;
+			}
+
+			// Matches `v * c`, `c * v` and either plus or minus a constant.
+			bool linear(const Expr* expr, uint32_t reg, int64_t& scale, int64_t& offset)
+			{
+				auto is_var = [&](const Expr* e) { return e->kind == ExprKind::Local && local(e->name) == reg; };
+				auto product = [&](const Expr* e)
+				{
+					if(e->kind != ExprKind::Binary || e->binary() != BinaryOp::Mul)
+						return false;
+
+					return (is_var(e->args[0]) && constant_int(e->args[1], scale)) || (constant_int(e->args[0], scale) && is_var(e->args[1]));
+				};
+
+				offset = 0;
+				if(product(expr))
+					return true;
+
+				if(expr->kind != ExprKind::Binary || (expr->binary() != BinaryOp::Add && expr->binary() != BinaryOp::Sub))
+					return false;
+
+				if(product(expr->args[0]) && constant_int(expr->args[1], offset))
+				{
+					if(expr->binary() == BinaryOp::Sub)
+						offset = -offset;
+
+					return true;
+				}
+
+				return expr->binary() == BinaryOp::Add && constant_int(expr->args[0], offset) && product(expr->args[1]);
+			}
+
+			// Replaces linear functions of a counted loop's variable in its
+			// body by registers that grow along with it. Every value they take,
+			// up to the one after the last step, must fit, so the additions
+			// can never overflow where the products would not have.
+			void reduce(const For* loop, Counted& counted)
+			{
+				std::vector<std::pair<std::pair<int64_t, int64_t>, uint32_t>> found;
+				std::function<void(const Expr*)> visit = [&](const Expr* expr)
+				{
+					int64_t scale, offset;
+					if(!hoisted.count(expr) && linear(expr, counted.reg, scale, offset))
+					{
+						int64_t end = counted.start + counted.trips * counted.step;
+						int64_t a, b, growth;
+						bool fits = !__builtin_mul_overflow(counted.start, scale, &a) && !__builtin_mul_overflow(end, scale, &b)
+							&& !__builtin_mul_overflow(scale, counted.step, &growth)
+							&& Value::fits_int(a) && Value::fits_int(b) && Value::fits_int(a + offset) && Value::fits_int(b + offset) && Value::fits_int(growth);
+
+						if(fits)
+						{
+							uint32_t reg = any;
+							for(auto& [key, existing] : found)
+							{
+								if(key == std::make_pair(scale, offset))
+									reg = existing;
+							}
+
+							if(reg == any)
+							{
+								reg = alloc();
+								value(expr, reg);
+								found.push_back({ { scale, offset }, reg });
+								counted.derived.emplace_back(reg, hoist_constant(Value::integer(growth)));
+							}
+
+							hoisted[expr] = reg;
+							hoisted_log.push_back(expr);
+							return;
+						}
+					}
+
+					for(const Expr* arg : expr->args)
+						visit(arg);
+				};
+
+				for(const Block* block : loop->body)
+				{
+					if(!known.dead.count(block))
+						each_expression(block, visit);
+				}
+
+				if(counted.unroll)
+					counted.limit = hoist_constant(Value::integer(counted.last - (unroll - 1) * counted.step));
+			}
+
+			// Compiles a call to a small function without loops or Parallel
+			// blocks as the body of the callee, its locals in registers above
+			// this frame's, so no frame is made for it. Arguments known to be
+			// constant specialize that copy of the body. Sets `done` when the
+			// call was inlined.
+			bool splice(const Call* call, uint32_t callee, const Expr* retvar, bool& done)
+			{
+				done = false;
+				const ParsedFunction& body = unit.parsed[callee];
+				if(!unit.inline_calls || !body.body || !body.loops.empty() || body.parallel || callers.size() > max_inline_depth || here() > max_inlined_code)
+					return true;
+
+				if(std::find(callers.begin(), callers.end(), callee) != callers.end())
+					return true;
+
+				std::vector<const Expr*> args;
+				std::vector<std::optional<uint64_t>> key;
+				bool specialized = false;
+				for(const std::string& arg : call->args)
+				{
+					Expr* expr = expression(arg);
+					if(!expr)
+						return false;
+
+					Value folded;
+					args.push_back(expr);
+					key.push_back(constant_of(expr, folded) ? std::optional<uint64_t>(folded.bits) : std::nullopt);
+					specialized = specialized || key.back();
+				}
+
+				const FunctionConstants* facts = &unit.propagation.functions[callee];
+				if(specialized)
+				{
+					auto it = unit.specialized.find({ callee, key });
+					if(it == unit.specialized.end())
+					{
+						std::vector<std::optional<Value>> values;
+						for(const std::optional<uint64_t>& bits : key)
+							values.push_back(bits ? std::optional<Value>(Value::from_bits(*bits)) : std::nullopt);
+
+						it = unit.specialized.emplace(std::make_pair(callee, key), unit.propagation.specialize(body, values)).first;
+					}
+
+					facts = &it->second;
+				}
+
+				if(statements(*body.body, *facts) > (hot || enclosing_loop() ? hot_inline_size : inline_size))
+					return true;
+
+				// A body the compiler rejects is left to the call, which
+				// reports it under the callee's name.
+				size_t start = here();
+				uint32_t generic_ops = function.generic_ops, specialized_ops = function.specialized_ops;
+				size_t switches = function.switches.size();
+				size_t ranges = function.inlined.size(), inlined = unit.inlined, specialized_calls = unit.specialized_calls, tail_calls = unit.tail_calls;
+
+				// A parameter the body never assigns is read where the
+				// argument already is; nothing in the body can change that.
+				std::vector<bool> assigned(body.locals.size(), false);
+				for(const Block* block : *body.body)
+					assignments(body, block, assigned);
+
+				uint32_t window = top;
+				top += body.registers();
+				max = std::max(max, top);
+				std::vector<uint32_t> registers(body.locals.size());
+				for(uint32_t local = 0; local < body.locals.size(); local++)
+					registers[local] = window + local;
+
+				for(uint32_t k = 0; k < args.size(); k++)
+					registers[k] = assigned[k] ? value(args[k], window + k) : value(args[k]);
+
+				for(uint32_t local = static_cast<uint32_t>(args.size()); local < body.locals.size(); local++)
+				{
+					if(facts->unassigned.empty() || facts->unassigned[local])
+						emit(Opcode::LoadK, registers[local], constant(Value::nil()));
+				}
+
+				uint32_t result = retvar && retvar->kind == ExprKind::Local ? local(retvar->name) : window;
+				size_t begin = here();
+				std::vector<size_t> exits;
+				FunctionCompiler inner(*this, callee, *facts, window, std::move(registers), result, exits);
+				bool ok = inner.comp(*body.body);
+				constants = std::move(inner.constants);
+				max = inner.max;
+				if(!ok)
+				{
+					function.code.erase(function.code.begin() + start, function.code.end());
+					function.generic_ops = generic_ops;
+					function.specialized_ops = specialized_ops;
+					function.inlined.resize(ranges);
+					function.switches.resize(switches);
+					unit.inlined = inlined;
+					unit.specialized_calls = specialized_calls;
+					unit.tail_calls = tail_calls;
+					top = window;
+					return true;
+				}
+
+				// A body that ends in a return needs no jump to the end.
+				if(!exits.empty() && exits.back() == here() - 1 && returns_last(*body.body, *facts))
+				{
+					function.code.pop_back();
+					exits.pop_back();
+				}
+				else
+					emit(Opcode::LoadK, result, constant(Value::nil()));
+
+				for(size_t exit : exits)
+					patch(exit, here());
+
+				function.inlined.push_back(Inlined{ static_cast<uint32_t>(begin), static_cast<uint32_t>(here()), module.functions[callee].name });
+				if(retvar && retvar->kind != ExprKind::Local)
+					store(retvar, window);
+
+				unit.inlined++;
+				if(specialized)
+					unit.specialized_calls++;
+
+				done = true;
+				return true;
+			}
+
+			// Statements of a body without loops that propagation left alive.
+			size_t statements(const Comp& body, const FunctionConstants& facts)
+			{
+				size_t count = 0;
+				for(const Block* block : body)
+				{
+					if(facts.dead.count(block) || dynamic_cast<const Comment*>(block))
+						continue;
+
+					count++;
+					if(auto branch = dynamic_cast<const If*>(block))
+						count += statements(branch->t, facts) + statements(branch->f, facts);
+					else if(auto branch = dynamic_cast<const Switch*>(block))
+					{
+						for(auto& [_, statements] : branch->cases)
+							count += this->statements(statements, facts);
+					}
+				}
+
+				return count;
+			}
+
+			bool returns_last(const Comp& body, const FunctionConstants& facts)
+			{
+				for(auto it = body.rbegin(); it != body.rend(); it++)
+				{
+					if(!facts.dead.count(*it) && !dynamic_cast<const Comment*>(*it))
+						return dynamic_cast<const Return*>(*it) != nullptr;
+				}
+
+				return false;
+			}
+
+			// Runs the increment of a For, moving every strength-reduced
+			// register along with the variable.
+			bool step(const For* loop, const Counted* counted)
+			{
+				if(loop->inc.empty())
+					return true;
+
+				Expr* inc = statement(loop->inc);
+				if(!inc)
+					return false;
+
+				effect(inc);
+				if(counted)
+				{
+					for(auto [reg, growth] : counted->derived)
+						emit(Opcode::AddI, reg, reg, growth);
+				}
+
+				return true;
+			}
+
+			Expr* expression(const std::string& source)
+			{
+				return parsed[source];
+			}
+
+			Expr* statement(const std::string& source)
+			{
+				return parsed[source];
+			}
+
+			Expr* target(const std::string& source)
+			{
+				return parsed[source];
+			}
+
+			// Evaluates `expr` and returns the register holding the result.
+			// Locals are read in place; anything else lands in `dst` when it is
+			// given, or in a fresh temporary.
+			uint32_t value(const Expr* expr, uint32_t dst = any)
+			{
+				auto reused = hoisted.find(expr);
+				if(reused != hoisted.end())
+					return copy(reused->second, dst);
+
+				// A local is read in place, which costs less than its constant.
+				Value folded;
+				if(expr->kind == ExprKind::Literal || (expr->kind != ExprKind::Local && known.value(expr, folded)))
+				{
+					if(expr->kind == ExprKind::Literal)
+						folded = expr->value;
+
+					auto loaded = hoisted_constants.find(folded.bits);
+					if(loaded != hoisted_constants.end())
+						return copy(loaded->second, dst);
+
+					uint32_t reg = dst != any ? dst : alloc();
+					emit(Opcode::LoadK, reg, constant(folded));
+					return reg;
+				}
+
+				switch(expr->kind)
+				{
+					case ExprKind::Local:
+						return copy(local(expr->name), dst);
+
+					case ExprKind::Global:
+					{
+						uint32_t reg = dst != any ? dst : alloc();
+						emit(Opcode::GetGlobal, reg, global(expr->name));
+						return reg;
+					}
+
+					case ExprKind::Unary:
+					{
+						uint32_t mark = top;
+						uint32_t operand = value(expr->args[0]);
+						top = mark;
+
+						uint32_t reg = dst != any ? dst : alloc();
+						emit(expr->unary() == UnaryOp::Neg ? Opcode::Neg : Opcode::Not, reg, operand);
+						return reg;
+					}
+
+					case ExprKind::Binary:
+					{
+						BinaryOp op = expr->binary();
+						if(op == BinaryOp::And || op == BinaryOp::Or)
+						{
+							// Short-circuit into a private temporary: writing `dst`
+							// early would clobber it if the right side reads it.
+							uint32_t reg = alloc();
+							value(expr->args[0], reg);
+							size_t skip = emit(op == BinaryOp::And ? Opcode::JumpIfNot : Opcode::JumpIf, reg);
+							value(expr->args[1], reg);
+							patch(skip, here());
+							top = reg + 1;
+
+							if(dst != any)
+							{
+								emit(Opcode::Move, dst, reg);
+								top = reg;
+								return dst;
+							}
+
+							return reg;
+						}
+
+						uint32_t mark = top;
+						uint32_t lhs = value(expr->args[0]);
+						uint32_t rhs = value(expr->args[1]);
+						top = mark;
+
+						if(op == BinaryOp::Gt || op == BinaryOp::Ge)
+						{
+							std::swap(lhs, rhs);
+							op = op == BinaryOp::Gt ? BinaryOp::Lt : BinaryOp::Le;
+						}
+
+						Opcode opcode = specialize(op, types[expr->args[0]], types[expr->args[1]]);
+						if(opcode == generic(op))
+							function.generic_ops++;
+						else
+							function.specialized_ops++;
+
+						uint32_t reg = dst != any ? dst : alloc();
+						emit(opcode, reg, lhs, rhs);
+						return reg;
+					}
+
+					case ExprKind::Index:
+					{
+						uint32_t mark = top;
+						uint32_t container = value(expr->args[0]);
+						uint32_t key = value(expr->args[1]);
+						top = mark;
+
+						uint32_t reg = dst != any ? dst : alloc();
+						emit(Opcode::Index, reg, container, key);
+						return reg;
+					}
+
+					case ExprKind::Array:
+					case ExprKind::Map:
+					case ExprKind::Builtin:
+					{
+						// A push onto a container an enclosing split loop
+						// defers the stores to waits as they do.
+						if(expr->kind == ExprKind::Builtin && expr->builtin() == Builtin::Push && expr->args[0]->kind == ExprKind::Local
+							&& setter(local(expr->args[0]->name)) == Opcode::Defer)
+						{
+							uint32_t mark = top;
+							uint32_t item = value(expr->args[1]);
+							emit(Opcode::DeferPush, local(expr->args[0]->name), 0, item);
+							top = mark;
+
+							uint32_t reg = dst != any ? dst : alloc();
+							emit(Opcode::LoadK, reg, constant(Value::nil()));
+							return reg;
+						}
+
+						uint32_t base = top;
+						for(const Expr* arg : expr->args)
+							value(arg, alloc());
+
+						uint32_t count = static_cast<uint32_t>(expr->args.size());
+						top = base;
+
+						if(expr->kind == ExprKind::Builtin)
+						{
+							alloc();
+							emit(Opcode::Builtin, base, expr->op, count);
+							if(dst != any)
+							{
+								emit(Opcode::Move, dst, base);
+								top = base;
+								return dst;
+							}
+
+							return base;
+						}
+
+						uint32_t reg = dst != any ? dst : alloc();
+						if(expr->kind == ExprKind::Array)
+							emit(Opcode::NewArray, reg, base, count);
+						else
+							emit(Opcode::NewMap, reg, base, count / 2);
+
+						return reg;
+					}
+
+					case ExprKind::Literal:
+					case ExprKind::Assign:
+						break;
+				}
+
+				return dst;
+			}
+
+			// Returns `reg`, moved into `dst` when that is given.
+			uint32_t copy(uint32_t reg, uint32_t dst)
+			{
+				if(dst == any || dst == reg)
+					return reg;
+
+				emit(Opcode::Move, dst, reg);
+				return dst;
+			}
+
+			// Stores into a container an enclosing split loop defers the
+			// stores to are Defer ops.
+			Opcode setter(uint32_t container) const
+			{
+				return std::find(deferring.begin(), deferring.end(), container) != deferring.end() ? Opcode::Defer : Opcode::SetIndex;
+			}
+
+			// Stores the value of `expr` into an assignable target.
+			void assign(const Expr* target, const Expr* expr)
+			{
+				if(target->kind == ExprKind::Local)
+				{
+					value(expr, local(target->name));
+					return;
+				}
+
+				uint32_t mark = top;
+				if(target->kind == ExprKind::Global)
+				{
+					uint32_t reg = value(expr);
+					emit(Opcode::SetGlobal, global(target->name), reg);
+				}
+				else
+				{
+					uint32_t container = value(target->args[0]);
+					uint32_t key = value(target->args[1]);
+					uint32_t reg = value(expr);
+					emit(setter(container), container, key, reg);
+				}
+
+				top = mark;
+			}
+
+			// Stores a register into an assignable target.
+			void store(const Expr* target, uint32_t reg)
+			{
+				if(target->kind == ExprKind::Local)
+				{
+					uint32_t dst = local(target->name);
+					if(dst != reg)
+						emit(Opcode::Move, dst, reg);
+				}
+				else if(target->kind == ExprKind::Global)
+					emit(Opcode::SetGlobal, global(target->name), reg);
+				else
+				{
+					uint32_t mark = top;
+					uint32_t container = value(target->args[0]);
+					uint32_t key = value(target->args[1]);
+					emit(setter(container), container, key, reg);
+					top = mark;
+				}
+			}
+
+			void effect(const Expr* expr)
+			{
+				if(expr->kind == ExprKind::Assign)
+					assign(expr->args[0], expr->args[1]);
+				else
+					value(expr);
+			}
+
+			// Whether running `block` can neither change anything nor fail:
+			// a comment, a block that never runs, an If or Switch with
+			// nothing to run but conditions that cannot fail, or a Parallel
+			// with nothing to run. When counting, every branch runs for its
+			// counts.
+			bool idle(const Block* block)
+			{
+				if(dynamic_cast<const Comment*>(block) || known.dead.count(block) || parsed.unreachable.count(block))
+					return true;
+
+				if(unit.instrument)
+					return false;
+
+				if(auto branch = dynamic_cast<const If*>(block))
+					return !fallible(expression(branch->cond)) && idle(branch->t) && idle(branch->f);
+
+				if(auto branch = dynamic_cast<const Switch*>(block))
+				{
+					if(fallible(expression(branch->expr)))
+						return false;
+
+					// A Break right in a case only leaves the Switch.
+					for(auto& [label, statements] : branch->cases)
+					{
+						if(label != "default" && fallible(expression(label)))
+							return false;
+
+						for(const Block* nested : statements)
+						{
+							if(!dynamic_cast<const Break*>(nested) && !idle(nested))
+								return false;
+						}
+					}
+
+					return true;
+				}
+
+				if(auto parallel = dynamic_cast<const Parallel*>(block))
+					return std::all_of(parallel->branches.begin(), parallel->branches.end(), [this](const Comp& branch) { return idle(branch); });
+
+				return false;
+			}
+
+			bool idle(const Comp& body)
+			{
+				return std::all_of(body.begin(), body.end(), [this](const Block* block) { return idle(block); });
+			}
+
+			// Whether evaluating `expr` could fail at run time. Comparing for
+			// equality, negating a truth value and the logical operators
+			// never fail themselves.
+			bool fallible(const Expr* expr)
+			{
+				if(!expr)
+					return true;
+
+				if(known.values.count(expr))
+					return false;
+
+				bool operands = std::any_of(expr->args.begin(), expr->args.end(), [this](const Expr* arg) { return fallible(arg); });
+				switch(expr->kind)
+				{
+					case ExprKind::Literal:
+					case ExprKind::Local:
+					case ExprKind::Global:
+						return false;
+
+					case ExprKind::Unary:
+						return expr->unary() != UnaryOp::Not || operands;
+
+					case ExprKind::Binary:
+					{
+						BinaryOp op = expr->binary();
+						return !(op == BinaryOp::Eq || op == BinaryOp::Ne || op == BinaryOp::And || op == BinaryOp::Or) || operands;
+					}
+
+					case ExprKind::Array:
+					case ExprKind::Map:
+						return operands;
+
+					default:
+						return true;
+				}
+			}
+
+			// Whether `source` has a value that constant propagation proved.
+			bool known_truth(const std::string& source, bool& truth)
+			{
+				Value folded;
+				if(!known.value(expression(source), folded))
+					return false;
+
+				truth = truthy(folded);
+				return true;
+			}
+
+			// Emits a jump taken when `cond` is `truth` and returns it for
+			// patching.
+			bool branch_on(const std::string& source, bool truth, size_t& jump)
+			{
+				Expr* cond = expression(source);
+				if(!cond)
+					return false;
+
+				uint32_t mark = top;
+				uint32_t reg = value(cond);
+				top = mark;
+				jump = emit(truth ? Opcode::JumpIf : Opcode::JumpIfNot, reg);
+				return true;
+			}
+
+			// Counts `branch` going its `way` when instrumenting.
+			void count(const Block* branch, uint32_t way)
+			{
+				if(unit.instrument)
+					emit(Opcode::Count, 0, parsed.branches.at(branch) + way);
+			}
+
+			uint64_t taken(const Block* branch, uint32_t way) const
+			{
+				return counts ? (*counts)[parsed.branches.at(branch) + way] : 0;
+			}
+
+			// Whether the profile saw an If go its `way` rarely enough to
+			// move that side out of line.
+			bool rare(const Block* branch, uint32_t way) const
+			{
+				uint64_t total = taken(branch, 0) + taken(branch, 1);
+				return total >= min_profile && taken(branch, way) * cold_ratio <= total;
+			}
+
+			// Whether the profile, if any, leaves open that `loop` runs its
+			// body.
+			bool entered(const Block* loop) const
+			{
+				if(!counts || !parsed.branches.count(loop))
+					return true;
+
+				return taken(loop, 0) || taken(loop, 1) < min_profile;
+			}
+
+			// Whether a side of an If can be compiled after the return: it is
+			// not inlined, and nothing in it jumps to the code around it.
+			bool outlinable(const Comp& body) const
+			{
+				return callers.size() == 1 && !body.empty() && !escapes(body);
+			}
+
+			bool comp(const Comp& body)
+			{
+				for(size_t k = 0; k < body.size(); k++)
+				{
+					const Block* block = body[k];
+					if(idle(block))
+						continue;
+
+					uint32_t mark = top;
+					size_t ret = tail_return(body, k);
+					tail = ret != any;
+					if(!generate(block))
+						return false;
+
+					// The Return after a tail call is never reached.
+					if(tail)
+						k = ret;
+
+					tail = false;
+					top = std::max<uint32_t>(mark, locals());
+				}
+
+				return true;
+			}
+
+			// Where the Return is that gives back what the call at `k` in
+			// `body` stores in a local, when nothing that runs comes between.
+			size_t tail_return(const Comp& body, size_t k)
+			{
+				auto call = dynamic_cast<const Call*>(body[k]);
+				if((returns && !tail_body) || !call || call->retvar.empty())
+					return any;
+
+				size_t next = k + 1;
+				while(next < body.size() && idle(body[next]))
+					next++;
+
+				auto ret = next < body.size() ? dynamic_cast<const Return*>(body[next]) : nullptr;
+				if(!ret || ret->expr.empty())
+					return any;
+
+				const Expr* retvar = target(call->retvar);
+				const Expr* expr = expression(ret->expr);
+				if(!retvar || !expr || retvar->kind != ExprKind::Local || expr->kind != ExprKind::Local || retvar->name != expr->name)
+					return any;
+
+				return next;
+			}
+
+			bool loop_body(const Comp& body, Loop& loop)
+			{
+				loops.push_back(Loop{ {}, {}, true });
+				bool ok = comp(body);
+				loop = std::move(loops.back());
+				loops.pop_back();
+				return ok;
+			}
+
+			bool generate(const Block* block)
+			{
+				if(auto assign = dynamic_cast<const Assign*>(block))
+				{
+					Expr* expr = statement(assign->expr);
+					if(!expr)
+						return false;
+
+					effect(expr);
+					return true;
+				}
+
+				if(auto input = dynamic_cast<const Input*>(block))
+				{
+					Expr* dst = target(input->expr);
+					if(!dst)
+						return false;
+
+					if(dst->kind == ExprKind::Local)
+						emit(Opcode::Input, local(dst->name));
+					else
+					{
+						uint32_t reg = alloc();
+						emit(Opcode::Input, reg);
+						store(dst, reg);
+					}
+
+					return true;
+				}
+
+				if(auto output = dynamic_cast<const Output*>(block))
+				{
+					Expr* expr = expression(output->expr);
+					if(!expr)
+						return false;
+
+					emit(Opcode::Output, value(expr), output->newline ? 1 : 0);
+					return true;
+				}
+
+				if(auto made = dynamic_cast<const Channel*>(block))
+				{
+					Expr* capacity = expression(made->capacity);
+					if(!capacity)
+						return false;
+
+					emit(Opcode::Channel, value(capacity), channel(made->name));
+					return true;
+				}
+
+				if(auto send = dynamic_cast<const Send*>(block))
+				{
+					Expr* expr = expression(send->expr);
+					if(!expr)
+						return false;
+
+					emit(Opcode::Send, value(expr), channel(send->channel));
+					return true;
+				}
+
+				if(auto receive = dynamic_cast<const Receive*>(block))
+				{
+					Expr* dst = target(receive->expr);
+					if(!dst)
+						return false;
+
+					if(dst->kind == ExprKind::Local)
+						emit(Opcode::Receive, local(dst->name), channel(receive->channel));
+					else
+					{
+						uint32_t reg = alloc();
+						emit(Opcode::Receive, reg, channel(receive->channel));
+						store(dst, reg);
+					}
+
+					return true;
+				}
+
+				if(auto branch = dynamic_cast<const If*>(block))
+				{
+					bool truth;
+					if(known_truth(branch->cond, truth))
+						return comp(truth ? branch->t : branch->f);
+
+					// With nothing to run on either side, all that is left
+					// is what the condition can fail on.
+					bool skip_then = idle(branch->t), skip_else = idle(branch->f);
+					if(skip_then && skip_else && !unit.instrument)
+					{
+						Expr* cond = expression(branch->cond);
+						if(!cond)
+							return false;
+
+						uint32_t mark = top;
+						value(cond);
+						top = mark;
+						return true;
+					}
+
+					// The side the profile saw taken more often falls
+					// through, and one it hardly ever saw goes after the
+					// return. An empty side never needs a jump over it.
+					bool outline_then = rare(block, 0) && outlinable(branch->t);
+					bool outline_else = !outline_then && rare(block, 1) && outlinable(branch->f);
+					uint32_t first = outline_then || (skip_then && !unit.instrument) || (taken(block, 1) > taken(block, 0) && !skip_else) ? 1 : 0;
+					const Comp& ahead = first ? branch->f : branch->t;
+					const Comp& aside = first ? branch->t : branch->f;
+
+					size_t to_aside;
+					if(!branch_on(branch->cond, first == 1, to_aside))
+						return false;
+
+					count(block, first);
+					if(!comp(ahead))
+						return false;
+
+					if(first ? outline_then : outline_else)
+					{
+						outlined.push_back(Outlined{ block, 1 - first, to_aside, here(), top, hoisted, hoisted_constants, hoisted_log, constants_log });
+						return true;
+					}
+
+					if(idle(aside) && !unit.instrument)
+					{
+						patch(to_aside, here());
+						return true;
+					}
+
+					size_t to_end = emit(Opcode::Jump);
+					patch(to_aside, here());
+					count(block, 1 - first);
+					if(!comp(aside))
+						return false;
+
+					patch(to_end, here());
+					return true;
+				}
+
+				if(auto loop = dynamic_cast<const While*>(block))
+				{
+					bool truth;
+					if(known_truth(loop->cond, truth) && !truth)
+						return true;
+
+					size_t head = open_loop(loop);
+					size_t exit;
+					if(!branch_on(loop->cond, false, exit))
+						return false;
+
+					count(loop, 0);
+					Loop info;
+					if(!loop_body(loop->body, info))
+						return false;
+
+					emit(Opcode::Jump, 0, static_cast<uint32_t>(head));
+					patch(exit, here());
+					count(loop, 1);
+					close(info, here(), head);
+					return true;
+				}
+
+				if(auto loop = dynamic_cast<const DoWhile*>(block))
+				{
+					size_t head = open_loop(loop);
+					Loop info;
+					if(!loop_body(loop->body, info))
+						return false;
+
+					size_t cond = here();
+					Expr* expr = expression(loop->cond);
+					if(!expr)
+						return false;
+
+					uint32_t mark = top;
+					uint32_t reg = value(expr);
+					top = mark;
+					if(unit.instrument)
+					{
+						size_t exit = emit(Opcode::JumpIfNot, reg);
+						count(loop, 0);
+						emit(Opcode::Jump, 0, static_cast<uint32_t>(head));
+						patch(exit, here());
+						count(loop, 1);
+					}
+					else
+						emit(Opcode::JumpIf, reg, static_cast<uint32_t>(head));
+
+					close(info, here(), cond);
+					return true;
+				}
+
+				if(auto loop = dynamic_cast<const For*>(block))
+				{
+					if(!loop->init.empty())
+					{
+						Expr* init = statement(loop->init);
+						if(!init)
+							return false;
+
+						uint32_t mark = top;
+						effect(init);
+						top = mark;
+					}
+
+					bool truth = false;
+					if(!loop->cond.empty() && known_truth(loop->cond, truth) && !truth)
+						return true;
+
+					Counted counted;
+					bool is_counted = counted_loop(loop, counted);
+					size_t head = open_loop(loop, is_counted ? &counted : nullptr);
+					if(is_counted && counted.unroll)
+					{
+						// While a whole unrolled iteration remains, the body
+						// runs that many times in a row without tests; the
+						// rest go through the loop as written.
+						uint32_t mark = top;
+						uint32_t test = alloc();
+						if(counted.step > 0)
+							emit(Opcode::LeI, test, counted.reg, counted.limit);
+						else
+							emit(Opcode::LeI, test, counted.limit, counted.reg);
+
+						size_t rest = emit(Opcode::JumpIfNot, test);
+						top = mark;
+						Loop info;
+						for(int64_t i = 0; i < unroll; i++)
+						{
+							count(loop, 0);
+							if(!loop_body(loop->body, info) || !step(loop, &counted))
+								return false;
+						}
+
+						emit(Opcode::Jump, 0, static_cast<uint32_t>(head));
+						patch(rest, here());
+						head = here();
+					}
+
+					size_t exit = any;
+					if(!loop->cond.empty() && !truth)
+					{
+						if(!branch_on(loop->cond, false, exit))
+							return false;
+
+						count(loop, 0);
+					}
+
+					Loop info;
+					if(!loop_body(loop->body, info))
+						return false;
+
+					size_t next = here();
+					if(!step(loop, is_counted ? &counted : nullptr))
+						return false;
+
+					emit(Opcode::Jump, 0, static_cast<uint32_t>(head));
+					if(exit != any)
+					{
+						patch(exit, here());
+						count(loop, 1);
+					}
+
+					close(info, here(), next);
+					return true;
+				}
+
+				if(auto loop = dynamic_cast<const Foreach*>(block))
+				{
+					Expr* var = target(loop->var);
+					Expr* iter = var ? expression(loop->iter) : nullptr;
+					if(!iter)
+						return false;
+
+					uint32_t collection = offset + parsed.iterator(loop);
+					value(iter, collection);
+					emit(Opcode::LoadK, collection + 1, constant(Value::integer(0)));
+
+					// A split loop's slices start over from the values
+					// hoisted before it.
+					const auto& independent = unit.independence.functions[callers.back()];
+					auto split = frame.empty() ? independent.find(loop) : independent.end();
+					size_t table = function.splits.size();
+					size_t marked = deferring.size();
+					if(split != independent.end())
+					{
+						SplitTable slices;
+						slices.start = static_cast<uint32_t>(emit(Opcode::Split, collection, static_cast<uint32_t>(table)) + 1);
+						for(const std::string& name : split->second.deferred)
+							slices.deferred.push_back(local(name));
+
+						for(const std::string& name : split->second.assigned)
+							slices.writes.push_back(local(name));
+
+						deferring.insert(deferring.end(), slices.deferred.begin(), slices.deferred.end());
+						function.splits.push_back(std::move(slices));
+						unit.split++;
+					}
+
+					size_t head = open_loop(loop);
+					size_t exit;
+					if(var->kind == ExprKind::Local)
+						exit = emit(Opcode::Iter, local(var->name), 0, collection);
+					else
+					{
+						uint32_t reg = alloc();
+						exit = emit(Opcode::Iter, reg, 0, collection);
+						store(var, reg);
+					}
+
+					Loop info;
+					if(!loop_body(loop->body, info))
+						return false;
+
+					emit(Opcode::Jump, 0, static_cast<uint32_t>(head));
+					close(info, here(), head);
+					patch(exit, here());
+					if(split != independent.end())
+					{
+						deferring.resize(marked);
+						emit(Opcode::Done, 0, static_cast<uint32_t>(table));
+						function.splits[table].exit = static_cast<uint32_t>(here());
+					}
+
+					return true;
+				}
+
+				if(auto branch = dynamic_cast<const Switch*>(block))
+				{
+					Expr* subject = expression(branch->expr);
+					if(!subject)
+						return false;
+
+					// When propagation knows the case taken, the tests go and
+					// only that case and the ones it falls into are laid out.
+					auto resolved = known.switches.find(block);
+					size_t first = resolved != known.switches.end() ? resolved->second : 0;
+					Value folded;
+					uint32_t reg = 0;
+					if(resolved == known.switches.end() || !known.value(subject, folded))
+						reg = value(subject);
+
+					uint32_t mark = top;
+
+					std::vector<size_t> to_case(branch->cases.size(), any);
+					size_t default_case = any;
+
+					// The constant labels before the first one that is not
+					// go through a table when there are enough of them; the
+					// rest are tested in turn where it misses. Of equal
+					// labels, the first takes the subject.
+					std::vector<Value> labels;
+					std::vector<size_t> in_table(branch->cases.size(), any);
+					size_t tested = 0;
+					for(; resolved == known.switches.end() && tested < branch->cases.size(); tested++)
+					{
+						const std::string& label = branch->cases[tested].first;
+						if(label == "default")
+							continue;
+
+						Expr* expr = expression(label);
+						if(!expr)
+							return false;
+
+						Value constant;
+						if(!constant_of(expr, constant))
+							break;
+
+						if(std::none_of(labels.begin(), labels.end(), [&](const Value& other) { return equal(other, constant); }))
+						{
+							in_table[tested] = labels.size();
+							labels.push_back(constant);
+						}
+					}
+
+					size_t table = any;
+					SwitchTable dispatch;
+					if(labels.size() >= min_switch_table && switch_table(labels, dispatch))
+					{
+						table = function.switches.size();
+						emit(Opcode::Switch, reg, static_cast<uint32_t>(table));
+						dispatch.targets.back() = static_cast<uint32_t>(here());
+						function.switches.push_back(std::move(dispatch));
+					}
+					else
+						tested = 0;
+
+					// The labels left to test in turn. Constant ones next to
+					// each other can match the subject only one at a time, so
+					// the profile may reorder them most frequent first, and
+					// any repeated among them can never be taken.
+					std::vector<size_t> tests;
+					size_t run = 0;
+					std::vector<Value> seen;
+					auto order = [&]()
+					{
+						if(counts)
+							std::stable_sort(tests.begin() + run, tests.end(), [&](size_t x, size_t y) { return taken(block, x) > taken(block, y); });
+					};
+
+					for(size_t i = 0; i < branch->cases.size(); i++)
+					{
+						const std::string& label = branch->cases[i].first;
+						if(label == "default")
+						{
+							default_case = i;
+							continue;
+						}
+
+						if(i < tested || resolved != known.switches.end())
+							continue;
+
+						Expr* expr = expression(label);
+						if(!expr)
+							return false;
+
+						Value constant;
+						if(!constant_of(expr, constant))
+						{
+							order();
+							tests.push_back(i);
+							run = tests.size();
+							seen.clear();
+							continue;
+						}
+
+						if(std::any_of(seen.begin(), seen.end(), [&](const Value& other) { return equal(other, constant); }))
+							continue;
+
+						seen.push_back(constant);
+						tests.push_back(i);
+					}
+
+					order();
+
+					for(size_t i : tests)
+					{
+						uint32_t rhs = value(expression(branch->cases[i].first));
+						uint32_t test = alloc();
+						emit(Opcode::Eq, test, reg, rhs);
+						to_case[i] = emit(Opcode::JumpIf, test);
+						top = mark;
+					}
+
+					size_t to_default = resolved == known.switches.end() ? emit(Opcode::Jump) : any;
+
+					// Case bodies are laid out in order and fall through into
+					// each other until a break, as in C.
+					loops.push_back(Loop{ {}, {}, false });
+					// When counting, a case is counted where the switch enters
+					// it, which falling through from the one before skips.
+					for(size_t i = first; i < branch->cases.size(); i++)
+					{
+						size_t over = unit.instrument && i > first ? emit(Opcode::Jump) : any;
+						if(to_case[i] != any)
+							patch(to_case[i], here());
+
+						if(table != any && in_table[i] != any)
+							function.switches[table].targets[in_table[i]] = static_cast<uint32_t>(here());
+
+						if(i == default_case && to_default != any)
+							patch(to_default, here());
+
+						count(block, static_cast<uint32_t>(i));
+						if(over != any)
+							patch(over, here());
+
+						if(!comp(branch->cases[i].second))
+							return false;
+					}
+
+					Loop info = std::move(loops.back());
+					loops.pop_back();
+
+					if(default_case == any && to_default != any)
+					{
+						size_t over = unit.instrument && first < branch->cases.size() ? emit(Opcode::Jump) : any;
+						patch(to_default, here());
+						count(block, static_cast<uint32_t>(branch->cases.size()));
+						if(over != any)
+							patch(over, here());
+					}
+
+					for(size_t jump : info.breaks)
+						patch(jump, here());
+
+					// A continue inside a switch belongs to the enclosing loop.
+					if(!info.continues.empty())
+					{
+						Loop* outer = enclosing_loop();
+						outer->continues.insert(outer->continues.end(), info.continues.begin(), info.continues.end());
+					}
+
+					return true;
+				}
+
+				if(dynamic_cast<const Break*>(block))
+				{
+					if(loops.empty())
+						return fail("break", "not inside a loop or switch");
+
+					loops.back().breaks.push_back(emit(Opcode::Jump));
+					return true;
+				}
+
+				if(dynamic_cast<const Continue*>(block))
+				{
+					if(!enclosing_loop())
+						return fail("continue", "not inside a loop");
+
+					loops.back().continues.push_back(emit(Opcode::Jump));
+					return true;
+				}
+
+				if(auto call = dynamic_cast<const Call*>(block))
+				{
+					auto callee = module.function_index.find(call->name);
+					if(callee == module.function_index.end())
+						return fail(call->name, "no such function");
+
+					uint32_t params = static_cast<uint32_t>(module.functions[callee->second].params);
+					if(call->args.size() != params)
+						return fail(call->name, "expects " + std::to_string(params) + " argument(s), got " + std::to_string(call->args.size()));
+
+					Expr* retvar = nullptr;
+					if(!call->retvar.empty() && !(retvar = target(call->retvar)))
+						return false;
+
+					bool inlined;
+					if(!splice(call, callee->second, retvar, inlined))
+						return false;
+
+					if(inlined)
+					{
+						tail = false;
+						return true;
+					}
+
+					uint32_t base = top;
+					for(const std::string& arg : call->args)
+					{
+						Expr* expr = expression(arg);
+						if(!expr)
+							return false;
+
+						value(expr, alloc());
+					}
+
+					top = base + 1;
+					max = std::max(max, top);
+					if(tail)
+					{
+						emit(Opcode::TailCall, base, callee->second, static_cast<uint32_t>(call->args.size()));
+						unit.tail_calls++;
+						return true;
+					}
+
+					emit(Opcode::Call, base, callee->second, static_cast<uint32_t>(call->args.size()));
+					if(retvar)
+						store(retvar, base);
+
+					return true;
+				}
+
+				if(auto ret = dynamic_cast<const Return*>(block))
+				{
+					if(returns)
+					{
+						Expr* expr = ret->expr.empty() ? nullptr : expression(ret->expr);
+						if(!ret->expr.empty() && !expr)
+							return false;
+
+						if(expr)
+							value(expr, result);
+						else
+							emit(Opcode::LoadK, result, constant(Value::nil()));
+
+						returns->push_back(emit(Opcode::Jump));
+						return true;
+					}
+
+					uint32_t reg;
+					if(ret->expr.empty())
+					{
+						reg = alloc();
+						emit(Opcode::LoadK, reg, constant(Value::nil()));
+					}
+					else
+					{
+						Expr* expr = expression(ret->expr);
+						if(!expr)
+							return false;
+
+						reg = value(expr);
+					}
+
+					emit(Opcode::Return, reg);
+					return true;
+				}
+
+				if(auto parallel = dynamic_cast<const Parallel*>(block))
+				{
+					// Every branch runs on a copy of this frame and ends in
+					// a Join. The Fork goes on at the join once all have,
+					// copying back the locals each branch assigns.
+					size_t table = function.forks.size();
+					function.forks.emplace_back();
+					emit(Opcode::Fork, 0, static_cast<uint32_t>(table));
+
+					ForkTable fork;
+					for(const Comp& branch : parallel->branches)
+					{
+						std::vector<bool> assigned(parsed.locals.size(), false);
+						for(const Block* nested : branch)
+							assignments(parsed, nested, assigned);
+
+						fork.writes.emplace_back();
+						for(auto& [name, k] : parsed.locals)
+						{
+							if(assigned[k])
+								fork.writes.back().push_back(local(name));
+						}
+
+						std::sort(fork.writes.back().begin(), fork.writes.back().end());
+						fork.branches.push_back(static_cast<uint32_t>(here()));
+						uint32_t mark = top;
+						if(!comp(branch))
+							return false;
+
+						emit(Opcode::Join);
+						top = mark;
+					}
+
+					fork.join = static_cast<uint32_t>(here());
+					function.forks[table] = std::move(fork);
+					return true;
+				}
+
+				if(dynamic_cast<const Comment*>(block))
+					return true;
+
+				return fail("?", "unsupported block type");
+			}
+
+			Loop* enclosing_loop()
+			{
+				for(auto it = loops.rbegin(); it != loops.rend(); it++)
+				{
+					if(it->loop)
+						return &*it;
+				}
+
+				return nullptr;
+			}
+
+			void close(const Loop& loop, size_t exit, size_t next)
+			{
+				for(size_t jump : loop.breaks)
+					patch(jump, exit);
+
+				for(size_t jump : loop.continues)
+					patch(jump, next);
+
+				release_hoisted();
+			}
+		};
+	}
+
+	bool Compiler::compile(const Program& program, Module& module)
+	{
+		std::vector<std::string> names;
+		for(auto& [name, _] : program.funcs)
+			names.push_back(name);
+
+		std::sort(names.begin(), names.end());
+
+		module.functions.clear();
+		module.function_index.clear();
+		module.globals.clear();
+		module.channels.clear();
+		module.functions.resize(names.size());
+		for(size_t i = 0; i < names.size(); i++)
+		{
+			module.functions[i].name = names[i];
+			module.functions[i].params = static_cast<uint32_t>(program.funcs.at(names[i]).first.size());
+			module.function_index[names[i]] = static_cast<uint32_t>(i);
+		}
+
+		auto main = module.function_index.find("main");
+		if(main == module.function_index.end())
+		{
+			error = "program has no main function";
+			return false;
+		}
+
+		module.entry = main->second;
+		if(module.functions[module.entry].params != 0)
+		{
+			error = "main must not take parameters";
+			return false;
+		}
+
+		return compile(program, module, module.functions);
+	}
+
+	bool Compiler::compile(const Program& program, Module& module, std::vector<Function>& functions)
+	{
+		if(&functions != &module.functions)
+		{
+			functions.assign(module.functions.size(), Function());
+			for(size_t i = 0; i < functions.size(); i++)
+			{
+				functions[i].name = module.functions[i].name;
+				functions[i].params = module.functions[i].params;
+			}
+		}
+
+		ExprPool pool;
+		Parser parser(pool, module.strings);
+		std::vector<ParsedFunction> parsed(functions.size());
+		diagnostics.clear();
+		for(size_t i = 0; i < functions.size(); i++)
+		{
+			auto& [args, body] = program.funcs.at(functions[i].name);
+			if(!parsed[i].parse(functions[i].name, args, body, parser))
+			{
+				error = "in function '" + functions[i].name + "': " + parsed[i].error;
+				return false;
+			}
+
+			for(const Block* block : parsed[i].stranded)
+				diagnostics.push_back({ functions[i].name, block, "unreachable code" });
+		}
+
+		// Functions called from a Parallel branch run alongside the other
+		// branches, so neither they nor anything they call may read input,
+		// assign a global, make a channel or store into an array or map they
+		// did not make.
+		for(bool changed = true; changed;)
+		{
+			changed = false;
+			for(ParsedFunction& function : parsed)
+			{
+				for(const Call* call : function.calls)
+				{
+					auto callee = module.function_index.find(call->name);
+					if(!function.unshareable && callee != module.function_index.end() && parsed[callee->second].unshareable)
+						function.unshareable = changed = true;
+				}
+			}
+		}
+
+		for(size_t i = 0; i < functions.size(); i++)
+		{
+			for(const Call* call : parsed[i].forked)
+			{
+				auto callee = module.function_index.find(call->name);
+				if(callee != module.function_index.end() && parsed[callee->second].unshareable)
+				{
+					error = "in function '" + functions[i].name + "': '" + call->name + "' is called from a Parallel branch but reads input, assigns a global, makes a channel or stores into an array or map it did not make";
+					return false;
+				}
+			}
+		}
+
+		TypeInference inference;
+		if(optimize)
+			inference.infer(parsed, module.function_index);
+		else
+			inference.functions.resize(parsed.size());
+
+		ConstantPropagation propagation;
+		if(optimize)
+			propagation.run(parsed);
+		else
+			propagation.functions.resize(parsed.size());
+
+		dead_blocks = propagation.dead_blocks;
+		folded_exprs = propagation.folded;
+
+		Purity purity;
+		purity.run(parsed, module.function_index);
+		for(size_t i = 0; i < functions.size(); i++)
+			functions[i].pure = purity.functions[i];
+
+		// A function that may wait on a channel stays interpreted, where a
+		// branch can put its frames aside until the channel is ready.
+		for(size_t i = 0; i < functions.size(); i++)
+			functions[i].waits = parsed[i].waits;
+
+		for(bool changed = true; changed;)
+		{
+			changed = false;
+			for(size_t i = 0; i < functions.size(); i++)
+			{
+				for(const Call* call : parsed[i].calls)
+				{
+					auto callee = module.function_index.find(call->name);
+					if(!functions[i].waits && callee != module.function_index.end() && functions[callee->second].waits)
+						functions[i].waits = changed = true;
+				}
+			}
+		}
+
+		Independence independence;
+		if(parallel_loops && !instrument)
+			independence.run(parsed, module.function_index);
+		else
+			independence.functions.resize(parsed.size());
+
+		Unit unit{ parsed, inference, propagation, independence, optimize && optimize_loops, optimize && inline_calls && !instrument, instrument, optimize ? profile : nullptr, {}, 0, 0, 0, 0, 0, 0 };
+		for(size_t i = 0; i < functions.size(); i++)
+		{
+			FunctionCompiler compiler(module, unit, static_cast<uint32_t>(i), functions[i]);
+			if(!compiler.compile(error))
+				return false;
+		}
+
+		inlined_calls = unit.inlined;
+		specialized_calls = unit.specialized_calls;
+		outlined_blocks = unit.outlined;
+		tail_calls = unit.tail_calls;
+		dropped_ops = unit.merged;
+		split_loops = unit.split;
+
+		return true;
+	}
+}
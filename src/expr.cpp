@@ -0,0 +1,597 @@
+#include<cctype>
+#include<cstdlib>
+
+// Diaflow
+#include<expr.h>
+
+namespace Diaflow
+{
+	namespace
+	{
+		enum class Token : uint8_t
+		{
+			End, Error, Int, Double, String, Name, Global, Punct
+		};
+
+		class Reader
+		{
+		public:
+			Reader(std::string_view source, ExprPool& pool, Strings& strings)
+				: source(source), pool(pool), strings(strings)
+			{
+				next();
+			}
+
+			Expr* statement()
+			{
+				Expr* target = expression();
+				if(!target)
+					return nullptr;
+
+				static const char* compound[] = { "+=", "-=", "*=", "/=", "%=" };
+				static const BinaryOp compound_ops[] = { BinaryOp::Add, BinaryOp::Sub, BinaryOp::Mul, BinaryOp::Div, BinaryOp::Mod };
+
+				if(is("=") || is("++") || is("--"))
+				{
+					if(!assignable(target))
+						return fail("left side of the assignment cannot be assigned to");
+
+					Expr* value;
+					if(is("="))
+					{
+						next();
+						value = expression();
+						if(!value)
+							return nullptr;
+					}
+					else
+					{
+						Expr* one = literal(Value::integer(1));
+						value = binary(is("++") ? BinaryOp::Add : BinaryOp::Sub, target, one);
+						next();
+					}
+
+					return assign(target, value);
+				}
+
+				for(size_t i = 0; i < sizeof(compound) / sizeof(*compound); i++)
+				{
+					if(!is(compound[i]))
+						continue;
+
+					if(!assignable(target))
+						return fail("left side of the assignment cannot be assigned to");
+
+					next();
+					Expr* rhs = expression();
+					if(!rhs)
+						return nullptr;
+
+					return assign(target, binary(compound_ops[i], target, rhs));
+				}
+
+				return target;
+			}
+
+			Expr* expression()
+			{
+				return logical_or();
+			}
+
+			bool finish(std::string* error)
+			{
+				if(!message.empty())
+				{
+					if(error)
+						*error = message;
+
+					return false;
+				}
+
+				if(token != Token::End)
+				{
+					if(error)
+						*error = "unexpected '" + std::string(text) + "'";
+
+					return false;
+				}
+
+				return true;
+			}
+
+			static bool assignable(const Expr* expr)
+			{
+				return expr->kind == ExprKind::Local || expr->kind == ExprKind::Global || expr->kind == ExprKind::Index;
+			}
+
+			Expr* fail(const std::string& what)
+			{
+				if(message.empty())
+					message = what;
+
+				return nullptr;
+			}
+
+		private:
+			std::string_view source;
+			ExprPool& pool;
+			Strings& strings;
+
+			size_t position = 0;
+			Token token = Token::End;
+			std::string_view text;
+			std::string literal_text;
+			std::string message;
+
+			bool is(const char* punct) const
+			{
+				return token == Token::Punct && text == punct;
+			}
+
+			bool accept(const char* punct)
+			{
+				if(!is(punct))
+					return false;
+
+				next();
+				return true;
+			}
+
+			bool expect(const char* punct)
+			{
+				if(accept(punct))
+					return true;
+
+				fail(std::string("expected '") + punct + "'");
+				return false;
+			}
+
+			void next()
+			{
+				while(position < source.size() && std::isspace(static_cast<unsigned char>(source[position])))
+					position++;
+
+				if(position >= source.size())
+				{
+					token = Token::End;
+					text = std::string_view();
+					return;
+				}
+
+				size_t start = position;
+				char c = source[position];
+
+				if(std::isdigit(static_cast<unsigned char>(c)) || (c == '.' && position + 1 < source.size() && std::isdigit(static_cast<unsigned char>(source[position + 1]))))
+				{
+					token = Token::Int;
+					while(position < source.size() && std::isdigit(static_cast<unsigned char>(source[position])))
+						position++;
+
+					if(position < source.size() && source[position] == '.')
+					{
+						token = Token::Double;
+						position++;
+						while(position < source.size() && std::isdigit(static_cast<unsigned char>(source[position])))
+							position++;
+					}
+
+					if(position < source.size() && (source[position] == 'e' || source[position] == 'E'))
+					{
+						size_t exponent = position + 1;
+						if(exponent < source.size() && (source[exponent] == '+' || source[exponent] == '-'))
+							exponent++;
+
+						if(exponent < source.size() && std::isdigit(static_cast<unsigned char>(source[exponent])))
+						{
+							token = Token::Double;
+							position = exponent;
+							while(position < source.size() && std::isdigit(static_cast<unsigned char>(source[position])))
+								position++;
+						}
+					}
+
+					text = source.substr(start, position - start);
+					return;
+				}
+
+				if(std::isalpha(static_cast<unsigned char>(c)) || c == '_' || c == '@')
+				{
+					token = c == '@' ? Token::Global : Token::Name;
+					if(c == '@')
+						start = ++position;
+
+					while(position < source.size() && (std::isalnum(static_cast<unsigned char>(source[position])) || source[position] == '_'))
+						position++;
+
+					text = source.substr(start, position - start);
+					if(text.empty())
+					{
+						token = Token::Error;
+						fail("expected a global name after '@'");
+					}
+
+					return;
+				}
+
+				if(c == '"' || c == '\'')
+				{
+					token = Token::String;
+					literal_text.clear();
+					position++;
+					while(position < source.size() && source[position] != c)
+					{
+						char ch = source[position++];
+						if(ch == '\\' && position < source.size())
+						{
+							ch = source[position++];
+							switch(ch)
+							{
+								case 'n': ch = '\n'; break;
+								case 't': ch = '\t'; break;
+								case 'r': ch = '\r'; break;
+								case '0': ch = '\0'; break;
+								default: break;
+							}
+						}
+
+						literal_text += ch;
+					}
+
+					if(position >= source.size())
+					{
+						token = Token::Error;
+						fail("unterminated string literal");
+						return;
+					}
+
+					position++;
+					text = source.substr(start, position - start);
+					return;
+				}
+
+				static const char* puncts[] = {
+					"==", "!=", "<=", ">=", "&&", "||", "++", "--", "+=", "-=", "*=", "/=", "%=",
+					"+", "-", "*", "/", "%", "<", ">", "!", "=", "(", ")", "[", "]", "{", "}", ",", ":"
+				};
+
+				for(const char* punct : puncts)
+				{
+					size_t length = std::char_traits<char>::length(punct);
+					if(source.substr(position, length) == punct)
+					{
+						token = Token::Punct;
+						text = source.substr(position, length);
+						position += length;
+						return;
+					}
+				}
+
+				token = Token::Error;
+				text = source.substr(position, 1);
+				fail("unexpected character '" + std::string(text) + "'");
+			}
+
+			Expr* literal(Value value)
+			{
+				Expr* expr = pool.make(ExprKind::Literal);
+				expr->value = value;
+				return expr;
+			}
+
+			Expr* binary(BinaryOp op, Expr* lhs, Expr* rhs)
+			{
+				Expr* expr = pool.make(ExprKind::Binary);
+				expr->op = static_cast<uint8_t>(op);
+				expr->args = { lhs, rhs };
+				return expr;
+			}
+
+			Expr* assign(Expr* target, Expr* value)
+			{
+				Expr* expr = pool.make(ExprKind::Assign);
+				expr->args = { target, value };
+				return expr;
+			}
+
+			template<typename Operand>
+			Expr* binary_level(Operand operand, std::initializer_list<std::pair<const char*, BinaryOp>> ops)
+			{
+				Expr* lhs = (this->*operand)();
+				while(lhs)
+				{
+					bool matched = false;
+					for(auto& [punct, op] : ops)
+					{
+						if(!is(punct))
+							continue;
+
+						next();
+						Expr* rhs = (this->*operand)();
+						if(!rhs)
+							return nullptr;
+
+						lhs = binary(op, lhs, rhs);
+						matched = true;
+						break;
+					}
+
+					if(!matched)
+						break;
+				}
+
+				return lhs;
+			}
+
+			Expr* logical_or()
+			{
+				return binary_level(&Reader::logical_and, { { "||", BinaryOp::Or } });
+			}
+
+			Expr* logical_and()
+			{
+				return binary_level(&Reader::equality, { { "&&", BinaryOp::And } });
+			}
+
+			Expr* equality()
+			{
+				return binary_level(&Reader::relational, { { "==", BinaryOp::Eq }, { "!=", BinaryOp::Ne } });
+			}
+
+			Expr* relational()
+			{
+				return binary_level(&Reader::additive, { { "<=", BinaryOp::Le }, { ">=", BinaryOp::Ge }, { "<", BinaryOp::Lt }, { ">", BinaryOp::Gt } });
+			}
+
+			Expr* additive()
+			{
+				return binary_level(&Reader::multiplicative, { { "+", BinaryOp::Add }, { "-", BinaryOp::Sub } });
+			}
+
+			Expr* multiplicative()
+			{
+				return binary_level(&Reader::unary, { { "*", BinaryOp::Mul }, { "/", BinaryOp::Div }, { "%", BinaryOp::Mod } });
+			}
+
+			Expr* unary()
+			{
+				if(is("-") || is("!"))
+				{
+					UnaryOp op = is("-") ? UnaryOp::Neg : UnaryOp::Not;
+					next();
+					Expr* operand = unary();
+					if(!operand)
+						return nullptr;
+
+					if(op == UnaryOp::Neg && operand->kind == ExprKind::Literal && operand->value.is_number())
+					{
+						if(operand->value.is_int())
+							operand->value = Value::integer(-operand->value.as_int());
+						else
+							operand->value = Value::number(-operand->value.as_double());
+
+						return operand;
+					}
+
+					Expr* expr = pool.make(ExprKind::Unary);
+					expr->op = static_cast<uint8_t>(op);
+					expr->args = { operand };
+					return expr;
+				}
+
+				return postfix();
+			}
+
+			Expr* postfix()
+			{
+				Expr* expr = primary();
+				while(expr && is("["))
+				{
+					next();
+					Expr* key = expression();
+					if(!key || !expect("]"))
+						return nullptr;
+
+					Expr* index = pool.make(ExprKind::Index);
+					index->args = { expr, key };
+					expr = index;
+				}
+
+				return expr;
+			}
+
+			bool list(const char* close, std::vector<Expr*>& items, bool pairs)
+			{
+				if(accept(close))
+					return true;
+
+				for(;;)
+				{
+					Expr* item = expression();
+					if(!item)
+						return false;
+
+					items.push_back(item);
+					if(pairs)
+					{
+						if(!expect(":"))
+							return false;
+
+						Expr* value = expression();
+						if(!value)
+							return false;
+
+						items.push_back(value);
+					}
+
+					if(accept(close))
+						return true;
+
+					if(!expect(","))
+						return false;
+				}
+			}
+
+			Expr* primary()
+			{
+				switch(token)
+				{
+					case Token::Int:
+					{
+						Value value;
+						if(!parse_int(text, value))
+							return fail("integer literal " + std::string(text) + " is malformed");
+
+						next();
+						return literal(value);
+					}
+
+					case Token::Double:
+					{
+						double d = std::strtod(std::string(text).c_str(), nullptr);
+						next();
+						return literal(Value::number(d));
+					}
+
+					case Token::String:
+					{
+						Expr* expr = literal(strings.intern(literal_text));
+						next();
+						return expr;
+					}
+
+					case Token::Global:
+					{
+						Expr* expr = pool.make(ExprKind::Global);
+						expr->name = text;
+						next();
+						return expr;
+					}
+
+					case Token::Name:
+					{
+						std::string name(text);
+						next();
+
+						if(name == "true" || name == "false")
+							return literal(Value::boolean(name == "true"));
+
+						if(name == "nil")
+							return literal(Value::nil());
+
+						if(!is("("))
+						{
+							Expr* expr = pool.make(ExprKind::Local);
+							expr->name = name;
+							return expr;
+						}
+
+						static const std::pair<const char*, Builtin> builtins[] = {
+							{ "len", Builtin::Len }, { "str", Builtin::Str }, { "int", Builtin::Int }, { "float", Builtin::Float },
+							{ "push", Builtin::Push }, { "abs", Builtin::Abs }, { "sqrt", Builtin::Sqrt }, { "floor", Builtin::Floor }
+						};
+
+						static const size_t arity[] = { 1, 1, 1, 1, 2, 1, 1, 1 };
+
+						for(auto& [builtin_name, builtin] : builtins)
+						{
+							if(name != builtin_name)
+								continue;
+
+							next();
+							Expr* expr = pool.make(ExprKind::Builtin);
+							expr->op = static_cast<uint8_t>(builtin);
+							expr->name = name;
+							if(!list(")", expr->args, false))
+								return nullptr;
+
+							if(expr->args.size() != arity[static_cast<int>(builtin)])
+								return fail(name + "() takes " + std::to_string(arity[static_cast<int>(builtin)]) + " argument(s)");
+
+							return expr;
+						}
+
+						return fail("unknown function '" + name + "' (use a call block to call flowchart functions)");
+					}
+
+					case Token::Punct:
+					{
+						if(accept("("))
+						{
+							Expr* expr = expression();
+							if(!expr || !expect(")"))
+								return nullptr;
+
+							return expr;
+						}
+
+						if(accept("["))
+						{
+							Expr* expr = pool.make(ExprKind::Array);
+							if(!list("]", expr->args, false))
+								return nullptr;
+
+							return expr;
+						}
+
+						if(accept("{"))
+						{
+							Expr* expr = pool.make(ExprKind::Map);
+							if(!list("}", expr->args, true))
+								return nullptr;
+
+							return expr;
+						}
+
+						return fail("unexpected '" + std::string(text) + "'");
+					}
+
+					case Token::End:
+						return fail("unexpected end of expression");
+
+					case Token::Error:
+						return nullptr;
+				}
+
+				return nullptr;
+			}
+		};
+	}
+
+	Expr* Parser::expression(std::string_view source, std::string* error)
+	{
+		Reader reader(source, pool, strings);
+		Expr* expr = reader.expression();
+		if(!reader.finish(error))
+			return nullptr;
+
+		return expr;
+	}
+
+	Expr* Parser::statement(std::string_view source, std::string* error)
+	{
+		Reader reader(source, pool, strings);
+		Expr* expr = reader.statement();
+		if(!reader.finish(error))
+			return nullptr;
+
+		return expr;
+	}
+
+	Expr* Parser::target(std::string_view source, std::string* error)
+	{
+		Reader reader(source, pool, strings);
+		Expr* expr = reader.expression();
+		if(!reader.finish(error))
+			return nullptr;
+
+		if(!Reader::assignable(expr))
+		{
+			if(error)
+				*error = "'" + std::string(source) + "' cannot be assigned to";
+
+			return nullptr;
+		}
+
+		return expr;
+	}
+}
@@ -0,0 +1,313 @@
+#include<algorithm>
+#include<unordered_set>
+
+// Diaflow
+#include<independence.h>
+
+namespace Diaflow
+{
+	namespace
+	{
+		typedef std::unordered_set<std::string> Locals;
+
+		// Walks the body of one Foreach, tracking the locals assigned on
+		// every path so far in the iteration.
+		class LoopCheck
+		{
+		public:
+			LoopCheck(const ParsedFunction& parsed, const std::vector<bool>& unsafe, const std::unordered_map<std::string, uint32_t>& index)
+				: parsed(parsed), unsafe(unsafe), index(index)
+			{}
+
+			bool check(const Foreach& loop, IndependentLoop& result)
+			{
+				const Expr* var = parsed[loop.var];
+				if(var->kind != ExprKind::Local)
+					return false;
+
+				written.insert(var->name);
+				collect(loop.body);
+
+				// The collection is computed before any iteration, but it is
+				// iterated as the body stores, so the stores may not wait for
+				// it either.
+				Locals before = written;
+				Locals assigned{ var->name };
+				if(!read(parsed[loop.iter], before, false) || !walk(loop.body, assigned, false))
+					return false;
+
+				for(const std::string& local : stored)
+				{
+					if(named.count(local))
+						return false;
+				}
+
+				result.assigned.assign(written.begin(), written.end());
+				result.deferred.assign(stored.begin(), stored.end());
+				std::sort(result.assigned.begin(), result.assigned.end());
+				std::sort(result.deferred.begin(), result.deferred.end());
+				return true;
+			}
+
+		private:
+			const ParsedFunction& parsed;
+			const std::vector<bool>& unsafe;
+			const std::unordered_map<std::string, uint32_t>& index;
+			// Locals assigned anywhere in the body, stored into by index and
+			// named other than as the target of an assignment.
+			Locals written, stored, named;
+
+			void collect(const Expr* expr)
+			{
+				if(expr->kind == ExprKind::Assign && expr->args[0]->kind == ExprKind::Local)
+					written.insert(expr->args[0]->name);
+
+				for(const Expr* arg : expr->args)
+					collect(arg);
+			}
+
+			void target(const std::string& source)
+			{
+				const Expr* expr = parsed[source];
+				if(expr->kind == ExprKind::Local)
+					written.insert(expr->name);
+				else
+					collect(expr);
+			}
+
+			void collect(const Comp& body)
+			{
+				auto expression = [&](const std::string& source)
+				{
+					if(!source.empty())
+						collect(parsed[source]);
+				};
+
+				for(const Block* block : body)
+				{
+					if(auto assign = dynamic_cast<const Assign*>(block))
+						expression(assign->expr);
+					else if(auto branch = dynamic_cast<const If*>(block))
+					{
+						collect(branch->t);
+						collect(branch->f);
+					}
+					else if(auto loop = dynamic_cast<const While*>(block))
+						collect(loop->body);
+					else if(auto loop = dynamic_cast<const DoWhile*>(block))
+						collect(loop->body);
+					else if(auto loop = dynamic_cast<const For*>(block))
+					{
+						expression(loop->init);
+						expression(loop->cond);
+						expression(loop->inc);
+						collect(loop->body);
+					}
+					else if(auto loop = dynamic_cast<const Foreach*>(block))
+					{
+						target(loop->var);
+						collect(loop->body);
+					}
+					else if(auto branch = dynamic_cast<const Switch*>(block))
+					{
+						for(auto& [_, statements] : branch->cases)
+							collect(statements);
+					}
+					else if(auto call = dynamic_cast<const Call*>(block))
+					{
+						if(!call->retvar.empty())
+							target(call->retvar);
+					}
+				}
+			}
+
+			// Checks the locals `expr` reads against those assigned so far.
+			// An assignment at the top of a statement always happens, so it
+			// adds its local to `assigned`.
+			bool read(const Expr* expr, Locals& assigned, bool statement)
+			{
+				if(expr->kind == ExprKind::Local)
+				{
+					named.insert(expr->name);
+					return !written.count(expr->name) || assigned.count(expr->name);
+				}
+				else if(expr->kind == ExprKind::Builtin && expr->builtin() == Builtin::Push)
+				{
+					// Pushes wait as stores do, and are made in order.
+					return deferrable(expr->args[0]) && read(expr->args[1], assigned, false);
+				}
+				else if(expr->kind == ExprKind::Assign)
+				{
+					const Expr* target = expr->args[0];
+					if(!read(expr->args[1], assigned, false) || !store(target, assigned))
+						return false;
+
+					if(target->kind == ExprKind::Local && statement)
+						assigned.insert(target->name);
+
+					return true;
+				}
+
+				for(const Expr* arg : expr->args)
+				{
+					if(!read(arg, assigned, false))
+						return false;
+				}
+
+				return true;
+			}
+
+			// Whether stores into `base` can wait: it must be a confined local
+			// the body never assigns.
+			bool deferrable(const Expr* base)
+			{
+				if(base->kind != ExprKind::Local || !parsed.confined.count(base->name) || written.count(base->name))
+					return false;
+
+				stored.insert(base->name);
+				return true;
+			}
+
+			// A target other than a local must be an index into a local whose
+			// stores can wait.
+			bool store(const Expr* target, Locals& assigned)
+			{
+				if(target->kind == ExprKind::Local)
+					return true;
+
+				return target->kind == ExprKind::Index && deferrable(target->args[0]) && read(target->args[1], assigned, false);
+			}
+
+			bool expression(const std::string& source, Locals& assigned, bool statement = false)
+			{
+				return source.empty() || read(parsed[source], assigned, statement);
+			}
+
+			// `breakable` tells whether a Break in `body` stays in the loop.
+			bool walk(const Comp& body, Locals& assigned, bool breakable)
+			{
+				for(const Block* block : body)
+				{
+					bool ok = true;
+					if(dynamic_cast<const Input*>(block) || dynamic_cast<const Return*>(block) || dynamic_cast<const Parallel*>(block)
+						|| dynamic_cast<const Channel*>(block) || dynamic_cast<const Send*>(block) || dynamic_cast<const Receive*>(block))
+						ok = false;
+					else if(dynamic_cast<const Break*>(block))
+						ok = breakable;
+					else if(auto assign = dynamic_cast<const Assign*>(block))
+						ok = expression(assign->expr, assigned, true);
+					else if(auto output = dynamic_cast<const Output*>(block))
+						ok = expression(output->expr, assigned);
+					else if(auto branch = dynamic_cast<const If*>(block))
+					{
+						Locals t = assigned, f = assigned;
+						ok = expression(branch->cond, assigned) && walk(branch->t, t, breakable) && walk(branch->f, f, breakable);
+					}
+					else if(auto loop = dynamic_cast<const While*>(block))
+					{
+						Locals inner = assigned;
+						ok = expression(loop->cond, assigned) && walk(loop->body, inner, true);
+					}
+					else if(auto loop = dynamic_cast<const DoWhile*>(block))
+					{
+						// A Continue goes straight to the condition.
+						Locals inner = assigned;
+						ok = walk(loop->body, inner, true) && expression(loop->cond, assigned);
+					}
+					else if(auto loop = dynamic_cast<const For*>(block))
+					{
+						ok = expression(loop->init, assigned, true) && expression(loop->cond, assigned);
+
+						// A Continue skips the rest of the body, so the increment
+						// only counts on what was assigned before it.
+						Locals inner = assigned, increment = assigned;
+						ok = ok && walk(loop->body, inner, true) && expression(loop->inc, increment, true);
+					}
+					else if(auto loop = dynamic_cast<const Foreach*>(block))
+					{
+						const Expr* var = parsed[loop->var];
+						Locals inner = assigned;
+						ok = var->kind == ExprKind::Local && expression(loop->iter, assigned);
+						if(ok)
+						{
+							inner.insert(var->name);
+							ok = walk(loop->body, inner, true);
+						}
+					}
+					else if(auto branch = dynamic_cast<const Switch*>(block))
+					{
+						ok = expression(branch->expr, assigned);
+						for(auto& [label, statements] : branch->cases)
+						{
+							Locals inner = assigned;
+							ok = ok && (label == "default" || expression(label, assigned)) && walk(statements, inner, true);
+						}
+					}
+					else if(auto call = dynamic_cast<const Call*>(block))
+					{
+						auto callee = index.find(call->name);
+						ok = callee != index.end() && !unsafe[callee->second];
+						for(const std::string& arg : call->args)
+							ok = ok && expression(arg, assigned);
+
+						if(ok && !call->retvar.empty())
+						{
+							const Expr* retvar = parsed[call->retvar];
+							ok = store(retvar, assigned);
+							if(retvar->kind == ExprKind::Local)
+								assigned.insert(retvar->name);
+						}
+					}
+
+					if(!ok)
+						return false;
+				}
+
+				return true;
+			}
+		};
+	}
+
+	void Independence::run(const std::vector<ParsedFunction>& parsed, const std::unordered_map<std::string, uint32_t>& index)
+	{
+		// A function is unsafe to call from an independent body if it or
+		// anything it calls reads input, assigns a global, stores or uses a
+		// channel.
+		std::vector<bool> unsafe(parsed.size());
+		for(size_t i = 0; i < parsed.size(); i++)
+			unsafe[i] = parsed[i].unshareable || parsed[i].stores || parsed[i].waits;
+
+		for(bool changed = true; changed;)
+		{
+			changed = false;
+			for(size_t i = 0; i < parsed.size(); i++)
+			{
+				if(unsafe[i])
+					continue;
+
+				for(const Call* call : parsed[i].calls)
+				{
+					auto callee = index.find(call->name);
+					if(callee == index.end() || unsafe[callee->second])
+					{
+						unsafe[i] = true;
+						changed = true;
+						break;
+					}
+				}
+			}
+		}
+
+		functions.assign(parsed.size(), {});
+		for(size_t i = 0; i < parsed.size(); i++)
+		{
+			for(auto& [block, _] : parsed[i].iterators)
+			{
+				IndependentLoop loop;
+				LoopCheck check(parsed[i], unsafe, index);
+				if(check.check(*static_cast<const Foreach*>(block), loop))
+					functions[i][block] = std::move(loop);
+			}
+		}
+	}
+}
@@ -0,0 +1,881 @@
+#include<cstddef>
+#include<cstdio>
+#include<cstring>
+#include<initializer_list>
+
+#if defined(__x86_64__) && defined(__linux__)
+#include<sys/mman.h>
+#include<unistd.h>
+#define DIAFLOW_JIT 1
+#endif
+
+// Diaflow
+#include<jit.h>
+#include<vm.h>
+
+namespace Diaflow
+{
+	// Runtime entry points of native code. Each runs one instruction the JIT
+	// does not inline, with the same semantics as the interpreter.
+	struct JitRuntime
+	{
+		static constexpr uint32_t ok = 0;
+		static constexpr uint32_t failed = 1;
+		static constexpr uint32_t done = 2;
+
+		// Runs `i`, giving `done` for an Iter that ran out of items and for
+		// a Split that ran its loop in slices.
+		static uint32_t step(NativeFrame* frame, const Instr* i, const Function* function)
+		{
+			VM& vm = *frame->vm;
+			Value* R = frame->registers;
+			size_t pc = i - function->code.data();
+
+			Fault fault = Fault::None;
+			switch(i->op)
+			{
+				case Opcode::Add: case Opcode::AddI:
+					fault = add(R[i->b], R[i->c], R[i->a], vm.heap);
+					break;
+
+				case Opcode::Sub: case Opcode::SubI:
+					fault = sub(R[i->b], R[i->c], R[i->a]);
+					break;
+
+				case Opcode::Mul: case Opcode::MulI:
+					fault = mul(R[i->b], R[i->c], R[i->a]);
+					break;
+
+				case Opcode::Div: case Opcode::DivI:
+					fault = div(R[i->b], R[i->c], R[i->a]);
+					break;
+
+				case Opcode::Mod: case Opcode::ModI:
+					fault = mod(R[i->b], R[i->c], R[i->a]);
+					break;
+
+				case Opcode::Lt:
+					fault = less(R[i->b], R[i->c], R[i->a]);
+					break;
+
+				case Opcode::Le:
+					fault = less_equal(R[i->b], R[i->c], R[i->a]);
+					break;
+
+				case Opcode::Neg:
+					if((fault = neg(R[i->b], R[i->a])) != Fault::None)
+					{
+						vm.fail(*function, pc, fault, &R[i->b], 1);
+						return failed;
+					}
+
+					return ok;
+
+				case Opcode::Not:
+					R[i->a] = Value::boolean(!truthy(R[i->b]));
+					return ok;
+
+				case Opcode::Eq:
+					R[i->a] = Value::boolean(equal(R[i->b], R[i->c]));
+					return ok;
+
+				case Opcode::Ne:
+					R[i->a] = Value::boolean(!equal(R[i->b], R[i->c]));
+					return ok;
+
+				case Opcode::EqS:
+					R[i->a] = Value::boolean(string_view(R[i->b]) == string_view(R[i->c]));
+					return ok;
+
+				case Opcode::NeS:
+					R[i->a] = Value::boolean(string_view(R[i->b]) != string_view(R[i->c]));
+					return ok;
+
+				case Opcode::Concat:
+					concat(R[i->b], R[i->c], R[i->a], vm.heap);
+					return ok;
+
+				case Opcode::Index:
+					fault = Diaflow::index(R[i->b], R[i->c], R[i->a], vm.heap);
+					break;
+
+				case Opcode::SetIndex:
+					if((fault = set_index(R[i->a], R[i->b], R[i->c], vm.heap)) != Fault::None)
+					{
+						Value operands[] = { R[i->a], R[i->b] };
+						vm.fail(*function, pc, fault, operands, 2);
+						return failed;
+					}
+
+					return ok;
+
+				case Opcode::NewArray:
+				{
+					Value array = vm.heap.array(i->c);
+					array.as_object<ArrayObject>()->items.assign(R + i->b, R + i->b + i->c);
+					R[i->a] = array;
+					return ok;
+				}
+
+				case Opcode::NewMap:
+				{
+					Value map = vm.heap.map();
+					auto& items = map.as_object<MapObject>()->items;
+					for(uint32_t k = 0; k < i->c; k++)
+						items.insert_or_assign(R[i->b + 2 * k], R[i->b + 2 * k + 1]);
+
+					vm.heap.grow(i->c * 4 * sizeof(Value));
+					R[i->a] = map;
+					return ok;
+				}
+
+				case Opcode::Builtin:
+					if((fault = builtin(static_cast<Builtin>(i->b), &R[i->a], R[i->a], vm.heap)) != Fault::None)
+					{
+						vm.fail(*function, pc, fault, &R[i->a], i->c);
+						return failed;
+					}
+
+					return ok;
+
+				case Opcode::Iter:
+				{
+					bool finished;
+					if((fault = iterate(R[i->c], R[i->c + 1], R[i->a], finished, vm.heap)) != Fault::None)
+					{
+						vm.fail(*function, pc, fault, &R[i->c], 1);
+						return failed;
+					}
+
+					return finished ? done : ok;
+				}
+
+				// The steps ran out at a loop head. Native frames cannot be
+				// put aside, so only the heap, which collects and goes on,
+				// or a limit gets here, which ends the run.
+				case Opcode::Loop:
+					if(vm.reclaim())
+						return ok;
+
+					vm.exceeded(*function, pc);
+					return failed;
+
+				case Opcode::Call:
+				case Opcode::TailCall:
+					return vm.invoke(*function, pc, *i, R, frame->depth) == Status::Ok ? ok : failed;
+
+				case Opcode::Fork:
+					return vm.fork(*function, pc, R, frame->depth) == Status::Ok ? ok : failed;
+
+				case Opcode::Split:
+				{
+					bool ran;
+					if(vm.split(*function, pc, R, frame->depth, ran) != Status::Ok)
+						return failed;
+
+					return ran ? done : ok;
+				}
+
+				case Opcode::Defer:
+				case Opcode::DeferPush:
+					return vm.defer(*function, pc, R, frame->depth) == Status::Ok ? ok : failed;
+
+				case Opcode::Input:
+					R[i->a] = vm.read();
+					return ok;
+
+				case Opcode::Output:
+					vm.print(R[i->a], i->b);
+					return ok;
+
+				case Opcode::Channel:
+					return vm.make(*function, pc, R) == Status::Ok ? ok : failed;
+
+				// Code that may wait is never compiled, so a full or empty
+				// channel here fails.
+				case Opcode::Send:
+				case Opcode::Receive:
+				{
+					bool waits;
+					return vm.exchange(*function, pc, R, waits) == Status::Ok ? ok : failed;
+				}
+
+				default:
+					vm.error = "in function '" + function->name + "': " + opcode_name(i->op) + " reached the runtime";
+					return failed;
+			}
+
+			if(fault != Fault::None)
+			{
+				Value operands[] = { R[i->b], R[i->c] };
+				vm.fail(*function, pc, fault, operands, 2);
+				return failed;
+			}
+
+			return ok;
+		}
+
+		static uint32_t test(NativeFrame* frame, const Instr* i, const Function*)
+		{
+			return truthy(frame->registers[i->a]);
+		}
+
+		// The index of the target a Switch goes to.
+		static uint32_t select(NativeFrame* frame, const Instr* i, const Function* function)
+		{
+			return function->switches[i->b].find(frame->registers[i->a]);
+		}
+	};
+
+#ifdef DIAFLOW_JIT
+	namespace
+	{
+		enum Reg : uint8_t
+		{
+			rax, rcx, rdx, rbx, rsp, rbp, rsi, rdi,
+			r8, r9, r10, r11, r12, r13, r14, r15,
+		};
+
+		// Condition codes, as in the low nibble of Jcc and SETcc.
+		enum class Cond : uint8_t
+		{
+			Overflow = 0x0, Below = 0x2, AboveEqual = 0x3, Equal = 0x4, NotEqual = 0x5, Above = 0x7,
+			Parity = 0xA, NoParity = 0xB, Less = 0xC, LessEqual = 0xE,
+		};
+
+		// Shift kinds, in the reg field of opcode C1.
+		constexpr uint8_t shl = 4;
+		constexpr uint8_t shr = 5;
+		constexpr uint8_t sar = 7;
+
+		class Assembler
+		{
+		public:
+			std::vector<uint8_t> bytes;
+
+			size_t here() const
+			{
+				return bytes.size();
+			}
+
+			void byte(uint8_t b)
+			{
+				bytes.push_back(b);
+			}
+
+			void u32(uint32_t v)
+			{
+				for(int k = 0; k < 4; k++)
+					byte(static_cast<uint8_t>(v >> (8 * k)));
+			}
+
+			void u64(uint64_t v)
+			{
+				for(int k = 0; k < 8; k++)
+					byte(static_cast<uint8_t>(v >> (8 * k)));
+			}
+
+			// An instruction with a [base + disp32] operand.
+			void mem(std::initializer_list<uint8_t> prefix, bool wide, std::initializer_list<uint8_t> opcode, int reg, int base, int32_t disp)
+			{
+				for(uint8_t b : prefix)
+					byte(b);
+
+				uint8_t rex = 0x40 | (wide ? 8 : 0) | (reg & 8 ? 4 : 0) | (base & 8 ? 1 : 0);
+				if(rex != 0x40)
+					byte(rex);
+
+				for(uint8_t b : opcode)
+					byte(b);
+
+				byte(static_cast<uint8_t>(0x80 | (reg & 7) << 3 | (base & 7)));
+				if((base & 7) == rsp)
+					byte(0x24);
+
+				u32(static_cast<uint32_t>(disp));
+			}
+
+			// An instruction with a register operand in ModRM.rm.
+			void reg(std::initializer_list<uint8_t> prefix, bool wide, std::initializer_list<uint8_t> opcode, int reg, int rm)
+			{
+				for(uint8_t b : prefix)
+					byte(b);
+
+				uint8_t rex = 0x40 | (wide ? 8 : 0) | (reg & 8 ? 4 : 0) | (rm & 8 ? 1 : 0);
+				if(rex != 0x40)
+					byte(rex);
+
+				for(uint8_t b : opcode)
+					byte(b);
+
+				byte(static_cast<uint8_t>(0xC0 | (reg & 7) << 3 | (rm & 7)));
+			}
+
+			void load(Reg dst, Reg base, int32_t disp)
+			{
+				mem({}, true, { 0x8B }, dst, base, disp);
+			}
+
+			void store(Reg base, int32_t disp, Reg src)
+			{
+				mem({}, true, { 0x89 }, src, base, disp);
+			}
+
+			void move(Reg dst, Reg src)
+			{
+				reg({}, true, { 0x89 }, src, dst);
+			}
+
+			void imm(Reg dst, uint64_t value)
+			{
+				byte(0x48 | (dst & 8 ? 1 : 0));
+				byte(static_cast<uint8_t>(0xB8 | (dst & 7)));
+				u64(value);
+			}
+
+			void shift(uint8_t kind, Reg r, uint8_t count)
+			{
+				reg({}, true, { 0xC1 }, kind, r);
+				byte(count);
+			}
+
+			// Two-operand ALU op `dst op= src`: add 01, or 09, and 21, sub 29,
+			// xor 31, cmp 39.
+			void alu(uint8_t opcode, Reg dst, Reg src)
+			{
+				reg({}, true, { opcode }, src, dst);
+			}
+
+			void set(Cond cond, Reg dst)
+			{
+				reg({}, false, { 0x0F, static_cast<uint8_t>(0x90 | static_cast<uint8_t>(cond)) }, 0, dst);
+			}
+
+			void push(Reg r)
+			{
+				if(r & 8)
+					byte(0x41);
+
+				byte(static_cast<uint8_t>(0x50 | (r & 7)));
+			}
+
+			void pop(Reg r)
+			{
+				if(r & 8)
+					byte(0x41);
+
+				byte(static_cast<uint8_t>(0x58 | (r & 7)));
+			}
+
+			void call(const void* target)
+			{
+				imm(rax, reinterpret_cast<uint64_t>(target));
+				byte(0xFF);
+				byte(0xD0);
+			}
+
+			// Jumps return the offset of their rel32 for patching.
+			size_t jump()
+			{
+				byte(0xE9);
+				u32(0);
+				return here() - 4;
+			}
+
+			size_t jump(Cond cond)
+			{
+				byte(0x0F);
+				byte(static_cast<uint8_t>(0x80 | static_cast<uint8_t>(cond)));
+				u32(0);
+				return here() - 4;
+			}
+
+			void patch(size_t rel, size_t target)
+			{
+				uint32_t offset = static_cast<uint32_t>(target - (rel + 4));
+				std::memcpy(&bytes[rel], &offset, sizeof(offset));
+			}
+
+			// Jumps through a table of offsets from its own start, indexed by
+			// eax. Returns the offset of the lea's disp32 for patching to the
+			// table, which entry() fills in.
+			size_t jump_table()
+			{
+				// lea rcx, [rip + disp32]
+				byte(0x48);
+				byte(0x8D);
+				byte(0x0D);
+				u32(0);
+				size_t rel = here() - 4;
+				// movsxd rax, dword [rcx + rax * 4]
+				byte(0x48);
+				byte(0x63);
+				byte(0x04);
+				byte(0x81);
+				alu(0x01, rax, rcx);
+				// jmp rax
+				byte(0xFF);
+				byte(0xE0);
+				return rel;
+			}
+
+			void entry(size_t at, size_t table, size_t target)
+			{
+				uint32_t offset = static_cast<uint32_t>(target - table);
+				std::memcpy(&bytes[at], &offset, sizeof(offset));
+			}
+		};
+
+		constexpr int32_t slot(uint32_t reg)
+		{
+			return static_cast<int32_t>(reg * sizeof(Value));
+		}
+
+		// rbx holds the registers, r12 the NativeFrame and r13 the globals.
+		class FunctionJit
+		{
+		public:
+			explicit FunctionJit(const Function& function)
+				: function(function), labels(function.code.size() + 1)
+			{}
+
+			std::vector<uint8_t> compile()
+			{
+				as.push(rbx);
+				as.push(r12);
+				as.push(r13);
+				as.push(r14);
+				as.push(r15);
+				as.move(r12, rdi);
+				as.load(rbx, r12, offsetof(NativeFrame, registers));
+				as.load(r13, r12, offsetof(NativeFrame, globals));
+
+				// Entries for on-stack replacement; anything else starts at 0.
+				as.mem({}, false, { 0x8B }, rax, r12, offsetof(NativeFrame, entry));
+				for(uint32_t head : function.loops)
+				{
+					if(head == Function::no_loop)
+						continue;
+
+					as.byte(0x3D);
+					as.u32(head);
+					branch(as.jump(Cond::Equal), head);
+				}
+
+				for(size_t pc = 0; pc < function.code.size(); pc++)
+				{
+					labels[pc] = as.here();
+					instr(pc);
+				}
+
+				labels.back() = as.here();
+
+				for(auto& [rel, pc] : slow)
+				{
+					as.patch(rel, as.here());
+					runtime(pc);
+					branch(as.jump(), pc + 1);
+				}
+
+				size_t failure = as.here();
+				as.byte(0xB8);
+				as.u32(1);
+				size_t epilogue = as.here();
+				as.pop(r15);
+				as.pop(r14);
+				as.pop(r13);
+				as.pop(r12);
+				as.pop(rbx);
+				as.byte(0xC3);
+
+				for(size_t rel : failures)
+					as.patch(rel, failure);
+
+				for(size_t rel : returns)
+					as.patch(rel, epilogue);
+
+				for(auto& [rel, pc] : branches)
+					as.patch(rel, labels[pc]);
+
+				for(auto& [table, pc] : tables)
+				{
+					const std::vector<uint32_t>& targets = function.switches[function.code[pc].b].targets;
+					for(size_t k = 0; k < targets.size(); k++)
+						as.entry(table + 4 * k, table, labels[targets[k]]);
+				}
+
+				return std::move(as.bytes);
+			}
+
+		private:
+			const Function& function;
+			Assembler as;
+			std::vector<size_t> labels;
+			std::vector<std::pair<size_t, size_t>> branches;
+			std::vector<std::pair<size_t, size_t>> slow;
+			std::vector<size_t> failures;
+			std::vector<size_t> returns;
+			std::vector<std::pair<size_t, size_t>> tables;
+
+			void branch(size_t rel, size_t pc)
+			{
+				branches.emplace_back(rel, pc);
+			}
+
+			void helper(const void* entry, size_t pc)
+			{
+				as.move(rdi, r12);
+				as.imm(rsi, reinterpret_cast<uint64_t>(&function.code[pc]));
+				as.imm(rdx, reinterpret_cast<uint64_t>(&function));
+				as.call(entry);
+			}
+
+			// Runs instruction `pc` through the runtime.
+			void runtime(size_t pc)
+			{
+				helper(reinterpret_cast<const void*>(&JitRuntime::step), pc);
+				const Instr& i = function.code[pc];
+				if(i.op == Opcode::Iter || i.op == Opcode::Split)
+				{
+					as.byte(0x3D);
+					as.u32(JitRuntime::done);
+					branch(as.jump(Cond::Equal), i.op == Opcode::Iter ? i.b : function.splits[i.b].exit);
+				}
+
+				as.reg({}, false, { 0x85 }, rax, rax);
+				failures.push_back(as.jump(Cond::NotEqual));
+			}
+
+			// Sign-extends the int payload of register `reg` into `dst`.
+			void unbox_int(Reg dst, uint32_t reg)
+			{
+				as.load(dst, rbx, slot(reg));
+				as.shift(shl, dst, 16);
+				as.shift(sar, dst, 16);
+			}
+
+			// Leaves for the slow path at `pc` unless registers `b` and `c`
+			// both hold ints, for a generic op to go on as its int variant.
+			void guard_ints(uint32_t b, uint32_t c, size_t pc)
+			{
+				as.imm(rdx, Value::header(Tag::Int));
+				for(uint32_t reg : { b, c })
+				{
+					as.load(rax, rbx, slot(reg));
+					as.shift(shr, rax, 48);
+					as.alu(0x39, rax, rdx);
+					slow.emplace_back(as.jump(Cond::NotEqual), pc);
+				}
+			}
+
+			// Stores rax as an int into register `reg`, leaving for the slow
+			// path at `pc` when it does not fit.
+			void box_int(uint32_t reg, size_t pc)
+			{
+				as.move(rdx, rax);
+				as.shift(shl, rdx, 16);
+				as.shift(sar, rdx, 16);
+				as.alu(0x39, rdx, rax);
+				slow.emplace_back(as.jump(Cond::NotEqual), pc);
+
+				as.shift(shl, rax, 16);
+				as.shift(shr, rax, 16);
+				as.imm(rcx, Value::boxed(Tag::Int, 0));
+				as.alu(0x09, rax, rcx);
+				as.store(rbx, slot(reg), rax);
+			}
+
+			// Stores the flag in al as a bool into register `reg`.
+			void box_bool(uint32_t reg)
+			{
+				as.reg({}, false, { 0x0F, 0xB6 }, rax, rax);
+				as.imm(rcx, Value::boxed(Tag::Bool, 0));
+				as.alu(0x09, rax, rcx);
+				as.store(rbx, slot(reg), rax);
+			}
+
+			void load_double(uint32_t reg)
+			{
+				as.mem({ 0xF3 }, false, { 0x0F, 0x7E }, 0, rbx, slot(reg));
+			}
+
+			void instr(size_t pc)
+			{
+				const Instr& i = function.code[pc];
+				switch(i.op)
+				{
+					case Opcode::Nop:
+						break;
+
+					case Opcode::Loop:
+						as.load(rax, r12, offsetof(NativeFrame, steps));
+						as.mem({}, true, { 0x83 }, 5, rax, 0);
+						as.byte(1);
+						slow.emplace_back(as.jump(Cond::Below), pc);
+						break;
+
+					case Opcode::Move:
+						as.load(rax, rbx, slot(i.b));
+						as.store(rbx, slot(i.a), rax);
+						break;
+
+					case Opcode::LoadK:
+						as.imm(rax, function.constants[i.b].bits);
+						as.store(rbx, slot(i.a), rax);
+						break;
+
+					case Opcode::GetGlobal:
+						as.load(rax, r13, slot(i.b));
+						as.store(rbx, slot(i.a), rax);
+						break;
+
+					case Opcode::SetGlobal:
+						as.load(rax, rbx, slot(i.b));
+						as.store(r13, slot(i.a), rax);
+						break;
+
+					case Opcode::Add:
+					case Opcode::Sub:
+						guard_ints(i.b, i.c, pc);
+						[[fallthrough]];
+
+					case Opcode::AddI:
+					case Opcode::SubI:
+						unbox_int(rax, i.b);
+						unbox_int(rcx, i.c);
+						as.alu(i.op == Opcode::AddI || i.op == Opcode::Add ? 0x01 : 0x29, rax, rcx);
+						box_int(i.a, pc);
+						break;
+
+					case Opcode::Mul:
+						guard_ints(i.b, i.c, pc);
+						[[fallthrough]];
+
+					case Opcode::MulI:
+						unbox_int(rax, i.b);
+						unbox_int(rcx, i.c);
+						as.reg({}, true, { 0x0F, 0xAF }, rax, rcx);
+						slow.emplace_back(as.jump(Cond::Overflow), pc);
+						box_int(i.a, pc);
+						break;
+
+					case Opcode::DivI:
+					case Opcode::ModI:
+						unbox_int(rax, i.b);
+						unbox_int(rcx, i.c);
+						as.reg({}, true, { 0x85 }, rcx, rcx);
+						slow.emplace_back(as.jump(Cond::Equal), pc);
+						as.byte(0x48);
+						as.byte(0x99);
+						as.reg({}, true, { 0xF7 }, 7, rcx);
+						if(i.op == Opcode::ModI)
+							as.move(rax, rdx);
+
+						box_int(i.a, pc);
+						break;
+
+					case Opcode::EqI:
+					case Opcode::NeI:
+						as.load(rax, rbx, slot(i.b));
+						as.mem({}, true, { 0x3B }, rax, rbx, slot(i.c));
+						as.set(i.op == Opcode::EqI ? Cond::Equal : Cond::NotEqual, rax);
+						box_bool(i.a);
+						break;
+
+					case Opcode::Lt:
+					case Opcode::Le:
+						guard_ints(i.b, i.c, pc);
+						[[fallthrough]];
+
+					case Opcode::LtI:
+					case Opcode::LeI:
+						unbox_int(rax, i.b);
+						unbox_int(rcx, i.c);
+						as.alu(0x39, rax, rcx);
+						as.set(i.op == Opcode::LtI || i.op == Opcode::Lt ? Cond::Less : Cond::LessEqual, rax);
+						box_bool(i.a);
+						break;
+
+					case Opcode::AddD:
+					case Opcode::SubD:
+					case Opcode::MulD:
+					case Opcode::DivD:
+					{
+						uint8_t op = i.op == Opcode::AddD ? 0x58 : i.op == Opcode::SubD ? 0x5C : i.op == Opcode::MulD ? 0x59 : 0x5E;
+						load_double(i.b);
+						as.mem({ 0xF2 }, false, { 0x0F, op }, 0, rbx, slot(i.c));
+						as.mem({ 0x66 }, false, { 0x0F, 0xD6 }, 0, rbx, slot(i.a));
+
+						// NaNs are stored canonical, as Value::number does.
+						as.reg({ 0x66 }, false, { 0x0F, 0x2E }, 0, 0);
+						size_t ordered = as.jump(Cond::NoParity);
+						as.imm(rax, Value::canonical_nan);
+						as.store(rbx, slot(i.a), rax);
+						as.patch(ordered, as.here());
+						break;
+					}
+
+					case Opcode::EqD:
+					case Opcode::NeD:
+						load_double(i.b);
+						as.mem({ 0x66 }, false, { 0x0F, 0x2E }, 0, rbx, slot(i.c));
+						if(i.op == Opcode::EqD)
+						{
+							as.set(Cond::Equal, rax);
+							as.set(Cond::NoParity, rcx);
+							as.reg({}, false, { 0x20 }, rcx, rax);
+						}
+						else
+						{
+							as.set(Cond::NotEqual, rax);
+							as.set(Cond::Parity, rcx);
+							as.reg({}, false, { 0x08 }, rcx, rax);
+						}
+
+						box_bool(i.a);
+						break;
+
+					case Opcode::LtD:
+					case Opcode::LeD:
+						// b < c as c > b, which is false when unordered.
+						load_double(i.c);
+						as.mem({ 0x66 }, false, { 0x0F, 0x2E }, 0, rbx, slot(i.b));
+						as.set(i.op == Opcode::LtD ? Cond::Above : Cond::AboveEqual, rax);
+						box_bool(i.a);
+						break;
+
+					case Opcode::Jump:
+						branch(as.jump(), i.b);
+						break;
+
+					case Opcode::Switch:
+					{
+						// The table lookup stays in the runtime; the jump to
+						// the case it picks is native.
+						helper(reinterpret_cast<const void*>(&JitRuntime::select), pc);
+						size_t rel = as.jump_table();
+						tables.emplace_back(as.here(), pc);
+						as.patch(rel, as.here());
+						for(size_t k = 0; k < function.switches[i.b].targets.size(); k++)
+							as.u32(0);
+
+						break;
+					}
+
+					case Opcode::JumpIf:
+					case Opcode::JumpIfNot:
+					{
+						bool on = i.op == Opcode::JumpIf;
+						as.load(rax, rbx, slot(i.a));
+						as.imm(rcx, Value::boolean(true).bits);
+						as.alu(0x39, rax, rcx);
+						branch(as.jump(Cond::Equal), on ? i.b : pc + 1);
+						as.imm(rcx, Value::boolean(false).bits);
+						as.alu(0x39, rax, rcx);
+						branch(as.jump(Cond::Equal), on ? pc + 1 : i.b);
+
+						helper(reinterpret_cast<const void*>(&JitRuntime::test), pc);
+						as.reg({}, false, { 0x85 }, rax, rax);
+						branch(as.jump(on ? Cond::NotEqual : Cond::Equal), i.b);
+						break;
+					}
+
+					case Opcode::Count:
+						// Only baseline code counts branches, and that is
+						// never compiled to native code.
+						break;
+
+					case Opcode::Fork:
+						// The branches run interpreted on VMs of their own,
+						// so native code goes straight on at the join.
+						runtime(pc);
+						branch(as.jump(), function.forks[i.b].join);
+						break;
+
+					case Opcode::Done:
+						// Slices run interpreted, so in native code this is
+						// only the end of the loop.
+						break;
+
+					case Opcode::TailCall:
+						// Native frames are on the C++ stack either way, so
+						// this is a call and a return.
+						runtime(pc);
+						[[fallthrough]];
+
+					case Opcode::Return:
+						as.load(rax, rbx, slot(i.a));
+						as.load(rcx, r12, offsetof(NativeFrame, result));
+						as.store(rcx, 0, rax);
+						as.reg({}, false, { 0x31 }, rax, rax);
+						returns.push_back(as.jump());
+						break;
+
+					default:
+						runtime(pc);
+						break;
+				}
+			}
+		};
+	}
+
+	Jit::~Jit()
+	{
+		for(auto& [memory, size] : regions)
+			munmap(memory, size);
+	}
+
+	bool Jit::supported()
+	{
+		return true;
+	}
+
+	NativeCode Jit::compile(const Function& function)
+	{
+		std::vector<uint8_t> code = FunctionJit(function).compile();
+
+		size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+		size_t size = (code.size() + page - 1) / page * page;
+		void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if(memory == MAP_FAILED)
+		{
+			error = "cannot map memory for native code";
+			return nullptr;
+		}
+
+		std::memcpy(memory, code.data(), code.size());
+		if(mprotect(memory, size, PROT_READ | PROT_EXEC) != 0)
+		{
+			munmap(memory, size);
+			error = "cannot make native code executable";
+			return nullptr;
+		}
+
+		regions.emplace_back(memory, size);
+
+		char path[64];
+		std::snprintf(path, sizeof(path), "/tmp/perf-%d.map", static_cast<int>(getpid()));
+		if(FILE* map = std::fopen(path, "a"))
+		{
+			std::fprintf(map, "%lx %zx diaflow:%s\n", static_cast<unsigned long>(reinterpret_cast<uintptr_t>(memory)), code.size(), function.name.c_str());
+			std::fclose(map);
+		}
+
+		return reinterpret_cast<NativeCode>(memory);
+	}
+#else
+	Jit::~Jit()
+	{}
+
+	bool Jit::supported()
+	{
+		return false;
+	}
+
+	NativeCode Jit::compile(const Function&)
+	{
+		error = "native code is only generated on x86-64 Linux";
+		return nullptr;
+	}
+#endif
+}
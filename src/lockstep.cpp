@@ -0,0 +1,493 @@
+#include<algorithm>
+#include<chrono>
+#include<sstream>
+
+// Diaflow
+#include<lockstep.h>
+#include<ops.h>
+#include<vm.h>
+
+namespace Diaflow
+{
+	namespace
+	{
+		constexpr size_t lanes = Lockstep::lanes;
+		constexpr uint32_t max_builtin_args = 4;
+
+		bool lane_op(const Instr& i)
+		{
+			switch(i.op)
+			{
+				case Opcode::Call:
+				case Opcode::TailCall:
+				case Opcode::Switch:
+				case Opcode::Index:
+				case Opcode::SetIndex:
+				case Opcode::NewArray:
+				case Opcode::NewMap:
+				case Opcode::Iter:
+				case Opcode::Fork:
+				case Opcode::Join:
+				case Opcode::Split:
+				case Opcode::Defer:
+				case Opcode::DeferPush:
+				case Opcode::Done:
+				case Opcode::Channel:
+				case Opcode::Send:
+				case Opcode::Receive:
+					return false;
+
+				case Opcode::Builtin:
+					return i.c <= max_builtin_args;
+
+				default:
+					return true;
+			}
+		}
+
+		// Runs `f` on every lane. Kept to a plain counted loop over all the
+		// lanes, active or not, so that it vectorizes.
+		template<typename F>
+		inline void each(F f)
+		{
+			for(size_t lane = 0; lane < lanes; lane++)
+				f(lane);
+		}
+	}
+
+	Lockstep::Lockstep(const Module& module)
+		: module(module)
+	{
+		const Function& function = module.functions[module.entry];
+		for(size_t pc = 0; pc < function.code.size() && unsupported.empty(); pc++)
+		{
+			if(!lane_op(function.code[pc]))
+				unsupported = std::string(opcode_name(function.code[pc].op)) + " at " + std::to_string(pc) + " in '" + function.name + "'";
+		}
+	}
+
+	bool Lockstep::run(const std::vector<std::string>& inputs)
+	{
+		runs.assign(inputs.size(), Batch::Run());
+		lockstep_runs = 0;
+		scalar_runs = 0;
+
+		std::vector<size_t> scalar;
+		if(unsupported.empty())
+		{
+			for(size_t first = 0; first < inputs.size(); first += lanes)
+				group(inputs, first, std::min(lanes, inputs.size() - first), scalar);
+		}
+		else
+		{
+			for(size_t k = 0; k < inputs.size(); k++)
+				scalar.push_back(k);
+		}
+
+		std::ostringstream out;
+		for(size_t input : scalar)
+		{
+			auto start = std::chrono::steady_clock::now();
+			std::istringstream in(inputs[input]);
+			out.str(std::string());
+			out.clear();
+
+			Batch::Run& run = runs[input];
+			VM vm(module, in, out);
+			vm.max_depth = max_depth;
+			vm.fuel = fuel;
+			vm.max_memory = max_memory;
+			vm.max_output = max_output;
+			run.status = vm.run();
+			run.output = out.str();
+			run.error = std::move(vm.error);
+			run.limit = vm.limit;
+
+			std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+			run.seconds = elapsed.count();
+		}
+
+		scalar_runs = scalar.size();
+		return std::all_of(runs.begin(), runs.end(), [](const Batch::Run& run) { return run.status == Status::Ok; });
+	}
+
+	void Lockstep::group(const std::vector<std::string>& inputs, size_t first, size_t count, std::vector<size_t>& scalar)
+	{
+		auto start = std::chrono::steady_clock::now();
+		const Function& function = module.functions[module.entry];
+		const Instr* code = function.code.data();
+		const Value* K = function.constants.data();
+
+		// Register r of lane l is at r * lanes + l, and likewise globals.
+		// The heap is shared by the lanes, and stops them all at the next
+		// loop head once past one run's limit, like running out of fuel.
+		Heap heap;
+		uint64_t steps = fuel;
+		heap.limit = max_memory;
+		heap.alarm = &steps;
+		std::vector<Value> R(function.registers * lanes);
+		std::vector<Value> G(module.globals.size() * lanes);
+		std::array<std::istringstream, lanes> in;
+		std::array<std::string, lanes> out;
+		std::string line;
+
+		Mask active{}, failed{};
+		for(size_t lane = 0; lane < count; lane++)
+		{
+			active[lane] = 1;
+			in[lane].str(inputs[first + lane]);
+		}
+
+		// Sends the active lanes marked in `leaving` to run on their own.
+		auto leave = [&](const Mask& leaving)
+		{
+			for(size_t lane = 0; lane < lanes; lane++)
+			{
+				if(active[lane] && leaving[lane])
+				{
+					active[lane] = 0;
+					scalar.push_back(first + lane);
+				}
+			}
+		};
+
+		auto check = [&]()
+		{
+			if(std::any_of(failed.begin(), failed.end(), [](uint8_t f) { return f; }))
+			{
+				leave(failed);
+				failed.fill(0);
+			}
+		};
+
+		// The lanes of register `r`. Operands that are not registers, such
+		// as jump targets, point past the last one and are never read.
+		auto at = [&](uint32_t r) { return R.data() + std::min<size_t>(r, function.registers) * lanes; };
+
+		size_t pc = 0;
+		bool running = true;
+		while(running && std::any_of(active.begin(), active.end(), [](uint8_t a) { return a; }))
+		{
+			const Instr& i = code[pc++];
+			Value* A = at(i.a);
+			const Value* B = at(i.b);
+			const Value* C = at(i.c);
+			switch(i.op)
+			{
+				case Opcode::Nop:
+				case Opcode::Count:
+					break;
+
+				case Opcode::Loop:
+					if(!steps--)
+					{
+						Mask all;
+						all.fill(1);
+						leave(all);
+					}
+
+					break;
+
+				case Opcode::Move:
+					each([&](size_t l) { A[l] = B[l]; });
+					break;
+
+				case Opcode::LoadK:
+				{
+					Value k = K[i.b];
+					each([&](size_t l) { A[l] = k; });
+					break;
+				}
+
+				case Opcode::GetGlobal:
+				{
+					const Value* g = &G[i.b * lanes];
+					each([&](size_t l) { A[l] = g[l]; });
+					break;
+				}
+
+				case Opcode::SetGlobal:
+				{
+					Value* g = &G[i.a * lanes];
+					each([&](size_t l) { g[l] = B[l]; });
+					break;
+				}
+
+				case Opcode::Add:
+				case Opcode::Sub:
+				case Opcode::Mul:
+				case Opcode::Div:
+				case Opcode::Mod:
+				case Opcode::Lt:
+				case Opcode::Le:
+				case Opcode::Concat:
+				{
+					for(size_t l = 0; l < lanes; l++)
+					{
+						if(!active[l])
+							continue;
+
+						Fault fault;
+						switch(i.op)
+						{
+							case Opcode::Add: fault = add(B[l], C[l], A[l], heap); break;
+							case Opcode::Sub: fault = sub(B[l], C[l], A[l]); break;
+							case Opcode::Mul: fault = mul(B[l], C[l], A[l]); break;
+							case Opcode::Div: fault = div(B[l], C[l], A[l]); break;
+							case Opcode::Mod: fault = mod(B[l], C[l], A[l]); break;
+							case Opcode::Lt: fault = less(B[l], C[l], A[l]); break;
+							case Opcode::Le: fault = less_equal(B[l], C[l], A[l]); break;
+							default: fault = concat(B[l], C[l], A[l], heap); break;
+						}
+
+						failed[l] = fault != Fault::None;
+					}
+
+					check();
+					break;
+				}
+
+				case Opcode::Neg:
+					for(size_t l = 0; l < lanes; l++)
+					{
+						if(active[l])
+							failed[l] = neg(B[l], A[l]) != Fault::None;
+					}
+
+					check();
+					break;
+
+				case Opcode::Not:
+					for(size_t l = 0; l < lanes; l++)
+						A[l] = Value::boolean(!truthy(B[l]));
+
+					break;
+
+				case Opcode::Eq:
+				case Opcode::Ne:
+				{
+					bool eq = i.op == Opcode::Eq;
+					for(size_t l = 0; l < lanes; l++)
+						A[l] = Value::boolean(equal(B[l], C[l]) == eq);
+
+					break;
+				}
+
+				case Opcode::AddI:
+					each([&](size_t l)
+					{
+						int64_t r = B[l].as_int() + C[l].as_int();
+						failed[l] = active[l] & !Value::fits_int(r);
+						A[l] = Value::integer(r);
+					});
+
+					check();
+					break;
+
+				case Opcode::SubI:
+					each([&](size_t l)
+					{
+						int64_t r = B[l].as_int() - C[l].as_int();
+						failed[l] = active[l] & !Value::fits_int(r);
+						A[l] = Value::integer(r);
+					});
+
+					check();
+					break;
+
+				case Opcode::MulI:
+					each([&](size_t l)
+					{
+						int64_t r;
+						bool overflow = __builtin_mul_overflow(B[l].as_int(), C[l].as_int(), &r);
+						failed[l] = active[l] & (overflow | !Value::fits_int(r));
+						A[l] = Value::integer(r);
+					});
+
+					check();
+					break;
+
+				case Opcode::DivI:
+				case Opcode::ModI:
+				{
+					bool quotient = i.op == Opcode::DivI;
+					each([&](size_t l)
+					{
+						int64_t x = B[l].as_int(), y = C[l].as_int();
+						bool zero = y == 0;
+						y = zero ? 1 : y;
+						int64_t r = quotient ? x / y : x % y;
+						failed[l] = active[l] & (zero | !Value::fits_int(r));
+						A[l] = Value::integer(r);
+					});
+
+					check();
+					break;
+				}
+
+				case Opcode::AddD:
+					each([&](size_t l) { A[l] = Value::number(B[l].as_double() + C[l].as_double()); });
+					break;
+
+				case Opcode::SubD:
+					each([&](size_t l) { A[l] = Value::number(B[l].as_double() - C[l].as_double()); });
+					break;
+
+				case Opcode::MulD:
+					each([&](size_t l) { A[l] = Value::number(B[l].as_double() * C[l].as_double()); });
+					break;
+
+				case Opcode::DivD:
+					each([&](size_t l) { A[l] = Value::number(B[l].as_double() / C[l].as_double()); });
+					break;
+
+				case Opcode::EqI:
+					each([&](size_t l) { A[l] = Value::boolean(B[l].bits == C[l].bits); });
+					break;
+
+				case Opcode::NeI:
+					each([&](size_t l) { A[l] = Value::boolean(B[l].bits != C[l].bits); });
+					break;
+
+				case Opcode::LtI:
+					each([&](size_t l) { A[l] = Value::boolean(B[l].as_int() < C[l].as_int()); });
+					break;
+
+				case Opcode::LeI:
+					each([&](size_t l) { A[l] = Value::boolean(B[l].as_int() <= C[l].as_int()); });
+					break;
+
+				case Opcode::EqD:
+					each([&](size_t l) { A[l] = Value::boolean(B[l].as_double() == C[l].as_double()); });
+					break;
+
+				case Opcode::NeD:
+					each([&](size_t l) { A[l] = Value::boolean(B[l].as_double() != C[l].as_double()); });
+					break;
+
+				case Opcode::LtD:
+					each([&](size_t l) { A[l] = Value::boolean(B[l].as_double() < C[l].as_double()); });
+					break;
+
+				case Opcode::LeD:
+					each([&](size_t l) { A[l] = Value::boolean(B[l].as_double() <= C[l].as_double()); });
+					break;
+
+				case Opcode::EqS:
+				case Opcode::NeS:
+				{
+					bool eq = i.op == Opcode::EqS;
+					for(size_t l = 0; l < lanes; l++)
+					{
+						if(active[l])
+							A[l] = Value::boolean((string_view(B[l]) == string_view(C[l])) == eq);
+					}
+
+					break;
+				}
+
+				case Opcode::Jump:
+					pc = i.b;
+					break;
+
+				// Most of the group decides the way; the lanes going the
+				// other way leave it.
+				case Opcode::JumpIf:
+				case Opcode::JumpIfNot:
+				{
+					Mask taken{};
+					size_t takers = 0, total = 0;
+					for(size_t l = 0; l < lanes; l++)
+					{
+						if(!active[l])
+							continue;
+
+						taken[l] = truthy(A[l]) == (i.op == Opcode::JumpIf);
+						takers += taken[l];
+						total++;
+					}
+
+					bool jump = 2 * takers >= total;
+					if(takers != 0 && takers != total)
+					{
+						for(size_t l = 0; l < lanes; l++)
+							failed[l] = taken[l] != jump;
+
+						check();
+					}
+
+					if(jump)
+						pc = i.b;
+
+					break;
+				}
+
+				case Opcode::Builtin:
+				{
+					Value args[max_builtin_args];
+					for(size_t l = 0; l < lanes; l++)
+					{
+						if(!active[l])
+							continue;
+
+						for(uint32_t k = 0; k < i.c; k++)
+							args[k] = R[(i.a + k) * lanes + l];
+
+						failed[l] = builtin(static_cast<Builtin>(i.b), args, A[l], heap) != Fault::None;
+					}
+
+					check();
+					break;
+				}
+
+				case Opcode::Input:
+					for(size_t l = 0; l < lanes; l++)
+					{
+						if(active[l])
+							A[l] = std::getline(in[l], line) ? parse_input(line, heap) : Value::nil();
+					}
+
+					break;
+
+				case Opcode::Output:
+					for(size_t l = 0; l < lanes; l++)
+					{
+						if(!active[l])
+							continue;
+
+						format(A[l], out[l]);
+						if(i.b)
+							out[l] += '\n';
+
+						failed[l] = out[l].size() > max_output;
+					}
+
+					check();
+					break;
+
+				case Opcode::Return:
+					running = false;
+					break;
+
+				default:
+					for(size_t l = 0; l < lanes; l++)
+						failed[l] = 1;
+
+					check();
+					break;
+			}
+		}
+
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		for(size_t lane = 0; lane < count; lane++)
+		{
+			if(!active[lane])
+				continue;
+
+			Batch::Run& run = runs[first + lane];
+			run.output = std::move(out[lane]);
+			run.seconds = elapsed.count() / count;
+			lockstep_runs++;
+		}
+	}
+}
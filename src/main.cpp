@@ -1,5 +1,8 @@
+#include<chrono>
 #include<iostream>
 #include<cstdint>
+#include<memory>
+#include<sstream>
 
 // SDL2
 #include<SDL2/SDL.h>
@@ -16,6 +19,10 @@
 
 // Diaflow
 #include<flow.h>
+#include<compiler.h>
+#include<runner.h>
+#include<scheduler.h>
+#include<vm.h>
 
 int main(int argc, char* argv[])
 {
@@ -71,6 +78,9 @@ int main(int argc, char* argv[])
 
 	ImGuiIO& io = ImGui::GetIO();
 
+	// Everything the editor runs besides drawing goes through this pool.
+	Diaflow::Scheduler scheduler;
+
 	Diaflow::Program program;
 	program["main"] = std::make_pair(
 		Diaflow::Args(),
@@ -96,8 +106,38 @@ int main(int argc, char* argv[])
 		}
 	);
 
+	Diaflow::Module module;
+	Diaflow::Compiler compiler;
+	bool compiled = false;
+	Diaflow::Scheduler::Group loading;
+	scheduler.submit(loading, [&] { compiled = compiler.compile(program, module); });
+
 	std::cout << program.xml_string() << std::endl;
 
+	scheduler.wait(loading);
+	if(!compiled)
+		std::cout << compiler.error << std::endl;
+
+	for(const Diaflow::Diagnostic& diagnostic : compiler.diagnostics)
+		std::cout << diagnostic.function << ": " << diagnostic.message << std::endl;
+
+	// A run stepped through goes in slices between frames, as many as fit
+	// in `frame_budget`, so that drawing never waits for it, and with no
+	// Scheduler, so that a Parallel block goes in slices too. It stops at
+	// an Input block until a line is typed for it. A run at full
+	// speed goes on a Runner's thread, and the console keeps the last
+	// `console_limit` bytes of what it prints.
+	constexpr uint64_t slice_steps = 4096;
+	constexpr std::chrono::milliseconds frame_budget(8);
+	constexpr size_t console_limit = 1 << 20;
+	std::istringstream input;
+	std::ostringstream output;
+	std::unique_ptr<Diaflow::VM> vm;
+	std::unique_ptr<Diaflow::Runner> runner;
+	bool paused = false;
+	std::string console;
+	char typed[256] = "";
+
 	bool running = true;
 	while(running)
 	{
@@ -116,6 +156,46 @@ int main(int argc, char* argv[])
 			};
 		}
 
+		if(vm && !paused && !vm->awaiting)
+		{
+			auto deadline = std::chrono::steady_clock::now() + frame_budget;
+			Diaflow::Status status;
+			do
+				status = vm->resume(slice_steps);
+			while(status == Diaflow::Status::Paused && !vm->awaiting && std::chrono::steady_clock::now() < deadline);
+
+			console += output.str();
+			output.str("");
+			if(status != Diaflow::Status::Paused)
+			{
+				if(status != Diaflow::Status::Ok)
+					console += vm->error + "\n";
+
+				vm.reset();
+			}
+		}
+
+		if(runner)
+		{
+			// Whether it finished is read first, so that nothing it printed
+			// before is left behind.
+			bool finished = runner->finished();
+			runner->drain(console);
+			if(finished)
+			{
+				if(runner->status() != Diaflow::Status::Ok)
+					console += runner->error() + "\n";
+
+				runner.reset();
+			}
+		}
+
+		if(console.size() > console_limit)
+		{
+			size_t cut = console.find('\n', console.size() - console_limit);
+			console.erase(0, cut == std::string::npos ? console.size() - console_limit : cut + 1);
+		}
+
 		ImGui_ImplOpenGL3_NewFrame();
 		ImGui_ImplSDL2_NewFrame(window);
 		ImGui::NewFrame();
@@ -179,9 +259,73 @@ int main(int argc, char* argv[])
 					ImGui::EndMenu();
 				}
 
+				if(ImGui::BeginMenu("Run"))
+				{
+					if(ImGui::MenuItem("Run", "F5", false, compiled && !vm && !runner))
+					{
+						console.clear();
+						runner = std::make_unique<Diaflow::Runner>(module, &scheduler);
+						runner->start();
+					}
+
+					if(ImGui::MenuItem("Step Through", "F10", false, compiled && !vm && !runner))
+					{
+						console.clear();
+						input.clear();
+						input.str("");
+						vm = std::make_unique<Diaflow::VM>(module, input, output);
+						vm->prompt = true;
+						vm->start();
+						paused = false;
+					}
+
+					if(ImGui::MenuItem(paused ? "Resume" : "Pause", "F6", false, vm != nullptr))
+						paused = !paused;
+
+					if(ImGui::MenuItem("Stop", "Shift+F5", false, vm || runner))
+					{
+						vm.reset();
+						if(runner)
+						{
+							runner->stop();
+							runner->drain(console);
+							if(runner->status() != Diaflow::Status::Ok)
+								console += runner->error() + "\n";
+
+							runner.reset();
+						}
+					}
+
+					ImGui::EndMenu();
+				}
+
 				ImGui::EndMenuBar();
 			}
 
+			if(vm)
+				ImGui::Text("%s in function '%s'", paused ? "Paused" : vm->awaiting ? "Waiting for input" : "Running", vm->position().c_str());
+
+			if(vm && vm->awaiting)
+			{
+				if(ImGui::InputText("Input", typed, sizeof(typed), ImGuiInputTextFlags_EnterReturnsTrue))
+				{
+					input.clear();
+					input.str(std::string(typed) + "\n");
+					typed[0] = '\0';
+					vm->awaiting = false;
+				}
+			}
+
+			if(runner && runner->waiting())
+			{
+				if(ImGui::InputText("Input", typed, sizeof(typed), ImGuiInputTextFlags_EnterReturnsTrue) && runner->post(typed))
+					typed[0] = '\0';
+			}
+
+			ImGui::BeginChild("Console");
+			ImGui::TextUnformatted(console.c_str(), console.c_str() + console.size());
+			ImGui::EndChild();
+
 			ImGui::End();
 		}
 
@@ -0,0 +1,457 @@
+#include<cctype>
+
+// Diaflow
+#include<parsed.h>
+
+namespace Diaflow
+{
+	bool ParsedFunction::parse(const std::string& name, const Args& args, const Comp& body, Parser& parser)
+	{
+		this->name = name;
+		this->args = &args;
+		this->body = &body;
+		this->parser = &parser;
+
+		for(const std::string& arg : args)
+		{
+			if(locals.count(arg))
+			{
+				error = "duplicate parameter '" + arg + "'";
+				return false;
+			}
+
+			locals[arg] = static_cast<uint32_t>(locals.size());
+		}
+
+		if(!scan(body))
+			return false;
+
+		sweep(body);
+
+		// A Foreach over a local only reads it, as printing or returning it
+		// does.
+		std::unordered_set<const Expr*> iterated = whole;
+		for(auto& [block, _] : iterators)
+			iterated.insert((*this)[static_cast<const Foreach*>(block)->iter]);
+
+		std::unordered_set<std::string> escaped(args.begin(), args.end());
+		for(auto& [_, expr] : exprs)
+		{
+			if(!iterated.count(expr) || expr->kind != ExprKind::Local)
+				escape(expr, escaped);
+		}
+
+		for(auto& [local, _] : locals)
+		{
+			if(!escaped.count(local))
+				confined.insert(local);
+		}
+
+		// Only a confined local holds an array or map nothing else can reach,
+		// so only stores into one can run alongside other code.
+		for(const Expr* base : bases)
+		{
+			if(base->kind != ExprKind::Local || !confined.count(base->name))
+				unshareable = true;
+		}
+
+		for(const std::string& local : branch_stores)
+		{
+			if(!confined.count(local))
+			{
+				error = "a Parallel branch cannot store into '" + local + "', whose array or map may be used elsewhere";
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	// Adds the locals `expr` lets other references to their value be made
+	// from: those it names other than by index, in len(), as what push()
+	// adds to or as assigned an array or map literal.
+	void ParsedFunction::escape(const Expr* expr, std::unordered_set<std::string>& escaped) const
+	{
+		const Expr* skipped = nullptr;
+		if(expr->kind == ExprKind::Local)
+			escaped.insert(expr->name);
+		else if(expr->kind == ExprKind::Index || (expr->kind == ExprKind::Builtin && (expr->builtin() == Builtin::Len || expr->builtin() == Builtin::Push)))
+			skipped = expr->args[0]->kind == ExprKind::Local ? expr->args[0] : nullptr;
+		else if(expr->kind == ExprKind::Assign && expr->args[0]->kind == ExprKind::Local)
+		{
+			skipped = expr->args[0];
+			if(expr->args[1]->kind != ExprKind::Array && expr->args[1]->kind != ExprKind::Map)
+				escaped.insert(skipped->name);
+		}
+
+		for(const Expr* arg : expr->args)
+		{
+			if(arg != skipped)
+				escape(arg, escaped);
+		}
+	}
+
+	void ParsedFunction::declare(const Expr* expr)
+	{
+		if(expr->kind == ExprKind::Local && !locals.count(expr->name))
+			locals[expr->name] = static_cast<uint32_t>(locals.size());
+		else if(expr->kind == ExprKind::Global)
+			effects = true;
+		else if(expr->kind == ExprKind::Builtin && expr->builtin() == Builtin::Push)
+		{
+			stores = true;
+			bases.push_back(expr->args[0]);
+		}
+
+		for(const Expr* arg : expr->args)
+			declare(arg);
+	}
+
+	bool ParsedFunction::parse(const std::string& source, Expr* (Parser::*rule)(std::string_view, std::string*))
+	{
+		if(exprs.count(&source))
+			return true;
+
+		std::string what;
+		Expr* expr = (parser->*rule)(source, &what);
+		if(!expr)
+		{
+			error = "'" + source + "': " + what;
+			return false;
+		}
+
+		declare(expr);
+		// Targets are always assigned, statements when they are assignments.
+		const Expr* assigned = rule == &Parser::target ? expr : expr->kind == ExprKind::Assign ? expr->args[0] : nullptr;
+		if(assigned && assigned->kind == ExprKind::Global)
+			unshareable = true;
+		else if(assigned && assigned->kind == ExprKind::Index)
+		{
+			stores = true;
+			bases.push_back(assigned->args[0]);
+		}
+
+		exprs[&source] = expr;
+		return true;
+	}
+
+	bool ParsedFunction::scan(const Comp& body)
+	{
+		auto expression = [this](const std::string& source) { return parse(source, &Parser::expression); };
+		auto statement = [this](const std::string& source) { return parse(source, &Parser::statement); };
+		auto target = [this](const std::string& source) { return parse(source, &Parser::target); };
+		auto named = [this](const std::string& channel)
+		{
+			bool ok = !channel.empty() && !std::isdigit(static_cast<unsigned char>(channel[0]));
+			for(char c : channel)
+				ok = ok && (std::isalnum(static_cast<unsigned char>(c)) || c == '_');
+
+			if(!ok)
+				error = "'" + channel + "' is not a channel name";
+
+			return ok;
+		};
+
+		for(const Block* block : body)
+		{
+			if(dynamic_cast<const While*>(block) || dynamic_cast<const DoWhile*>(block) || dynamic_cast<const For*>(block) || dynamic_cast<const Foreach*>(block))
+				loops[block] = static_cast<uint32_t>(loops.size());
+
+			if(dynamic_cast<const Foreach*>(block))
+				iterators[block] = static_cast<uint32_t>(iterators.size());
+
+			uint32_t outcomes = 0;
+			if(dynamic_cast<const If*>(block) || dynamic_cast<const While*>(block) || dynamic_cast<const DoWhile*>(block))
+				outcomes = 2;
+			else if(auto loop = dynamic_cast<const For*>(block))
+				outcomes = loop->cond.empty() ? 0 : 2;
+			else if(auto branch = dynamic_cast<const Switch*>(block))
+				outcomes = static_cast<uint32_t>(branch->cases.size() + 1);
+
+			if(outcomes)
+			{
+				branches[block] = counters;
+				counters += outcomes;
+			}
+
+			bool ok = true;
+			if(auto assign = dynamic_cast<const Assign*>(block))
+				ok = statement(assign->expr);
+			else if(auto input = dynamic_cast<const Input*>(block))
+			{
+				effects = true;
+				unshareable = true;
+				ok = target(input->expr);
+			}
+			else if(auto output = dynamic_cast<const Output*>(block))
+			{
+				effects = true;
+				ok = expression(output->expr);
+				whole.insert((*this)[output->expr]);
+			}
+			else if(auto branch = dynamic_cast<const If*>(block))
+				ok = expression(branch->cond) && scan(branch->t) && scan(branch->f);
+			else if(auto loop = dynamic_cast<const While*>(block))
+				ok = expression(loop->cond) && scan(loop->body);
+			else if(auto loop = dynamic_cast<const DoWhile*>(block))
+				ok = expression(loop->cond) && scan(loop->body);
+			else if(auto loop = dynamic_cast<const For*>(block))
+			{
+				ok = (loop->init.empty() || statement(loop->init))
+					&& (loop->cond.empty() || expression(loop->cond))
+					&& (loop->inc.empty() || statement(loop->inc))
+					&& scan(loop->body);
+			}
+			else if(auto loop = dynamic_cast<const Foreach*>(block))
+				ok = target(loop->var) && expression(loop->iter) && scan(loop->body);
+			else if(auto branch = dynamic_cast<const Switch*>(block))
+			{
+				ok = expression(branch->expr);
+				for(auto& [label, body] : branch->cases)
+					ok = ok && (label == "default" || expression(label)) && scan(body);
+			}
+			else if(auto call = dynamic_cast<const Call*>(block))
+			{
+				calls.push_back(call);
+				ok = call->retvar.empty() || target(call->retvar);
+				for(const std::string& arg : call->args)
+					ok = ok && expression(arg);
+			}
+			else if(auto ret = dynamic_cast<const Return*>(block))
+			{
+				ok = ret->expr.empty() || expression(ret->expr);
+				if(ok && !ret->expr.empty())
+					whole.insert((*this)[ret->expr]);
+			}
+			else if(auto channel = dynamic_cast<const Channel*>(block))
+			{
+				effects = unshareable = true;
+				ok = named(channel->name) && expression(channel->capacity);
+			}
+			else if(auto send = dynamic_cast<const Send*>(block))
+			{
+				effects = waits = true;
+				ok = named(send->channel) && expression(send->expr);
+			}
+			else if(auto receive = dynamic_cast<const Receive*>(block))
+			{
+				effects = waits = true;
+				ok = named(receive->channel) && target(receive->expr);
+			}
+			else if(auto parallel = dynamic_cast<const Parallel*>(block))
+			{
+				this->parallel = true;
+				std::vector<std::unordered_set<std::string>> written(parallel->branches.size()), used(parallel->branches.size());
+				for(size_t k = 0; ok && k < parallel->branches.size(); k++)
+				{
+					size_t first = calls.size();
+					ok = scan(parallel->branches[k]) && isolate(parallel->branches[k], 0, false, written[k], used[k]);
+					forked.insert(forked.end(), calls.begin() + first, calls.end());
+				}
+
+				for(size_t k = 0; ok && k < parallel->branches.size(); k++)
+				{
+					for(size_t other = 0; ok && other < parallel->branches.size(); other++)
+					{
+						if(other == k)
+							continue;
+
+						for(const std::string& local : written[k])
+						{
+							if(used[other].count(local))
+							{
+								error = "local '" + local + "' is assigned or stored into in one Parallel branch and used in another";
+								return false;
+							}
+						}
+					}
+				}
+			}
+
+			if(!ok)
+				return false;
+		}
+
+		return true;
+	}
+
+	// Marks what follows a block that always leaves `body`, and tells whether
+	// `body` always leaves. Loops and switches are taken to finish, as a Break
+	// inside only leaves them.
+	bool ParsedFunction::sweep(const Comp& body)
+	{
+		bool leaves = false, reported = false;
+		for(const Block* block : body)
+		{
+			if(dynamic_cast<const Comment*>(block))
+				continue;
+
+			if(leaves)
+			{
+				if(!reported)
+					stranded.push_back(block);
+
+				reported = true;
+				unreachable.insert(block);
+				continue;
+			}
+
+			if(dynamic_cast<const Break*>(block) || dynamic_cast<const Continue*>(block) || dynamic_cast<const Return*>(block))
+				leaves = true;
+			else if(auto branch = dynamic_cast<const If*>(block))
+			{
+				bool t = sweep(branch->t);
+				bool f = sweep(branch->f);
+				leaves = t && f;
+			}
+			else if(auto loop = dynamic_cast<const While*>(block))
+				sweep(loop->body);
+			else if(auto loop = dynamic_cast<const DoWhile*>(block))
+				sweep(loop->body);
+			else if(auto loop = dynamic_cast<const For*>(block))
+				sweep(loop->body);
+			else if(auto loop = dynamic_cast<const Foreach*>(block))
+				sweep(loop->body);
+			else if(auto branch = dynamic_cast<const Switch*>(block))
+			{
+				for(auto& [_, statements] : branch->cases)
+					sweep(statements);
+			}
+			else if(auto parallel = dynamic_cast<const Parallel*>(block))
+			{
+				for(const Comp& statements : parallel->branches)
+					sweep(statements);
+			}
+		}
+
+		return leaves;
+	}
+
+	// Checks that a Parallel branch keeps to itself, as the block requires,
+	// and collects the locals it assigns and the ones it names at all.
+	// `loops` counts the loops around `body` inside the branch, and
+	// `breakable` tells whether a Break there stays in the branch.
+	bool ParsedFunction::isolate(const Comp& body, uint32_t loops, bool breakable, std::unordered_set<std::string>& written, std::unordered_set<std::string>& used)
+	{
+		auto fail = [this](const std::string& what)
+		{
+			error = "a Parallel branch cannot " + what;
+			return false;
+		};
+
+		auto expression = [&](const std::string& source) { return source.empty() || isolate((*this)[source], written, used); };
+		auto assigned = [&](const std::string& source)
+		{
+			const Expr* target = (*this)[source];
+			if(target->kind == ExprKind::Local)
+				written.insert(target->name);
+			else if(target->kind == ExprKind::Global)
+				return fail("assign the global '@" + target->name + "'");
+			else if(target->kind == ExprKind::Index && !change(target->args[0], written))
+				return false;
+
+			return isolate(target, written, used);
+		};
+
+		for(const Block* block : body)
+		{
+			bool ok = true;
+			if(dynamic_cast<const Input*>(block))
+				ok = fail("read input");
+			else if(dynamic_cast<const Return*>(block))
+				ok = fail("return");
+			else if(dynamic_cast<const Break*>(block) && !breakable)
+				ok = fail("break out of it");
+			else if(dynamic_cast<const Continue*>(block) && !loops)
+				ok = fail("continue a loop outside it");
+			else if(auto assign = dynamic_cast<const Assign*>(block))
+				ok = expression(assign->expr);
+			else if(auto output = dynamic_cast<const Output*>(block))
+				ok = expression(output->expr);
+			else if(auto branch = dynamic_cast<const If*>(block))
+				ok = expression(branch->cond) && isolate(branch->t, loops, breakable, written, used) && isolate(branch->f, loops, breakable, written, used);
+			else if(auto loop = dynamic_cast<const While*>(block))
+				ok = expression(loop->cond) && isolate(loop->body, loops + 1, true, written, used);
+			else if(auto loop = dynamic_cast<const DoWhile*>(block))
+				ok = expression(loop->cond) && isolate(loop->body, loops + 1, true, written, used);
+			else if(auto loop = dynamic_cast<const For*>(block))
+				ok = expression(loop->init) && expression(loop->cond) && expression(loop->inc) && isolate(loop->body, loops + 1, true, written, used);
+			else if(auto loop = dynamic_cast<const Foreach*>(block))
+				ok = assigned(loop->var) && expression(loop->iter) && isolate(loop->body, loops + 1, true, written, used);
+			else if(auto branch = dynamic_cast<const Switch*>(block))
+			{
+				ok = expression(branch->expr);
+				for(auto& [label, statements] : branch->cases)
+					ok = ok && (label == "default" || expression(label)) && isolate(statements, loops, true, written, used);
+			}
+			else if(auto call = dynamic_cast<const Call*>(block))
+			{
+				ok = call->retvar.empty() || assigned(call->retvar);
+				for(const std::string& arg : call->args)
+					ok = ok && expression(arg);
+			}
+			else if(dynamic_cast<const Channel*>(block))
+				ok = fail("make a channel");
+			else if(auto send = dynamic_cast<const Send*>(block))
+				ok = expression(send->expr);
+			else if(auto receive = dynamic_cast<const Receive*>(block))
+				ok = assigned(receive->expr);
+			else if(auto parallel = dynamic_cast<const Parallel*>(block))
+			{
+				for(const Comp& statements : parallel->branches)
+					ok = ok && isolate(statements, 0, false, written, used);
+			}
+
+			if(!ok)
+				return false;
+		}
+
+		return true;
+	}
+
+	bool ParsedFunction::isolate(const Expr* expr, std::unordered_set<std::string>& written, std::unordered_set<std::string>& used)
+	{
+		if(expr->kind == ExprKind::Local)
+			used.insert(expr->name);
+		else if(expr->kind == ExprKind::Assign)
+		{
+			const Expr* target = expr->args[0];
+			if(target->kind == ExprKind::Global)
+			{
+				error = "a Parallel branch cannot assign the global '@" + target->name + "'";
+				return false;
+			}
+
+			if(target->kind == ExprKind::Local)
+				written.insert(target->name);
+			else if(target->kind == ExprKind::Index && !change(target->args[0], written))
+				return false;
+		}
+		else if(expr->kind == ExprKind::Builtin && expr->builtin() == Builtin::Push && !change(expr->args[0], written))
+			return false;
+
+		for(const Expr* arg : expr->args)
+		{
+			if(!isolate(arg, written, used))
+				return false;
+		}
+
+		return true;
+	}
+
+	// A branch stores into an array or map only through a local, counted as
+	// one it assigns so that no other branch may use it. The local must be
+	// confined, which is checked once the whole function is parsed.
+	bool ParsedFunction::change(const Expr* base, std::unordered_set<std::string>& written)
+	{
+		if(base->kind != ExprKind::Local)
+		{
+			error = "a Parallel branch cannot store into an array or map other than through a local";
+			return false;
+		}
+
+		written.insert(base->name);
+		branch_stores.insert(base->name);
+		return true;
+	}
+}
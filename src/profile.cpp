@@ -0,0 +1,113 @@
+#include<algorithm>
+#include<fstream>
+#include<iomanip>
+#include<sstream>
+
+// Diaflow
+#include<profile.h>
+
+namespace Diaflow
+{
+	namespace
+	{
+		const char* const header = "diaflow-profile 1";
+	}
+
+	std::string Profile::path(const std::string& chart)
+	{
+		return chart + ".profile";
+	}
+
+	// One line per function: its quoted name, the number of counters and
+	// the counters.
+	bool Profile::load(const std::string& path)
+	{
+		std::ifstream file(path);
+		std::string line;
+		if(!file || !std::getline(file, line) || line != header)
+		{
+			error = "'" + path + "' is not a profile";
+			return false;
+		}
+
+		// Nothing is added unless the whole file reads.
+		std::vector<std::pair<std::string, std::vector<uint64_t>>> read;
+		while(std::getline(file, line))
+		{
+			std::istringstream in(line);
+			std::string name;
+			size_t slots;
+			if(!(in >> std::quoted(name) >> slots))
+			{
+				error = "'" + path + "': malformed line '" + line + "'";
+				return false;
+			}
+
+			// Every counter takes a space and a digit at least.
+			std::streamoff used = in.tellg();
+			if(slots > (line.size() - std::min<size_t>(line.size(), used)) / 2)
+			{
+				error = "'" + path + "': too few counters for '" + name + "'";
+				return false;
+			}
+
+			std::vector<uint64_t> counts(slots);
+			for(uint64_t& count : counts)
+			{
+				if(!(in >> count))
+				{
+					error = "'" + path + "': too few counters for '" + name + "'";
+					return false;
+				}
+			}
+
+			read.emplace_back(std::move(name), std::move(counts));
+		}
+
+		for(auto& [name, counts] : read)
+		{
+			uint64_t* total = counters(name, counts.size());
+			for(size_t k = 0; k < counts.size(); k++)
+				total[k] += counts[k];
+		}
+
+		return true;
+	}
+
+	bool Profile::save(const std::string& path)
+	{
+		std::ofstream file(path);
+		file << header << "\n";
+		for(auto& [name, counts] : functions)
+		{
+			file << std::quoted(name) << " " << counts.size();
+			for(uint64_t count : counts)
+				file << " " << count;
+
+			file << "\n";
+		}
+
+		if(!(file.close(), file))
+		{
+			error = "cannot write '" + path + "'";
+			return false;
+		}
+
+		return true;
+	}
+
+	const std::vector<uint64_t>* Profile::find(const std::string& name, size_t slots) const
+	{
+		auto it = functions.find(name);
+		return it != functions.end() && it->second.size() == slots ? &it->second : nullptr;
+	}
+
+	uint64_t* Profile::counters(const std::string& name, size_t slots)
+	{
+		std::vector<uint64_t>& counts = functions[name];
+		if(counts.size() != slots)
+			counts.assign(slots, 0);
+
+		return counts.data();
+	}
+}
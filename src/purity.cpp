@@ -0,0 +1,36 @@
+// Diaflow
+#include<purity.h>
+
+namespace Diaflow
+{
+	void Purity::run(const std::vector<ParsedFunction>& parsed, const std::unordered_map<std::string, uint32_t>& index)
+	{
+		functions.assign(parsed.size(), false);
+		for(size_t i = 0; i < parsed.size(); i++)
+			functions[i] = !parsed[i].effects;
+
+		// Everything starts pure unless it has effects of its own, and a
+		// function calling an impure one becomes impure until nothing
+		// changes, so recursion among pure functions stays pure.
+		for(bool changed = true; changed;)
+		{
+			changed = false;
+			for(size_t i = 0; i < parsed.size(); i++)
+			{
+				if(!functions[i])
+					continue;
+
+				for(const Call* call : parsed[i].calls)
+				{
+					auto callee = index.find(call->name);
+					if(callee == index.end() || !functions[callee->second])
+					{
+						functions[i] = false;
+						changed = true;
+						break;
+					}
+				}
+			}
+		}
+	}
+}
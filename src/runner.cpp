@@ -0,0 +1,162 @@
+#include<chrono>
+
+// Diaflow
+#include<runner.h>
+
+namespace Diaflow
+{
+	namespace
+	{
+		constexpr size_t printed_capacity = 1 << 22;
+		constexpr size_t lines_capacity = 256;
+		constexpr size_t sink_size = 1 << 16;
+	}
+
+	Runner::Runner(const Module& module, Scheduler* scheduler)
+		: module(module), scheduler(scheduler), printed(printed_capacity), lines(lines_capacity), sink(*this), source(*this), out(&sink), in(&source)
+	{}
+
+	Runner::~Runner()
+	{
+		stop();
+	}
+
+	void Runner::start()
+	{
+		thread = std::thread([this] { run(); });
+	}
+
+	void Runner::stop()
+	{
+		stopping.store(true, std::memory_order_relaxed);
+		if(thread.joinable())
+			thread.join();
+	}
+
+	bool Runner::finished() const
+	{
+		return done.load(std::memory_order_acquire);
+	}
+
+	bool Runner::waiting() const
+	{
+		return reading.load(std::memory_order_relaxed);
+	}
+
+	Status Runner::status() const
+	{
+		return result;
+	}
+
+	const std::string& Runner::error() const
+	{
+		return message;
+	}
+
+	void Runner::drain(std::string& text)
+	{
+		char chunk[4096];
+		while(size_t count = printed.pop(chunk, sizeof(chunk)))
+			text.append(chunk, count);
+	}
+
+	bool Runner::post(std::string line)
+	{
+		return lines.push(std::move(line));
+	}
+
+	void Runner::run()
+	{
+		VM vm(module, in, out);
+		vm.scheduler = scheduler;
+		vm.start();
+
+		Status status;
+		while((status = vm.resume(slice_steps)) == Status::Paused)
+		{
+			out.flush();
+			if(stopping.load(std::memory_order_relaxed))
+			{
+				vm.error = "stopped in function '" + vm.position() + "'";
+				status = Status::Error;
+				break;
+			}
+		}
+
+		// A run stopped while it waited for a line read nothing and went on.
+		if(stopping.load(std::memory_order_relaxed) && status == Status::Ok)
+		{
+			vm.error = "stopped";
+			status = Status::Error;
+		}
+
+		out.flush();
+		result = status;
+		message = vm.error;
+		done.store(true, std::memory_order_release);
+	}
+
+	Runner::Sink::Sink(Runner& runner)
+		: runner(runner), buffer(sink_size)
+	{
+		setp(buffer.data(), buffer.data() + buffer.size());
+	}
+
+	Runner::Sink::int_type Runner::Sink::overflow(int_type c)
+	{
+		sync();
+		if(!traits_type::eq_int_type(c, traits_type::eof()))
+		{
+			*pptr() = traits_type::to_char_type(c);
+			pbump(1);
+		}
+
+		return traits_type::not_eof(c);
+	}
+
+	// Hands the buffer over, waiting while the editor has yet to take what
+	// came before. Output of a stopped run is dropped.
+	int Runner::Sink::sync()
+	{
+		const char* begin = pbase();
+		while(begin < pptr() && !runner.stopping.load(std::memory_order_relaxed))
+		{
+			begin += runner.printed.push(begin, pptr() - begin);
+			if(begin < pptr())
+				std::this_thread::yield();
+		}
+
+		setp(buffer.data(), buffer.data() + buffer.size());
+		return 0;
+	}
+
+	Runner::Source::Source(Runner& runner)
+		: runner(runner)
+	{}
+
+	// Takes the next line the editor posted, printing everything before
+	// it first. People type slowly, so waiting sleeps rather than spins.
+	Runner::Source::int_type Runner::Source::underflow()
+	{
+		if(gptr() < egptr())
+			return traits_type::to_int_type(*gptr());
+
+		runner.out.flush();
+		runner.reading.store(true, std::memory_order_relaxed);
+		while(!runner.lines.pop(line))
+		{
+			if(runner.stopping.load(std::memory_order_relaxed))
+			{
+				runner.reading.store(false, std::memory_order_relaxed);
+				return traits_type::eof();
+			}
+
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+
+		runner.reading.store(false, std::memory_order_relaxed);
+		line += '\n';
+		setg(&line[0], &line[0], &line[0] + line.size());
+		return traits_type::to_int_type(*gptr());
+	}
+}
@@ -0,0 +1,537 @@
+// Diaflow
+#include<sccp.h>
+#include<cfg.h>
+#include<ssa.h>
+
+namespace Diaflow
+{
+	namespace
+	{
+		struct Lattice
+		{
+			enum State : uint8_t
+			{
+				Top, Constant, Bottom
+			};
+
+			State state = Top;
+			Value value;
+
+			static Lattice constant(Value value)
+			{
+				// Heap objects belong to the run that made them.
+				if(value.is(Tag::String) || value.is_array() || value.is_map())
+					return bottom();
+
+				return Lattice{ Constant, value };
+			}
+
+			static Lattice bottom()
+			{
+				return Lattice{ Bottom, Value() };
+			}
+
+			bool operator==(const Lattice& other) const
+			{
+				return state == other.state && (state != Constant || value == other.value);
+			}
+		};
+
+		Lattice meet(const Lattice& a, const Lattice& b)
+		{
+			if(a.state == Lattice::Top)
+				return b;
+
+			if(b.state == Lattice::Top || a == b)
+				return a;
+
+			return Lattice::bottom();
+		}
+
+		class Propagator
+		{
+		public:
+			Propagator(const ParsedFunction& parsed, FunctionConstants& result, const std::vector<std::optional<Value>>* args = nullptr)
+				: parsed(parsed), result(result), args(args)
+			{}
+
+			void run()
+			{
+				// A function the compiler will reject anyway keeps no facts.
+				if(!cfg.build(*parsed.body))
+					return;
+
+				ssa.build(cfg, parsed);
+				const uint32_t size = static_cast<uint32_t>(cfg.blocks.size());
+				values.assign(ssa.size(), Lattice());
+				users.assign(ssa.size(), {});
+				executable.assign(size, false);
+				queued.assign(size, false);
+				edges.assign(size, 0);
+
+				for(uint32_t local = 0; local < parsed.locals.size(); local++)
+				{
+					if(local >= parsed.args->size())
+						values[local] = Lattice::constant(Value::nil());
+					else if(args && (*args)[local])
+						values[local] = Lattice::constant(*(*args)[local]);
+					else
+						values[local] = Lattice::bottom();
+				}
+
+				for(uint32_t b : cfg.order)
+				{
+					auto use = [&](uint32_t value)
+					{
+						if(users[value].empty() || users[value].back() != b)
+							users[value].push_back(b);
+					};
+
+					for(const Phi& phi : ssa.phis[b])
+					{
+						for(uint32_t arg : phi.args)
+							use(arg);
+					}
+
+					auto read = [&](const Expr* expr) { each_use(expr, use); };
+					for_each_access(cfg, parsed, b, read, [&](const Expr*, uint32_t, const Expr* value)
+					{
+						if(value)
+							read(value);
+					});
+
+					// A label test also depends on the subject evaluated before it.
+					if(cfg.blocks[b].exit == Exit::Case)
+						read(parsed[static_cast<const Switch*>(cfg.blocks[b].block)->expr]);
+				}
+
+				executable[Cfg::entry] = true;
+				push(Cfg::entry);
+				while(!work.empty())
+				{
+					uint32_t b = work.back();
+					work.pop_back();
+					queued[b] = false;
+					visit(b);
+				}
+
+				collect();
+			}
+
+		private:
+			const ParsedFunction& parsed;
+			FunctionConstants& result;
+			const std::vector<std::optional<Value>>* args;
+			Cfg cfg;
+			Ssa ssa;
+			Heap heap;
+
+			std::vector<Lattice> values;
+			std::vector<std::vector<uint32_t>> users;
+			std::unordered_map<const Expr*, Lattice> exprs;
+			std::vector<bool> executable;
+			std::vector<bool> queued;
+			// One bit per successor edge found executable.
+			std::vector<uint8_t> edges;
+			std::vector<uint32_t> work;
+
+			template<typename F>
+			void each_use(const Expr* expr, F f)
+			{
+				if(expr->kind == ExprKind::Local)
+				{
+					auto it = ssa.uses.find(expr);
+					if(it != ssa.uses.end())
+						f(it->second);
+				}
+
+				for(const Expr* arg : expr->args)
+					each_use(arg, f);
+			}
+
+			void push(uint32_t b)
+			{
+				if(!queued[b])
+				{
+					queued[b] = true;
+					work.push_back(b);
+				}
+			}
+
+			void set(uint32_t value, const Lattice& lattice)
+			{
+				Lattice lowered = meet(values[value], lattice);
+				if(lowered == values[value])
+					return;
+
+				values[value] = lowered;
+				for(uint32_t b : users[value])
+					push(b);
+			}
+
+			void take(uint32_t b, uint32_t edge)
+			{
+				if(edges[b] & (1u << edge))
+					return;
+
+				edges[b] |= static_cast<uint8_t>(1u << edge);
+				uint32_t next = cfg.blocks[b].succs[edge];
+				executable[next] = true;
+				push(next);
+			}
+
+			bool live(uint32_t from, uint32_t to) const
+			{
+				const BasicBlock& b = cfg.blocks[from];
+				return ((edges[from] & 1) && b.succs[0] == to) || ((edges[from] & 2) && b.succs[1] == to);
+			}
+
+			Lattice eval(const Expr* expr)
+			{
+				Lattice lattice = compute(expr);
+				auto it = exprs.find(expr);
+				if(it != exprs.end())
+					lattice = it->second = meet(it->second, lattice);
+				else
+					exprs.emplace(expr, lattice);
+
+				return lattice;
+			}
+
+			Lattice compute(const Expr* expr)
+			{
+				switch(expr->kind)
+				{
+					case ExprKind::Literal:
+						return Lattice::constant(expr->value);
+
+					case ExprKind::Local:
+					{
+						auto it = ssa.uses.find(expr);
+						return it != ssa.uses.end() ? values[it->second] : Lattice::bottom();
+					}
+
+					case ExprKind::Unary:
+					{
+						Lattice x = eval(expr->args[0]);
+						if(x.state != Lattice::Constant)
+							return x;
+
+						if(expr->unary() == UnaryOp::Not)
+							return Lattice::constant(Value::boolean(!truthy(x.value)));
+
+						Value out;
+						return neg(x.value, out) == Fault::None ? Lattice::constant(out) : Lattice::bottom();
+					}
+
+					case ExprKind::Binary:
+					{
+						BinaryOp op = expr->binary();
+						Lattice a = eval(expr->args[0]);
+						Lattice b = eval(expr->args[1]);
+						if(op == BinaryOp::And || op == BinaryOp::Or)
+						{
+							if(a.state != Lattice::Constant)
+								return a.state == Lattice::Top ? a : Lattice::bottom();
+
+							return truthy(a.value) == (op == BinaryOp::And) ? b : a;
+						}
+
+						if(a.state == Lattice::Bottom || b.state == Lattice::Bottom)
+							return Lattice::bottom();
+
+						if(a.state == Lattice::Top || b.state == Lattice::Top)
+							return Lattice();
+
+						return binary(op, a.value, b.value);
+					}
+
+					case ExprKind::Builtin:
+					{
+						bool known = expr->builtin() != Builtin::Push;
+						bool top = false;
+						std::vector<Value> args;
+						for(const Expr* arg : expr->args)
+						{
+							Lattice x = eval(arg);
+							known = known && x.state != Lattice::Bottom;
+							top = top || x.state == Lattice::Top;
+							args.push_back(x.value);
+						}
+
+						if(!known)
+							return Lattice::bottom();
+
+						if(top)
+							return Lattice();
+
+						Value out;
+						return builtin(expr->builtin(), args.data(), out, heap) == Fault::None ? Lattice::constant(out) : Lattice::bottom();
+					}
+
+					default:
+						for(const Expr* arg : expr->args)
+							eval(arg);
+
+						return Lattice::bottom();
+				}
+			}
+
+			Lattice binary(BinaryOp op, const Value& a, const Value& b)
+			{
+				Value out;
+				Fault fault = Fault::None;
+				switch(op)
+				{
+					case BinaryOp::Add: fault = add(a, b, out, heap); break;
+					case BinaryOp::Sub: fault = sub(a, b, out); break;
+					case BinaryOp::Mul: fault = mul(a, b, out); break;
+					case BinaryOp::Div: fault = div(a, b, out); break;
+					case BinaryOp::Mod: fault = mod(a, b, out); break;
+					case BinaryOp::Eq: out = Value::boolean(equal(a, b)); break;
+					case BinaryOp::Ne: out = Value::boolean(!equal(a, b)); break;
+					case BinaryOp::Lt: fault = less(a, b, out); break;
+					case BinaryOp::Le: fault = less_equal(a, b, out); break;
+					case BinaryOp::Gt: fault = less(b, a, out); break;
+					case BinaryOp::Ge: fault = less_equal(b, a, out); break;
+					default: return Lattice::bottom();
+				}
+
+				return fault == Fault::None ? Lattice::constant(out) : Lattice::bottom();
+			}
+
+			void visit(uint32_t b)
+			{
+				if(!executable[b])
+					return;
+
+				Slice<const uint32_t> preds = cfg.preds(b);
+				for(const Phi& phi : ssa.phis[b])
+				{
+					Lattice lattice;
+					for(size_t k = 0; k < preds.size(); k++)
+					{
+						if(live(preds[k], b))
+							lattice = meet(lattice, values[phi.args[k]]);
+					}
+
+					set(phi.value, lattice);
+				}
+
+				for_each_access(cfg, parsed, b, [this](const Expr* expr) { eval(expr); }, [this](const Expr* site, uint32_t, const Expr* value)
+				{
+					set(ssa.defs.at(site), value ? eval(value) : Lattice::bottom());
+				});
+
+				const BasicBlock& block = cfg.blocks[b];
+				switch(block.exit)
+				{
+					case Exit::Jump:
+					case Exit::Return:
+						take(b, 0);
+						break;
+
+					case Exit::Branch:
+					{
+						Lattice cond = exprs[parsed[*block.source]];
+						if(cond.state == Lattice::Constant)
+							take(b, truthy(cond.value) ? 0 : 1);
+						else if(cond.state == Lattice::Bottom)
+						{
+							take(b, 0);
+							take(b, 1);
+						}
+
+						break;
+					}
+
+					case Exit::Case:
+					{
+						// The subject is evaluated again rather than read from
+						// the block computing it, which may not have seen the
+						// locals it reads change yet.
+						Lattice label = exprs[parsed[*block.source]];
+						Lattice subject = eval(parsed[static_cast<const Switch*>(block.block)->expr]);
+						if(label.state == Lattice::Constant && subject.state == Lattice::Constant)
+							take(b, equal(subject.value, label.value) ? 0 : 1);
+						else if(label.state == Lattice::Bottom || subject.state == Lattice::Bottom)
+						{
+							take(b, 0);
+							take(b, 1);
+						}
+
+						break;
+					}
+
+					case Exit::Next:
+						take(b, 0);
+						take(b, 1);
+						break;
+
+					case Exit::End:
+						break;
+				}
+			}
+
+			// Counts the outermost expressions the compiler will replace; it
+			// reads a constant local in place.
+			void count(const Expr* expr)
+			{
+				if(expr->kind != ExprKind::Literal && expr->kind != ExprKind::Local && result.values.count(expr))
+				{
+					result.folded++;
+					return;
+				}
+
+				for(const Expr* arg : expr->args)
+					count(arg);
+			}
+
+			void collect()
+			{
+				for(auto& [expr, lattice] : exprs)
+				{
+					if(lattice.state == Lattice::Constant && expr->kind != ExprKind::Literal)
+						result.values[expr] = lattice.value;
+				}
+
+				// The first values are the locals on entry; a read of one that
+				// is not a parameter, directly or through a phi, finds nil.
+				result.unassigned.assign(parsed.locals.size(), false);
+				auto unassigned = [&](uint32_t value)
+				{
+					if(value < parsed.locals.size() && value >= parsed.args->size())
+						result.unassigned[value] = true;
+				};
+
+				auto read = [&](const Expr* expr)
+				{
+					count(expr);
+					each_use(expr, unassigned);
+				};
+
+				for(uint32_t b = 0; b < cfg.blocks.size(); b++)
+				{
+					Slice<const uint32_t> preds = cfg.preds(b);
+					for(const Phi& phi : ssa.phis[b])
+					{
+						for(size_t k = 0; k < preds.size(); k++)
+						{
+							if(live(preds[k], b))
+								unassigned(phi.args[k]);
+						}
+					}
+				}
+
+				// A block is live when any part of it runs: a step, the exit it
+				// owns, or the start of the loop it was written as.
+				std::unordered_set<const Block*> live;
+				for(uint32_t b = 0; b < cfg.blocks.size(); b++)
+				{
+					if(!executable[b])
+						continue;
+
+					for(const Step& step : cfg.steps(b))
+						live.insert(step.block);
+
+					live.insert(cfg.blocks[b].block);
+					live.insert(cfg.blocks[b].loop_block);
+					for_each_access(cfg, parsed, b, read, [&](const Expr*, uint32_t, const Expr* value)
+					{
+						if(value)
+							read(value);
+					});
+
+				}
+
+				for(uint32_t b = 0; b < cfg.blocks.size(); b++)
+				{
+					if(executable[b] || b == Cfg::exit)
+						continue;
+
+					result.dead_blocks++;
+					for(const Step& step : cfg.steps(b))
+					{
+						if(!live.count(step.block))
+							result.dead.insert(step.block);
+					}
+
+					for(const Block* block : { cfg.blocks[b].block, cfg.blocks[b].loop_block })
+					{
+						if(block && !live.count(block))
+							result.dead.insert(block);
+					}
+				}
+
+				for(uint32_t b = 0; b < cfg.blocks.size(); b++)
+				{
+					if(!executable[b])
+						continue;
+
+					for(const Step& step : cfg.steps(b))
+					{
+						if(step.kind == StepKind::Subject)
+							resolve(static_cast<const Switch*>(step.block), b);
+					}
+				}
+			}
+
+			// Follows the label tests of a Switch while exactly one way out of
+			// each is executable.
+			void resolve(const Switch* branch, uint32_t b)
+			{
+				for(;;)
+				{
+					const BasicBlock& block = cfg.blocks[b];
+					if(block.exit != Exit::Case || block.block != branch)
+					{
+						size_t entry = branch->cases.size();
+						for(size_t i = 0; i < branch->cases.size(); i++)
+						{
+							if(branch->cases[i].first == "default")
+								entry = i;
+						}
+
+						result.switches[branch] = entry;
+						return;
+					}
+
+					if(edges[b] == 1)
+					{
+						for(size_t i = 0; i < branch->cases.size(); i++)
+						{
+							if(&branch->cases[i].first == block.source)
+								result.switches[branch] = i;
+						}
+
+						return;
+					}
+
+					if(edges[b] != 2)
+						return;
+
+					b = block.succs[1];
+				}
+			}
+		};
+	}
+
+	void ConstantPropagation::run(const std::vector<ParsedFunction>& parsed)
+	{
+		functions.assign(parsed.size(), FunctionConstants());
+		dead_blocks = folded = 0;
+		for(size_t i = 0; i < parsed.size(); i++)
+		{
+			Propagator(parsed[i], functions[i]).run();
+			dead_blocks += functions[i].dead_blocks;
+			folded += functions[i].folded;
+		}
+	}
+
+	FunctionConstants ConstantPropagation::specialize(const ParsedFunction& parsed, const std::vector<std::optional<Value>>& args) const
+	{
+		FunctionConstants result;
+		Propagator(parsed, result, &args).run();
+		return result;
+	}
+}
@@ -0,0 +1,211 @@
+#include<algorithm>
+#include<cstdio>
+
+// Diaflow
+#include<scheduler.h>
+
+namespace Diaflow
+{
+	namespace
+	{
+		struct Current
+		{
+			const Scheduler* scheduler = nullptr;
+			size_t worker = 0;
+			// Tasks running on this thread, one inside the wait of another.
+			size_t nesting = 0;
+		};
+
+		thread_local Current current;
+	}
+
+	Scheduler::Scheduler(uint32_t threads)
+		: started(std::chrono::steady_clock::now())
+	{
+		size_t count = threads ? threads : std::max(1u, std::thread::hardware_concurrency());
+		for(size_t k = 0; k < count; k++)
+			queues.push_back(std::make_unique<Worker>());
+
+		for(size_t k = 1; k < count; k++)
+			this->threads.emplace_back(&Scheduler::loop, this, k);
+	}
+
+	Scheduler::~Scheduler()
+	{
+		{
+			std::lock_guard<std::mutex> guard(sleep);
+			stopping = true;
+		}
+
+		wake.notify_all();
+		for(std::thread& thread : threads)
+			thread.join();
+	}
+
+	size_t Scheduler::workers() const
+	{
+		return queues.size();
+	}
+
+	size_t Scheduler::worker() const
+	{
+		return current.scheduler == this ? current.worker : 0;
+	}
+
+	void Scheduler::submit(Group& group, std::function<void()> task)
+	{
+		group.pending++;
+		Worker& own = *queues[worker()];
+		{
+			std::lock_guard<std::mutex> guard(own.lock);
+			own.tasks.push_back({ std::move(task), &group });
+		}
+
+		{
+			std::lock_guard<std::mutex> guard(sleep);
+			queued++;
+		}
+
+		wake.notify_one();
+	}
+
+	// Pops the newest task of worker `self`, or else steals the oldest of
+	// the first other worker that has one.
+	bool Scheduler::take(size_t self, Task& task)
+	{
+		Worker& own = *queues[self];
+		{
+			std::lock_guard<std::mutex> guard(own.lock);
+			if(!own.tasks.empty())
+			{
+				task = std::move(own.tasks.back());
+				own.tasks.pop_back();
+				queued--;
+				return true;
+			}
+		}
+
+		for(size_t k = 1; k < queues.size(); k++)
+		{
+			Worker& victim = *queues[(self + k) % queues.size()];
+			std::lock_guard<std::mutex> guard(victim.lock);
+			if(!victim.tasks.empty())
+			{
+				task = std::move(victim.tasks.front());
+				victim.tasks.pop_front();
+				queued--;
+				own.steals.fetch_add(1, std::memory_order_relaxed);
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	void Scheduler::execute(size_t self, Task& task)
+	{
+		// A task run while another waits is busy time of the outer one
+		// already.
+		Worker& own = *queues[self];
+		auto start = std::chrono::steady_clock::now();
+		current.nesting++;
+		task.run();
+		current.nesting--;
+		std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - start;
+		if(!current.nesting)
+			own.busy.fetch_add(static_cast<uint64_t>(elapsed.count()), std::memory_order_relaxed);
+
+		own.done.fetch_add(1, std::memory_order_relaxed);
+
+		// The last task of a group wakes whoever waits on it.
+		if(task.group->pending.fetch_sub(1) == 1)
+		{
+			std::lock_guard<std::mutex> guard(sleep);
+			wake.notify_all();
+		}
+	}
+
+	void Scheduler::loop(size_t self)
+	{
+		current = { this, self, 0 };
+		Task task;
+		while(true)
+		{
+			if(take(self, task))
+			{
+				execute(self, task);
+				continue;
+			}
+
+			std::unique_lock<std::mutex> guard(sleep);
+			wake.wait(guard, [this] { return stopping || queued > 0; });
+			if(stopping && queued == 0)
+				return;
+		}
+	}
+
+	void Scheduler::wait(Group& group)
+	{
+		size_t self = worker();
+		Task task;
+		while(group.pending > 0)
+		{
+			if(take(self, task))
+			{
+				execute(self, task);
+				continue;
+			}
+
+			std::unique_lock<std::mutex> guard(sleep);
+			wake.wait(guard, [&] { return group.pending == 0 || queued > 0; });
+		}
+	}
+
+	void Scheduler::parallel_for(size_t begin, size_t end, size_t grain, const std::function<void(size_t)>& f)
+	{
+		grain = std::max<size_t>(1, grain);
+		Group group;
+		for(size_t first = begin; first < end; first += grain)
+		{
+			size_t last = std::min(end, first + grain);
+			submit(group, [&f, first, last]
+			{
+				for(size_t k = first; k < last; k++)
+					f(k);
+			});
+		}
+
+		wait(group);
+	}
+
+	std::vector<Scheduler::Utilization> Scheduler::utilization() const
+	{
+		std::vector<Utilization> all;
+		for(const auto& worker : queues)
+		{
+			Utilization u;
+			u.tasks = worker->done.load(std::memory_order_relaxed);
+			u.steals = worker->steals.load(std::memory_order_relaxed);
+			u.busy = worker->busy.load(std::memory_order_relaxed) / 1e9;
+			all.push_back(u);
+		}
+
+		return all;
+	}
+
+	std::string Scheduler::report() const
+	{
+		std::chrono::duration<double> up = std::chrono::steady_clock::now() - started;
+		std::vector<Utilization> all = utilization();
+		std::string out;
+		for(size_t k = 0; k < all.size(); k++)
+		{
+			char line[128];
+			std::snprintf(line, sizeof(line), "worker %zu: %llu tasks, %llu steals, %.3fs busy (%.0f%%)\n", k, static_cast<unsigned long long>(all[k].tasks),
+				static_cast<unsigned long long>(all[k].steals), all[k].busy, up.count() > 0 ? 100 * all[k].busy / up.count() : 0.0);
+			out += line;
+		}
+
+		return out;
+	}
+}
@@ -0,0 +1,169 @@
+// Diaflow
+#include<ssa.h>
+
+namespace Diaflow
+{
+	namespace
+	{
+		template<typename F>
+		void each_local(const Expr* expr, F f)
+		{
+			if(expr->kind == ExprKind::Local)
+				f(expr);
+
+			for(const Expr* arg : expr->args)
+				each_local(arg, f);
+		}
+	}
+
+	uint32_t Ssa::make(uint32_t local, uint32_t block)
+	{
+		locals.push_back(local);
+		blocks.push_back(block);
+		return static_cast<uint32_t>(locals.size() - 1);
+	}
+
+	void Ssa::build(const Cfg& cfg, const ParsedFunction& parsed)
+	{
+		const uint32_t count = static_cast<uint32_t>(parsed.locals.size());
+		const uint32_t size = static_cast<uint32_t>(cfg.blocks.size());
+		locals.clear();
+		blocks.clear();
+		uses.clear();
+		defs.clear();
+		phis.assign(size, {});
+
+		for(uint32_t local = 0; local < count; local++)
+			make(local, Cfg::entry);
+
+		std::vector<std::vector<uint32_t>> assigned(count);
+		for(uint32_t b : cfg.order)
+		{
+			for_each_access(cfg, parsed, b, [](const Expr*) {}, [&](const Expr*, uint32_t local, const Expr*)
+			{
+				if(assigned[local].empty() || assigned[local].back() != b)
+					assigned[local].push_back(b);
+			});
+		}
+
+		// Dominance frontiers, walking up from the predecessors of every join.
+		std::vector<std::vector<uint32_t>> frontier(size);
+		for(uint32_t b : cfg.order)
+		{
+			if(cfg.preds(b).size() < 2)
+				continue;
+
+			for(uint32_t runner : cfg.preds(b))
+			{
+				for(; runner != cfg.blocks[b].idom; runner = cfg.blocks[runner].idom)
+				{
+					if(frontier[runner].empty() || frontier[runner].back() != b)
+						frontier[runner].push_back(b);
+				}
+			}
+		}
+
+		std::vector<uint32_t> has_phi(size, BasicBlock::none), queued(size, BasicBlock::none);
+		std::vector<uint32_t> work;
+		for(uint32_t local = 0; local < count; local++)
+		{
+			work = assigned[local];
+			for(uint32_t b : work)
+				queued[b] = local;
+
+			while(!work.empty())
+			{
+				uint32_t b = work.back();
+				work.pop_back();
+				for(uint32_t join : frontier[b])
+				{
+					if(has_phi[join] == local)
+						continue;
+
+					has_phi[join] = local;
+					phis[join].push_back(Phi{ local, make(local, join), std::vector<uint32_t>(cfg.preds(join).size(), BasicBlock::none) });
+					if(queued[join] != local)
+					{
+						queued[join] = local;
+						work.push_back(join);
+					}
+				}
+			}
+		}
+
+		// Renaming walks the dominator tree, keeping the current value of
+		// every local on a stack and logging pushes so leaving a block can
+		// undo them.
+		std::vector<std::vector<uint32_t>> current(count);
+		for(uint32_t local = 0; local < count; local++)
+			current[local].push_back(local);
+
+		std::vector<uint32_t> log;
+		struct Visit
+		{
+			uint32_t block;
+			uint32_t child;
+			size_t mark;
+		};
+
+		std::vector<Visit> stack;
+		auto enter = [&](uint32_t b)
+		{
+			stack.push_back(Visit{ b, 0, log.size() });
+			for(const Phi& phi : phis[b])
+			{
+				current[phi.local].push_back(phi.value);
+				log.push_back(phi.local);
+			}
+
+			auto read = [&](const Expr* expr)
+			{
+				each_local(expr, [&](const Expr* local) { uses[local] = current[parsed.local(local->name)].back(); });
+			};
+
+			for_each_access(cfg, parsed, b, read, [&](const Expr* site, uint32_t local, const Expr* value)
+			{
+				if(value)
+					read(value);
+
+				uint32_t v = make(local, b);
+				defs[site] = v;
+				current[local].push_back(v);
+				log.push_back(local);
+			});
+
+			const BasicBlock& block = cfg.blocks[b];
+			for(uint32_t i = 0; i < block.successors(); i++)
+			{
+				uint32_t next = block.succs[i];
+				Slice<const uint32_t> preds = cfg.preds(next);
+				for(size_t k = 0; k < preds.size(); k++)
+				{
+					if(preds[k] != b)
+						continue;
+
+					for(Phi& phi : phis[next])
+						phi.args[k] = current[phi.local].back();
+				}
+			}
+		};
+
+		enter(Cfg::entry);
+		while(!stack.empty())
+		{
+			Visit& visit = stack.back();
+			Slice<const uint32_t> children = cfg.children(visit.block);
+			if(visit.child < children.size())
+			{
+				enter(children[visit.child++]);
+				continue;
+			}
+
+			for(size_t i = log.size(); i > visit.mark; i--)
+				current[log[i - 1]].pop_back();
+
+			log.resize(visit.mark);
+			stack.pop_back();
+		}
+	}
+}
@@ -0,0 +1,81 @@
+// Diaflow
+#include<tier.h>
+#include<compiler.h>
+
+namespace Diaflow
+{
+	TierManager::TierManager(const Program& program, Module& module)
+		: program(program), module(module)
+	{}
+
+	bool TierManager::compile()
+	{
+		Compiler compiler;
+		compiler.optimize = false;
+		compiler.instrument = profile != nullptr;
+		if(!compiler.compile(program, module))
+		{
+			error = compiler.error;
+			return false;
+		}
+
+		optimized.clear();
+		attempted = false;
+		natives.assign(module.functions.size(), nullptr);
+		jitted.assign(module.functions.size(), false);
+		counters.assign(module.functions.size(), Counters());
+		for(size_t i = 0; i < module.functions.size(); i++)
+			counters[i].backedges.assign(module.functions[i].loops.size(), 0);
+
+		return true;
+	}
+
+	Tier TierManager::top() const
+	{
+		return native && Jit::supported() ? Tier::Native : Tier::Optimized;
+	}
+
+	const Function* TierManager::function(uint32_t index, Tier tier)
+	{
+		if(tier == Tier::Baseline)
+			return &module.functions[index];
+
+		if(!attempted)
+		{
+			attempted = true;
+			Compiler compiler;
+			compiler.profile = profile;
+			if(!compiler.compile(program, module, optimized))
+			{
+				error = compiler.error;
+				optimized.clear();
+			}
+		}
+
+		if(index >= optimized.size())
+			return nullptr;
+
+		if(tier == Tier::Optimized)
+			return &optimized[index];
+
+		// A branch waiting on a channel is put aside by the interpreter,
+		// which native code could not do.
+		if(optimized[index].waits)
+			return nullptr;
+
+		if(!jitted[index])
+		{
+			jitted[index] = true;
+			natives[index] = jit.compile(optimized[index]);
+			if(!natives[index])
+				error = jit.error;
+		}
+
+		return natives[index] ? &optimized[index] : nullptr;
+	}
+
+	NativeCode TierManager::native_code(uint32_t index) const
+	{
+		return index < natives.size() ? natives[index] : nullptr;
+	}
+}
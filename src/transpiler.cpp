@@ -0,0 +1,678 @@
+#include<cctype>
+#include<cstdio>
+#include<cstdlib>
+#include<fstream>
+
+// Diaflow
+#include<transpiler.h>
+#include<compiler.h>
+#include<expr.h>
+#include<parsed.h>
+
+namespace Diaflow
+{
+	namespace
+	{
+		std::string quote(std::string_view s)
+		{
+			std::string out = "\"";
+			for(char c : s)
+			{
+				unsigned char u = static_cast<unsigned char>(c);
+				if(c == '"' || c == '\\')
+					out += std::string("\\") + c;
+				else if(c == '\n')
+					out += "\\n";
+				else if(c == '\t')
+					out += "\\t";
+				else if(u < 0x20 || u >= 0x7F)
+				{
+					char escape[8];
+					std::snprintf(escape, sizeof(escape), "\\%03o", u);
+					out += escape;
+				}
+				else
+					out += c;
+			}
+
+			return out + "\"";
+		}
+
+		std::string identifier(const std::string& name)
+		{
+			std::string out;
+			for(char c : name)
+				out += std::isalnum(static_cast<unsigned char>(c)) ? c : '_';
+
+			return out;
+		}
+
+		const char* builtin_name(Builtin which)
+		{
+			switch(which)
+			{
+				case Builtin::Len: return "Len";
+				case Builtin::Str: return "Str";
+				case Builtin::Int: return "Int";
+				case Builtin::Float: return "Float";
+				case Builtin::Push: return "Push";
+				case Builtin::Abs: return "Abs";
+				case Builtin::Sqrt: return "Sqrt";
+				case Builtin::Floor: return "Floor";
+			}
+
+			return "Len";
+		}
+
+		const char* binary_name(BinaryOp op)
+		{
+			switch(op)
+			{
+				case BinaryOp::Add: return "add";
+				case BinaryOp::Sub: return "sub";
+				case BinaryOp::Mul: return "mul";
+				case BinaryOp::Div: return "div";
+				case BinaryOp::Mod: return "mod";
+				case BinaryOp::Eq: return "eq";
+				case BinaryOp::Ne: return "ne";
+				case BinaryOp::Lt: return "lt";
+				case BinaryOp::Le: return "le";
+				case BinaryOp::Gt: return "gt";
+				case BinaryOp::Ge: return "ge";
+				case BinaryOp::And: return "logical_and";
+				case BinaryOp::Or: return "logical_or";
+			}
+
+			return "add";
+		}
+
+		// Whether evaluating `expr` can neither fail nor have effects, so it
+		// may go anywhere in C++'s evaluation order.
+		bool simple(const Expr* expr)
+		{
+			return expr->kind == ExprKind::Literal || expr->kind == ExprKind::Local || expr->kind == ExprKind::Global;
+		}
+
+		// Names and string constants shared by the functions of one program.
+		struct Symbols
+		{
+			std::unordered_map<std::string, std::string> functions;
+			std::unordered_map<std::string, std::string> globals;
+			std::unordered_map<std::string, std::string> texts;
+			std::string declarations;
+
+			std::string global(const std::string& name)
+			{
+				auto it = globals.find(name);
+				if(it != globals.end())
+					return it->second;
+
+				std::string id = "g_" + identifier(name);
+				if(identifier(name) != name)
+					id += "_" + std::to_string(globals.size());
+
+				declarations += "static Value " + id + ";\n";
+				return globals[name] = id;
+			}
+
+			std::string text(std::string_view s)
+			{
+				auto it = texts.find(std::string(s));
+				if(it != texts.end())
+					return it->second;
+
+				std::string id = "text_" + std::to_string(texts.size());
+				declarations += "static const Value " + id + " = text(" + quote(s) + ");\n";
+				return texts[std::string(s)] = id;
+			}
+		};
+
+		// Whether control never leaves the end of `body`.
+		bool ends(const Comp& body)
+		{
+			if(body.empty())
+				return false;
+
+			const Block* last = body.back();
+			return dynamic_cast<const Return*>(last) || dynamic_cast<const Break*>(last) || dynamic_cast<const Continue*>(last);
+		}
+
+		class FunctionWriter
+		{
+		public:
+			FunctionWriter(const ParsedFunction& parsed, Symbols& symbols, std::string& out)
+				: parsed(parsed), symbols(symbols), out(out)
+			{}
+
+			void write()
+			{
+				locals.resize(parsed.locals.size());
+				for(auto& [name, reg] : parsed.locals)
+					locals[reg] = name;
+
+				out += "static Value " + signature() + "\n{\n";
+				line("Frame frame(" + quote(parsed.name) + ");");
+				if(locals.size() > parsed.args->size())
+				{
+					std::string declaration = "Value ";
+					for(size_t i = parsed.args->size(); i < locals.size(); i++)
+						declaration += (i > parsed.args->size() ? ", v_" : "v_") + locals[i];
+
+					line(declaration + ";");
+				}
+
+				out += "\n";
+				size_t start = out.size();
+				comp(*parsed.body);
+				if(jumps)
+					out.insert(start, "tail:\n");
+
+				if(!ends(*parsed.body))
+					line("return Value();");
+				out += "}\n";
+			}
+
+			std::string signature()
+			{
+				std::string s = symbols.functions.at(parsed.name) + "(";
+				for(size_t i = 0; i < parsed.args->size(); i++)
+					s += (i ? ", Value v_" : "Value v_") + (*parsed.args)[i];
+
+				return s + ")";
+			}
+
+		private:
+			const ParsedFunction& parsed;
+			Symbols& symbols;
+			std::string& out;
+			int depth = 1;
+			int temporaries = 0;
+			// Local names by register, and whether a tail call jumps back
+			// to the top of the function.
+			std::vector<std::string> locals;
+			bool jumps = false;
+
+			void line(const std::string& text)
+			{
+				out.append(depth, '\t');
+				out += text + "\n";
+			}
+
+			std::string temporary()
+			{
+				return "t" + std::to_string(temporaries++);
+			}
+
+			void open()
+			{
+				line("{");
+				depth++;
+			}
+
+			void close()
+			{
+				depth--;
+				line("}");
+			}
+
+			std::string literal(const Value& value)
+			{
+				switch(value.type())
+				{
+					case Type::Nil:
+						return "Value()";
+
+					case Type::Bool:
+						return value.as_bool() ? "Value::boolean(true)" : "Value::boolean(false)";
+
+					case Type::Int:
+						return "Value::integer(" + std::to_string(value.as_int()) + ")";
+
+					case Type::Double:
+					{
+						double d = value.as_double();
+						if(std::isinf(d))
+							return d > 0 ? "Value::number(HUGE_VAL)" : "Value::number(-HUGE_VAL)";
+
+						char digits[32];
+						std::snprintf(digits, sizeof(digits), "%.17g", d);
+						std::string s = digits;
+						if(s.find_first_of(".e") == std::string::npos)
+							s += ".0";
+
+						return "Value::number(" + s + ")";
+					}
+
+					default:
+						return symbols.text(string_view(value));
+				}
+			}
+
+			std::string list(const std::vector<Expr*>& args)
+			{
+				std::string s;
+				for(size_t i = 0; i < args.size(); i++)
+					s += (i ? ", " : "") + expr(args[i]);
+
+				return s;
+			}
+
+			std::string expr(const Expr* e)
+			{
+				switch(e->kind)
+				{
+					case ExprKind::Literal:
+						return literal(e->value);
+
+					case ExprKind::Local:
+						return "v_" + e->name;
+
+					case ExprKind::Global:
+						return symbols.global(e->name);
+
+					case ExprKind::Unary:
+						return std::string(e->unary() == UnaryOp::Neg ? "negate(" : "logical_not(") + expr(e->args[0]) + ")";
+
+					case ExprKind::Binary:
+					{
+						BinaryOp op = e->binary();
+						if(op == BinaryOp::And || op == BinaryOp::Or)
+							return std::string(binary_name(op)) + "(" + expr(e->args[0]) + ", [&] { return " + expr(e->args[1]) + "; })";
+
+						return std::string(binary_name(op)) + "({ " + list(e->args) + " })";
+					}
+
+					case ExprKind::Index:
+						return "index({ " + list(e->args) + " })";
+
+					case ExprKind::Array:
+						return "array({ " + list(e->args) + " })";
+
+					case ExprKind::Map:
+						return "map({ " + list(e->args) + " })";
+
+					case ExprKind::Builtin:
+						return std::string("builtin(Builtin::") + builtin_name(e->builtin()) + ", { " + list(e->args) + " })";
+
+					case ExprKind::Assign:
+						return assignment(e->args[0], expr(e->args[1]));
+				}
+
+				return "Value()";
+			}
+
+			// `target = code` as a C++ expression. Containers and keys are
+			// evaluated before the value, as the interpreter does.
+			std::string assignment(const Expr* target, const std::string& code)
+			{
+				if(target->kind == ExprKind::Local)
+					return "v_" + target->name + " = " + code;
+
+				if(target->kind == ExprKind::Global)
+					return symbols.global(target->name) + " = " + code;
+
+				return "set_index({ " + expr(target->args[0]) + ", " + expr(target->args[1]) + ", " + code + " })";
+			}
+
+			// Stores a value that was computed before the target was looked
+			// at, going through a temporary for indexed targets.
+			void store(const Expr* target, const std::string& code)
+			{
+				if(target->kind != ExprKind::Index)
+				{
+					line(assignment(target, code) + ";");
+					return;
+				}
+
+				std::string t = temporary();
+				line("Value " + t + " = " + code + ";");
+				line(assignment(target, t) + ";");
+			}
+
+			void body(const Comp& comp)
+			{
+				open();
+				this->comp(comp);
+				close();
+			}
+
+			void comp(const Comp& body)
+			{
+				for(size_t k = 0; k < body.size(); k++)
+				{
+					if(tail_call(body, k))
+						jump(*static_cast<const Call*>(body[k]));
+					else
+						statement(body[k]);
+				}
+			}
+
+			// Whether the block at `k` in `body` calls the function it is in
+			// and stores the result in a local that the next Return gives
+			// back, comments aside, as the bytecode compiler finds tail calls.
+			bool tail_call(const Comp& body, size_t k)
+			{
+				auto call = dynamic_cast<const Call*>(body[k]);
+				if(!call || call->name != parsed.name || call->retvar.empty())
+					return false;
+
+				size_t next = k + 1;
+				while(next < body.size() && dynamic_cast<const Comment*>(body[next]))
+					next++;
+
+				auto ret = next < body.size() ? dynamic_cast<const Return*>(body[next]) : nullptr;
+				if(!ret || ret->expr.empty())
+					return false;
+
+				const Expr* retvar = parsed[call->retvar];
+				const Expr* expr = parsed[ret->expr];
+				return retvar->kind == ExprKind::Local && expr->kind == ExprKind::Local && retvar->name == expr->name;
+			}
+
+			// A tail call runs in the caller's frame, like the VM's: the
+			// arguments take the place of the parameters, the other locals
+			// are nil again and the body starts over, adding no depth.
+			void jump(const Call& call)
+			{
+				open();
+				std::vector<std::string> args;
+				for(const std::string& arg : call.args)
+				{
+					args.push_back(temporary());
+					line("Value " + args.back() + " = " + expr(parsed[arg]) + ";");
+				}
+
+				for(size_t i = 0; i < locals.size(); i++)
+					line("v_" + locals[i] + " = " + (i < args.size() ? args[i] : std::string("Value()")) + ";");
+
+				line("goto tail;");
+				close();
+				jumps = true;
+			}
+
+			void statement(const Block* block)
+			{
+				if(auto assign = dynamic_cast<const Assign*>(block))
+					line(expr(parsed[assign->expr]) + ";");
+				else if(auto input = dynamic_cast<const Input*>(block))
+					store(parsed[input->expr], "input()");
+				else if(auto output = dynamic_cast<const Output*>(block))
+					line("output(" + expr(parsed[output->expr]) + (output->newline ? ", true);" : ", false);"));
+				else if(auto branch = dynamic_cast<const If*>(block))
+				{
+					line("if(truthy(" + expr(parsed[branch->cond]) + "))");
+					body(branch->t);
+					if(!branch->f.empty())
+					{
+						line("else");
+						body(branch->f);
+					}
+				}
+				else if(auto loop = dynamic_cast<const While*>(block))
+				{
+					line("while(truthy(" + expr(parsed[loop->cond]) + "))");
+					body(loop->body);
+				}
+				else if(auto loop = dynamic_cast<const DoWhile*>(block))
+				{
+					line("do");
+					body(loop->body);
+					line("while(truthy(" + expr(parsed[loop->cond]) + "));");
+				}
+				else if(auto loop = dynamic_cast<const For*>(block))
+				{
+					std::string init = loop->init.empty() ? "" : expr(parsed[loop->init]);
+					std::string cond = loop->cond.empty() ? "" : " truthy(" + expr(parsed[loop->cond]) + ")";
+					std::string inc = loop->inc.empty() ? "" : " " + expr(parsed[loop->inc]);
+					line("for(" + init + ";" + cond + ";" + inc + ")");
+					body(loop->body);
+				}
+				else if(auto loop = dynamic_cast<const Foreach*>(block))
+				{
+					const Expr* var = parsed[loop->var];
+					std::string iteration = temporary();
+					if(var->kind != ExprKind::Index)
+					{
+						line("for(Iteration " + iteration + "(" + expr(parsed[loop->iter]) + "); " + iteration + ".next(" + expr(var) + "); )");
+						body(loop->body);
+					}
+					else
+					{
+						std::string item = temporary();
+						line("Value " + item + ";");
+						line("for(Iteration " + iteration + "(" + expr(parsed[loop->iter]) + "); " + iteration + ".next(" + item + "); )");
+						open();
+						line(assignment(var, item) + ";");
+						comp(loop->body);
+						close();
+					}
+				}
+				else if(auto branch = dynamic_cast<const Switch*>(block))
+					switch_statement(*branch);
+				else if(dynamic_cast<const Break*>(block))
+					line("break;");
+				else if(dynamic_cast<const Continue*>(block))
+					line("continue;");
+				else if(auto call = dynamic_cast<const Call*>(block))
+					call_statement(*call);
+				else if(auto ret = dynamic_cast<const Return*>(block))
+					line("return " + (ret->expr.empty() ? std::string("Value()") : expr(parsed[ret->expr])) + ";");
+				else if(auto parallel = dynamic_cast<const Parallel*>(block))
+				{
+					// Branches of a Parallel give the same result run in
+					// turn, which is how the generated program runs them.
+					for(const Comp& branch : parallel->branches)
+						body(branch);
+				}
+				else if(auto comment = dynamic_cast<const Comment*>(block))
+				{
+					size_t start = 0;
+					do
+					{
+						size_t end = comment->comment.find('\n', start);
+						std::string text = comment->comment.substr(start, end == std::string::npos ? end : end - start);
+						start = end == std::string::npos ? end : end + 1;
+
+						// A line comment ending in a backslash, even one
+						// followed by spaces, would splice the next line into
+						// it.
+						size_t last = text.find_last_not_of(" \t\r\v\f");
+						if(last == std::string::npos || text[last] != '\\')
+						{
+							line("// " + text);
+							continue;
+						}
+
+						for(size_t at = text.find("*/"); at != std::string::npos; at = text.find("*/", at))
+							text.insert(at + 1, " ");
+
+						line("/* " + text + " */");
+					}
+					while(start != std::string::npos);
+				}
+			}
+
+			// Labels are compared in order until one matches; the bodies then
+			// run from that case on until a break, as in C.
+			void switch_statement(const Switch& branch)
+			{
+				open();
+				std::string subject = temporary();
+				std::string which = temporary();
+				line("Value " + subject + " = " + expr(parsed[branch.expr]) + ";");
+
+				int fallback = -1;
+				for(size_t i = 0; i < branch.cases.size(); i++)
+				{
+					if(branch.cases[i].first == "default")
+						fallback = static_cast<int>(i);
+				}
+
+				line("int " + which + " = " + std::to_string(fallback) + ";");
+				std::string chain;
+				for(size_t i = 0; i < branch.cases.size(); i++)
+				{
+					const std::string& label = branch.cases[i].first;
+					if(label == "default")
+						continue;
+
+					line(chain + "if(equal(" + subject + ", " + expr(parsed[label]) + "))");
+					line("\t" + which + " = " + std::to_string(i) + ";");
+					chain = "else ";
+				}
+
+				line("switch(" + which + ")");
+				open();
+				for(size_t i = 0; i < branch.cases.size(); i++)
+				{
+					if(i && !ends(branch.cases[i - 1].second))
+						line("\t[[fallthrough]];");
+
+					line("case " + std::to_string(i) + ":");
+					depth++;
+					comp(branch.cases[i].second);
+					depth--;
+				}
+
+				// A label may not end the block, and the last case may be
+				// empty.
+				line("\tbreak;");
+				close();
+				close();
+			}
+
+			void call_statement(const Call& call)
+			{
+				std::vector<std::string> args;
+				size_t effects = 0;
+				for(const std::string& arg : call.args)
+				{
+					args.push_back(expr(parsed[arg]));
+					effects += !simple(parsed[arg]);
+				}
+
+				// C++ leaves the order of arguments open, so arguments that
+				// can fail are evaluated into temporaries first.
+				bool ordered = effects > 1;
+				if(ordered)
+				{
+					open();
+					for(std::string& arg : args)
+					{
+						std::string t = temporary();
+						line("Value " + t + " = " + arg + ";");
+						arg = t;
+					}
+				}
+
+				std::string code = symbols.functions.at(call.name) + "(";
+				for(size_t i = 0; i < args.size(); i++)
+					code += (i ? ", " : "") + args[i];
+
+				code += ")";
+				if(call.retvar.empty())
+					line(code + ";");
+				else
+					store(parsed[call.retvar], code);
+
+				if(ordered)
+					close();
+			}
+		};
+	}
+
+	bool Transpiler::translate(const Program& program, std::string& out)
+	{
+		// The bytecode compiler checks everything the C++ compiler would
+		// otherwise complain about, with the messages users already know.
+		Module module;
+		Compiler checker;
+		if(!checker.compile(program, module))
+		{
+			error = checker.error;
+			return false;
+		}
+
+		// The exported program runs the branches of a Parallel block in turn,
+		// so one could never wait for another to send.
+		if(!module.channels.empty())
+		{
+			error = "a program with channels cannot be exported";
+			return false;
+		}
+
+		ExprPool pool;
+		Parser parser(pool, module.strings);
+		Symbols symbols;
+		std::vector<ParsedFunction> parsed(module.functions.size());
+		for(size_t i = 0; i < module.functions.size(); i++)
+		{
+			const std::string& name = module.functions[i].name;
+			auto& [args, body] = program.funcs.at(name);
+			parsed[i].parse(name, args, body, parser);
+
+			std::string id = "f_" + identifier(name);
+			if(identifier(name) != name)
+				id += "_" + std::to_string(i);
+
+			symbols.functions[name] = id;
+		}
+
+		std::string prototypes, functions;
+		for(const ParsedFunction& function : parsed)
+		{
+			FunctionWriter writer(function, symbols, functions);
+			prototypes += "static Value " + writer.signature() + ";\n";
+			functions += "\n";
+			writer.write();
+		}
+
+		out = "// Exported from a Diaflow flowchart. Build with the Diaflow include\n"
+			"// directory on the include path:\n"
+			"//   c++ -std=c++17 -O2 -I<diaflow>/include <this file>\n"
+			"// It reads standard input, or the file named by its first argument.\n"
+			"#include<aot.h>\n\n"
+			"using namespace Diaflow::Aot;\n\n";
+
+		out += prototypes;
+		if(!symbols.declarations.empty())
+			out += "\n" + symbols.declarations;
+
+		out += functions;
+		out += "\nint main(int argc, char** argv)\n{\n\tif(!start(argc, argv))\n\t\treturn 1;\n\n\t" + symbols.functions.at("main") + "();\n\treturn finish();\n}\n";
+		return true;
+	}
+
+	bool Transpiler::build(const Program& program, const std::string& source, const std::string& binary)
+	{
+		std::string code;
+		if(!translate(program, code))
+			return false;
+
+		std::ofstream file(source, std::ios::binary);
+		if(!(file << code) || !(file.close(), file))
+		{
+			error = "cannot write '" + source + "'";
+			return false;
+		}
+
+		auto shell = [](const std::string& s)
+		{
+			std::string out = "'";
+			for(char c : s)
+				out += c == '\'' ? std::string("'\\''") : std::string(1, c);
+
+			return out + "'";
+		};
+
+		std::string command = compiler + " " + flags + " -I" + shell(include_dir) + " " + shell(source) + " -o " + shell(binary);
+		int status = std::system(command.c_str());
+		if(status != 0)
+		{
+			error = "'" + command + "' failed with status " + std::to_string(status);
+			return false;
+		}
+
+		return true;
+	}
+}
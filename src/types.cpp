@@ -0,0 +1,554 @@
+#include<utility>
+
+// Diaflow
+#include<types.h>
+
+namespace Diaflow
+{
+	namespace
+	{
+		// Bounds a loop condition puts on a local: strictly below or above an
+		// int, so that one more or one less is still an int.
+		constexpr uint8_t below = 1, above = 2;
+
+		struct Env
+		{
+			std::vector<Types> locals;
+			std::vector<uint8_t> bounds;
+			bool live = true;
+
+			bool operator==(const Env& other) const
+			{
+				return live == other.live && (!live || (locals == other.locals && bounds == other.bounds));
+			}
+
+			void join(const Env& other)
+			{
+				if(!other.live)
+					return;
+
+				if(!live)
+				{
+					*this = other;
+					return;
+				}
+
+				for(size_t i = 0; i < locals.size(); i++)
+				{
+					locals[i] |= other.locals[i];
+					bounds[i] &= other.bounds[i];
+				}
+			}
+
+			static Env dead()
+			{
+				Env env;
+				env.live = false;
+				return env;
+			}
+		};
+
+		struct LoopEnv
+		{
+			Env breaks = Env::dead();
+			Env continues = Env::dead();
+			bool loop;
+		};
+
+		Types arithmetic(BinaryOp op, Type a, Type b)
+		{
+			if(op == BinaryOp::Add && (a == Type::String || b == Type::String))
+				return types_of(Type::String);
+
+			// Any but the remainder can leave the range of ints for a double.
+			if(a == Type::Int && b == Type::Int)
+				return op == BinaryOp::Mod ? types_of(Type::Int) : number_types;
+
+			if((a == Type::Int || a == Type::Double) && (b == Type::Int || b == Type::Double))
+				return types_of(Type::Double);
+
+			return 0;
+		}
+
+		Types binary(BinaryOp op, Types a, Types b)
+		{
+			if(!a || !b)
+				return 0;
+
+			switch(op)
+			{
+				case BinaryOp::Eq:
+				case BinaryOp::Ne:
+				case BinaryOp::Lt:
+				case BinaryOp::Le:
+				case BinaryOp::Gt:
+				case BinaryOp::Ge:
+					return types_of(Type::Bool);
+
+				case BinaryOp::And:
+				case BinaryOp::Or:
+					return a | b;
+
+				default:
+					break;
+			}
+
+			Types result = 0;
+			for(unsigned x = 0; x <= static_cast<unsigned>(Type::Map); x++)
+			{
+				if(!(a & (1u << x)))
+					continue;
+
+				for(unsigned y = 0; y <= static_cast<unsigned>(Type::Map); y++)
+				{
+					if(b & (1u << y))
+						result |= arithmetic(op, static_cast<Type>(x), static_cast<Type>(y));
+				}
+			}
+
+			return result;
+		}
+
+		// Where an int may be, so may a double, as negating the least int gives.
+		Types widened(Types types)
+		{
+			return types & types_of(Type::Int) ? types | types_of(Type::Double) : types;
+		}
+
+		Types builtin(Builtin which, Types arg)
+		{
+			switch(which)
+			{
+				case Builtin::Len: return types_of(Type::Int);
+				case Builtin::Str: return types_of(Type::String);
+				case Builtin::Int: return number_types;
+				case Builtin::Float: return types_of(Type::Double);
+				case Builtin::Push: return types_of(Type::Nil);
+				case Builtin::Abs: return widened(arg & number_types);
+				case Builtin::Sqrt: return types_of(Type::Double);
+				case Builtin::Floor: return types_of(Type::Double);
+			}
+
+			return any_type;
+		}
+
+		class FunctionInference
+		{
+		public:
+			FunctionInference(const ParsedFunction& parsed, std::vector<FunctionTypes>& functions, const std::unordered_map<std::string, uint32_t>& index, FunctionTypes& types)
+				: parsed(parsed), functions(functions), index(index), types(types)
+			{}
+
+			void run()
+			{
+				types.exprs.clear();
+
+				Env env;
+				env.locals.assign(parsed.locals.size(), types_of(Type::Nil));
+				env.bounds.assign(parsed.locals.size(), 0);
+				for(size_t i = 0; i < types.params.size(); i++)
+					env.locals[i] = types.params[i];
+
+				comp(*parsed.body, env);
+				if(env.live)
+					types.result |= types_of(Type::Nil);
+			}
+
+		private:
+			const ParsedFunction& parsed;
+			std::vector<FunctionTypes>& functions;
+			const std::unordered_map<std::string, uint32_t>& index;
+			FunctionTypes& types;
+			std::vector<LoopEnv> loops;
+
+			Types record(const Expr* expr, Types t)
+			{
+				types.exprs[expr] |= t;
+				return t;
+			}
+
+			Types expr(const Expr* e, Env& env)
+			{
+				switch(e->kind)
+				{
+					case ExprKind::Literal:
+						return record(e, types_of(e->value.type()));
+
+					case ExprKind::Local:
+						return record(e, env.locals[parsed.local(e->name)]);
+
+					case ExprKind::Global:
+						return record(e, any_type);
+
+					case ExprKind::Unary:
+					{
+						Types a = expr(e->args[0], env);
+						return record(e, e->unary() == UnaryOp::Neg ? widened(a & number_types) : types_of(Type::Bool));
+					}
+
+					case ExprKind::Binary:
+					{
+						Types a = expr(e->args[0], env);
+						Types b = expr(e->args[1], env);
+						return record(e, steps(e, env) ? types_of(Type::Int) : binary(e->binary(), a, b));
+					}
+
+					case ExprKind::Index:
+					{
+						Types container = expr(e->args[0], env);
+						expr(e->args[1], env);
+
+						Types t = 0;
+						if(container & (types_of(Type::Array) | types_of(Type::Map)))
+							t |= any_type;
+
+						if(container & types_of(Type::String))
+							t |= types_of(Type::String);
+
+						return record(e, t);
+					}
+
+					case ExprKind::Array:
+					case ExprKind::Map:
+					{
+						for(const Expr* arg : e->args)
+							expr(arg, env);
+
+						return record(e, types_of(e->kind == ExprKind::Array ? Type::Array : Type::Map));
+					}
+
+					case ExprKind::Builtin:
+					{
+						Types first = 0;
+						for(const Expr* arg : e->args)
+						{
+							Types t = expr(arg, env);
+							if(arg == e->args.front())
+								first = t;
+						}
+
+						return record(e, builtin(e->builtin(), first));
+					}
+
+					case ExprKind::Assign:
+					{
+						Types t = expr(e->args[1], env);
+						store(e->args[0], t, env);
+						return t;
+					}
+				}
+
+				return any_type;
+			}
+
+			// Whether `e` adds one to an int local kept below an int, or takes
+			// one from one kept above, which stays an int.
+			bool steps(const Expr* e, const Env& env)
+			{
+				BinaryOp op = e->binary();
+				const Expr* x = e->args[0];
+				const Expr* y = e->args[1];
+				if(op == BinaryOp::Add && y->kind == ExprKind::Local)
+					std::swap(x, y);
+
+				if((op != BinaryOp::Add && op != BinaryOp::Sub) || x->kind != ExprKind::Local || y->kind != ExprKind::Literal || y->value != Value::integer(1))
+					return false;
+
+				size_t local = parsed.local(x->name);
+				return only(env.locals[local], Type::Int) && (env.bounds[local] & (op == BinaryOp::Add ? below : above));
+			}
+
+			// Bounds the locals compared by `cond`, which holds, with < or >.
+			void narrow(const Expr* cond, Env& env)
+			{
+				if(cond->kind != ExprKind::Binary)
+					return;
+
+				BinaryOp op = cond->binary();
+				if(op == BinaryOp::And)
+				{
+					narrow(cond->args[0], env);
+					narrow(cond->args[1], env);
+					return;
+				}
+
+				if(op != BinaryOp::Lt && op != BinaryOp::Gt)
+					return;
+
+				const Expr* low = cond->args[op == BinaryOp::Lt ? 0 : 1];
+				const Expr* high = cond->args[op == BinaryOp::Lt ? 1 : 0];
+				if(!only(types[low], Type::Int) || !only(types[high], Type::Int))
+					return;
+
+				if(low->kind == ExprKind::Local)
+					env.bounds[parsed.local(low->name)] |= below;
+
+				if(high->kind == ExprKind::Local)
+					env.bounds[parsed.local(high->name)] |= above;
+			}
+
+			void store(const Expr* target, Types t, Env& env)
+			{
+				if(target->kind == ExprKind::Local)
+				{
+					env.locals[parsed.local(target->name)] = t;
+					env.bounds[parsed.local(target->name)] = 0;
+				}
+				else if(target->kind == ExprKind::Index)
+				{
+					expr(target->args[0], env);
+					expr(target->args[1], env);
+				}
+			}
+
+			void comp(const Comp& body, Env& env)
+			{
+				for(const Block* block : body)
+					statement(block, env);
+			}
+
+			LoopEnv loop_body(const Comp& body, Env& env)
+			{
+				loops.push_back(LoopEnv{ Env::dead(), Env::dead(), true });
+				comp(body, env);
+				LoopEnv info = loops.back();
+				loops.pop_back();
+				return info;
+			}
+
+			// Iterates a loop to a fixed point. `iteration` runs one pass from
+			// the loop head, returning the state on exit through the condition
+			// and leaving the back-edge state in its argument.
+			template<typename Iteration>
+			void fixpoint(Env& env, Iteration iteration)
+			{
+				Env head = env;
+				for(;;)
+				{
+					Env state = head;
+					Env breaks = Env::dead();
+					Env exit = iteration(state, breaks);
+
+					Env next = head;
+					next.join(state);
+					if(next == head)
+					{
+						env = exit;
+						env.join(breaks);
+						return;
+					}
+
+					head = next;
+				}
+			}
+
+			void statement(const Block* block, Env& env)
+			{
+				if(!env.live)
+				{
+					env.locals.assign(parsed.locals.size(), 0);
+					env.bounds.assign(parsed.locals.size(), 0);
+				}
+
+				if(auto assign = dynamic_cast<const Assign*>(block))
+					expr(parsed[assign->expr], env);
+				else if(auto input = dynamic_cast<const Input*>(block))
+					store(parsed[input->expr], input_types, env);
+				else if(auto output = dynamic_cast<const Output*>(block))
+					expr(parsed[output->expr], env);
+				else if(auto made = dynamic_cast<const Channel*>(block))
+					expr(parsed[made->capacity], env);
+				else if(auto send = dynamic_cast<const Send*>(block))
+					expr(parsed[send->expr], env);
+				else if(auto receive = dynamic_cast<const Receive*>(block))
+					store(parsed[receive->expr], any_type, env);
+				else if(auto branch = dynamic_cast<const If*>(block))
+				{
+					expr(parsed[branch->cond], env);
+					Env other = env;
+					comp(branch->t, env);
+					comp(branch->f, other);
+					env.join(other);
+				}
+				else if(auto loop = dynamic_cast<const While*>(block))
+				{
+					fixpoint(env, [&](Env& state, Env& breaks)
+					{
+						expr(parsed[loop->cond], state);
+						Env exit = state;
+						narrow(parsed[loop->cond], state);
+						LoopEnv info = loop_body(loop->body, state);
+						state.join(info.continues);
+						breaks = info.breaks;
+						return exit;
+					});
+				}
+				else if(auto loop = dynamic_cast<const DoWhile*>(block))
+				{
+					fixpoint(env, [&](Env& state, Env& breaks)
+					{
+						LoopEnv info = loop_body(loop->body, state);
+						state.join(info.continues);
+						expr(parsed[loop->cond], state);
+						breaks = info.breaks;
+						return state;
+					});
+				}
+				else if(auto loop = dynamic_cast<const For*>(block))
+				{
+					if(!loop->init.empty())
+						expr(parsed[loop->init], env);
+
+					fixpoint(env, [&](Env& state, Env& breaks)
+					{
+						if(!loop->cond.empty())
+							expr(parsed[loop->cond], state);
+
+						Env exit = loop->cond.empty() ? Env::dead() : state;
+						if(!loop->cond.empty())
+							narrow(parsed[loop->cond], state);
+
+						LoopEnv info = loop_body(loop->body, state);
+						state.join(info.continues);
+						if(!loop->inc.empty() && state.live)
+							expr(parsed[loop->inc], state);
+
+						breaks = info.breaks;
+						return exit;
+					});
+				}
+				else if(auto loop = dynamic_cast<const Foreach*>(block))
+				{
+					Types iter = expr(parsed[loop->iter], env);
+					Types item = 0;
+					if(iter & (types_of(Type::Array) | types_of(Type::Map)))
+						item |= any_type;
+
+					if(iter & types_of(Type::String))
+						item |= types_of(Type::String);
+
+					if(iter & types_of(Type::Int))
+						item |= types_of(Type::Int);
+
+					fixpoint(env, [&](Env& state, Env& breaks)
+					{
+						Env exit = state;
+						store(parsed[loop->var], item, state);
+						LoopEnv info = loop_body(loop->body, state);
+						state.join(info.continues);
+						breaks = info.breaks;
+						return exit;
+					});
+				}
+				else if(auto branch = dynamic_cast<const Switch*>(block))
+				{
+					expr(parsed[branch->expr], env);
+
+					bool has_default = false;
+					for(auto& [label, _] : branch->cases)
+					{
+						if(label == "default")
+							has_default = true;
+						else
+							expr(parsed[label], env);
+					}
+
+					loops.push_back(LoopEnv{ Env::dead(), Env::dead(), false });
+					Env fall = Env::dead();
+					for(auto& [_, body] : branch->cases)
+					{
+						Env entry = env;
+						entry.join(fall);
+						comp(body, entry);
+						fall = entry;
+					}
+
+					LoopEnv info = loops.back();
+					loops.pop_back();
+
+					if(!has_default)
+						fall.join(env);
+
+					fall.join(info.breaks);
+					env = fall;
+
+					for(auto it = loops.rbegin(); it != loops.rend(); it++)
+					{
+						if(it->loop)
+						{
+							it->continues.join(info.continues);
+							break;
+						}
+					}
+				}
+				else if(dynamic_cast<const Break*>(block))
+				{
+					if(!loops.empty())
+						loops.back().breaks.join(env);
+
+					env = Env::dead();
+				}
+				else if(dynamic_cast<const Continue*>(block))
+				{
+					if(!loops.empty())
+						loops.back().continues.join(env);
+
+					env = Env::dead();
+				}
+				else if(auto call = dynamic_cast<const Call*>(block))
+				{
+					auto callee = index.find(call->name);
+					FunctionTypes* target = callee != index.end() ? &functions[callee->second] : nullptr;
+
+					for(size_t i = 0; i < call->args.size(); i++)
+					{
+						Types t = expr(parsed[call->args[i]], env);
+						if(target && i < target->params.size())
+							target->params[i] |= t;
+					}
+
+					if(!call->retvar.empty())
+						store(parsed[call->retvar], target ? target->result : any_type, env);
+				}
+				else if(auto ret = dynamic_cast<const Return*>(block))
+				{
+					types.result |= ret->expr.empty() ? types_of(Type::Nil) : expr(parsed[ret->expr], env);
+					env = Env::dead();
+				}
+				else if(auto parallel = dynamic_cast<const Parallel*>(block))
+				{
+					// No branch uses what another assigns, so they type as
+					// if run one after another.
+					for(const Comp& branch : parallel->branches)
+						comp(branch, env);
+				}
+			}
+		};
+	}
+
+	void TypeInference::infer(const std::vector<ParsedFunction>& parsed, const std::unordered_map<std::string, uint32_t>& index)
+	{
+		functions.assign(parsed.size(), FunctionTypes());
+		for(size_t i = 0; i < parsed.size(); i++)
+			functions[i].params.assign(parsed[i].args->size(), 0);
+
+		// Parameter and return types only grow, so this terminates; the last
+		// pass sees stable signatures and leaves exact expression types.
+		for(;;)
+		{
+			std::vector<std::pair<std::vector<Types>, Types>> before;
+			for(const FunctionTypes& types : functions)
+				before.emplace_back(types.params, types.result);
+
+			for(size_t i = 0; i < parsed.size(); i++)
+				FunctionInference(parsed[i], functions, index, functions[i]).run();
+
+			bool changed = false;
+			for(size_t i = 0; i < functions.size(); i++)
+				changed |= before[i].first != functions[i].params || before[i].second != functions[i].result;
+
+			if(!changed)
+				return;
+		}
+	}
+}
@@ -0,0 +1,1670 @@
+#include<algorithm>
+#include<memory>
+#include<sstream>
+
+// Diaflow
+#include<vm.h>
+
+namespace Diaflow
+{
+	VM::VM(const Module& module, std::istream& in, std::ostream& out)
+		: globals(module.globals.size()), memo_hits(module.functions.size(), 0), memo_misses(module.functions.size(), 0), module(module), in(in), out(out), lines(dynamic_cast<FileInput*>(in.rdbuf())),
+		code(module.functions.size(), std::vector<Code>(tier_count)), tier(module.functions.size(), Tier::Baseline),
+		ceiling(module.functions.size(), Tier::Baseline), memos(module.functions.size()), channels(module.channels.size())
+	{
+		heap.alarm = &steps;
+	}
+
+	Status VM::run()
+	{
+		Value result;
+		Status status = call(module.entry, nullptr, result);
+		out.flush();
+		return status;
+	}
+
+	Status VM::call(uint32_t index, const Value* args, Value& result)
+	{
+		ceiling.assign(ceiling.size(), tiers ? tiers->top() : Tier::Baseline);
+		frames.clear();
+		pending.clear();
+		segment = 0;
+		top = 0;
+		Code& current = enter(index);
+		Value* frame = push(current.function->registers);
+		std::copy(args, args + current.function->params, frame);
+		arm(fuel);
+		Status status = execute(index, &current, frame, result, 0);
+		steps = UINT64_MAX;
+		return finished(index, status, result);
+	}
+
+	void VM::start()
+	{
+		Tier highest = tiers ? std::min(tiers->top(), Tier::Optimized) : Tier::Baseline;
+		ceiling.assign(ceiling.size(), highest);
+		frames.clear();
+		pending.clear();
+		segment = 0;
+		top = 0;
+		Code& current = enter(module.entry);
+		Value* frame = push(current.function->registers);
+		suspended = Suspended{ module.entry, &current, 0, frame, &returned, 0 };
+		arm(fuel);
+		steps = UINT64_MAX;
+	}
+
+	Status VM::resume(uint64_t steps)
+	{
+		granted = std::min(steps, fuel_left);
+		fueled = granted == fuel_left;
+		this->steps = granted;
+		awaiting = false;
+		Suspended at = suspended;
+		Status status = execute(at.index, at.current, at.registers, *at.result, at.depth, at.pc, 0);
+		restore();
+		fuel_left -= granted - this->steps;
+		this->steps = UINT64_MAX;
+		if(status != Status::Paused)
+		{
+			status = finished(module.entry, status, returned);
+			out.flush();
+		}
+
+		return status;
+	}
+
+	const std::string& VM::position() const
+	{
+		return suspended.current->function->name_at(suspended.pc);
+	}
+
+	namespace
+	{
+		constexpr size_t first_segment = 4096;
+	}
+
+	// Registers for a new frame on top of the stack, all nil. A frame that
+	// does not fit in what is left of the segment starts the next one, at
+	// least twice as large as the one before.
+	Value* VM::push(size_t count)
+	{
+		if(stack.empty())
+			stack.emplace_back(std::max(count, first_segment));
+
+		if(top + count > stack[segment].size())
+		{
+			size_t size = std::max(count, 2 * stack[segment].size());
+			segment++;
+			top = 0;
+			if(segment == stack.size())
+				stack.emplace_back(size);
+			else if(stack[segment].size() < count)
+				stack[segment] = std::vector<Value>(size);
+		}
+
+		Value* registers = stack[segment].data() + top;
+		std::fill(registers, registers + count, Value());
+		top += count;
+		return registers;
+	}
+
+	// Makes the frame on top of the stack, which starts at `registers`, at
+	// least `count` registers long. Gives where the frame is now: it moves
+	// when the segment is full.
+	Value* VM::grow(Value* registers, size_t count)
+	{
+		size_t size = stack[segment].data() + top - registers;
+		if(count <= size)
+			return registers;
+
+		if(top + count - size <= stack[segment].size())
+		{
+			std::fill(registers + size, registers + count, Value());
+			top += count - size;
+			return registers;
+		}
+
+		Value* moved = push(count);
+		std::copy(registers, registers + size, moved);
+		return moved;
+	}
+
+	VM::Code& VM::load(uint32_t index, Tier level)
+	{
+		Code& current = code[index][static_cast<size_t>(level)];
+		if(!current.function)
+		{
+			current.function = level == Tier::Baseline ? &module.functions[index] : tiers->function(index, level);
+			current.instrs = current.function->code;
+			current.misses.assign(current.instrs.size(), 0);
+			if(level == Tier::Native)
+				current.native = tiers->native_code(index);
+
+			Profile* counting = forked ? nullptr : profile ? profile : tiers ? tiers->profile : nullptr;
+			if(counting && current.function->counters)
+				current.counters = counting->counters(current.function->name, current.function->counters);
+		}
+
+		return current;
+	}
+
+	// The code a new frame of function `index` starts in, counting the call.
+	VM::Code& VM::enter(uint32_t index)
+	{
+		if(tier[index] < ceiling[index] && ++tiers->counters[index].calls >= tiers->call_threshold)
+			promote(index);
+
+		return load(index, tier[index]);
+	}
+
+	// Moves function `index` up a tier. Returns the code of the new tier, or
+	// nullptr when the manager cannot provide it, which keeps the function
+	// where it is.
+	VM::Code* VM::promote(uint32_t index)
+	{
+		Tier next = static_cast<Tier>(static_cast<uint8_t>(tier[index]) + 1);
+		if(!tiers->function(index, next))
+		{
+			ceiling[index] = tier[index];
+			return nullptr;
+		}
+
+		tier[index] = next;
+		promotions++;
+		return &load(index, next);
+	}
+
+	namespace
+	{
+		Opcode specialized(Opcode op, const Value& x, const Value& y)
+		{
+			if(x.is_int() && y.is_int())
+			{
+				switch(op)
+				{
+					case Opcode::Add: return Opcode::AddI;
+					case Opcode::Sub: return Opcode::SubI;
+					case Opcode::Mul: return Opcode::MulI;
+					case Opcode::Div: return Opcode::DivI;
+					case Opcode::Mod: return Opcode::ModI;
+					case Opcode::Eq: return Opcode::EqI;
+					case Opcode::Ne: return Opcode::NeI;
+					case Opcode::Lt: return Opcode::LtI;
+					case Opcode::Le: return Opcode::LeI;
+					default: return op;
+				}
+			}
+
+			if(x.is_double() && y.is_double())
+			{
+				switch(op)
+				{
+					case Opcode::Add: return Opcode::AddD;
+					case Opcode::Sub: return Opcode::SubD;
+					case Opcode::Mul: return Opcode::MulD;
+					case Opcode::Div: return Opcode::DivD;
+					case Opcode::Eq: return Opcode::EqD;
+					case Opcode::Ne: return Opcode::NeD;
+					case Opcode::Lt: return Opcode::LtD;
+					case Opcode::Le: return Opcode::LeD;
+					default: return op;
+				}
+			}
+
+			if(x.is_string() && y.is_string())
+			{
+				switch(op)
+				{
+					case Opcode::Add: return Opcode::Concat;
+					case Opcode::Eq: return Opcode::EqS;
+					case Opcode::Ne: return Opcode::NeS;
+					default: return op;
+				}
+			}
+
+			return op;
+		}
+
+		// Whether the operands still satisfy the guard of a quickened op.
+		bool admits(Opcode op, const Value& x, const Value& y)
+		{
+			switch(op)
+			{
+				case Opcode::AddI: case Opcode::SubI: case Opcode::MulI: case Opcode::DivI: case Opcode::ModI:
+				case Opcode::EqI: case Opcode::NeI: case Opcode::LtI: case Opcode::LeI:
+					return x.is_int() && y.is_int();
+
+				case Opcode::AddD: case Opcode::SubD: case Opcode::MulD: case Opcode::DivD:
+				case Opcode::EqD: case Opcode::NeD: case Opcode::LtD: case Opcode::LeD:
+					return x.is_double() && y.is_double();
+
+				default:
+					return x.is_string() && y.is_string();
+			}
+		}
+	}
+
+	void VM::quicken(Code& current, size_t pc, const Value& x, const Value& y)
+	{
+		if(current.misses[pc] >= quicken_limit)
+			return;
+
+		Instr& instr = current.instrs[pc];
+		Opcode op = specialized(instr.op, x, y);
+		if(op == instr.op)
+			return;
+
+		instr.op = op;
+		instr.flags |= Instr::guarded;
+		quickened++;
+	}
+
+	void VM::dequicken(Code& current, size_t pc)
+	{
+		Instr& instr = current.instrs[pc];
+		instr.op = generic_opcode(instr.op);
+		instr.flags &= ~Instr::guarded;
+		current.misses[pc]++;
+		dequickened++;
+	}
+
+	Value VM::read()
+	{
+		std::string_view text;
+		if(lines)
+			return lines->line(text) ? parse_input(text, heap) : Value::nil();
+
+		if(!std::getline(in, line))
+			return Value::nil();
+
+		return parse_input(line, heap);
+	}
+
+	// Runs the Call op `i` at `pc` made from native code of `caller` at
+	// `depth`, in a new activation of the interpreter.
+	Status VM::invoke(const Function& caller, size_t pc, const Instr& i, Value* R, uint32_t depth)
+	{
+		if(!steps-- && !reclaim())
+		{
+			steps = 0;
+			return exceeded(caller, pc);
+		}
+
+		if(depth + 1 >= max_depth)
+			return exhausted(caller, pc);
+
+		Memo memo = i.op == Opcode::Call ? recall(i.b, R + i.a, R[i.a]) : Memo::Off;
+		if(memo == Memo::Hit)
+			return Status::Ok;
+
+		Code& callee = enter(i.b);
+		size_t base = segment, mark = top;
+		Value* registers = push(callee.function->registers);
+		std::copy(R + i.a, R + i.a + i.c, registers);
+		Status status = execute(i.b, &callee, registers, R[i.a], depth + 1);
+		segment = base;
+		top = mark;
+		if(status == Status::Ok && memo == Memo::Miss)
+			remember(i.b, R[i.a]);
+
+		return status;
+	}
+
+	// A VM for one branch or slice, printing into `output`. It shares the
+	// globals as they stand and the tier of every function, which it keeps.
+	std::unique_ptr<VM> VM::spawn(std::ostream& output)
+	{
+		restore();
+		auto vm = std::make_unique<VM>(module, in, output);
+		vm->globals = globals;
+		vm->max_depth = max_depth;
+		vm->tiers = tiers;
+		vm->tier = tier;
+		vm->ceiling = tier;
+		vm->memoize = memoize;
+		vm->memo_slots = memo_slots;
+		vm->scheduler = scheduler;
+		vm->split_items = split_items;
+		vm->channels = channels;
+		vm->forked = true;
+		vm->max_memory = max_memory - std::min(max_memory, heap.bytes);
+		vm->max_output = max_output - std::min(max_output, written);
+		vm->arm(fuel_left - (granted - steps));
+		return vm;
+	}
+
+	// Runs the branches of the Fork op at `pc` of `function`, whose frame
+	// is at `R`, each on a VM of its own, and takes back what they leave.
+	// Branches waiting on a channel run again, round after round, until all
+	// have finished. When a round moves nothing, a branch itself puts the
+	// whole block aside and gives Blocked, to be run again from the Fork op
+	// with the branches where they were. In a run in slices the branches
+	// run in turn on what is left of the slice, and the block is put aside
+	// the same way, giving Paused, when a branch uses it up.
+	Status VM::fork(const Function& function, size_t pc, Value* R, uint32_t depth)
+	{
+		const ForkTable& table = function.forks[function.code[pc].b];
+		uint32_t index = module.function_index.at(function.name);
+		Tier level = &function == &module.functions[index] ? Tier::Baseline : Tier::Optimized;
+		size_t count = table.branches.size();
+
+		// A collection that fell due comes first, for the branches to share
+		// what the run has left of its memory.
+		if(waiting.empty() && heap.taken && !forked)
+			collect(returned);
+
+		restore();
+		std::vector<Branch> branches = std::move(waiting);
+		waiting.clear();
+		if(branches.empty())
+		{
+			forks++;
+			branches = std::vector<Branch>(count);
+			for(Branch& branch : branches)
+			{
+				branch.vm = spawn(branch.out);
+				branch.vm->task = true;
+			}
+		}
+
+		bool sliced = !fueled && nested == 0;
+		auto run = [&](size_t k)
+		{
+			Branch& branch = branches[k];
+			VM& vm = *branch.vm;
+			if(sliced)
+			{
+				vm.granted = std::min(steps, vm.fuel_left);
+				vm.fueled = vm.granted == vm.fuel_left;
+				vm.steps = vm.granted;
+			}
+
+			Value result;
+			if(branch.registers)
+			{
+				Suspended at = vm.suspended;
+				branch.status = vm.execute(at.index, at.current, at.registers, *at.result, at.depth, at.pc, 0);
+			}
+			else
+			{
+				Code* current = &vm.load(index, level);
+				Value* frame = vm.push(function.registers);
+				std::copy(R, R + function.registers, frame);
+				branch.registers = frame;
+				branch.status = vm.execute(index, current, frame, result, depth, table.branches[k]);
+			}
+
+			// What the branch spent ends the slice sooner, but comes out of
+			// its own fuel rather than the run's, as it does run whole.
+			if(sliced)
+			{
+				uint64_t spent = vm.granted - vm.steps;
+				vm.fuel_left -= spent;
+				steps -= std::min(steps, spent);
+				granted -= std::min(granted, spent);
+			}
+		};
+
+		std::vector<size_t> blocked;
+		for(;;)
+		{
+			blocked.clear();
+			for(size_t k = 0; k < count; k++)
+			{
+				if(branches[k].status == Status::Blocked || branches[k].status == Status::Paused)
+					blocked.push_back(k);
+			}
+
+			if(blocked.empty())
+				break;
+
+			uint64_t moved = transfers();
+			if(scheduler && blocked.size() > 1 && !sliced)
+			{
+				Scheduler::Group group;
+				for(size_t n = 1; n < blocked.size(); n++)
+					scheduler->submit(group, [&run, k = blocked[n]] { run(k); });
+
+				run(blocked[0]);
+				scheduler->wait(group);
+			}
+			else
+			{
+				for(size_t k : blocked)
+					run(k);
+			}
+
+			bool failed = false, finished = false, paused = false;
+			for(size_t k : blocked)
+			{
+				failed = failed || branches[k].status == Status::Error;
+				paused = paused || branches[k].status == Status::Paused;
+				finished = finished || (branches[k].status != Status::Blocked && branches[k].status != Status::Paused);
+			}
+
+			// A branch that failed ends the block, whatever the others wait for.
+			if(failed)
+				break;
+
+			if(paused)
+			{
+				waiting = std::move(branches);
+				return Status::Paused;
+			}
+
+			if(finished || transfers() != moved)
+				continue;
+
+			if(task && nested == 0)
+			{
+				waiting = std::move(branches);
+				return Status::Blocked;
+			}
+
+			break;
+		}
+
+		// Everything comes back in branch order, so output and the first
+		// error are those of running the branches in turn.
+		Status status = Status::Ok;
+		std::string waits;
+		for(size_t k = 0; k < count; k++)
+		{
+			Branch& branch = branches[k];
+			VM& vm = *branch.vm;
+			heap.absorb(vm.heap);
+			forks += vm.forks;
+			splits += vm.splits;
+			for(size_t f = 0; f < memo_hits.size(); f++)
+			{
+				memo_hits[f] += vm.memo_hits[f];
+				memo_misses[f] += vm.memo_misses[f];
+			}
+
+			if(status != Status::Ok)
+				continue;
+
+			emit(branch.out.str());
+			if(branch.status == Status::Blocked)
+			{
+				const Instr& at = vm.suspended.current->instrs[vm.suspended.pc];
+				waits += waits.empty() ? " (" : ", ";
+				waits += "branch " + std::to_string(k + 1);
+				if(at.op == Opcode::Send)
+					waits += " to send to '" + module.channels[at.b] + "'";
+				else if(at.op == Opcode::Receive)
+					waits += " to receive from '" + module.channels[at.b] + "'";
+				else
+					waits += " in a Parallel block of its own";
+
+				continue;
+			}
+
+			if(branch.status != Status::Ok)
+			{
+				error = std::move(vm.error);
+				limit = vm.limit;
+				status = Status::Error;
+				continue;
+			}
+
+			for(uint32_t reg : table.writes[k])
+				R[reg] = branch.registers[reg];
+		}
+
+		if(status == Status::Ok && !waits.empty())
+		{
+			error = "in function '" + function.name_at(pc) + "': deadlock: every branch of the Parallel block that has not finished waits" + waits + ")";
+			status = Status::Error;
+		}
+
+		return status;
+	}
+
+	// The values ever sent and received on every channel of the run, which
+	// only grows while something moves.
+	uint64_t VM::transfers() const
+	{
+		uint64_t total = 0;
+		for(const auto& channel : channels)
+		{
+			if(channel)
+				total += channel->pushed() + channel->popped();
+		}
+
+		return total;
+	}
+
+	// Runs the Channel op at `pc`, making a new channel.
+	Status VM::make(const Function& function, size_t pc, Value* R)
+	{
+		const Instr& i = function.code[pc];
+		const Value& capacity = R[i.a];
+		if(!capacity.is_int() || capacity.as_int() < 1 || capacity.as_int() > max_capacity)
+		{
+			error = "in function '" + function.name_at(pc) + "': the capacity of channel '" + module.channels[i.b] + "' must be an integer from 1 to " + std::to_string(max_capacity);
+			return Status::Error;
+		}
+
+		channels[i.b] = std::make_shared<BoundedQueue<Value>>(static_cast<size_t>(capacity.as_int()));
+		return Status::Ok;
+	}
+
+	// Runs the Send or Receive op at `pc`. On a full or empty channel it
+	// sets `waits` in a branch that can be put aside, and fails anywhere
+	// else, as nothing else runs that could make room or send.
+	Status VM::exchange(const Function& function, size_t pc, Value* R, bool& waits)
+	{
+		const Instr& i = function.code[pc];
+		const std::string& name = module.channels[i.b];
+		waits = false;
+		BoundedQueue<Value>* channel = channels[i.b].get();
+		if(!channel)
+		{
+			error = "in function '" + function.name_at(pc) + "': channel '" + name + "' was never made";
+			return Status::Error;
+		}
+
+		bool sending = i.op == Opcode::Send;
+		if(sending ? channel->push(R[i.a]) : channel->pop(R[i.a]))
+			return Status::Ok;
+
+		if(task && nested == 0)
+		{
+			waits = true;
+			return Status::Ok;
+		}
+
+		error = "in function '" + function.name_at(pc) + "': deadlock: channel '" + name + "'";
+		error += sending ? " is full and nothing else runs to receive from it" : " is empty and nothing else runs to send to it";
+		return Status::Error;
+	}
+
+	namespace
+	{
+		// Makes the store or push of the Defer op `op`, and gives the
+		// operands to report a fault with.
+		Fault deferred_store(Opcode op, const Value& container, const Value& key, const Value& value, Value* operands, Heap& heap)
+		{
+			operands[0] = container;
+			operands[1] = op == Opcode::Defer ? key : value;
+			if(op == Opcode::Defer)
+				return set_index(container, key, value, heap);
+
+			Value result;
+			return builtin(Builtin::Push, operands, result, heap);
+		}
+	}
+
+	// Runs the Foreach split at `pc` of `function` in slices of the
+	// collection, each on a VM of its own, and takes back what they leave,
+	// setting `ran`. Leaves the loop to run in turn when it is too short,
+	// no Scheduler could share it out or this is a slice already.
+	Status VM::split(const Function& function, size_t pc, Value* R, uint32_t depth, bool& ran)
+	{
+		const Instr& i = function.code[pc];
+		const SplitTable& table = function.splits[i.b];
+		Value collection = R[i.a];
+		ran = false;
+
+		size_t count = 0;
+		if(collection.is_array())
+			count = collection.as_object<ArrayObject>()->items.size();
+		else if(collection.is_map())
+			count = collection.as_object<MapObject>()->items.size();
+		else if(collection.is_string())
+			count = string_view(collection).size();
+		else if(collection.is_int() && collection.as_int() > 0)
+			count = static_cast<size_t>(collection.as_int());
+
+		if(!scheduler || slice || scheduler->workers() < 2 || !split_items || count < 2 * size_t(split_items))
+			return Status::Ok;
+
+		// Maps go over a snapshot of their keys, as Iter takes.
+		if(collection.is_map())
+		{
+			Value keys = heap.array(count);
+			for(auto& [key, _] : collection.as_object<MapObject>()->items)
+				keys.as_object<ArrayObject>()->items.push_back(key);
+
+			collection = keys;
+		}
+
+		uint32_t index = module.function_index.at(function.name);
+		Tier level = &function == &module.functions[index] ? Tier::Baseline : Tier::Optimized;
+		size_t count_slices = std::min<size_t>(4 * scheduler->workers(), count / split_items);
+		const Value unassigned = Value::from_bits(Value::boxed(Tag::Nil, 1));
+		ran = true;
+		splits++;
+
+		struct Slice
+		{
+			std::ostringstream out;
+			std::unique_ptr<VM> vm;
+			Value* registers = nullptr;
+			Status status = Status::Ok;
+		};
+
+		std::vector<Slice> slices(count_slices);
+		for(size_t k = 0; k < count_slices; k++)
+		{
+			size_t begin = count * k / count_slices, end = count * (k + 1) / count_slices;
+			Value part;
+			if(collection.is_string())
+				part = heap.string(string_view(collection).substr(begin, end - begin));
+			else
+			{
+				part = heap.array(end - begin);
+				std::vector<Value>& items = part.as_object<ArrayObject>()->items;
+				if(collection.is_array())
+				{
+					const std::vector<Value>& all = collection.as_object<ArrayObject>()->items;
+					items.assign(all.begin() + begin, all.begin() + end);
+				}
+				else
+				{
+					for(size_t n = begin; n < end; n++)
+						items.push_back(Value::integer(static_cast<int64_t>(n)));
+				}
+			}
+
+			// A slice starts with the locals the body assigns unassigned,
+			// so the last slice to assign one is the one it comes back from.
+			Slice& current = slices[k];
+			current.vm = spawn(current.out);
+			VM& vm = *current.vm;
+			vm.slice = &table;
+			vm.slice_depth = depth;
+			for(uint32_t reg : table.deferred)
+				vm.deferring.push_back(R[reg]);
+
+			current.registers = vm.push(function.registers);
+			std::copy(R, R + function.registers, current.registers);
+			current.registers[i.a] = part;
+			current.registers[i.a + 1] = Value::integer(0);
+			for(uint32_t reg : table.writes)
+				current.registers[reg] = unassigned;
+		}
+
+		auto run = [&](size_t k)
+		{
+			VM& vm = *slices[k].vm;
+			Code* current = &vm.load(index, level);
+			Value result;
+			slices[k].status = vm.execute(index, current, slices[k].registers, result, depth, table.start);
+		};
+
+		Scheduler::Group group;
+		for(size_t k = 1; k < count_slices; k++)
+			scheduler->submit(group, [&run, k] { run(k); });
+
+		run(0);
+		scheduler->wait(group);
+
+		// Stores and output come back in slice order, and a slice that
+		// failed ends the loop where it failed, as running in turn would.
+		Status status = Status::Ok;
+		for(Slice& current : slices)
+		{
+			VM& vm = *current.vm;
+			heap.absorb(vm.heap);
+			forks += vm.forks;
+			splits += vm.splits;
+			for(size_t f = 0; f < memo_hits.size(); f++)
+			{
+				memo_hits[f] += vm.memo_hits[f];
+				memo_misses[f] += vm.memo_misses[f];
+			}
+
+			if(status != Status::Ok)
+				continue;
+
+			std::string printed = current.out.str();
+			for(const Deferred& store : vm.deferred)
+			{
+				Value operands[2];
+				Fault fault = deferred_store(function.code[store.pc].op, store.container, store.key, store.value, operands, heap);
+				if(fault != Fault::None)
+				{
+					emit(std::string_view(printed).substr(0, store.printed));
+					status = fail(function, store.pc, fault, operands, 2);
+					break;
+				}
+			}
+
+			if(status != Status::Ok)
+				continue;
+
+			emit(printed);
+			if(current.status != Status::Ok)
+			{
+				error = std::move(vm.error);
+				limit = vm.limit;
+				status = Status::Error;
+				continue;
+			}
+
+			for(uint32_t reg : table.writes)
+			{
+				if(current.registers[reg].bits != unassigned.bits)
+					R[reg] = current.registers[reg];
+			}
+		}
+
+		return status;
+	}
+
+	// Runs the Defer or DeferPush op at `pc`: in a slice, a store into or
+	// push onto one of the containers its loop defers waits, in the loop's
+	// own frame; anywhere else it is made.
+	Status VM::defer(const Function& function, size_t pc, Value* R, uint32_t depth)
+	{
+		const Instr& i = function.code[pc];
+		Value key = i.op == Opcode::Defer ? R[i.b] : Value::nil();
+		if(slice && depth == slice_depth && std::find_if(deferring.begin(), deferring.end(), [&](const Value& v) { return v.bits == R[i.a].bits; }) != deferring.end())
+		{
+			deferred.push_back({ R[i.a], key, R[i.c], pc, static_cast<size_t>(out.tellp()) });
+			return Status::Ok;
+		}
+
+		Value operands[2];
+		Fault fault = deferred_store(i.op, R[i.a], key, R[i.c], operands, heap);
+		if(fault != Fault::None)
+			return fail(function, pc, fault, operands, 2);
+
+		return Status::Ok;
+	}
+
+	Status VM::exhausted(const Function& caller, size_t pc)
+	{
+		error = "in function '" + caller.name_at(pc) + "': call stack exhausted";
+		limit = Limit::Depth;
+		return Status::Error;
+	}
+
+	// Ends the run at the op at `pc` of `function` for the limit it went
+	// past, once its steps ran out.
+	Status VM::exceeded(const Function& function, size_t pc)
+	{
+		std::string what = "ran out of fuel";
+		limit = Limit::Fuel;
+		if(heap.bytes > max_memory)
+		{
+			what = "allocated more memory than it may";
+			limit = Limit::Memory;
+		}
+		else if(written > max_output)
+		{
+			what = "printed more than it may";
+			limit = Limit::Output;
+		}
+
+		error = "in function '" + function.name_at(pc) + "': " + what;
+		return Status::Error;
+	}
+
+	// A run that went past its memory or output with no step left to stop
+	// at fails all the same, once its heap is collected, keeping `result`.
+	Status VM::finished(uint32_t index, Status status, const Value& result)
+	{
+		if(status == Status::Ok && heap.bytes > max_memory && !forked)
+			collect(result);
+
+		if(status == Status::Ok && (heap.bytes > max_memory || written > max_output))
+			return exceeded(module.functions[index], 0);
+
+		return status;
+	}
+
+	// Once the steps ran out at a step: when the heap took them, collects
+	// it and gives them back but for the step. Gives false for a run that
+	// is to stop there.
+	bool VM::reclaim()
+	{
+		steps = 0;
+		if(!heap.taken)
+			return false;
+
+		if(!forked)
+			collect(returned);
+
+		restore();
+		if(!steps)
+			return false;
+
+		steps--;
+		return true;
+	}
+
+	// Gives back the steps the heap took, where the run counts what it has
+	// left away from a step and cannot collect. A run past a limit keeps
+	// none.
+	void VM::restore()
+	{
+		if(heap.bytes <= max_memory && written <= max_output)
+			steps += heap.taken;
+
+		heap.taken = 0;
+	}
+
+	// Frees every object the run no longer reaches from the registers of its
+	// frames, its globals, its memo caches and the calls still to be cached,
+	// the stores a slice holds back, the values waiting in its channels and
+	// `result`. The registers above the top of the stack are cleared, as
+	// they may hold objects freed here.
+	void VM::collect(const Value& result)
+	{
+		for(size_t k = 0; k < stack.size(); k++)
+		{
+			size_t used = k < segment ? stack[k].size() : k == segment ? top : 0;
+			for(size_t r = 0; r < used; r++)
+				heap.mark(stack[k][r]);
+
+			std::fill(stack[k].begin() + used, stack[k].end(), Value());
+		}
+
+		for(const Value& value : globals)
+			heap.mark(value);
+
+		for(const MemoTable& memo : memos)
+		{
+			for(const Value& key : memo.keys)
+				heap.mark(key);
+
+			for(const Value& value : memo.results)
+				heap.mark(value);
+		}
+
+		for(const Value& value : pending)
+			heap.mark(value);
+
+		for(const Value& value : deferring)
+			heap.mark(value);
+
+		for(const Deferred& store : deferred)
+		{
+			heap.mark(store.container);
+			heap.mark(store.key);
+			heap.mark(store.value);
+		}
+
+		for(const auto& channel : channels)
+		{
+			if(channel)
+				channel->each([&](const Value& value) { heap.mark(value); });
+		}
+
+		heap.mark(result);
+		heap.sweep();
+		collections++;
+	}
+
+	// Starts counting down `fuel` steps, and what the run allocates and prints.
+	void VM::arm(uint64_t fuel)
+	{
+		limit = Limit::None;
+		fuel_left = granted = steps = fuel;
+		fueled = true;
+		written = 0;
+		heap.limit = max_memory;
+		heap.due = forked ? SIZE_MAX : heap.bytes + Heap::first_collection;
+		heap.taken = 0;
+	}
+
+	namespace
+	{
+		// Hashes memo cache keys by exact value, so that 1 and 1.0 differ,
+		// as the results computed from them may. Gives 0 when an argument is
+		// an array or map, which the call could change or keep.
+		uint64_t memo_key(const Value* args, uint32_t count)
+		{
+			uint64_t hash = 0xCBF29CE484222325;
+			for(uint32_t k = 0; k < count; k++)
+			{
+				if(args[k].is_array() || args[k].is_map())
+					return 0;
+
+				uint64_t bits = args[k].is_string() ? std::hash<std::string_view>()(string_view(args[k])) : args[k].bits;
+				hash = (hash ^ bits) * 0x100000001B3;
+			}
+
+			hash ^= hash >> 32;
+			hash *= 0xBF58476D1CE4E5B9;
+			hash ^= hash >> 29;
+			return hash | 1;
+		}
+
+		bool same(const Value& x, const Value& y)
+		{
+			return x.bits == y.bits || (x.is_string() && y.is_string() && string_view(x) == string_view(y));
+		}
+	}
+
+	// Looks the call of function `index` on `args` up in its cache. On a
+	// miss the arguments wait in `pending` for remember() to store the result
+	// under.
+	VM::Memo VM::recall(uint32_t index, const Value* args, Value& result)
+	{
+		const Function& function = module.functions[index];
+		if(!memoize || !function.pure || !memo_slots)
+			return Memo::Off;
+
+		uint64_t tag = memo_key(args, function.params);
+		if(!tag)
+			return Memo::Off;
+
+		MemoTable& table = memos[index];
+		if(table.tags.empty())
+		{
+			table.tags.assign(memo_slots, 0);
+			table.keys.resize(static_cast<size_t>(memo_slots) * function.params);
+			table.results.resize(memo_slots);
+		}
+
+		size_t slot = tag % table.tags.size();
+		if(table.tags[slot] == tag && std::equal(args, args + function.params, table.keys.begin() + slot * function.params, same))
+		{
+			memo_hits[index]++;
+			result = table.results[slot];
+			return Memo::Hit;
+		}
+
+		memo_misses[index]++;
+		pending.insert(pending.end(), args, args + function.params);
+		return Memo::Miss;
+	}
+
+	// Stores `result` for the innermost pending call, one of function
+	// `index`.
+	void VM::remember(uint32_t index, const Value& result)
+	{
+		uint32_t params = module.functions[index].params;
+		auto args = pending.end() - params;
+		if(!result.is_array() && !result.is_map())
+		{
+			MemoTable& table = memos[index];
+			uint64_t tag = memo_key(&*args, params);
+			size_t slot = tag % table.tags.size();
+			table.tags[slot] = tag;
+			std::copy(args, pending.end(), table.keys.begin() + slot * params);
+			table.results[slot] = result;
+		}
+
+		pending.erase(args, pending.end());
+	}
+
+	std::string VM::memo_report() const
+	{
+		std::string out;
+		for(size_t i = 0; i < memo_hits.size(); i++)
+		{
+			uint64_t calls = memo_hits[i] + memo_misses[i];
+			if(!calls)
+				continue;
+
+			out += module.functions[i].name + ": " + std::to_string(memo_hits[i]) + " hits, " + std::to_string(memo_misses[i]) + " misses";
+			out += " (" + std::to_string(memo_hits[i] * 100 / calls) + "% hit)\n";
+		}
+
+		return out;
+	}
+
+	// The code a frame of function `index` runs in the interpreter, and its
+	// tier: `current` itself, or the bytecode it was compiled from when it is
+	// native code that cannot be entered.
+	VM::Code* VM::interpreted(uint32_t index, Code* current, Tier& level)
+	{
+		level = tier[index];
+		if(!current->native)
+			return current;
+
+		level = Tier::Optimized;
+		return &load(index, level);
+	}
+
+	void VM::print(const Value& value, bool newline)
+	{
+		line.clear();
+		format(value, line);
+		if(newline)
+			line += '\n';
+
+		emit(line);
+	}
+
+	// Prints `text`, as far as the run may print.
+	void VM::emit(std::string_view text)
+	{
+		size_t room = max_output - std::min(max_output, written);
+		written += text.size();
+		if(text.size() > room)
+		{
+			text = text.substr(0, room);
+			steps = 0;
+		}
+
+		out << text;
+	}
+
+	Status VM::native(const Code& current, Value* frame, Value& result, uint32_t entry, uint32_t depth)
+	{
+		NativeFrame context{ this, frame, globals.data(), &result, entry, depth, &steps };
+		nested++;
+		uint32_t failed = current.native(&context);
+		nested--;
+		return failed ? Status::Error : Status::Ok;
+	}
+
+	Status VM::fail(const Function& function, size_t pc, Fault fault, const Value* operands, size_t count)
+	{
+		error = "in function '" + function.name_at(pc) + "': " + fault_message(fault);
+		if(fault == Fault::Type && count)
+		{
+			error += std::string(" (") + opcode_name(function.code[pc].op);
+			for(size_t i = 0; i < count; i++)
+				error += std::string(i ? ", " : " ") + type_name(operands[i].type());
+
+			error += ")";
+		}
+
+		return Status::Error;
+	}
+
+	// Runs the frame of function `index` at `frame` to its Return, along with
+	// every interpreted frame it calls, which stack up in `frames` above the
+	// ones of outer activations. A branch put aside goes on with `floor` 0,
+	// its callers still in `frames`.
+	Status VM::execute(uint32_t index, Code* current, Value* frame, Value& result, uint32_t depth, size_t entry, size_t floor)
+	{
+		if(current->native && nested < native_nesting)
+			return native(*current, frame, result, 0, depth);
+
+		Tier level;
+		current = interpreted(index, current, level);
+		const Function* function = current->function;
+		const Instr* code = current->instrs.data();
+		const Value* K = function->constants.data();
+		Value* R = frame;
+		Value* out = &result;
+		size_t pc = entry;
+		if(floor == SIZE_MAX)
+			floor = frames.size();
+
+		// Keeps where the branch waits or the slice ended, at the op at
+		// `pc`, to run it again.
+		auto suspend = [&](size_t at, Status status)
+		{
+			suspended = Suspended{ index, current, at, R, out, depth };
+			return status;
+		};
+
+		// Once the steps run out: ends the slice, or the run when that went
+		// past one of its limits.
+		auto halt = [&](size_t at)
+		{
+			steps = 0;
+			if(fueled || heap.bytes > max_memory || written > max_output)
+				return exceeded(*function, at);
+
+			return suspend(at, Status::Paused);
+		};
+
+		// Gives the frame on top back to its caller, or false when the caller
+		// is outside this activation.
+		auto leave = [&]()
+		{
+			if(frames.size() == floor)
+				return false;
+
+			const Frame& caller = frames.back();
+			if(caller.memoized != Frame::unmemoized)
+				remember(caller.memoized, *out);
+
+			index = caller.index;
+			current = caller.current;
+			level = caller.level;
+			pc = caller.pc;
+			R = caller.registers;
+			out = caller.result;
+			segment = caller.segment;
+			top = caller.top;
+			frames.pop_back();
+			depth--;
+
+			function = current->function;
+			code = current->instrs.data();
+			K = function->constants.data();
+			return true;
+		};
+
+		for(;;)
+		{
+			const Instr& i = code[pc++];
+
+			// A quickened op whose operands changed type goes back to the
+			// generic op and runs again as that.
+			if((i.flags & Instr::guarded) && !admits(i.op, R[i.b], R[i.c]))
+			{
+				dequicken(*current, --pc);
+				continue;
+			}
+
+			switch(i.op)
+			{
+				case Opcode::Nop:
+					break;
+
+				case Opcode::Move:
+					R[i.a] = R[i.b];
+					break;
+
+				case Opcode::LoadK:
+					R[i.a] = K[i.b];
+					break;
+
+				case Opcode::GetGlobal:
+					R[i.a] = globals[i.b];
+					break;
+
+				case Opcode::SetGlobal:
+					globals[i.a] = R[i.b];
+					break;
+
+				case Opcode::Add:
+				{
+					quicken(*current, pc - 1, R[i.b], R[i.c]);
+					const Value& x = R[i.b];
+					const Value& y = R[i.c];
+					if(x.is_int() && y.is_int())
+					{
+						int64_t r = x.as_int() + y.as_int();
+						if(Value::fits_int(r))
+						{
+							R[i.a] = Value::integer(r);
+							break;
+						}
+					}
+
+					Fault fault = add(x, y, R[i.a], heap);
+					if(fault != Fault::None)
+					{
+						Value operands[] = { R[i.b], R[i.c] };
+						return fail(*function, pc - 1, fault, operands, 2);
+					}
+
+					break;
+				}
+
+				case Opcode::Sub:
+				case Opcode::Mul:
+				case Opcode::Div:
+				case Opcode::Mod:
+				{
+					Opcode op = i.op;
+					quicken(*current, pc - 1, R[i.b], R[i.c]);
+					const Value& x = R[i.b];
+					const Value& y = R[i.c];
+					Fault fault;
+					switch(op)
+					{
+						case Opcode::Sub: fault = sub(x, y, R[i.a]); break;
+						case Opcode::Mul: fault = mul(x, y, R[i.a]); break;
+						case Opcode::Div: fault = div(x, y, R[i.a]); break;
+						default: fault = mod(x, y, R[i.a]); break;
+					}
+
+					if(fault != Fault::None)
+					{
+						Value operands[] = { R[i.b], R[i.c] };
+						return fail(*function, pc - 1, fault, operands, 2);
+					}
+
+					break;
+				}
+
+				case Opcode::Neg:
+				{
+					Fault fault = neg(R[i.b], R[i.a]);
+					if(fault != Fault::None)
+						return fail(*function, pc - 1, fault, &R[i.b], 1);
+
+					break;
+				}
+
+				case Opcode::Not:
+					R[i.a] = Value::boolean(!truthy(R[i.b]));
+					break;
+
+				case Opcode::Eq:
+					quicken(*current, pc - 1, R[i.b], R[i.c]);
+					R[i.a] = Value::boolean(equal(R[i.b], R[i.c]));
+					break;
+
+				case Opcode::Ne:
+					quicken(*current, pc - 1, R[i.b], R[i.c]);
+					R[i.a] = Value::boolean(!equal(R[i.b], R[i.c]));
+					break;
+
+				case Opcode::Lt:
+				case Opcode::Le:
+				{
+					Opcode op = i.op;
+					quicken(*current, pc - 1, R[i.b], R[i.c]);
+					const Value& x = R[i.b];
+					const Value& y = R[i.c];
+					if(x.is_int() && y.is_int())
+					{
+						R[i.a] = Value::boolean(op == Opcode::Lt ? x.as_int() < y.as_int() : x.as_int() <= y.as_int());
+						break;
+					}
+
+					Fault fault = op == Opcode::Lt ? less(x, y, R[i.a]) : less_equal(x, y, R[i.a]);
+					if(fault != Fault::None)
+					{
+						Value operands[] = { R[i.b], R[i.c] };
+						return fail(*function, pc - 1, fault, operands, 2);
+					}
+
+					break;
+				}
+
+				case Opcode::AddI:
+				case Opcode::SubI:
+				case Opcode::MulI:
+				{
+					int64_t x = R[i.b].as_int(), y = R[i.c].as_int(), r;
+					if(i.op == Opcode::AddI)
+						r = x + y;
+					else if(i.op == Opcode::SubI)
+						r = x - y;
+					else if(__builtin_mul_overflow(x, y, &r))
+					{
+						R[i.a] = Value::number(static_cast<double>(x) * static_cast<double>(y));
+						break;
+					}
+
+					R[i.a] = Value::widened(r);
+					break;
+				}
+
+				case Opcode::DivI:
+				case Opcode::ModI:
+				{
+					int64_t x = R[i.b].as_int(), y = R[i.c].as_int();
+					if(y == 0)
+						return fail(*function, pc - 1, Fault::DivideByZero);
+
+					R[i.a] = Value::widened(i.op == Opcode::DivI ? x / y : x % y);
+					break;
+				}
+
+				case Opcode::AddD:
+					R[i.a] = Value::number(R[i.b].as_double() + R[i.c].as_double());
+					break;
+
+				case Opcode::SubD:
+					R[i.a] = Value::number(R[i.b].as_double() - R[i.c].as_double());
+					break;
+
+				case Opcode::MulD:
+					R[i.a] = Value::number(R[i.b].as_double() * R[i.c].as_double());
+					break;
+
+				case Opcode::DivD:
+					R[i.a] = Value::number(R[i.b].as_double() / R[i.c].as_double());
+					break;
+
+				case Opcode::EqI:
+					R[i.a] = Value::boolean(R[i.b].bits == R[i.c].bits);
+					break;
+
+				case Opcode::NeI:
+					R[i.a] = Value::boolean(R[i.b].bits != R[i.c].bits);
+					break;
+
+				case Opcode::LtI:
+					R[i.a] = Value::boolean(R[i.b].as_int() < R[i.c].as_int());
+					break;
+
+				case Opcode::LeI:
+					R[i.a] = Value::boolean(R[i.b].as_int() <= R[i.c].as_int());
+					break;
+
+				case Opcode::EqD:
+					R[i.a] = Value::boolean(R[i.b].as_double() == R[i.c].as_double());
+					break;
+
+				case Opcode::NeD:
+					R[i.a] = Value::boolean(R[i.b].as_double() != R[i.c].as_double());
+					break;
+
+				case Opcode::LtD:
+					R[i.a] = Value::boolean(R[i.b].as_double() < R[i.c].as_double());
+					break;
+
+				case Opcode::LeD:
+					R[i.a] = Value::boolean(R[i.b].as_double() <= R[i.c].as_double());
+					break;
+
+				case Opcode::EqS:
+					R[i.a] = Value::boolean(string_view(R[i.b]) == string_view(R[i.c]));
+					break;
+
+				case Opcode::NeS:
+					R[i.a] = Value::boolean(string_view(R[i.b]) != string_view(R[i.c]));
+					break;
+
+				case Opcode::Concat:
+					concat(R[i.b], R[i.c], R[i.a], heap);
+					break;
+
+				case Opcode::Jump:
+					pc = i.b;
+					break;
+
+				case Opcode::Switch:
+				{
+					const SwitchTable& table = function->switches[i.b];
+					pc = table.targets[table.find(R[i.a])];
+					break;
+				}
+
+				case Opcode::Loop:
+					if(!steps-- && !reclaim())
+						return halt(pc - 1);
+
+					if(level < ceiling[index] && ++tiers->counters[index].backedges[i.a] >= tiers->loop_threshold)
+					{
+						// On-stack replacement. Locals and Foreach state keep
+						// their registers in every tier, and a tier that
+						// hoisted values out of the loop enters it through
+						// code recomputing them, so the frame carries over as
+						// it is.
+						Code* next = level == tier[index] ? promote(index) : &load(index, tier[index]);
+						uint32_t entry = next ? next->function->loops[i.a] : Function::no_loop;
+						if(entry == Function::no_loop)
+							break;
+
+						// Native code too deep on the C++ stack waits for
+						// a frame nearer the bottom.
+						if(next->native && nested >= native_nesting)
+							break;
+
+						uint32_t loop = i.a;
+						current = next;
+						function = next->function;
+						code = next->instrs.data();
+						K = function->constants.data();
+						level = tier[index];
+						R = grow(R, function->registers);
+
+						tiers->counters[index].backedges[loop] = 0;
+						replacements++;
+						if(current->native)
+						{
+							Status status = native(*current, R, *out, entry, depth);
+							if(status != Status::Ok || !leave())
+								return status;
+
+							break;
+						}
+
+						pc = entry + 1;
+					}
+
+					break;
+
+				case Opcode::JumpIf:
+					if(truthy(R[i.a]))
+						pc = i.b;
+
+					break;
+
+				case Opcode::JumpIfNot:
+					if(!truthy(R[i.a]))
+						pc = i.b;
+
+					break;
+
+				case Opcode::Index:
+				{
+					Fault fault = Diaflow::index(R[i.b], R[i.c], R[i.a], heap);
+					if(fault != Fault::None)
+					{
+						Value operands[] = { R[i.b], R[i.c] };
+						return fail(*function, pc - 1, fault, operands, 2);
+					}
+
+					break;
+				}
+
+				case Opcode::SetIndex:
+				{
+					Fault fault = set_index(R[i.a], R[i.b], R[i.c], heap);
+					if(fault != Fault::None)
+					{
+						Value operands[] = { R[i.a], R[i.b] };
+						return fail(*function, pc - 1, fault, operands, 2);
+					}
+
+					break;
+				}
+
+				case Opcode::NewArray:
+				{
+					Value array = heap.array(i.c);
+					std::vector<Value>& items = array.as_object<ArrayObject>()->items;
+					items.assign(R + i.b, R + i.b + i.c);
+					R[i.a] = array;
+					break;
+				}
+
+				case Opcode::NewMap:
+				{
+					Value map = heap.map();
+					auto& items = map.as_object<MapObject>()->items;
+					for(uint32_t k = 0; k < i.c; k++)
+						items.insert_or_assign(R[i.b + 2 * k], R[i.b + 2 * k + 1]);
+
+					heap.grow(i.c * 4 * sizeof(Value));
+					R[i.a] = map;
+					break;
+				}
+
+				case Opcode::Builtin:
+				{
+					Fault fault = builtin(static_cast<Builtin>(i.b), &R[i.a], R[i.a], heap);
+					if(fault != Fault::None)
+						return fail(*function, pc - 1, fault, &R[i.a], i.c);
+
+					break;
+				}
+
+				case Opcode::Iter:
+				{
+					bool done;
+					Fault fault = iterate(R[i.c], R[i.c + 1], R[i.a], done, heap);
+					if(fault != Fault::None)
+						return fail(*function, pc - 1, fault, &R[i.c], 1);
+
+					if(done)
+						pc = i.b;
+
+					break;
+				}
+
+				case Opcode::Call:
+				{
+					if(!steps-- && !reclaim())
+						return halt(pc - 1);
+
+					if(depth + 1 >= max_depth)
+						return exhausted(*function, pc - 1);
+
+					Memo memo = recall(i.b, R + i.a, R[i.a]);
+					if(memo == Memo::Hit)
+						break;
+
+					Code* callee = &enter(i.b);
+					Frame caller{ index, current, level, pc, R, out, segment, top, memo == Memo::Miss ? i.b : Frame::unmemoized };
+					Value* registers = push(callee->function->registers);
+					std::copy(R + i.a, R + i.a + i.c, registers);
+					if(callee->native && nested < native_nesting)
+					{
+						Status status = native(*callee, registers, R[i.a], 0, depth + 1);
+						segment = caller.segment;
+						top = caller.top;
+						if(status != Status::Ok)
+							return status;
+
+						if(memo == Memo::Miss)
+							remember(i.b, R[i.a]);
+
+						break;
+					}
+
+					frames.push_back(caller);
+					out = &R[i.a];
+					index = i.b;
+					current = interpreted(index, callee, level);
+					function = current->function;
+					code = current->instrs.data();
+					K = function->constants.data();
+					R = registers;
+					pc = 0;
+					depth++;
+					break;
+				}
+
+				case Opcode::TailCall:
+				{
+					if(!steps-- && !reclaim())
+						return halt(pc - 1);
+
+					// The callee takes over the frame: the arguments move
+					// down to the first registers, the others are nil again
+					// and its Return goes straight to this frame's caller.
+					Code* callee = &enter(i.b);
+					size_t size = stack[segment].data() + top - R;
+					for(uint32_t k = 0; k < i.c; k++)
+						R[k] = R[i.a + k];
+
+					std::fill(R + i.c, R + size, Value());
+					R = grow(R, callee->function->registers);
+					index = i.b;
+					if(callee->native && nested < native_nesting)
+					{
+						Status status = native(*callee, R, *out, 0, depth);
+						if(status != Status::Ok || !leave())
+							return status;
+
+						break;
+					}
+
+					current = interpreted(index, callee, level);
+					function = current->function;
+					code = current->instrs.data();
+					K = function->constants.data();
+					pc = 0;
+					break;
+				}
+
+				case Opcode::Return:
+					*out = R[i.a];
+					if(!leave())
+						return Status::Ok;
+
+					break;
+
+				case Opcode::Input:
+					awaiting = prompt && in.rdbuf()->in_avail() <= 0;
+					if(awaiting)
+						return suspend(pc - 1, Status::Paused);
+
+					R[i.a] = read();
+					break;
+
+				case Opcode::Output:
+					print(R[i.a], i.b);
+					break;
+
+				case Opcode::Count:
+					if(current->counters)
+						current->counters[i.b]++;
+
+					break;
+
+				case Opcode::Fork:
+				{
+					Status status = fork(*function, pc - 1, R, depth);
+					if(status == Status::Blocked || status == Status::Paused)
+						return suspend(pc - 1, status);
+
+					if(status != Status::Ok)
+						return status;
+
+					pc = function->forks[i.b].join;
+					break;
+				}
+
+				// Only a branch VM reaches it, at the end of its branch.
+				case Opcode::Join:
+					return Status::Ok;
+
+				case Opcode::Split:
+				{
+					bool ran;
+					Status status = split(*function, pc - 1, R, depth, ran);
+					if(status != Status::Ok)
+						return status;
+
+					if(ran)
+						pc = function->splits[i.b].exit;
+
+					break;
+				}
+
+				case Opcode::Defer:
+				case Opcode::DeferPush:
+				{
+					Status status = defer(*function, pc - 1, R, depth);
+					if(status != Status::Ok)
+						return status;
+
+					break;
+				}
+
+				// The end of the loop, and of a slice in the loop's frame.
+				case Opcode::Done:
+					if(slice == &function->splits[i.b] && depth == slice_depth)
+						return Status::Ok;
+
+					break;
+
+				case Opcode::Channel:
+				{
+					Status status = make(*function, pc - 1, R);
+					if(status != Status::Ok)
+						return status;
+
+					break;
+				}
+
+				case Opcode::Send:
+				case Opcode::Receive:
+				{
+					bool waits;
+					Status status = exchange(*function, pc - 1, R, waits);
+					if(status != Status::Ok)
+						return status;
+
+					if(waits)
+						return suspend(pc - 1, Status::Blocked);
+
+					break;
+				}
+			}
+		}
+	}
+}